@@ -0,0 +1,99 @@
+#include <gflags/gflags.h>
+
+#include <cmath>
+#include <cstdio>
+#include <ctime>
+#include <random>
+#include <vector>
+
+#include "bfp.h"
+#include "timer.h"
+
+double freq_ghz = -1.0;  // RDTSC frequency
+
+DEFINE_uint64(ofdm_ca_num, 2048, "Number of OFDM subcarriers (FFT size)");
+DEFINE_uint64(cp_len, 128, "Cyclic prefix length in samples");
+DEFINE_double(rms_dbfs, -20.0, "RMS level of the samples in dBFS");
+DEFINE_uint64(n_iters, 100000, "Symbols converted per experiment");
+
+/// The 16-bit to float conversion of SimdConvertShortToFloat, without its
+/// header's dependencies
+static void ShortToFloat(const short* in_buf, float* out_buf, size_t n_elems) {
+  const __m512 magic = _mm512_set1_ps(1.f / 32768.f);
+  for (size_t i = 0; i < n_elems; i += 16) {
+    const __m256i val16 =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(in_buf + i));
+    const __m512 val = _mm512_cvtepi32_ps(_mm512_cvtepi16_epi32(val16));
+    _mm512_storeu_ps(out_buf + i, _mm512_mul_ps(val, magic));
+  }
+}
+
+/// Signal-to-quantization-noise ratio in dB
+static double Sqnr(const std::vector<float>& ref,
+                   const std::vector<float>& out) {
+  double signal = 0;
+  double noise = 0;
+  for (size_t i = 0; i < ref.size(); i++) {
+    signal += ref[i] * ref[i];
+    noise += (out[i] - ref[i]) * (out[i] - ref[i]);
+  }
+  return 10 * std::log10(signal / noise);
+}
+
+int main(int argc, char** argv) {
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+  freq_ghz = measure_rdtsc_freq();
+  const size_t samps = FLAGS_cp_len + FLAGS_ofdm_ca_num;
+
+  std::mt19937 gen(42);
+  std::normal_distribution<float> dist(
+      0.f, std::pow(10.f, FLAGS_rms_dbfs / 20.f) / std::sqrt(2.f));
+  std::vector<float> ref(2 * samps);
+  for (auto& v : ref) {
+    v = dist(gen);
+  }
+  std::vector<float> fft_in(2 * FLAGS_ofdm_ca_num);
+  std::vector<float> out(2 * samps);
+
+  // 16-bit fixed point, as sent without compression
+  std::vector<short> iq16(2 * samps);
+  for (size_t i = 0; i < 2 * samps; i++) {
+    iq16[i] = static_cast<short>(
+        std::lrint(std::clamp(ref[i] * 32768.f, -32768.f, 32767.f)));
+  }
+  size_t start = rdtsc();
+  for (size_t it = 0; it < FLAGS_n_iters; it++) {
+    ShortToFloat(&iq16[2 * FLAGS_cp_len], fft_in.data(),
+                 2 * FLAGS_ofdm_ca_num);
+  }
+  const double ns_16 =
+      (rdtsc() - start) / freq_ghz / FLAGS_n_iters;
+  ShortToFloat(iq16.data(), out.data(), 2 * samps);
+  std::printf(
+      "16-bit:     %5zu bytes/symbol, convert %7.1f ns, SQNR %5.1f dB\n",
+      4 * samps, ns_16, Sqnr(ref, out));
+
+  for (size_t iq_width : {14, 12, 9}) {
+    std::vector<uint8_t> bfp(BfpCompressedBytes(samps, iq_width));
+    start = rdtsc();
+    for (size_t it = 0; it < FLAGS_n_iters; it++) {
+      BfpCompress(ref.data(), bfp.data(), samps, iq_width);
+    }
+    const double ns_compress = (rdtsc() - start) / freq_ghz / FLAGS_n_iters;
+
+    start = rdtsc();
+    for (size_t it = 0; it < FLAGS_n_iters; it++) {
+      SimdBfpDecompress(bfp.data(), fft_in.data(), FLAGS_cp_len,
+                        FLAGS_ofdm_ca_num, iq_width);
+    }
+    const double ns_decompress =
+        (rdtsc() - start) / freq_ghz / FLAGS_n_iters;
+    SimdBfpDecompress(bfp.data(), out.data(), 0, samps, iq_width);
+    std::printf(
+        "BFP %2zu-bit: %5zu bytes/symbol (%4.1f%%), convert %7.1f ns, "
+        "compress %7.1f ns, SQNR %5.1f dB\n",
+        iq_width, bfp.size(), bfp.size() * 100.0 / (4 * samps), ns_decompress,
+        ns_compress, Sqnr(ref, out));
+  }
+  return 0;
+}
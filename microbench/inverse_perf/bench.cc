@@ -13,6 +13,8 @@ static constexpr double warmup_fraction = .2;
 DEFINE_uint64(n_iters, 10000, "Number of iterations of inversion");
 DEFINE_uint64(n_rows, 64, "Number of matrix rows");
 DEFINE_uint64(n_cols, 32, "Number of matrix columns");
+DEFINE_uint64(batch_size, 16,
+              "Number of matrices inverted together in batched mode");
 
 enum class PinvMode { kFormula, kSVD };
 
@@ -46,6 +48,71 @@ std::pair<std::vector<arma::cx_fmat>, double> arma_pseudo_inverses(
   return std::pair<std::vector<arma::cx_fmat>, double>(ret, timer.avg_usec());
 }
 
+// Compute the pseudo-inverses of batch_size matrices at a time with MKL's
+// compact routines: W' = A * inv(A' * A), with A' * A = L * L'. Returns the
+// pseudo-inverses and the average microseconds per matrix.
+std::pair<std::vector<arma::cx_fmat>, double> mkl_batched_pseudo_inverses(
+    const std::vector<arma::cx_fmat>& test_matrices) {
+  const size_t batch_size = FLAGS_batch_size;
+  const size_t n_batches = FLAGS_n_iters / batch_size;
+  const MKL_INT m = FLAGS_n_rows;
+  const MKL_INT u = FLAGS_n_cols;
+  const MKL_INT nm = batch_size;
+  const MKL_Complex8 one = {1.0f, 0.0f};
+  const MKL_Complex8 zero = {0.0f, 0.0f};
+
+  const MKL_COMPACT_PACK format = mkl_get_format_compact();
+  float* a_compact = static_cast<float*>(
+      mkl_malloc(mkl_cget_size_compact(m, u, format, nm), 64));
+  float* gram_compact = static_cast<float*>(
+      mkl_malloc(mkl_cget_size_compact(u, u, format, nm), 64));
+  std::vector<arma::cx_fmat> outputs_t(batch_size, arma::cx_fmat(m, u));
+  std::vector<const MKL_Complex8*> in_ptrs(batch_size);
+  std::vector<MKL_Complex8*> out_ptrs(batch_size);
+  for (size_t i = 0; i < batch_size; i++) {
+    out_ptrs[i] = reinterpret_cast<MKL_Complex8*>(outputs_t[i].memptr());
+  }
+
+  TscTimer timer(n_batches, freq_ghz);
+  std::vector<arma::cx_fmat> ret;
+  for (size_t batch = 0; batch < n_batches; batch++) {
+    for (size_t i = 0; i < batch_size; i++) {
+      in_ptrs[i] = reinterpret_cast<const MKL_Complex8*>(
+          test_matrices[batch * batch_size + i].memptr());
+    }
+
+    const bool take_measurement = (batch >= n_batches * warmup_fraction);
+    if (take_measurement) timer.start();
+
+    MKL_INT info;
+    mkl_cgepack_compact(MKL_COL_MAJOR, m, u, in_ptrs.data(), m, a_compact, m,
+                        format, nm);
+    mkl_cgemm_compact(MKL_COL_MAJOR, MKL_CONJTRANS, MKL_NOTRANS, u, u, m, &one,
+                      a_compact, m, a_compact, m, &zero, gram_compact, u,
+                      format, nm);
+    mkl_cpotrf_compact(MKL_COL_MAJOR, MKL_LOWER, u, gram_compact, u, &info,
+                       format, nm);
+    mkl_ctrsm_compact(MKL_COL_MAJOR, MKL_RIGHT, MKL_LOWER, MKL_CONJTRANS,
+                      MKL_NONUNIT, m, u, &one, gram_compact, u, a_compact, m,
+                      format, nm);
+    mkl_ctrsm_compact(MKL_COL_MAJOR, MKL_RIGHT, MKL_LOWER, MKL_NOTRANS,
+                      MKL_NONUNIT, m, u, &one, gram_compact, u, a_compact, m,
+                      format, nm);
+    mkl_cgeunpack_compact(MKL_COL_MAJOR, m, u, out_ptrs.data(), m, a_compact,
+                          m, format, nm);
+
+    if (take_measurement) timer.stop();
+    for (size_t i = 0; i < batch_size; i++) {
+      ret.push_back(outputs_t[i].t());
+    }
+  }
+
+  mkl_free(a_compact);
+  mkl_free(gram_compact);
+  return std::pair<std::vector<arma::cx_fmat>, double>(
+      ret, timer.avg_usec() / batch_size);
+}
+
 int main(int argc, char** argv) {
   mkl_set_num_threads(1);
   arma::arma_rng::set_seed_random();
@@ -63,16 +130,26 @@ int main(int argc, char** argv) {
       arma_pseudo_inverses(test_matrices, PinvMode::kFormula);
   std::pair<std::vector<arma::cx_fmat>, double> ret_svd =
       arma_pseudo_inverses(test_matrices, PinvMode::kSVD);
+  std::pair<std::vector<arma::cx_fmat>, double> ret_batched =
+      mkl_batched_pseudo_inverses(test_matrices);
 
   // Header: "<matrix size> <Microseconds with formula> <Microseconds with SVD>
-  // <Speedup with formula>"
-  std::printf("%zux%zu %.1f %.1f %.1f\n", FLAGS_n_rows, FLAGS_n_cols,
+  // <Speedup with formula> <Microseconds per matrix batched> <Speedup with
+  // batching>"
+  std::printf("%zux%zu %.1f %.1f %.1f %.2f %.1f\n", FLAGS_n_rows, FLAGS_n_cols,
          ret_formula.second, ret_svd.second,
-         ret_svd.second / ret_formula.second);
+         ret_svd.second / ret_formula.second, ret_batched.second,
+         ret_formula.second / ret_batched.second);
 
   double norm_sum = 0.0;
+  double batched_norm_sum = 0.0;
   for (size_t i = 0; i < FLAGS_n_iters; i++) {
     norm_sum += arma::norm(ret_formula.first[i] - ret_svd.first[i]);
   }
-  std::fprintf(stderr, "Computation proof = %.2f\n", norm_sum);
+  for (size_t i = 0; i < ret_batched.first.size(); i++) {
+    batched_norm_sum +=
+        arma::norm(ret_formula.first[i] - ret_batched.first[i]);
+  }
+  std::fprintf(stderr, "Computation proof = %.2f, batched = %.2f\n", norm_sum,
+               batched_norm_sum);
 }
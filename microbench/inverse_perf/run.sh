@@ -1,7 +1,8 @@
 #!/bin/bash
-echo "Matrix_size Formula_us SVD_us SVD/Formula"
-for n_rows in 64; do
-  for n_cols in 8 16 24 32 40 48 56; do 
-    numactl --physcpubind=0 --membind=0 ./bench --n_rows ${n_rows} --n_cols ${n_cols} --n_iters 10000  2>/dev/null
+echo "Matrix_size Formula_us SVD_us SVD/Formula Batched_us Formula/Batched"
+for n_rows in 8 16 32 64; do
+  for n_cols in 4 8 16 32; do
+    if [ ${n_cols} -gt ${n_rows} ]; then continue; fi
+    numactl --physcpubind=0 --membind=0 ./bench --n_rows ${n_rows} --n_cols ${n_cols} --n_iters 10000 --batch_size 16 2>/dev/null
   done
 done
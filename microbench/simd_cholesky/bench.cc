@@ -0,0 +1,90 @@
+#include <gflags/gflags.h>
+#include <mkl.h>
+#define ARMA_DONT_PRINT_ERRORS
+#include <armadillo>
+#include <cstdio>
+#include <ctime>
+#include <vector>
+
+#include "simd_cholesky.h"
+#include "timer.h"
+
+double freq_ghz = -1.0;  // RDTSC frequency
+
+DEFINE_uint64(n_ants, 64, "Number of base station antennas");
+DEFINE_uint64(n_ues, 8, "Number of UEs (1 to 16)");
+DEFINE_uint64(n_subcarriers, 1024, "Number of subcarriers per iteration");
+DEFINE_uint64(n_iters, 100, "Number of iterations over all subcarriers");
+
+int main(int argc, char** argv) {
+  mkl_set_num_threads(1);
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+  freq_ghz = measure_rdtsc_freq();
+  nano_sleep(100 * 1000 * 1000, freq_ghz);  // Trigger turbo for 100 ms
+
+  const size_t n_sc =
+      FLAGS_n_subcarriers / kCholeskyLanes * kCholeskyLanes;
+  SimdZfCholeskyFn simd_zf = GetSimdZfCholesky(FLAGS_n_ues);
+  if (simd_zf == nullptr) {
+    std::fprintf(stderr, "No specialization for %zu UEs\n", FLAGS_n_ues);
+    return 1;
+  }
+
+  // The CSI of each UE, with the subcarriers of one antenna contiguous as in
+  // the CSI buffers without partial transposes
+  std::vector<arma::cx_fmat> csi(FLAGS_n_ues);
+  for (auto& c : csi) {
+    c = arma::randn<arma::cx_fmat>(n_sc, FLAGS_n_ants);
+  }
+  std::vector<arma::cx_fmat> zf_arma(n_sc);
+  std::vector<arma::cx_fmat> zf_simd(
+      n_sc, arma::cx_fmat(FLAGS_n_ues, FLAGS_n_ants));
+
+  size_t start = rdtsc();
+  arma::cx_fmat h(FLAGS_n_ants, FLAGS_n_ues);
+  for (size_t it = 0; it < FLAGS_n_iters; it++) {
+    for (size_t sc = 0; sc < n_sc; sc++) {
+      for (size_t u = 0; u < FLAGS_n_ues; u++) {
+        h.col(u) = csi[u].row(sc).st();
+      }
+      zf_arma[sc] = arma::inv_sympd(h.t() * h) * h.t();
+    }
+  }
+  const double us_arma =
+      to_msec(rdtsc() - start, freq_ghz) * 1000 / (FLAGS_n_iters * n_sc);
+
+  const float* csi_ptrs[kMaxCholeskyUes];
+  float* zf_ptrs[kCholeskyLanes];
+  CholeskyCsiLayout layout;
+  layout.csi_ = csi_ptrs;
+  layout.ant_stride_ = 2 * n_sc;
+  layout.group_stride_ = 2 * kCholeskyLaneGroup;
+  start = rdtsc();
+  for (size_t it = 0; it < FLAGS_n_iters; it++) {
+    for (size_t sc = 0; sc < n_sc; sc += kCholeskyLanes) {
+      for (size_t u = 0; u < FLAGS_n_ues; u++) {
+        csi_ptrs[u] = reinterpret_cast<const float*>(csi[u].colptr(0) + sc);
+      }
+      for (size_t lane = 0; lane < kCholeskyLanes; lane++) {
+        zf_ptrs[lane] = reinterpret_cast<float*>(zf_simd[sc + lane].memptr());
+      }
+      simd_zf(layout, zf_ptrs, FLAGS_n_ants, 0.0f);
+    }
+  }
+  const double us_simd =
+      to_msec(rdtsc() - start, freq_ghz) * 1000 / (FLAGS_n_iters * n_sc);
+
+  double max_rel_diff = 0;
+  for (size_t sc = 0; sc < n_sc; sc++) {
+    max_rel_diff =
+        std::max(max_rel_diff, static_cast<double>(
+                                   arma::norm(zf_simd[sc] - zf_arma[sc]) /
+                                   arma::norm(zf_arma[sc])));
+  }
+  std::printf(
+      "%zux%zu: inv_sympd %.3f us, SIMD Cholesky (%zu lanes) %.3f us per "
+      "subcarrier, speedup %.1f, max relative difference %.1e\n",
+      FLAGS_n_ants, FLAGS_n_ues, us_arma, kCholeskyLanes, us_simd,
+      us_arma / us_simd, max_rel_diff);
+  return 0;
+}
@@ -0,0 +1,217 @@
+#include <gflags/gflags.h>
+#include <linux/perf_event.h>
+#include <pthread.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <complex>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#include "timer.h"
+
+double freq_ghz = -1.0;  // RDTSC frequency
+
+DEFINE_uint64(n_workers, 4, "Number of worker threads");
+DEFINE_uint64(core_offset, 0, "Worker thread i is pinned to core_offset + i");
+DEFINE_uint64(bs_ant_num, 64, "Number of base station antennas");
+DEFINE_uint64(ue_num, 16, "Number of users");
+DEFINE_uint64(ofdm_data_num, 1200, "Number of data subcarriers");
+DEFINE_uint64(demul_block_size, 48, "Subcarriers per demul/precode task");
+DEFINE_uint64(ul_syms, 13, "Uplink symbols demodulated per frame");
+DEFINE_uint64(n_frames, 200, "Number of frames per experiment");
+
+using cf = std::complex<float>;
+
+/// A sense-reversing spin barrier for the worker threads
+class SpinBarrier {
+ public:
+  explicit SpinBarrier(size_t n) : n_(n) {}
+  void Wait() {
+    const size_t gen = gen_.load(std::memory_order_acquire);
+    if (count_.fetch_add(1, std::memory_order_acq_rel) == n_ - 1) {
+      count_.store(0, std::memory_order_relaxed);
+      gen_.fetch_add(1, std::memory_order_release);
+    } else {
+      while (gen_.load(std::memory_order_acquire) == gen) {
+      }
+    }
+  }
+
+ private:
+  const size_t n_;
+  std::atomic<size_t> count_{0};
+  std::atomic<size_t> gen_{0};
+};
+
+/// Count last-level cache misses of the calling thread
+class LlcMissCounter {
+ public:
+  LlcMissCounter() {
+    struct perf_event_attr attr;
+    std::memset(&attr, 0, sizeof(attr));
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.size = sizeof(attr);
+    attr.config = PERF_COUNT_HW_CACHE_MISSES;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    fd_ = static_cast<int>(syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0));
+  }
+  ~LlcMissCounter() {
+    if (fd_ >= 0) {
+      close(fd_);
+    }
+  }
+  void Start() {
+    if (fd_ >= 0) {
+      ioctl(fd_, PERF_EVENT_IOC_RESET, 0);
+      ioctl(fd_, PERF_EVENT_IOC_ENABLE, 0);
+    }
+  }
+  /// Stop counting and return the misses since Start(), or 0 if perf events
+  /// are not available
+  size_t Stop() {
+    size_t count = 0;
+    if (fd_ >= 0) {
+      ioctl(fd_, PERF_EVENT_IOC_DISABLE, 0);
+      if (read(fd_, &count, sizeof(count)) != sizeof(count)) {
+        count = 0;
+      }
+    }
+    return count;
+  }
+  bool Valid() const { return fd_ >= 0; }
+
+ private:
+  int fd_;
+};
+
+struct alignas(64) WorkerResult {
+  size_t demul_cycles_ = 0;
+  size_t llc_misses_ = 0;
+  float proof_ = 0;
+};
+
+/// Emulates DoZF: write the ue_num x bs_ant_num precoder of each subcarrier
+static void ZfBlock(std::vector<cf>& zf, const std::vector<cf>& csi,
+                    size_t block, size_t frame_id) {
+  const size_t mat_size = FLAGS_bs_ant_num * FLAGS_ue_num;
+  const float scale = 1.0f / (1 + (frame_id & 0x7));
+  const size_t sc_end = std::min((block + 1) * FLAGS_demul_block_size,
+                                 static_cast<size_t>(FLAGS_ofdm_data_num));
+  for (size_t sc = block * FLAGS_demul_block_size; sc < sc_end; sc++) {
+    for (size_t i = 0; i < mat_size; i++) {
+      zf[sc * mat_size + i] = std::conj(csi[sc * mat_size + i]) * scale;
+    }
+  }
+}
+
+/// Emulates DoDemul: equalize every uplink symbol with the precoders
+static float DemulBlock(const std::vector<cf>& zf, const std::vector<cf>& data,
+                        size_t block) {
+  const size_t mat_size = FLAGS_bs_ant_num * FLAGS_ue_num;
+  const size_t sc_end = std::min((block + 1) * FLAGS_demul_block_size,
+                                 static_cast<size_t>(FLAGS_ofdm_data_num));
+  float proof = 0;
+  for (size_t sym = 0; sym < FLAGS_ul_syms; sym++) {
+    for (size_t sc = block * FLAGS_demul_block_size; sc < sc_end; sc++) {
+      const cf* mat = &zf[sc * mat_size];
+      const cf* rx = &data[sc * FLAGS_bs_ant_num];
+      for (size_t ue = 0; ue < FLAGS_ue_num; ue++) {
+        cf sum = 0;
+        for (size_t ant = 0; ant < FLAGS_bs_ant_num; ant++) {
+          sum += mat[ue * FLAGS_bs_ant_num + ant] * rx[ant];
+        }
+        proof += sum.real();
+      }
+    }
+  }
+  return proof;
+}
+
+/// Run n_frames of ZF followed by demul. With affinity, the worker that
+/// computed the precoders of a block also demodulates it; otherwise the
+/// block goes to the next worker, as happens when tasks are taken from a
+/// shared queue by whichever core is free.
+static void Bench(bool affinity) {
+  const size_t mat_size = FLAGS_bs_ant_num * FLAGS_ue_num;
+  const size_t num_blocks =
+      1 + (FLAGS_ofdm_data_num - 1) / FLAGS_demul_block_size;
+  std::vector<cf> csi(FLAGS_ofdm_data_num * mat_size, cf(0.5f, -0.5f));
+  std::vector<cf> zf(FLAGS_ofdm_data_num * mat_size);
+  std::vector<cf> data(FLAGS_ofdm_data_num * FLAGS_bs_ant_num, cf(1, 0));
+  std::vector<WorkerResult> results(FLAGS_n_workers);
+  SpinBarrier barrier(FLAGS_n_workers);
+  std::atomic<bool> perf_valid(true);
+
+  std::vector<std::thread> workers;
+  for (size_t tid = 0; tid < FLAGS_n_workers; tid++) {
+    workers.emplace_back([&, tid]() {
+      cpu_set_t cpuset;
+      CPU_ZERO(&cpuset);
+      CPU_SET(FLAGS_core_offset + tid, &cpuset);
+      pthread_setaffinity_np(pthread_self(), sizeof(cpuset), &cpuset);
+
+      LlcMissCounter llc;
+      if (llc.Valid() == false) {
+        perf_valid = false;
+      }
+      const size_t demul_tid = affinity ? tid : (tid + 1) % FLAGS_n_workers;
+      for (size_t frame_id = 0; frame_id < FLAGS_n_frames; frame_id++) {
+        for (size_t b = tid; b < num_blocks; b += FLAGS_n_workers) {
+          ZfBlock(zf, csi, b, frame_id);
+        }
+        barrier.Wait();
+
+        llc.Start();
+        const size_t start_tsc = rdtsc();
+        for (size_t b = demul_tid; b < num_blocks; b += FLAGS_n_workers) {
+          results[tid].proof_ += DemulBlock(zf, data, b);
+        }
+        results[tid].demul_cycles_ += rdtsc() - start_tsc;
+        results[tid].llc_misses_ += llc.Stop();
+        barrier.Wait();
+      }
+    });
+  }
+  for (auto& w : workers) {
+    w.join();
+  }
+
+  size_t demul_cycles = 0;
+  size_t llc_misses = 0;
+  float proof = 0;
+  for (const auto& r : results) {
+    demul_cycles = std::max(demul_cycles, r.demul_cycles_);
+    llc_misses += r.llc_misses_;
+    proof += r.proof_;
+  }
+  std::printf("%-12s demul time per frame = %.1f us, ",
+              affinity ? "Affinity:" : "No affinity:",
+              to_usec(demul_cycles, freq_ghz) / FLAGS_n_frames);
+  if (perf_valid == true) {
+    std::printf("LLC misses per frame = %.0f\n",
+                static_cast<double>(llc_misses) / FLAGS_n_frames);
+  } else {
+    std::printf("LLC misses unavailable (perf_event_open failed)\n");
+  }
+  std::fprintf(stderr, "Computation proof = %.2f\n", proof);
+}
+
+int main(int argc, char** argv) {
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+  freq_ghz = measure_rdtsc_freq();
+  nano_sleep(100 * 1000 * 1000, freq_ghz);  // Trigger turbo for 100 ms
+
+  std::printf(
+      "%zu workers, %zu x %zu precoders, %zu subcarriers, block size %zu\n",
+      FLAGS_n_workers, FLAGS_ue_num, FLAGS_bs_ant_num, FLAGS_ofdm_data_num,
+      FLAGS_demul_block_size);
+  Bench(false);
+  Bench(true);
+  return 0;
+}
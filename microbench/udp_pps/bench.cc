@@ -0,0 +1,107 @@
+#include <gflags/gflags.h>
+#include <pthread.h>
+
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "timer.h"
+#include "udp_client.h"
+#include "udp_server.h"
+
+double freq_ghz = -1.0;  // RDTSC frequency
+
+DEFINE_uint64(n_ports, 8, "Number of receiving UDP ports (antennas)");
+DEFINE_uint64(base_port, 31000, "First receiving UDP port");
+DEFINE_uint64(packet_len, 8256, "Packet size in bytes");
+DEFINE_uint64(batch_size, 32, "Packets per sendmmsg/recvmmsg call");
+DEFINE_uint64(duration_ms, 2000, "Duration of each experiment");
+DEFINE_uint64(core_offset, 0,
+              "The sender runs on core_offset and the receiver on the next "
+              "core");
+
+static void PinToCore(size_t core) {
+  cpu_set_t cpuset;
+  CPU_ZERO(&cpuset);
+  CPU_SET(core, &cpuset);
+  pthread_setaffinity_np(pthread_self(), sizeof(cpuset), &cpuset);
+}
+
+/// Send and receive for duration_ms, with batch_size packets per system call
+/// (or one packet per call if batch_size is 1)
+static void Bench(size_t batch_size) {
+  std::vector<std::unique_ptr<UDPServer>> servers;
+  for (size_t i = 0; i < FLAGS_n_ports; i++) {
+    servers.push_back(std::make_unique<UDPServer>(FLAGS_base_port + i,
+                                                  64 * 1024 * 1024));
+  }
+  std::atomic<bool> running(true);
+  size_t num_sent = 0;
+  size_t num_received = 0;
+
+  std::thread receiver([&]() {
+    PinToCore(FLAGS_core_offset + 1);
+    std::vector<uint8_t> rx_buf(batch_size * FLAGS_packet_len);
+    size_t port = 0;
+    while (running == true) {
+      ssize_t ret;
+      if (batch_size == 1) {
+        ret = servers[port]->Recv(rx_buf.data(), FLAGS_packet_len) > 0 ? 1 : 0;
+      } else {
+        ret = servers[port]->RecvBatch(rx_buf.data(), FLAGS_packet_len,
+                                       batch_size);
+      }
+      if (ret > 0) {
+        num_received += ret;
+      }
+      port = (port + 1) % FLAGS_n_ports;
+    }
+  });
+
+  PinToCore(FLAGS_core_offset);
+  UDPClient client;
+  std::vector<uint8_t> tx_buf(batch_size * FLAGS_packet_len, 1);
+  std::vector<const uint8_t*> msgs(batch_size);
+  std::vector<uint16_t> ports(batch_size);
+  size_t next_port = 0;
+  const size_t start_tsc = rdtsc();
+  const size_t duration_cycles = FLAGS_duration_ms * 1000000 * freq_ghz;
+  while (rdtsc() - start_tsc < duration_cycles) {
+    if (batch_size == 1) {
+      client.Send("127.0.0.1", FLAGS_base_port + next_port, tx_buf.data(),
+                  FLAGS_packet_len);
+      next_port = (next_port + 1) % FLAGS_n_ports;
+    } else {
+      for (size_t i = 0; i < batch_size; i++) {
+        msgs[i] = &tx_buf[i * FLAGS_packet_len];
+        ports[i] = FLAGS_base_port + next_port;
+        next_port = (next_port + 1) % FLAGS_n_ports;
+      }
+      client.SendBatch("127.0.0.1", ports.data(), msgs.data(),
+                       FLAGS_packet_len, batch_size);
+    }
+    num_sent += batch_size;
+  }
+  const double send_sec = to_sec(rdtsc() - start_tsc, freq_ghz);
+  nano_sleep(100 * 1000 * 1000, freq_ghz);  // Let the receiver drain
+  running = false;
+  receiver.join();
+
+  std::printf(
+      "Batch size %3zu: sent %.2f Mpps, received %.2f Mpps (%.1f%% of sent, "
+      "%.2f Gbps)\n",
+      batch_size, num_sent / send_sec / 1e6, num_received / send_sec / 1e6,
+      100.0 * num_received / num_sent,
+      num_received * FLAGS_packet_len * 8 / send_sec / 1e9);
+}
+
+int main(int argc, char** argv) {
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+  freq_ghz = measure_rdtsc_freq();
+  std::printf("%zu ports, %zu-byte packets over loopback\n", FLAGS_n_ports,
+              FLAGS_packet_len);
+  Bench(1);
+  Bench(FLAGS_batch_size);
+  return 0;
+}
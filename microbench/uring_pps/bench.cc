@@ -0,0 +1,175 @@
+#include <gflags/gflags.h>
+#include <liburing.h>
+#include <pthread.h>
+
+#include <atomic>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "timer.h"
+#include "udp_client.h"
+#include "udp_server.h"
+
+double freq_ghz = -1.0;  // RDTSC frequency
+
+DEFINE_uint64(n_ports, 8, "Number of receiving UDP ports (antennas)");
+DEFINE_uint64(base_port, 31000, "First receiving UDP port");
+DEFINE_uint64(packet_len, 8256, "Packet size in bytes");
+DEFINE_uint64(send_batch, 32, "Packets per sendmmsg call of the sender");
+DEFINE_uint64(n_bufs, 4096,
+              "Receive buffers in the provided buffer ring (a power of two)");
+DEFINE_uint64(duration_ms, 2000, "Duration of each experiment");
+DEFINE_uint64(core_offset, 0,
+              "The sender runs on core_offset and the receiver on the next "
+              "core");
+
+using Servers = std::vector<std::unique_ptr<UDPServer>>;
+
+static void PinToCore(size_t core) {
+  cpu_set_t cpuset;
+  CPU_ZERO(&cpuset);
+  CPU_SET(core, &cpuset);
+  pthread_setaffinity_np(pthread_self(), sizeof(cpuset), &cpuset);
+}
+
+/// One recv() call per port poll, as in PacketTXRX::LoopTxRx
+static size_t RecvLoop(Servers& servers, const std::atomic<bool>& running) {
+  std::vector<uint8_t> rx_buf(FLAGS_packet_len);
+  size_t num_received = 0;
+  size_t port = 0;
+  while (running == true) {
+    if (servers[port]->Recv(rx_buf.data(), FLAGS_packet_len) > 0) {
+      num_received++;
+    }
+    port = (port + 1) % FLAGS_n_ports;
+  }
+  return num_received;
+}
+
+/// One multishot receive per port into a provided buffer ring, as in
+/// PacketTXRX::LoopTxRxUring. Buffers are returned to the ring right away.
+static size_t UringLoop(Servers& servers, const std::atomic<bool>& running) {
+  struct io_uring ring;
+  struct io_uring_params params;
+  std::memset(&params, 0, sizeof(params));
+  params.flags = IORING_SETUP_CQSIZE;
+  params.cq_entries = 4096;
+  int ret = io_uring_queue_init_params(64, &ring, &params);
+  if (ret != 0) {
+    std::fprintf(stderr, "io_uring_queue_init failed: %s\n", strerror(-ret));
+    exit(-1);
+  }
+  struct io_uring_buf_ring* buf_ring =
+      io_uring_setup_buf_ring(&ring, FLAGS_n_bufs, 0, 0, &ret);
+  if (buf_ring == nullptr) {
+    std::fprintf(stderr, "io_uring_setup_buf_ring failed: %s\n",
+                 strerror(-ret));
+    exit(-1);
+  }
+  const int mask = io_uring_buf_ring_mask(FLAGS_n_bufs);
+  std::vector<uint8_t> bufs(FLAGS_n_bufs * FLAGS_packet_len);
+  for (size_t i = 0; i < FLAGS_n_bufs; i++) {
+    io_uring_buf_ring_add(buf_ring, &bufs[i * FLAGS_packet_len],
+                          FLAGS_packet_len, i, mask, i);
+  }
+  io_uring_buf_ring_advance(buf_ring, FLAGS_n_bufs);
+
+  std::vector<bool> armed(FLAGS_n_ports, false);
+  size_t num_received = 0;
+  struct io_uring_cqe* cqes[64];
+  while (running == true) {
+    for (size_t port = 0; port < FLAGS_n_ports; port++) {
+      if (armed[port] == false) {
+        struct io_uring_sqe* sqe = io_uring_get_sqe(&ring);
+        io_uring_prep_recv_multishot(sqe, servers[port]->Fd(), nullptr, 0, 0);
+        sqe->flags |= IOSQE_BUFFER_SELECT;
+        sqe->buf_group = 0;
+        io_uring_sqe_set_data64(sqe, port);
+        armed[port] = true;
+      }
+    }
+    if (io_uring_sq_ready(&ring) > 0) {
+      io_uring_submit(&ring);
+    }
+
+    const unsigned num_cqes = io_uring_peek_batch_cqe(&ring, cqes, 64);
+    int num_readded = 0;
+    for (unsigned i = 0; i < num_cqes; i++) {
+      if ((cqes[i]->flags & IORING_CQE_F_MORE) == 0) {
+        armed[io_uring_cqe_get_data64(cqes[i])] = false;
+      }
+      if (cqes[i]->res > 0) {
+        num_received++;
+        const unsigned bid = cqes[i]->flags >> IORING_CQE_BUFFER_SHIFT;
+        io_uring_buf_ring_add(buf_ring, &bufs[bid * FLAGS_packet_len],
+                              FLAGS_packet_len, bid, mask, num_readded);
+        num_readded++;
+      }
+    }
+    io_uring_buf_ring_advance(buf_ring, num_readded);
+    io_uring_cq_advance(&ring, num_cqes);
+  }
+
+  io_uring_free_buf_ring(&ring, buf_ring, FLAGS_n_bufs, 0);
+  io_uring_queue_exit(&ring);
+  return num_received;
+}
+
+static void Bench(
+    const char* name,
+    const std::function<size_t(Servers&, const std::atomic<bool>&)>& loop) {
+  Servers servers;
+  for (size_t i = 0; i < FLAGS_n_ports; i++) {
+    servers.push_back(std::make_unique<UDPServer>(FLAGS_base_port + i,
+                                                  64 * 1024 * 1024));
+  }
+  std::atomic<bool> running(true);
+  size_t num_received = 0;
+  std::thread receiver([&]() {
+    PinToCore(FLAGS_core_offset + 1);
+    num_received = loop(servers, running);
+  });
+
+  PinToCore(FLAGS_core_offset);
+  UDPClient client;
+  std::vector<uint8_t> tx_buf(FLAGS_packet_len, 1);
+  std::vector<const uint8_t*> msgs(FLAGS_send_batch, tx_buf.data());
+  std::vector<uint16_t> ports(FLAGS_send_batch);
+  size_t next_port = 0;
+  size_t num_sent = 0;
+  const size_t start_tsc = rdtsc();
+  const size_t duration_cycles = FLAGS_duration_ms * 1000000 * freq_ghz;
+  while (rdtsc() - start_tsc < duration_cycles) {
+    for (size_t i = 0; i < FLAGS_send_batch; i++) {
+      ports[i] = FLAGS_base_port + next_port;
+      next_port = (next_port + 1) % FLAGS_n_ports;
+    }
+    client.SendBatch("127.0.0.1", ports.data(), msgs.data(), FLAGS_packet_len,
+                     FLAGS_send_batch);
+    num_sent += FLAGS_send_batch;
+  }
+  const double send_sec = to_sec(rdtsc() - start_tsc, freq_ghz);
+  nano_sleep(100 * 1000 * 1000, freq_ghz);  // Let the receiver drain
+  running = false;
+  receiver.join();
+
+  std::printf(
+      "%-9s: sent %.2f Mpps, received %.2f Mpps per receiving core (%.1f%% "
+      "of sent, %.2f Gbps)\n",
+      name, num_sent / send_sec / 1e6, num_received / send_sec / 1e6,
+      100.0 * num_received / num_sent,
+      num_received * FLAGS_packet_len * 8 / send_sec / 1e9);
+}
+
+int main(int argc, char** argv) {
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+  freq_ghz = measure_rdtsc_freq();
+  std::printf("%zu ports, %zu-byte packets over loopback\n", FLAGS_n_ports,
+              FLAGS_packet_len);
+  Bench("recv()", RecvLoop);
+  Bench("io_uring", UringLoop);
+  return 0;
+}
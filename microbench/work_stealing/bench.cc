@@ -0,0 +1,201 @@
+#include <gflags/gflags.h>
+
+#include <array>
+#include <atomic>
+#include <random>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+#include "concurrentqueue.h"
+#include "timer.h"
+#include "work_stealing_queue.h"
+
+double freq_ghz = -1.0;  // RDTSC frequency
+
+DEFINE_uint64(n_tasks, 500000, "Number of tasks per experiment");
+DEFINE_uint64(task_ns, 1000, "Mean duration of one task in nanoseconds");
+DEFINE_uint64(burst_size, 16, "Number of same-type tasks enqueued at once");
+DEFINE_uint64(max_inflight_per_worker, 4,
+              "Max outstanding tasks per worker, to mimic a loaded pipeline");
+DEFINE_string(workers, "8,16,32", "Comma-separated worker thread counts");
+
+// Number of task types, as polled by Agora::Worker (ZF, FFT, Decode, Demul,
+// IFFT, Precode, Encode)
+static constexpr size_t kNumTaskTypes = 7;
+
+struct Task {
+  size_t type_;
+  size_t duration_ns_;
+  size_t enqueue_tsc_;
+};
+
+struct alignas(64) WorkerResult {
+  size_t num_tasks_ = 0;
+  size_t latency_cycles_ = 0;
+};
+
+struct Result {
+  double mtasks_per_sec_;
+  double avg_latency_us_;
+};
+
+/// Run one task and record its queueing + service latency
+static inline void RunTask(const Task& task, WorkerResult& result) {
+  nano_sleep(task.duration_ns_, freq_ghz);
+  result.latency_cycles_ += rdtsc() - task.enqueue_tsc_;
+  result.num_tasks_++;
+}
+
+/// Generate the task sequence shared by both schedulers. Task durations are
+/// skewed so that some workers fall behind their peers.
+static std::vector<Task> GenTasks() {
+  std::mt19937 gen(0);
+  std::uniform_int_distribution<size_t> type_dist(0, kNumTaskTypes - 1);
+  std::exponential_distribution<double> duration_dist(1.0 / FLAGS_task_ns);
+  std::vector<Task> tasks(FLAGS_n_tasks);
+  size_t type = 0;
+  for (size_t i = 0; i < tasks.size(); i++) {
+    if (i % FLAGS_burst_size == 0) {
+      type = type_dist(gen);
+    }
+    tasks[i].type_ = type;
+    tasks[i].duration_ns_ = static_cast<size_t>(duration_dist(gen));
+  }
+  return tasks;
+}
+
+/// Run the producer until all tasks are enqueued and completed. push_fn
+/// enqueues one task.
+template <typename PushFn>
+static void Produce(std::vector<Task>& tasks, const std::atomic<size_t>& done,
+                    size_t max_inflight, PushFn push_fn) {
+  size_t i = 0;
+  while (i < tasks.size()) {
+    if (i - done.load(std::memory_order_acquire) >= max_inflight) {
+      continue;
+    }
+    const size_t burst_end = std::min(i + FLAGS_burst_size, tasks.size());
+    for (; i < burst_end; i++) {
+      tasks[i].enqueue_tsc_ = rdtsc();
+      push_fn(tasks[i]);
+    }
+  }
+  while (done.load(std::memory_order_acquire) < tasks.size()) {
+  }
+}
+
+static Result Summarize(const std::vector<WorkerResult>& results,
+                        size_t duration_cycles) {
+  size_t num_tasks = 0;
+  size_t latency_cycles = 0;
+  for (const auto& r : results) {
+    num_tasks += r.num_tasks_;
+    latency_cycles += r.latency_cycles_;
+  }
+  Result ret;
+  ret.mtasks_per_sec_ =
+      num_tasks / (to_sec(duration_cycles, freq_ghz) * 1000000.0);
+  ret.avg_latency_us_ = to_usec(latency_cycles, freq_ghz) / num_tasks;
+  return ret;
+}
+
+/// The current Agora scheme: one MPMC queue per task type, polled by every
+/// worker in a fixed priority order
+static Result BenchQueues(std::vector<Task> tasks, size_t n_workers) {
+  std::array<moodycamel::ConcurrentQueue<Task>, kNumTaskTypes> queues;
+  std::vector<std::unique_ptr<moodycamel::ProducerToken>> ptoks;
+  for (auto& q : queues) {
+    ptoks.emplace_back(std::make_unique<moodycamel::ProducerToken>(q));
+  }
+  std::atomic<size_t> done(0);
+  std::atomic<bool> running(true);
+  std::vector<WorkerResult> results(n_workers);
+
+  std::vector<std::thread> workers;
+  for (size_t tid = 0; tid < n_workers; tid++) {
+    workers.emplace_back([&, tid]() {
+      Task task;
+      while (running.load(std::memory_order_relaxed) == true) {
+        for (auto& q : queues) {
+          if (q.try_dequeue(task) == true) {
+            RunTask(task, results[tid]);
+            done.fetch_add(1, std::memory_order_release);
+            break;
+          }
+        }
+      }
+    });
+  }
+
+  const size_t start_tsc = rdtsc();
+  Produce(tasks, done, FLAGS_max_inflight_per_worker * n_workers,
+          [&](const Task& task) {
+            queues[task.type_].enqueue(*ptoks[task.type_], task);
+          });
+  const size_t duration_cycles = rdtsc() - start_tsc;
+
+  running = false;
+  for (auto& w : workers) {
+    w.join();
+  }
+  return Summarize(results, duration_cycles);
+}
+
+/// One deque per worker with stealing, as used by the "work_stealing" worker
+/// scheduler
+static Result BenchWorkStealing(std::vector<Task> tasks, size_t n_workers) {
+  WorkStealingQueues<Task> queues(n_workers);
+  std::atomic<size_t> done(0);
+  std::atomic<bool> running(true);
+  std::vector<WorkerResult> results(n_workers);
+
+  std::vector<std::thread> workers;
+  for (size_t tid = 0; tid < n_workers; tid++) {
+    workers.emplace_back([&, tid]() {
+      Task task;
+      while (running.load(std::memory_order_relaxed) == true) {
+        if (queues.TryPop(tid, task) == true) {
+          RunTask(task, results[tid]);
+          done.fetch_add(1, std::memory_order_release);
+        }
+      }
+    });
+  }
+
+  const size_t start_tsc = rdtsc();
+  Produce(tasks, done, FLAGS_max_inflight_per_worker * n_workers,
+          [&](const Task& task) { queues.Push(task); });
+  const size_t duration_cycles = rdtsc() - start_tsc;
+
+  running = false;
+  for (auto& w : workers) {
+    w.join();
+  }
+  std::printf("  Work stealing: %zu steals (%.1f%% of tasks)\n",
+              queues.NumSteals(), queues.NumSteals() * 100.0 / tasks.size());
+  return Summarize(results, duration_cycles);
+}
+
+int main(int argc, char** argv) {
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+  freq_ghz = measure_rdtsc_freq();
+  nano_sleep(100 * 1000 * 1000, freq_ghz);  // Trigger turbo for 100 ms
+
+  const std::vector<Task> tasks = GenTasks();
+  std::stringstream ss(FLAGS_workers);
+  std::string token;
+  while (std::getline(ss, token, ',')) {
+    const size_t n_workers = std::stoul(token);
+    std::printf("%zu workers, %zu tasks, mean task duration %zu ns\n",
+                n_workers, tasks.size(), FLAGS_task_ns);
+    const Result queues = BenchQueues(tasks, n_workers);
+    const Result stealing = BenchWorkStealing(tasks, n_workers);
+    std::printf(
+        "  Per-type queues: %.2f Mtasks/s, avg latency %.2f us\n"
+        "  Work stealing:   %.2f Mtasks/s, avg latency %.2f us\n",
+        queues.mtasks_per_sec_, queues.avg_latency_us_,
+        stealing.mtasks_per_sec_, stealing.avg_latency_us_);
+  }
+  return 0;
+}
@@ -0,0 +1,115 @@
+#include <gflags/gflags.h>
+#include <mkl.h>
+#define ARMA_DONT_PRINT_ERRORS
+#include <armadillo>
+#include <cmath>
+#include <cstdio>
+#include <vector>
+
+#include "iterative_zf.h"
+#include "timer.h"
+
+double freq_ghz = -1.0;  // RDTSC frequency
+
+DEFINE_uint64(n_ants, 64, "Number of base station antennas");
+DEFINE_uint64(n_ues, 8, "Number of UEs");
+DEFINE_uint64(n_subcarriers, 256, "Number of subcarriers");
+DEFINE_uint64(n_frames, 100, "Number of frames");
+DEFINE_double(corr, 0.99, "Correlation of the channel from frame to frame");
+DEFINE_double(snr_db, 20.0, "SNR of the received symbols for the EVM");
+DEFINE_uint64(iters, 2, "Number of iterations");
+DEFINE_string(method, "neumann", "neumann or gauss_seidel");
+DEFINE_bool(warm_start, true, "Start from the previous frame's detector");
+DEFINE_double(max_residual, 0.03,
+              "Relative residual above which to invert exactly");
+
+// Squared error of the detector w on a random QPSK vector received over h
+static double SquaredError(const arma::cx_fmat& w, const arma::cx_fmat& h,
+                           const arma::cx_fvec& x, const arma::cx_fvec& noise) {
+  return std::pow(arma::norm(w * (h * x + noise) - x), 2);
+}
+
+int main(int argc, char** argv) {
+  mkl_set_num_threads(1);
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+  freq_ghz = measure_rdtsc_freq();
+  nano_sleep(100 * 1000 * 1000, freq_ghz);  // Trigger turbo for 100 ms
+
+  const size_t n_sc = FLAGS_n_subcarriers;
+  const IterativeZfMethod method = IterativeZfMethodFromString(FLAGS_method);
+  const auto corr = static_cast<float>(FLAGS_corr);
+  const auto noise_std =
+      static_cast<float>(std::pow(10.0, -FLAGS_snr_db / 20.0) / std::sqrt(2));
+
+  // Unit-power Rayleigh fading per subcarrier
+  std::vector<arma::cx_fmat> csi(n_sc);
+  for (auto& h : csi) {
+    h = arma::randn<arma::cx_fmat>(FLAGS_n_ants, FLAGS_n_ues) / std::sqrt(2.f);
+  }
+  std::vector<arma::cx_fmat> zf_exact(n_sc);
+  std::vector<arma::cx_fmat> zf_approx(n_sc);
+
+  size_t cycles_exact = 0;
+  size_t cycles_approx = 0;
+  size_t num_fallbacks = 0;
+  double err_exact = 0;
+  double err_approx = 0;
+  for (size_t frame = 0; frame < FLAGS_n_frames; frame++) {
+    for (auto& h : csi) {
+      h = corr * h + std::sqrt(1 - corr * corr) *
+                         arma::randn<arma::cx_fmat>(FLAGS_n_ants,
+                                                    FLAGS_n_ues) /
+                         std::sqrt(2.f);
+    }
+
+    size_t start = rdtsc();
+    for (size_t sc = 0; sc < n_sc; sc++) {
+      const arma::cx_fmat& h = csi[sc];
+      zf_exact[sc] = arma::inv_sympd(h.t() * h) * h.t();
+    }
+    cycles_exact += rdtsc() - start;
+
+    start = rdtsc();
+    for (size_t sc = 0; sc < n_sc; sc++) {
+      const arma::cx_fmat& h = csi[sc];
+      const arma::cx_fmat h_t = h.t();
+      const arma::cx_fmat gram = h_t * h;
+      if ((FLAGS_warm_start == false) || (frame == 0)) {
+        zf_approx[sc] = IterativeZfColdStart(h_t, gram);
+      }
+      const float residual =
+          IterativeZf(h_t, gram, zf_approx[sc], FLAGS_iters, method);
+      if (residual > FLAGS_max_residual) {
+        zf_approx[sc] = arma::inv_sympd(gram) * h_t;
+        num_fallbacks++;
+      }
+    }
+    cycles_approx += rdtsc() - start;
+
+    for (size_t sc = 0; sc < n_sc; sc++) {
+      const arma::cx_fvec x =
+          (arma::sign(arma::randn<arma::fvec>(FLAGS_n_ues)) +
+           arma::cx_float(0, 1) *
+               arma::sign(arma::randn<arma::fvec>(FLAGS_n_ues))) /
+          std::sqrt(2.f);
+      const arma::cx_fvec noise =
+          noise_std * arma::randn<arma::cx_fvec>(FLAGS_n_ants);
+      err_exact += SquaredError(zf_exact[sc], csi[sc], x, noise);
+      err_approx += SquaredError(zf_approx[sc], csi[sc], x, noise);
+    }
+  }
+
+  const double n_total = FLAGS_n_frames * n_sc;
+  const double us_exact = to_msec(cycles_exact, freq_ghz) * 1000 / n_total;
+  const double us_approx = to_msec(cycles_approx, freq_ghz) * 1000 / n_total;
+  std::printf(
+      "%zux%zu, SNR %.1f dB: inv_sympd %.3f us, EVM %.2f%%; %zu %s "
+      "iterations (%s start) %.3f us, EVM %.2f%%, %.1f%% inverted; speedup "
+      "%.2f\n",
+      FLAGS_n_ants, FLAGS_n_ues, FLAGS_snr_db, us_exact,
+      100 * std::sqrt(err_exact / (n_total * FLAGS_n_ues)), FLAGS_iters,
+      FLAGS_method.c_str(), FLAGS_warm_start ? "warm" : "cold", us_approx,
+      100 * std::sqrt(err_approx / (n_total * FLAGS_n_ues)),
+      100 * num_fallbacks / n_total, us_exact / us_approx);
+  return 0;
+}
@@ -4,8 +4,10 @@
  */
 #include "channel_sim.h"
 
+#include <random>
 #include <utility>
 
+#include "bfp.h"
 #include "datatype_conversion.h"
 
 static std::atomic<bool> running = true;
@@ -40,7 +42,7 @@ ChannelSim::ChannelSim(const Config* const config_bs,
                        const Config* const config_ue, size_t bs_thread_num,
                        size_t user_thread_num, size_t worker_thread_num,
                        size_t in_core_offset, std::string in_chan_type,
-                       double in_chan_snr)
+                       double in_chan_snr, double in_packet_loss)
     : bscfg_(config_bs),
       uecfg_(config_ue),
       bs_thread_num_(bs_thread_num),
@@ -50,7 +52,10 @@ ChannelSim::ChannelSim(const Config* const config_bs,
       worker_thread_num_(worker_thread_num),
       core_offset_(in_core_offset),
       channel_type_(std::move(in_chan_type)),
-      channel_snr_(in_chan_snr) {
+      channel_snr_(in_chan_snr),
+      packet_loss_(in_packet_loss) {
+  RtAssert((packet_loss_ >= 0) && (packet_loss_ < 1),
+           "Packet loss probability must be in [0, 1)");
   // initialize parameters from config
   srand(time(nullptr));
   dl_data_plus_beacon_symbols_ =
@@ -60,6 +65,14 @@ ChannelSim::ChannelSim(const Config* const config_bs,
 
   server_bs_.resize(bs_socket_num_);
   client_bs_.resize(bs_socket_num_);
+  if (bscfg_->Transport() == "shm") {
+    RtAssert(bscfg_->NumRadios() == bs_socket_num_,
+             "The shm transport requires one antenna per BS radio");
+    shm_fronthaul_ = std::make_unique<ShmFronthaul>(
+        bscfg_->ShmPath(), bscfg_->NumRadios(),
+        std::max(bscfg_->PacketLength(), bscfg_->DlPacketLength()),
+        bscfg_->ShmRingSlots(), false /* create */);
+  }
   server_ue_.resize(user_socket_num_);
   client_ue_.resize(user_socket_num_);
 
@@ -73,8 +86,18 @@ ChannelSim::ChannelSim(const Config* const config_bs,
       kFrameWnd * bscfg_->Frame().NumTotalSyms() *
       (bscfg_->BsAntNum() + uecfg_->UeAntNum()) * kDefaultQueueSize);
 
-  assert(bscfg_->PacketLength() == uecfg_->PacketLength());
-  payload_length_ = bscfg_->PacketLength() - Packet::kOffsetOfData;
+  RtAssert(bscfg_->SampsPerSymbol() == uecfg_->SampsPerSymbol(),
+           "The BS and UE configs must have the same symbol length");
+  RtAssert((bscfg_->FronthaulFragsPerSymbol() == 1) &&
+               (uecfg_->FronthaulFragsPerSymbol() == 1),
+           "The channel simulator sends time-domain symbols, which cannot be "
+           "fragmented");
+  RtAssert((bscfg_->BfpIqWidth() == 0) || (bscfg_->FftInRru() == false),
+           "The channel simulator compresses time-domain symbols only");
+  RtAssert(uecfg_->BfpIqWidth() == 0,
+           "The channel simulator does not compress the UE fronthaul");
+  // One antenna's symbol of 16-bit IQ samples
+  payload_length_ = 4 * bscfg_->SampsPerSymbol();
 
   // initialize bs-facing and client-facing data buffers
   size_t tx_buffer_ue_size = kFrameWnd * dl_data_plus_beacon_symbols_ *
@@ -123,6 +146,10 @@ ChannelSim::ChannelSim(const Config* const config_bs,
 
 ChannelSim::~ChannelSim() {
   std::printf("Destroying channel simulator\n");
+  if ((packet_loss_ > 0) || (shm_fronthaul_ != nullptr)) {
+    std::printf("Channel Sim: dropped %zu packets to BS antennas\n",
+                num_lost_bs_packets_.load());
+  }
   running.store(false);
   for (auto& join_thread : task_threads_) {
     join_thread.join();
@@ -308,6 +335,20 @@ void* ChannelSim::BsRxLoop(int tid) {
   moodycamel::ProducerToken local_ptok(message_queue_);
   PinToCoreWithOffset(ThreadType::kWorkerTXRX, core_offset_ + 1, tid);
 
+  if (shm_fronthaul_ != nullptr) {
+    while (running) {
+      for (size_t socket_id = socket_lo; socket_id < socket_hi; ++socket_id) {
+        const Packet* pkt =
+            shm_fronthaul_->ConsumerSlot(ShmDirection::kDownlink, socket_id);
+        if (pkt != nullptr) {
+          HandleBsPacket(pkt, socket_id, local_ptok);
+          shm_fronthaul_->Consume(ShmDirection::kDownlink, socket_id);
+        }
+      }
+    }
+    return nullptr;
+  }
+
   // initialize bs-facing sockets
   size_t sock_buf_size = (1024 * 1024 * 64 * 8) - 1;
   for (size_t socket_id = socket_lo; socket_id < socket_hi; ++socket_id) {
@@ -322,7 +363,7 @@ void* ChannelSim::BsRxLoop(int tid) {
         bscfg_->BsServerPort() + socket_id);
   }
 
-  std::vector<uint8_t> udp_pkt_buf(bscfg_->PacketLength(), 0);
+  std::vector<uint8_t> udp_pkt_buf(bscfg_->DlPacketLength(), 0);
   size_t socket_id = socket_lo;
   while (running) {
     int rx_bytes =
@@ -331,30 +372,8 @@ void* ChannelSim::BsRxLoop(int tid) {
       std::printf("BS socket %zu receive failed\n", socket_id);
       throw std::runtime_error("ChannelSim: BS socket receive failed");
     } else if (static_cast<size_t>(rx_bytes) == udp_pkt_buf.size()) {
-      const auto* pkt = reinterpret_cast<Packet*>(&udp_pkt_buf[0]);
-
-      size_t frame_id = pkt->frame_id_;
-      size_t symbol_id = pkt->symbol_id_;
-      size_t ant_id = pkt->ant_id_;
-      if (kDebugPrintInTask) {
-        std::printf(
-            "Received BS packet for frame %zu, symbol %zu, ant %zu from "
-            "socket %zu\n",
-            frame_id, symbol_id, ant_id, socket_id);
-      }
-      size_t dl_symbol_id = GetDlSymbolIdx(symbol_id);
-      size_t symbol_offset =
-          (frame_id % kFrameWnd) * dl_data_plus_beacon_symbols_ + dl_symbol_id;
-      size_t offset = symbol_offset * bscfg_->BsAntNum() + ant_id;
-      std::memcpy(&rx_buffer_bs_[offset * payload_length_], pkt->data_,
-                  payload_length_);
-
-      RtAssert(message_queue_.enqueue(
-                   local_ptok,
-                   EventData(
-                       EventType::kPacketRX,
-                       gen_tag_t::FrmSymAnt(frame_id, symbol_id, ant_id).tag_)),
-               "BS socket message enqueue failed!");
+      HandleBsPacket(reinterpret_cast<Packet*>(&udp_pkt_buf[0]), socket_id,
+                     local_ptok);
       if (++socket_id == socket_hi) {
         socket_id = socket_lo;
       }
@@ -368,6 +387,32 @@ void* ChannelSim::BsRxLoop(int tid) {
   return nullptr;
 }
 
+void ChannelSim::HandleBsPacket(const Packet* pkt, size_t socket_id,
+                                moodycamel::ProducerToken& ptok) {
+  size_t frame_id = pkt->frame_id_;
+  size_t symbol_id = pkt->symbol_id_;
+  size_t ant_id = pkt->ant_id_;
+  if (kDebugPrintInTask) {
+    std::printf(
+        "Received BS packet for frame %zu, symbol %zu, ant %zu from "
+        "socket %zu\n",
+        frame_id, symbol_id, ant_id, socket_id);
+  }
+  size_t dl_symbol_id = GetDlSymbolIdx(symbol_id);
+  size_t symbol_offset =
+      (frame_id % kFrameWnd) * dl_data_plus_beacon_symbols_ + dl_symbol_id;
+  size_t offset = symbol_offset * bscfg_->BsAntNum() + ant_id;
+  // With BFP compression, the compressed samples are stored as received
+  std::memcpy(&rx_buffer_bs_[offset * payload_length_], pkt->data_,
+              bscfg_->DlPacketLength() - Packet::kOffsetOfData);
+
+  RtAssert(message_queue_.enqueue(
+               ptok, EventData(EventType::kPacketRX,
+                               gen_tag_t::FrmSymAnt(frame_id, symbol_id, ant_id)
+                                   .tag_)),
+           "BS socket message enqueue failed!");
+}
+
 void* ChannelSim::UeRxLoop(int tid) {
   size_t socket_lo = tid * user_socket_num_ / user_thread_num_;
   size_t socket_hi = (tid + 1) * user_socket_num_ / user_thread_num_;
@@ -391,7 +436,7 @@ void* ChannelSim::UeRxLoop(int tid) {
         uecfg_->UeServerPort() + socket_id);
   }
 
-  std::vector<uint8_t> udp_pkt_buf(bscfg_->PacketLength(), 0);
+  std::vector<uint8_t> udp_pkt_buf(uecfg_->PacketLength(), 0);
   size_t socket_id = socket_lo;
   while (running) {
     int rx_bytes =
@@ -446,29 +491,95 @@ void* ChannelSim::UeRxLoop(int tid) {
 
 /// Warning: Threads are sharing these sender sockets.
 void ChannelSim::DoTx(size_t frame_id, size_t symbol_id, size_t max_ant,
-                      std::vector<char>& tx_buffer, size_t buffer_offset,
+                      const Config* dest_cfg, std::vector<char>& tx_buffer,
+                      size_t buffer_offset,
                       std::vector<std::unique_ptr<UDPClient>>& udp_clients,
                       const std::string& dest_address, size_t dest_port,
-                      arma::cx_fmat& format_dest) {
-  auto* dst_ptr = reinterpret_cast<short*>(&tx_buffer.at(buffer_offset));
-  SimdConvertFloatToShort(reinterpret_cast<float*>(format_dest.memptr()),
-                          dst_ptr, 2 * bscfg_->SampsPerSymbol() * max_ant);
+                      arma::cx_fmat& format_dest, double loss_prob) {
+  // One generator per sending thread
+  static thread_local std::mt19937 loss_gen(std::random_device{}());
+  std::bernoulli_distribution loss_dist(loss_prob);
+  const size_t bfp_iq_width = dest_cfg->BfpIqWidth();
+  if (bfp_iq_width == 0) {
+    auto* dst_ptr = reinterpret_cast<short*>(&tx_buffer.at(buffer_offset));
+    SimdConvertFloatToShort(reinterpret_cast<float*>(format_dest.memptr()),
+                            dst_ptr, 2 * bscfg_->SampsPerSymbol() * max_ant);
+  }
 
-  std::vector<uint8_t> udp_pkt_buf(bscfg_->PacketLength(), 0);
+  const size_t ants_per_packet = dest_cfg->FronthaulAntsPerPacket();
+  std::vector<uint8_t> udp_pkt_buf(dest_cfg->PacketLength(), 0);
   auto* pkt = reinterpret_cast<Packet*>(&udp_pkt_buf[0]);
-  for (size_t ant_id = 0; ant_id < max_ant; ant_id++) {
+  for (size_t ant_id = 0; ant_id < max_ant; ant_id += ants_per_packet) {
     pkt->frame_id_ = frame_id;
     pkt->symbol_id_ = symbol_id;
     pkt->ant_id_ = ant_id;
     pkt->cell_id_ = 0;
-    std::memcpy(pkt->data_,
-                &tx_buffer[buffer_offset + ant_id * payload_length_],
-                payload_length_);
+    for (size_t i = 0; i < ants_per_packet; i++) {
+      auto* ant_data = reinterpret_cast<uint8_t*>(pkt->data_) +
+                       i * dest_cfg->PacketAntBytes();
+      if (bfp_iq_width > 0) {
+        BfpCompress(reinterpret_cast<float*>(format_dest.colptr(ant_id + i)),
+                    ant_data, bscfg_->SampsPerSymbol(), bfp_iq_width);
+      } else {
+        std::memcpy(ant_data,
+                    &tx_buffer[buffer_offset + (ant_id + i) * payload_length_],
+                    payload_length_);
+      }
+    }
+    if ((loss_prob > 0) && (loss_dist(loss_gen) == true)) {
+      num_lost_bs_packets_++;
+      continue;
+    }
     udp_clients.at(ant_id)->Send(dest_address, dest_port + ant_id,
                                  udp_pkt_buf.data(), udp_pkt_buf.size());
   }
 }
 
+void ChannelSim::DoTxShm(size_t frame_id, size_t symbol_id,
+                         size_t buffer_offset, arma::cx_fmat& format_dest) {
+  static thread_local std::mt19937 loss_gen(std::random_device{}());
+  std::bernoulli_distribution loss_dist(packet_loss_);
+  const size_t bfp_iq_width = bscfg_->BfpIqWidth();
+  if (bfp_iq_width == 0) {
+    auto* dst_ptr = reinterpret_cast<short*>(&tx_buffer_bs_.at(buffer_offset));
+    SimdConvertFloatToShort(reinterpret_cast<float*>(format_dest.memptr()),
+                            dst_ptr,
+                            2 * bscfg_->SampsPerSymbol() * bscfg_->BsAntNum());
+  }
+
+  const size_t ants_per_packet = bscfg_->FronthaulAntsPerPacket();
+  std::lock_guard<std::mutex> lock(shm_ul_mutex_);
+  for (size_t ant_id = 0; ant_id < bscfg_->BsAntNum();
+       ant_id += ants_per_packet) {
+    if ((packet_loss_ > 0) && (loss_dist(loss_gen) == true)) {
+      num_lost_bs_packets_++;
+      continue;
+    }
+    Packet* pkt = shm_fronthaul_->ProducerSlot(ShmDirection::kUplink, ant_id);
+    if (pkt == nullptr) {
+      // Agora is not keeping up, and the packet is lost as a full socket
+      // buffer would lose it
+      num_lost_bs_packets_++;
+      continue;
+    }
+    new (pkt) Packet(frame_id, symbol_id, 0 /* cell_id */, ant_id);
+    for (size_t i = 0; i < ants_per_packet; i++) {
+      auto* ant_data =
+          reinterpret_cast<uint8_t*>(pkt->data_) + i * bscfg_->PacketAntBytes();
+      if (bfp_iq_width > 0) {
+        BfpCompress(reinterpret_cast<float*>(format_dest.colptr(ant_id + i)),
+                    ant_data, bscfg_->SampsPerSymbol(), bfp_iq_width);
+      } else {
+        std::memcpy(
+            ant_data,
+            &tx_buffer_bs_[buffer_offset + (ant_id + i) * payload_length_],
+            payload_length_);
+      }
+    }
+    shm_fronthaul_->Produce(ShmDirection::kUplink, ant_id);
+  }
+}
+
 void ChannelSim::DoTxBs(int tid, size_t tag) {
   const size_t frame_id = gen_tag_t(tag).frame_id_;
   const size_t symbol_id = gen_tag_t(tag).symbol_id_;
@@ -515,8 +626,13 @@ void ChannelSim::DoTxBs(int tid, size_t tag) {
     Utils::PrintMat(fmat_dst, "rx_ul");
   }
 
-  DoTx(frame_id, symbol_id, bscfg_->BsAntNum(), tx_buffer_bs_, total_offset_bs,
-       client_bs_, bscfg_->BsServerAddr(), bscfg_->BsServerPort(), fmat_dst);
+  if (shm_fronthaul_ != nullptr) {
+    DoTxShm(frame_id, symbol_id, total_offset_bs, fmat_dst);
+  } else {
+    DoTx(frame_id, symbol_id, bscfg_->BsAntNum(), bscfg_, tx_buffer_bs_,
+         total_offset_bs, client_bs_, bscfg_->BsServerAddr(),
+         bscfg_->BsServerPort(), fmat_dst, packet_loss_);
+  }
 
   RtAssert(message_queue_.enqueue(
                *task_ptok_[tid],
@@ -548,8 +664,19 @@ void ChannelSim::DoTxUser(int tid, size_t tag) {
   // apply channel, convert back to complex short to TX
   arma::cx_fmat fmat_src =
       arma::zeros<arma::cx_fmat>(bscfg_->SampsPerSymbol(), bscfg_->BsAntNum());
-  SimdConvertShortToFloat(src_ptr, reinterpret_cast<float*>(fmat_src.memptr()),
-                          2 * bscfg_->SampsPerSymbol() * bscfg_->BsAntNum());
+  if (bscfg_->BfpIqWidth() > 0) {
+    for (size_t ant_id = 0; ant_id < bscfg_->BsAntNum(); ant_id++) {
+      SimdBfpDecompress(
+          reinterpret_cast<uint8_t*>(
+              &rx_buffer_bs_[total_offset_bs + ant_id * payload_length_]),
+          reinterpret_cast<float*>(fmat_src.colptr(ant_id)), 0,
+          bscfg_->SampsPerSymbol(), bscfg_->BfpIqWidth());
+    }
+  } else {
+    SimdConvertShortToFloat(src_ptr,
+                            reinterpret_cast<float*>(fmat_src.memptr()),
+                            2 * bscfg_->SampsPerSymbol() * bscfg_->BsAntNum());
+  }
 
   // Apply Channel
   arma::cx_fmat fmat_dst;
@@ -565,8 +692,9 @@ void ChannelSim::DoTxUser(int tid, size_t tag) {
     Utils::PrintMat(fmat_dst, "rx_dl");
   }
 
-  DoTx(frame_id, symbol_id, uecfg_->UeAntNum(), tx_buffer_ue_, total_offset_ue,
-       client_ue_, uecfg_->UeServerAddr(), uecfg_->UeServerPort(), fmat_dst);
+  DoTx(frame_id, symbol_id, uecfg_->UeAntNum(), uecfg_, tx_buffer_ue_,
+       total_offset_ue, client_ue_, uecfg_->UeServerAddr(),
+       uecfg_->UeServerPort(), fmat_dst, 0 /* no loss */);
 
   RtAssert(message_queue_.enqueue(
                *task_ptok_[tid],
@@ -9,8 +9,10 @@
 
 #include <algorithm>
 #include <armadillo>
+#include <atomic>
 #include <ctime>
 #include <iomanip>
+#include <mutex>
 #include <numeric>
 
 #include "buffer.h"
@@ -19,6 +21,7 @@
 #include "config.h"
 #include "gettime.h"
 #include "memory_manage.h"
+#include "shm_transport.h"
 #include "signal_handler.h"
 #include "symbols.h"
 #include "udp_client.h"
@@ -37,7 +40,7 @@ class ChannelSim {
              size_t bs_thread_num, size_t user_thread_num,
              size_t worker_thread_num, size_t in_core_offset = 30,
              std::string in_chan_type = std::string("RAYLEIGH"),
-             double in_chan_snr = 20);
+             double in_chan_snr = 20, double in_packet_loss = 0);
   ~ChannelSim();
 
   void Start();
@@ -60,11 +63,30 @@ class ChannelSim {
   void* TaskThread(int tid);
 
  private:
+  // Send the symbol of max_ant antennas, in the packet format of dest_cfg
   void DoTx(size_t frame_id, size_t symbol_id, size_t max_ant,
-            std::vector<char>& tx_buffer, size_t buffer_offset,
+            const Config* dest_cfg, std::vector<char>& tx_buffer,
+            size_t buffer_offset,
             std::vector<std::unique_ptr<UDPClient>>& udp_clients,
             const std::string& dest_address, size_t dest_port,
-            arma::cx_fmat& format_dest);
+            arma::cx_fmat& format_dest, double loss_prob);
+
+  // Write the uplink symbol to the BS antennas' rings, with the shm
+  // transport
+  void DoTxShm(size_t frame_id, size_t symbol_id, size_t buffer_offset,
+               arma::cx_fmat& format_dest);
+
+  // Save the samples of a packet received from a BS antenna and notify the
+  // master thread
+  void HandleBsPacket(const Packet* pkt, size_t socket_id,
+                      moodycamel::ProducerToken& ptok);
+
+  // Agora's shared memory rings, with the shm transport of the BS config.
+  // The BS RX threads consume the downlink rings of their antennas. Any
+  // task thread may produce uplink packets, so they take
+  // shm_ul_mutex_ to keep one producer per uplink ring.
+  std::unique_ptr<ShmFronthaul> shm_fronthaul_;
+  std::mutex shm_ul_mutex_;
 
   // BS-facing sending clients
   std::vector<std::unique_ptr<UDPClient>> client_bs_;
@@ -118,6 +140,11 @@ class ChannelSim {
   std::string channel_type_;
   double channel_snr_;
 
+  // Probability of dropping each packet sent to the BS, to emulate
+  // fronthaul loss
+  double packet_loss_;
+  std::atomic<size_t> num_lost_bs_packets_{0};
+
   size_t* bs_rx_counter_;
   size_t* user_rx_counter_;
   std::array<size_t, kFrameWnd> bs_tx_counter_;
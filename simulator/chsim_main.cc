@@ -24,6 +24,8 @@ DEFINE_string(ue_conf_file,
               "UE Config filename");
 DEFINE_string(chan_model, "RAYLEIGH", "Simulator Channel Type: RAYLEIGH/AWGN");
 DEFINE_double(chan_snr, 20.0, "Signal-to-Noise Ratio");
+DEFINE_double(packet_loss, 0.0,
+              "Probability of dropping each uplink packet sent to the BS");
 
 int main(int argc, char* argv[]) {
   int ret = EXIT_FAILURE;
@@ -42,7 +44,7 @@ int main(int argc, char* argv[]) {
       auto sim = std::make_unique<ChannelSim>(
           bs_config.get(), ue_config.get(), FLAGS_bs_threads, FLAGS_ue_threads,
           FLAGS_worker_threads, FLAGS_core_offset, FLAGS_chan_model,
-          FLAGS_chan_snr);
+          FLAGS_chan_snr, FLAGS_packet_loss);
       sim->Start();
       ret = EXIT_SUCCESS;
     } catch (SignalException& e) {
@@ -7,6 +7,7 @@
 #include <algorithm>
 #include <thread>
 
+#include "bfp.h"
 #include "datatype_conversion.h"
 #include "logger.h"
 #include "udp_client.h"
@@ -83,6 +84,15 @@ Sender::Sender(Config* cfg, size_t socket_thread_num, size_t core_offset,
     task_ptok_[i] = new moodycamel::ProducerToken(send_queue_);
   }
 
+#if !defined(USE_DPDK)
+  if (cfg->Transport() == "shm") {
+    shm_fronthaul_ = std::make_unique<ShmFronthaul>(
+        cfg->ShmPath(), cfg->NumRadios(),
+        std::max(cfg->PacketLength(), cfg->DlPacketLength()),
+        cfg->ShmRingSlots(), false /* create */);
+  }
+#endif
+
   // Create a master thread when started from simulator
   if (create_thread_for_master == true) {
     this->threads_.emplace_back(&Sender::MasterThread, this,
@@ -142,6 +152,7 @@ Sender::~Sender() {
   }
 
   iq_data_short_.Free();
+  iq_data_bfp_.Free();
   for (auto& i : packet_count_per_symbol_) {
     delete[] i;
   }
@@ -186,13 +197,17 @@ size_t Sender::FindNextSymbol(size_t start_symbol) {
 }
 
 void Sender::ScheduleSymbol(size_t frame, size_t symbol_id) {
-  for (size_t i = 0; i < cfg_->BsAntNum(); i++) {
+  // One task per packet of antennas
+  const size_t ants_per_packet = cfg_->FronthaulAntsPerPacket();
+  for (size_t i = 0; i < cfg_->BsAntNum(); i += ants_per_packet) {
     auto req_tag = gen_tag_t::FrmSymAnt(frame, symbol_id, i);
     // Split up the antennas amoung the worker threads
-    RtAssert(
-        send_queue_.enqueue(*task_ptok_[i % socket_thread_num_], req_tag.tag_),
-        "Send task enqueue failed");
+    RtAssert(send_queue_.enqueue(
+                 *task_ptok_[(i / ants_per_packet) % socket_thread_num_],
+                 req_tag.tag_),
+             "Send task enqueue failed");
   }
+  send_waker_.Notify();
 }
 
 void* Sender::MasterThread(int /*unused*/) {
@@ -234,7 +249,7 @@ void* Sender::MasterThread(int /*unused*/) {
       }
       // Check to see if the current symbol is finished
       if (packet_count_per_symbol_[comp_frame_slot][ctag.symbol_id_] ==
-          cfg_->BsAntNum()) {
+          cfg_->BsAntNum() / cfg_->FronthaulAntsPerPacket()) {
         // Finished with the current symbol
         packet_count_per_symbol_[comp_frame_slot][ctag.symbol_id_] = 0;
 
@@ -323,14 +338,23 @@ void* Sender::WorkerThread(int tid) {
       cfg_->Frame().NumULSyms();  // TEMP not sure if this is ok
   const size_t radio_lo = (tid * cfg_->NumRadios()) / socket_thread_num_;
   const size_t radio_hi = ((tid + 1) * cfg_->NumRadios()) / socket_thread_num_;
-  const size_t ant_num_this_thread =
-      cfg_->BsAntNum() / socket_thread_num_ +
-      (static_cast<size_t>(tid) < cfg_->BsAntNum() % socket_thread_num_ ? 1
-                                                                        : 0);
+  // Each task sends the packet of ants_per_packet antennas, or the
+  // num_frags fragments of one antenna's symbol
+  const size_t ants_per_packet = cfg_->FronthaulAntsPerPacket();
+  const size_t num_frags = cfg_->FronthaulFragsPerSymbol();
+  const size_t sc_per_frag = cfg_->OfdmCaNum() / num_frags;
+  const size_t bfp_iq_width = cfg_->BfpIqWidth();
+  const size_t tasks_per_symbol = cfg_->BsAntNum() / ants_per_packet;
+  const size_t pkt_num_this_thread =
+      (tasks_per_symbol / socket_thread_num_ +
+       (static_cast<size_t>(tid) < tasks_per_symbol % socket_thread_num_
+            ? 1
+            : 0)) *
+      num_frags;
 #if defined(USE_DPDK)
   const size_t port_id = tid % cfg_->DpdkNumPorts();
   const size_t queue_id = tid / cfg_->DpdkNumPorts();
-  rte_mbuf* tx_mbufs[kDequeueBulkSize];
+  std::vector<rte_mbuf*> tx_mbufs(kDequeueBulkSize * num_frags);
 #else
   UDPClient udp_client;
 #endif
@@ -341,109 +365,188 @@ void* Sender::WorkerThread(int tid) {
           cfg_->OfdmCaNum() * sizeof(complex_float)));
   auto* socks_pkt_buf = static_cast<Packet*>(PaddedAlignedAlloc(
       Agora_memory::Alignment_t::kAlign32, cfg_->PacketLength()));
+  // Scratch for one antenna's symbol, whose FFT output is split into
+  // fragments or compressed
+  auto* symbol_buf = static_cast<short*>(PaddedAlignedAlloc(
+      Agora_memory::Alignment_t::kAlign64,
+      (cfg_->CpLen() + cfg_->OfdmCaNum()) * 2 * sizeof(short)));
 
   double begin = GetTime::GetTimeUs();
   size_t total_tx_packets = 0;
   size_t total_tx_packets_rolling = 0;
   size_t cur_radio = radio_lo;
+  size_t num_shm_drops = 0;
 
-  MLPD_INFO("Sender: In thread %d, %zu antennas, total bs antennas: %zu\n", tid,
-            ant_num_this_thread, cfg_->BsAntNum());
+  MLPD_INFO(
+      "Sender: In thread %d, %zu packets per symbol, total bs antennas: %zu\n",
+      tid, pkt_num_this_thread, cfg_->BsAntNum());
 
   // We currently don't support zero-padding OFDM prefix and postfix
-  RtAssert(cfg_->PacketLength() ==
-           Packet::kOffsetOfData +
-               (kUse12BitIQ ? 3 : 4) * (cfg_->CpLen() + cfg_->OfdmCaNum()));
+  RtAssert(cfg_->SampsPerSymbol() == cfg_->CpLen() + cfg_->OfdmCaNum());
   size_t ant_num_per_cell = cfg_->BsAntNum() / cfg_->NumCells();
 
+  IdleStat idle_stat;
+  IdlePolicy idle(cfg_->IdleSpinIters(), cfg_->IdlePauseIters(),
+                  cfg_->IdleSleepUs(), &send_waker_, &idle_stat);
   size_t tags[kDequeueBulkSize];
   while (keep_running.load() == true) {
     size_t num_tags = this->send_queue_.try_dequeue_bulk_from_producer(
         *(this->task_ptok_[tid]), tags, kDequeueBulkSize);
-    if (num_tags > 0) {
+    if (num_tags == 0) {
+      idle.OnIdle();
+    } else {
+      idle.OnWork();
+#if defined(USE_DPDK)
+      size_t num_tx_mbufs = 0;
+#endif
       for (size_t tag_id = 0; (tag_id < num_tags); tag_id++) {
         size_t start_tsc_send = GetTime::Rdtsc();
 
         auto tag = gen_tag_t(tags[tag_id]);
         assert((cfg_->GetSymbolType(tag.symbol_id_) == SymbolType::kPilot) ||
                (cfg_->GetSymbolType(tag.symbol_id_) == SymbolType::kUL));
+        const size_t cell_id = tag.ant_id_ / ant_num_per_cell;
+
+        if (num_frags > 1) {
+          // Run the FFT once for all fragments of the symbol
+          std::memcpy(symbol_buf,
+                      iq_data_short_[(tag.symbol_id_ * cfg_->BsAntNum()) +
+                                     tag.ant_id_],
+                      (cfg_->CpLen() + cfg_->OfdmCaNum()) * 4);
+          RunFft(symbol_buf, fft_inout, mkl_handle);
+        }
 
-        // Send a message to the server. We assume that the server is running.
-        Packet* pkt = socks_pkt_buf;
+        for (size_t frag_id = 0; frag_id < num_frags; frag_id++) {
+          // Send a message to the server. We assume that the server is
+          // running.
+          Packet* pkt = socks_pkt_buf;
 #if defined(USE_DPDK)
-        tx_mbufs[tag_id] = DpdkTransport::AllocUdp(
-            mbuf_pool_, sender_mac_addr_[port_id], server_mac_addr_[port_id],
-            bs_rru_addr_, bs_server_addr_, this->cfg_->BsRruPort() + tid,
-            this->cfg_->BsServerPort() + tid, this->cfg_->PacketLength());
-        pkt = reinterpret_cast<Packet*>(
-            rte_pktmbuf_mtod(tx_mbufs[tag_id], uint8_t*) + kPayloadOffset);
+          tx_mbufs[num_tx_mbufs] = DpdkTransport::AllocUdp(
+              mbuf_pool_, sender_mac_addr_[port_id], server_mac_addr_[port_id],
+              bs_rru_addr_, bs_server_addr_, this->cfg_->BsRruPort() + tid,
+              this->cfg_->BsServerPort() + tid, this->cfg_->PacketLength());
+          pkt = reinterpret_cast<Packet*>(
+              rte_pktmbuf_mtod(tx_mbufs[num_tx_mbufs], uint8_t*) +
+              kPayloadOffset);
+          num_tx_mbufs++;
+#else
+          Packet* shm_slot = nullptr;
+          if (shm_fronthaul_ != nullptr) {
+            // Build the packet in place in the ring. If the ring is full, it
+            // is built in socks_pkt_buf and dropped.
+            shm_slot =
+                shm_fronthaul_->ProducerSlot(ShmDirection::kUplink, cur_radio);
+            if (shm_slot != nullptr) {
+              pkt = shm_slot;
+            } else {
+              num_shm_drops++;
+            }
+          }
 #endif
 
-        if ((kDebugPrintSender == true)) {
-          std::printf(
-              "Sender : worker %d processing frame %d symbol %d, type %d\n",
-              tid, tag.frame_id_, tag.symbol_id_,
-              static_cast<int>(cfg_->GetSymbolType(tag.symbol_id_)));
-        }
+          if ((kDebugPrintSender == true)) {
+            std::printf(
+                "Sender : worker %d processing frame %d symbol %d, type %d\n",
+                tid, tag.frame_id_, tag.symbol_id_,
+                static_cast<int>(cfg_->GetSymbolType(tag.symbol_id_)));
+          }
 
-        // Update the TX buffer
-        pkt->frame_id_ = tag.frame_id_;
-        pkt->symbol_id_ = tag.symbol_id_;
-        pkt->cell_id_ = tag.ant_id_ / ant_num_per_cell;
-        pkt->ant_id_ = tag.ant_id_ - ant_num_per_cell * (pkt->cell_id_);
-        std::memcpy(
-            pkt->data_,
-            iq_data_short_[(pkt->symbol_id_ * cfg_->BsAntNum()) + tag.ant_id_],
-            (cfg_->CpLen() + cfg_->OfdmCaNum()) * (kUse12BitIQ ? 3 : 4));
-        if (cfg_->FftInRru() == true) {
-          RunFft(pkt, fft_inout, mkl_handle);
-        }
+          // Update the TX buffer
+          pkt->frame_id_ = tag.frame_id_;
+          pkt->symbol_id_ = tag.symbol_id_;
+          pkt->cell_id_ = cell_id;
+          pkt->ant_id_ = tag.ant_id_ - ant_num_per_cell * cell_id;
+          pkt->frag_id_ = frag_id;
+          if ((num_frags > 1) && (bfp_iq_width > 0)) {
+            BfpCompress(reinterpret_cast<float*>(&fft_inout[frag_id *
+                                                            sc_per_frag]),
+                        reinterpret_cast<uint8_t*>(pkt->data_), sc_per_frag,
+                        bfp_iq_width);
+          } else if (num_frags > 1) {
+            std::memcpy(pkt->data_, &symbol_buf[2 * frag_id * sc_per_frag],
+                        sc_per_frag * 4);
+          } else {
+            for (size_t i = 0; i < ants_per_packet; i++) {
+              const size_t iq_row =
+                  (tag.symbol_id_ * cfg_->BsAntNum()) + tag.ant_id_ + i;
+              auto* samples = reinterpret_cast<short*>(
+                  reinterpret_cast<uint8_t*>(pkt->data_) +
+                  i * cfg_->PacketAntBytes());
+              if ((bfp_iq_width > 0) && (cfg_->FftInRru() == true)) {
+                // Compress the float FFT output
+                std::memcpy(symbol_buf, iq_data_short_[iq_row],
+                            (cfg_->CpLen() + cfg_->OfdmCaNum()) * 4);
+                RunFft(symbol_buf, fft_inout, mkl_handle);
+                BfpCompress(reinterpret_cast<float*>(fft_inout),
+                            reinterpret_cast<uint8_t*>(samples),
+                            cfg_->OfdmCaNum(), bfp_iq_width);
+              } else if (bfp_iq_width > 0) {
+                std::memcpy(samples, iq_data_bfp_[iq_row],
+                            cfg_->PacketAntBytes());
+              } else {
+                std::memcpy(samples, iq_data_short_[iq_row],
+                            (cfg_->CpLen() + cfg_->OfdmCaNum()) *
+                                (kUse12BitIQ ? 3 : 4));
+                if (cfg_->FftInRru() == true) {
+                  RunFft(samples, fft_inout, mkl_handle);
+                }
+              }
+            }
+          }
 
 #ifndef USE_DPDK
-        udp_client.Send(cfg_->BsServerAddr(), cfg_->BsServerPort() + cur_radio,
-                        reinterpret_cast<uint8_t*>(socks_pkt_buf),
-                        cfg_->PacketLength());
+          if (shm_fronthaul_ == nullptr) {
+            udp_client.Send(cfg_->BsServerAddr(),
+                            cfg_->BsServerPort() + cur_radio,
+                            reinterpret_cast<uint8_t*>(socks_pkt_buf),
+                            cfg_->PacketLength());
+          } else if (shm_slot != nullptr) {
+            shm_fronthaul_->Produce(ShmDirection::kUplink, cur_radio);
+          }
 #endif
 
-        if (kDebugSenderReceiver == true) {
-          std::printf(
-              "Thread %d (tag = %s) transmit frame %d, symbol %d, ant "
-              "%d, TX time: %.3f us\n",
-              tid, gen_tag_t(tag).ToString().c_str(), pkt->frame_id_,
-              pkt->symbol_id_, pkt->ant_id_,
-              GetTime::CyclesToUs(GetTime::Rdtsc() - start_tsc_send,
-                                  freq_ghz_));
-        }
+          if (kDebugSenderReceiver == true) {
+            std::printf(
+                "Thread %d (tag = %s) transmit frame %d, symbol %d, ant "
+                "%d, frag %d, TX time: %.3f us\n",
+                tid, gen_tag_t(tag).ToString().c_str(), pkt->frame_id_,
+                pkt->symbol_id_, pkt->ant_id_, pkt->frag_id_,
+                GetTime::CyclesToUs(GetTime::Rdtsc() - start_tsc_send,
+                                    freq_ghz_));
+          }
 
-        total_tx_packets_rolling++;
-        total_tx_packets++;
-        if (total_tx_packets_rolling ==
-            ant_num_this_thread * max_symbol_id * 1000) {
-          double end = GetTime::GetTimeUs();
-          double byte_len = cfg_->PacketLength() * ant_num_this_thread *
-                            max_symbol_id * 1000.f;
-          double diff = end - begin;
-          std::printf("Thread %zu send %zu frames in %f secs, tput %f Mbps\n",
-                      (size_t)tid,
-                      total_tx_packets / (ant_num_this_thread * max_symbol_id),
-                      diff / 1e6, byte_len * 8 * 1e6 / diff / 1024 / 1024);
-          begin = GetTime::GetTimeUs();
-          total_tx_packets_rolling = 0;
-        }
+          total_tx_packets_rolling++;
+          total_tx_packets++;
+          if (total_tx_packets_rolling ==
+              pkt_num_this_thread * max_symbol_id * 1000) {
+            double end = GetTime::GetTimeUs();
+            double byte_len = cfg_->PacketLength() * pkt_num_this_thread *
+                              max_symbol_id * 1000.f;
+            double diff = end - begin;
+            std::printf(
+                "Thread %zu send %zu frames in %f secs, tput %f Mbps\n",
+                (size_t)tid,
+                total_tx_packets / (pkt_num_this_thread * max_symbol_id),
+                diff / 1e6, byte_len * 8 * 1e6 / diff / 1024 / 1024);
+            begin = GetTime::GetTimeUs();
+            total_tx_packets_rolling = 0;
+          }
 
-        if (++cur_radio == radio_hi) {
-          cur_radio = radio_lo;
+          if (++cur_radio == radio_hi) {
+            cur_radio = radio_lo;
+          }
         }
       }
 
 #if defined(USE_DPDK)
-      size_t nb_tx_new = rte_eth_tx_burst(port_id + cfg_->DpdkPortOffset(),
-                                          queue_id, tx_mbufs, num_tags);
-      if (unlikely(nb_tx_new != num_tags)) {
+      size_t nb_tx_new =
+          rte_eth_tx_burst(port_id + cfg_->DpdkPortOffset(), queue_id,
+                           tx_mbufs.data(), num_tx_mbufs);
+      if (unlikely(nb_tx_new != num_tx_mbufs)) {
         std::printf(
             "Thread %d rte_eth_tx_burst() failed, nb_tx_new: %zu, "
-            "num_tags: %zu\n",
-            tid, nb_tx_new, num_tags);
+            "num_tx_mbufs: %zu\n",
+            tid, nb_tx_new, num_tx_mbufs);
         keep_running.store(false);
         break;
       }
@@ -456,9 +559,17 @@ void* Sender::WorkerThread(int tid) {
   DftiFreeDescriptor(&mkl_handle);
 
   std::free(static_cast<void*>(socks_pkt_buf));
+  std::free(static_cast<void*>(symbol_buf));
   std::free(static_cast<void*>(fft_inout));
   MLPD_FRAME("Sender: worker thread %d exit\n", tid);
-  std::printf("Sender: worker thread %d exit\n", tid);
+  std::printf("Sender: worker thread %d exit, idle %.1f%%, %zu sleeps\n", tid,
+              idle_stat.idle_cycles_ * 100.0 /
+                  (GetTime::Rdtsc() - idle_stat.start_tsc_),
+              idle_stat.num_sleeps_);
+  if (num_shm_drops > 0) {
+    std::printf("Sender: worker thread %d dropped %zu packets on full rings\n",
+                tid, num_shm_drops);
+  }
   return nullptr;
 }
 
@@ -480,6 +591,14 @@ void Sender::InitIqFromFile(const std::string& filename) {
   iq_data_short_.Calloc(packets_per_frame,
                         (cfg_->CpLen() + cfg_->OfdmCaNum()) * 2,
                         Agora_memory::Alignment_t::kAlign64);
+  // With FFT in the RRU, the frequency-domain samples are compressed as
+  // they are sent
+  const bool bfp_time_domain =
+      (cfg_->BfpIqWidth() > 0) && (cfg_->FftInRru() == false);
+  if (bfp_time_domain == true) {
+    iq_data_bfp_.Calloc(packets_per_frame, cfg_->PacketAntBytes(),
+                        Agora_memory::Alignment_t::kAlign64);
+  }
 
   Table<float> iq_data_float;
   iq_data_float.Calloc(packets_per_frame,
@@ -512,6 +631,10 @@ void Sender::InitIqFromFile(const std::string& filename) {
             static_cast<unsigned short>(iq_data_float[i][j] * 32768);
       }
     }
+    if (bfp_time_domain == true) {
+      BfpCompress(iq_data_float[i], iq_data_bfp_[i],
+                  cfg_->CpLen() + cfg_->OfdmCaNum(), cfg_->BfpIqWidth());
+    }
   }
   std::fclose(fp);
   iq_data_float.Free();
@@ -534,17 +657,17 @@ void Sender::WriteStatsToFile(size_t tx_frame_count) const {
   }
 }
 
-void Sender::RunFft(Packet* pkt, complex_float* fft_inout,
+void Sender::RunFft(short* samples, complex_float* fft_inout,
                     DFTI_DESCRIPTOR_HANDLE mkl_handle) const {
-  // pkt->data has (cp_len + ofdm_ca_num) unsigned short samples. After FFT,
+  // samples has (cp_len + ofdm_ca_num) unsigned short samples. After FFT,
   // we'll remove the cyclic prefix and have ofdm_ca_num() short samples left.
-  SimdConvertShortToFloat(&pkt->data_[2 * cfg_->CpLen()],
+  SimdConvertShortToFloat(&samples[2 * cfg_->CpLen()],
                           reinterpret_cast<float*>(fft_inout),
                           cfg_->OfdmCaNum() * 2);
 
   DftiComputeForward(mkl_handle, reinterpret_cast<float*>(fft_inout));
 
-  SimdConvertFloat32ToFloat16(reinterpret_cast<float*>(pkt->data_),
+  SimdConvertFloat32ToFloat16(reinterpret_cast<float*>(samples),
                               reinterpret_cast<float*>(fft_inout),
                               cfg_->OfdmCaNum() * 2);
 }
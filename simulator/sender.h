@@ -22,8 +22,10 @@
 #include "config.h"
 #include "datatype_conversion.h"
 #include "gettime.h"
+#include "idle_policy.h"
 #include "memory_manage.h"
 #include "mkl_dfti.h"
+#include "shm_transport.h"
 #include "symbols.h"
 #include "utils.h"
 
@@ -97,9 +99,10 @@ class Sender {
   size_t FindNextSymbol(size_t start_symbol);
   void ScheduleSymbol(size_t frame, size_t symbol_id);
 
-  // Run FFT on the data field in pkt, output to fft_inout
-  // Recombine pkt header data and fft output data into payload
-  void RunFft(Packet* pkt, complex_float* fft_inout,
+  // Run FFT on one antenna's time-domain samples, using fft_inout as scratch
+  // Overwrite the samples with the float16 FFT output. fft_inout keeps the
+  // float FFT output.
+  void RunFft(short* samples, complex_float* fft_inout,
               DFTI_DESCRIPTOR_HANDLE mkl_handle) const;
 
   Config* cfg_;
@@ -132,11 +135,19 @@ class Sender {
   moodycamel::ConcurrentQueue<size_t> completion_queue_ =
       moodycamel::ConcurrentQueue<size_t>(1024);
   moodycamel::ProducerToken** task_ptok_;
+  // Wakes worker threads sleeping under the adaptive idle policy
+  IdleWaker send_waker_;
 
   // First dimension: symbol_num_perframe * BS_ANT_NUM
   // Second dimension: (CP_LEN + OFDM_CA_NUM) * 2
   Table<unsigned short> iq_data_short_;
 
+  // With BFP compression and FFT in Agora, the compressed samples of each
+  // symbol and antenna
+  // First dimension: symbol_num_perframe * BS_ANT_NUM
+  // Second dimension: PacketAntBytes()
+  Table<uint8_t> iq_data_bfp_;
+
   // Number of packets transmitted for each symbol in a frame
   size_t* packet_count_per_symbol_[kFrameWnd];
 
@@ -145,6 +156,10 @@ class Sender {
 
   std::vector<std::thread> threads_;
 
+  // Agora's shared memory rings, with the shm transport. Worker threads
+  // write packets directly into the uplink ring slots of their radios.
+  std::unique_ptr<ShmFronthaul> shm_fronthaul_;
+
 #if defined(USE_DPDK)
   struct rte_mempool* mbuf_pool_;
   uint32_t bs_rru_addr_;     // IPv4 address of this data sender
@@ -6,7 +6,9 @@
 #include "agora.h"
 
 #include <cmath>
+#include <cstring>
 #include <memory>
+#include <numeric>
 
 static const bool kDebugDeferral = false;
 static const size_t kDefaultMessageQueueSize = 512;
@@ -34,6 +36,11 @@ Agora::Agora(Config* const cfg)
 
   PinToCoreWithOffset(ThreadType::kMaster, cfg->CoreOffset(), 0,
                       false /* quiet */);
+  idle_sleep_enabled_ = (cfg->IdleSpinIters() != SIZE_MAX);
+  if (cfg->TraceRingSizeLog2() > 0) {
+    // Must precede the creation of the TXRX and worker threads
+    Tracer::Enable(cfg->TraceRingSizeLog2());
+  }
   CheckIncrementScheduleFrame(0, ScheduleProcessingFlags::kProcessingComplete);
   // Important to set cur_sche_frame_id_ after the call to
   // CheckIncrementScheduleFrame because it will be incremented however,
@@ -83,6 +90,10 @@ Agora::~Agora() {
     MLPD_SYMBOL("Agora: Joining worker thread\n");
     worker_thread.join();
   }
+  if (Tracer::Enabled() == true) {
+    Tracer::Dump(std::string(TOSTRING(PROJECT_DIRECTORY)) + "/data/trace.json",
+                 config_->FreqGhz());
+  }
   FreeUplinkBuffers();
   FreeDownlinkBuffers();
 
@@ -112,15 +123,156 @@ void Agora::SendSnrReport(EventType event_type, size_t frame_id,
   }
 }
 
+void Agora::EnqueueWorkerTask(EventType event_type, size_t qid,
+                              const EventData& event) {
+  Tracer::Record(event_type, event.tags_[0], TracePhase::kEnqueue,
+                 (event_type == EventType::kFFT) ? TraceTagType::kFftReq
+                                                 : TraceTagType::kGen);
+  if (work_stealing_queues_ != nullptr) {
+    const bool subcarrier_task = (event_type == EventType::kZF) ||
+                                 (event_type == EventType::kDemul) ||
+                                 (event_type == EventType::kPrecode);
+    if ((config_->SubcarrierAffinity() == true) && (subcarrier_task == true)) {
+      work_stealing_queues_->Push(
+          SubcarrierOwner(gen_tag_t(event.tags_[0]).sc_id_), event);
+    } else {
+      work_stealing_queues_->Push(event);
+    }
+  } else if (deadline_queue_ != nullptr) {
+    size_t frame_id;
+    size_t symbol_id;
+    if (event_type == EventType::kFFT) {
+      // FFT request tags hold packet offsets, so read the symbol from the
+      // first packet of the batch
+      const fft_req_tag_t fft_tag(event.tags_[0]);
+      const auto* pkt = reinterpret_cast<const Packet*>(
+          socket_buffer_[fft_tag.tid_] +
+          config_->PacketBufferOffset(fft_tag.offset_));
+      frame_id = pkt->frame_id_;
+      symbol_id = pkt->symbol_id_;
+    } else {
+      frame_id = gen_tag_t(event.tags_[0]).frame_id_;
+      symbol_id = gen_tag_t(event.tags_[0]).symbol_id_;
+    }
+    deadline_queue_->Push(TaskDeadlineTsc(event_type, frame_id, symbol_id),
+                          event);
+  } else if (config_->DecentralizedScheduling() == true) {
+    // In decentralized mode, tasks are also scheduled by worker threads, so
+    // the master's producer tokens cannot be used
+    TryEnqueueFallback(GetConq(event_type, qid), event);
+  } else {
+    TryEnqueueFallback(GetConq(event_type, qid), GetPtok(event_type, qid),
+                       event);
+  }
+  if (idle_sleep_enabled_ == true) {
+    worker_waker_.Notify();
+  }
+}
+
+void Agora::ScheduleFftTasks() {
+  std::queue<fft_req_tag_t>& cur_fftq =
+      fft_queue_arr_[(this->cur_sche_frame_id_ % kFrameWnd)];
+  size_t qid = FrameQueueId(this->cur_sche_frame_id_);
+  // The frame being scheduled must not share its queue set with a frame
+  // that is still being processed
+  if ((cur_fftq.size() >= config_->FftBlockSize()) &&
+      (this->cur_sche_frame_id_ <
+       this->cur_proc_frame_id_ + config_->PipelineDepth())) {
+    size_t num_fft_blocks = cur_fftq.size() / config_->FftBlockSize();
+    for (size_t i = 0; i < num_fft_blocks; i++) {
+      EventData do_fft_task;
+      do_fft_task.num_tags_ = config_->FftBlockSize();
+      do_fft_task.event_type_ = EventType::kFFT;
+
+      for (size_t j = 0; j < config_->FftBlockSize(); j++) {
+        do_fft_task.tags_[j] = cur_fftq.front().tag_;
+        cur_fftq.pop();
+
+        if (this->fft_created_count_ == 0) {
+          this->stats_->MasterSetTsc(TsType::kProcessingStarted,
+                                     this->cur_sche_frame_id_);
+        }
+        this->fft_created_count_++;
+        if (this->fft_created_count_ == rx_counters_.num_pkts_per_frame_) {
+          this->fft_created_count_ = 0;
+          if (config_->BigstationMode() == true) {
+            this->CheckIncrementScheduleFrame(cur_sche_frame_id_,
+                                              kUplinkComplete);
+          }
+        }
+      }
+      EnqueueWorkerTask(EventType::kFFT, qid, do_fft_task);
+    }
+  }
+}
+
+size_t Agora::SubcarrierOwner(size_t sc_id) const {
+  // Partition the subcarriers into ranges of the least common multiple of the
+  // demul/precode block size and the span of a ZF task. Each range holds
+  // whole demul, precode and ZF blocks, so all three are queued to the same
+  // worker even when their block sizes differ.
+  const size_t range_size =
+      std::lcm(config_->DemulBlockSize(),
+               config_->ZfBlockSize() * config_->ZfBatchSize());
+  return (sc_id / range_size) % config_->WorkerThreadNum();
+}
+
+size_t Agora::TaskDeadlineTsc(EventType event_type, size_t frame_id,
+                              size_t symbol_id) const {
+  // Slack, in symbol durations, from the end of the reception of a symbol
+  // until its uplink tasks should complete. Later stages of the pipeline get
+  // more slack, so that they do not preempt earlier stages of older symbols.
+  static constexpr double kFftSlackSymbols = 1.0;
+  static constexpr double kZfSlackSymbols = 2.0;
+  static constexpr double kDemulSlackSymbols = 2.0;
+  static constexpr double kDecodeSlackSymbols = 4.0;
+
+  const double frame_cycles =
+      config_->GetFrameDurationSec() * 1e9 * config_->FreqGhz();
+  const double symbol_cycles = frame_cycles / config_->Frame().NumTotalSyms();
+  const size_t frame_start_tsc =
+      stats_->MasterGetTsc(TsType::kFirstSymbolRX, frame_id);
+
+  double slack_symbols;
+  switch (event_type) {
+    case EventType::kFFT:
+      slack_symbols = kFftSlackSymbols;
+      break;
+    case EventType::kZF:
+      // ZF tags hold subcarriers; ZF can start once the last pilot is in
+      symbol_id = config_->Frame().GetPilotSymbol(
+          config_->Frame().NumPilotSyms() - 1);
+      slack_symbols = kZfSlackSymbols;
+      break;
+    case EventType::kDemul:
+      slack_symbols = kDemulSlackSymbols;
+      break;
+    case EventType::kDecode:
+      slack_symbols = kDecodeSlackSymbols;
+      break;
+    default:
+      // Downlink symbols of frame_id go on the air TX_FRAME_DELTA frames
+      // after the frame was received
+      return frame_start_tsc +
+             static_cast<size_t>(TX_FRAME_DELTA * frame_cycles +
+                                 symbol_id * symbol_cycles);
+  }
+  return frame_start_tsc +
+         static_cast<size_t>((symbol_id + 1 + slack_symbols) * symbol_cycles);
+}
+
 void Agora::ScheduleDownlinkProcessing(size_t frame_id) {
   size_t num_pilot_symbols = config_->Frame().ClientDlPilotSymbols();
 
   for (size_t i = 0; i < num_pilot_symbols; i++) {
-    if (zf_last_frame_ == frame_id) {
+    if (config_->DecentralizedScheduling() == true) {
+      // Pilot symbols have no encoding, so they only wait for the precoder
+      ResolvePrecodeDependency(frame_id, config_->Frame().GetDLSymbol(i));
+    } else if (IsZfDone(frame_id) == true) {
       ScheduleSubcarriers(EventType::kPrecode, frame_id,
                           config_->Frame().GetDLSymbol(i));
     } else {
-      encode_cur_frame_for_symbol_.at(i) = frame_id;
+      encode_cur_frame_for_symbol_.at(frame_id % kFrameWnd).at(i) = frame_id;
     }
   }
 
@@ -143,7 +295,7 @@ void Agora::ScheduleAntennas(EventType event_type, size_t frame_id,
   EventData event;
   event.num_tags_ = config_->FftBlockSize();
   event.event_type_ = event_type;
-  size_t qid = frame_id & 0x1;
+  size_t qid = FrameQueueId(frame_id);
   for (size_t i = 0; i < num_blocks; i++) {
     if ((i == num_blocks - 1) && num_remainder > 0) {
       event.num_tags_ = num_remainder;
@@ -152,8 +304,7 @@ void Agora::ScheduleAntennas(EventType event_type, size_t frame_id,
       event.tags_[j] = base_tag.tag_;
       base_tag.ant_id_++;
     }
-    TryEnqueueFallback(GetConq(event_type, qid), GetPtok(event_type, qid),
-                       event);
+    EnqueueWorkerTask(event_type, qid, event);
   }
 }
 
@@ -176,6 +327,9 @@ void Agora::ScheduleAntennasTX(size_t frame_id, size_t symbol_id) {
                            tx_ptoks_ptr_[i % config_->SocketThreadNum()],
                            events_list.data(), config_->NumChannels());
   }
+  if (idle_sleep_enabled_ == true) {
+    packet_tx_rx_->NotifyTx();
+  }
 }
 
 void Agora::ScheduleSubcarriers(EventType event_type, size_t frame_id,
@@ -198,7 +352,7 @@ void Agora::ScheduleSubcarriers(EventType event_type, size_t frame_id,
       assert(false);
   }
 
-  size_t qid = (frame_id & 0x1);
+  size_t qid = FrameQueueId(frame_id);
   if (event_type == EventType::kZF) {
     EventData event;
     event.event_type_ = event_type;
@@ -218,13 +372,11 @@ void Agora::ScheduleSubcarriers(EventType event_type, size_t frame_id,
                                 block_size * (i * event.num_tags_ + j))
                 .tag_;
       }
-      TryEnqueueFallback(GetConq(event_type, qid), GetPtok(event_type, qid),
-                         event);
+      EnqueueWorkerTask(event_type, qid, event);
     }
   } else {
     for (size_t i = 0; i < num_events; i++) {
-      TryEnqueueFallback(GetConq(event_type, qid), GetPtok(event_type, qid),
-                         EventData(event_type, base_tag.tag_));
+      EnqueueWorkerTask(event_type, qid, EventData(event_type, base_tag.tag_));
       base_tag.sc_id_ += block_size;
     }
   }
@@ -251,7 +403,7 @@ void Agora::ScheduleCodeblocks(EventType event_type, size_t frame_id,
   EventData event;
   event.num_tags_ = config_->EncodeBlockSize();
   event.event_type_ = event_type;
-  size_t qid = frame_id & 0x1;
+  size_t qid = FrameQueueId(frame_id);
   for (size_t i = 0; i < num_blocks; i++) {
     if ((i == num_blocks - 1) && num_remainder > 0) {
       event.num_tags_ = num_remainder;
@@ -260,8 +412,7 @@ void Agora::ScheduleCodeblocks(EventType event_type, size_t frame_id,
       event.tags_[j] = base_tag.tag_;
       base_tag.cb_id_++;
     }
-    TryEnqueueFallback(GetConq(event_type, qid), GetPtok(event_type, qid),
-                       event);
+    EnqueueWorkerTask(event_type, qid, event);
   }
 }
 
@@ -284,17 +435,30 @@ void Agora::Start() {
   if (packet_tx_rx_->StartTxRx(socket_buffer_, socket_buffer_status_,
                                socket_buffer_status_size_,
                                this->stats_->FrameStart(), dl_socket_buffer_,
-                               calib_dl_buffer_, calib_ul_buffer_) == false) {
+                               calib_dl_buffer_, calib_ul_buffer_,
+                               this->stats_->SocketIdleStat(0)) == false) {
     this->Stop();
     return;
   }
 
   PinToCoreWithOffset(ThreadType::kMaster, cfg->CoreOffset(), 0);
+  Tracer::RegisterThread("Master");
 
   // Counters for printing summary
   size_t tx_count = 0;
   double tx_begin = GetTime::GetTimeUs();
 
+  // In decentralized mode, workers count task completions and schedule the
+  // next stage themselves. They forward one event per completed symbol (or
+  // per frame for ZF) to the master.
+  const bool decentralized = cfg->DecentralizedScheduling();
+  // In drop mode, completions of dropped frames arrive after the frame's
+  // counters were reset, and are ignored
+  const bool drop_late_frames = cfg->DropLateFrames();
+  // Zero-fill the missing packets of pilot and uplink symbols that time out
+  const bool rx_symbol_timeout = (cfg->RxSymbolTimeoutUs() > 0);
+  const size_t ants_per_packet = cfg->FronthaulAntsPerPacket();
+
   bool is_turn_to_dequeue_from_io = true;
   const size_t max_events_needed =
       std::max(kDequeueBulkSizeTXRX * (cfg->SocketThreadNum() + 1 /* MAC */),
@@ -317,15 +481,32 @@ void Agora::Start() {
             events_list + num_events, kDequeueBulkSizeTXRX);
       }
     } else {
-      num_events +=
-          complete_task_queue_[(this->cur_proc_frame_id_ & 0x1)]
-              .try_dequeue_bulk(events_list + num_events, max_events_needed);
+      // Drain the completion queues of all frames in the pipeline, oldest
+      // frame first
+      for (size_t i = 0; (i < cfg->PipelineDepth()) &&
+                         (num_events < max_events_needed);
+           i++) {
+        num_events +=
+            complete_task_queue_[FrameQueueId(this->cur_proc_frame_id_ + i)]
+                .try_dequeue_bulk(events_list + num_events,
+                                  max_events_needed - num_events);
+      }
     }
     is_turn_to_dequeue_from_io = !is_turn_to_dequeue_from_io;
 
+    const size_t handle_start_tsc = GetTime::Rdtsc();
     // Handle each event
     for (size_t ev_i = 0; ev_i < num_events; ev_i++) {
       EventData& event = events_list[ev_i];
+      if ((drop_late_frames == true) && (IsDroppedFrameEvent(event) == true)) {
+        continue;
+      }
+      // Completions carry gen_tag_t tags, received packets rx_tag_t tags
+      const TraceTagType trace_tag_type =
+          (event.event_type_ == EventType::kPacketRX) ? TraceTagType::kRx
+                                                      : TraceTagType::kGen;
+      Tracer::Record(event.event_type_, event.tags_[0],
+                     TracePhase::kHandleBegin, trace_tag_type);
 
       // FFT processing is scheduled after falling through the switch
       switch (event.event_type_) {
@@ -333,21 +514,59 @@ void Agora::Start() {
           size_t socket_thread_id = rx_tag_t(event.tags_[0]).tid_;
           size_t sock_buf_offset = rx_tag_t(event.tags_[0]).offset_;
           auto* pkt = (Packet*)(socket_buffer_[socket_thread_id] +
-                                (sock_buf_offset * cfg->PacketLength()));
+                                cfg->PacketBufferOffset(sock_buf_offset));
 
-          if (pkt->frame_id_ >= ((this->cur_sche_frame_id_ + kFrameWnd))) {
-            MLPD_ERROR(
-                "Error: Received packet for future frame %u beyond "
-                "frame window (= %zu + %zu). This can happen if "
-                "Agora is running slowly, e.g., in debug mode\n",
-                pkt->frame_id_, this->cur_sche_frame_id_, kFrameWnd);
-            cfg->Running(false);
+          if ((drop_late_frames == true) &&
+              (pkt->frame_id_ < this->cur_proc_frame_id_)) {
+            // The packet's frame was dropped
+            this->stats_->MasterAddLatePacket(pkt->frame_id_);
+            ReleaseRxBuffer(socket_thread_id, sock_buf_offset);
             break;
           }
 
-          UpdateRxCounters(pkt->frame_id_, pkt->symbol_id_);
-          fft_queue_arr_[pkt->frame_id_ % kFrameWnd].push(
-              fft_req_tag_t(event.tags_[0]));
+          // Each antenna of a multi-antenna packet gets its own FFT task,
+          // and the packet's buffer is freed after the last one
+          if (ants_per_packet > 1) {
+            socket_buffer_status_[socket_thread_id][sock_buf_offset] =
+                ants_per_packet;
+          }
+
+          if (pkt->frame_id_ >= ((this->cur_sche_frame_id_ + kFrameWnd))) {
+            if (drop_late_frames == true) {
+              // Drop the oldest frames until the packet's frame fits in the
+              // frame window
+              bool work_finished = false;
+              while (pkt->frame_id_ >= this->cur_sche_frame_id_ + kFrameWnd) {
+                work_finished = DropStalestFrame() || work_finished;
+              }
+              if (work_finished == true) {
+                goto finish;
+              }
+            } else {
+              MLPD_ERROR(
+                  "Error: Received packet for future frame %u beyond "
+                  "frame window (= %zu + %zu). This can happen if "
+                  "Agora is running slowly, e.g., in debug mode\n",
+                  pkt->frame_id_, this->cur_sche_frame_id_, kFrameWnd);
+              cfg->Running(false);
+              break;
+            }
+          }
+
+          for (size_t ant_idx = 0; ant_idx < ants_per_packet; ant_idx++) {
+            if ((rx_symbol_timeout == true) &&
+                (RecordRxPacket(pkt->frame_id_, pkt->symbol_id_,
+                                pkt->ant_id_ + ant_idx) == false)) {
+              // The antenna was zero-filled after its symbol timed out
+              ReleaseRxBuffer(socket_thread_id, sock_buf_offset);
+              this->stats_->MasterAddTimedOutPacket();
+              continue;
+            }
+
+            UpdateRxCounters(pkt->frame_id_, pkt->symbol_id_);
+            fft_queue_arr_[pkt->frame_id_ % kFrameWnd].push(
+                fft_req_tag_t(socket_thread_id, sock_buf_offset, ant_idx));
+          }
         } break;
 
         case EventType::kFFT: {
@@ -361,15 +580,21 @@ void Agora::Start() {
             size_t frame_id = gen_tag_t(event.tags_[tag_id]).frame_id_;
             PrintPerTaskDone(PrintType::kZF, frame_id, 0,
                              zf_counters_.GetTaskCount(frame_id));
-            bool last_zf_task = this->zf_counters_.CompleteTask(frame_id);
+            bool last_zf_task =
+                decentralized || this->zf_counters_.CompleteTask(frame_id);
             if (last_zf_task == true) {
               this->stats_->MasterSetTsc(TsType::kZFDone, frame_id);
-              zf_last_frame_ = frame_id;
+              zf_done_frame_.at(frame_id % kFrameWnd) = frame_id;
               PrintPerFrameDone(PrintType::kZF, frame_id);
               this->zf_counters_.Reset(frame_id);
+              if (decentralized == true) {
+                // Demul and precode were scheduled by the worker
+                continue;
+              }
 
               for (size_t i = 0; i < cfg->Frame().NumULSyms(); i++) {
-                if (this->fft_cur_frame_for_symbol_.at(i) == frame_id) {
+                if (this->fft_cur_frame_for_symbol_.at(frame_id % kFrameWnd)
+                        .at(i) == frame_id) {
                   ScheduleSubcarriers(EventType::kDemul, frame_id,
                                       cfg->Frame().GetULSymbol(i));
                 }
@@ -377,9 +602,9 @@ void Agora::Start() {
               // Schedule precoding for downlink symbols
               for (size_t i = 0; i < cfg->Frame().NumDLSyms(); i++) {
                 size_t last_encoded_frame =
-                    this->encode_cur_frame_for_symbol_.at(i);
-                if ((last_encoded_frame != SIZE_MAX) &&
-                    (last_encoded_frame >= frame_id)) {
+                    this->encode_cur_frame_for_symbol_.at(frame_id % kFrameWnd)
+                        .at(i);
+                if (last_encoded_frame == frame_id) {
                   ScheduleSubcarriers(EventType::kPrecode, frame_id,
                                       cfg->Frame().GetDLSymbol(i));
                 }
@@ -395,10 +620,13 @@ void Agora::Start() {
 
           PrintPerTaskDone(PrintType::kDemul, frame_id, symbol_id, base_sc_id);
           bool last_demul_task =
+              decentralized ||
               this->demul_counters_.CompleteTask(frame_id, symbol_id);
 
           if (last_demul_task == true) {
-            ScheduleCodeblocks(EventType::kDecode, frame_id, symbol_id);
+            if (decentralized == false) {
+              ScheduleCodeblocks(EventType::kDecode, frame_id, symbol_id);
+            }
             PrintPerSymbolDone(PrintType::kDemul, frame_id, symbol_id);
             bool last_demul_symbol =
                 this->demul_counters_.CompleteSymbol(frame_id);
@@ -422,9 +650,10 @@ void Agora::Start() {
           size_t symbol_id = gen_tag_t(event.tags_[0]).symbol_id_;
 
           bool last_decode_task =
+              decentralized ||
               this->decode_counters_.CompleteTask(frame_id, symbol_id);
           if (last_decode_task == true) {
-            if (kEnableMac == true) {
+            if ((kEnableMac == true) && (decentralized == false)) {
               ScheduleUsers(EventType::kPacketToMac, frame_id, symbol_id);
             }
             PrintPerSymbolDone(PrintType::kDecode, frame_id, symbol_id);
@@ -434,7 +663,6 @@ void Agora::Start() {
               this->stats_->MasterSetTsc(TsType::kDecodeDone, frame_id);
               PrintPerFrameDone(PrintType::kDecode, frame_id);
               if (kEnableMac == false) {
-                assert(this->cur_proc_frame_id_ == frame_id);
                 bool work_finished = this->CheckFrameComplete(frame_id);
                 if (work_finished == true) {
                   goto finish;
@@ -464,7 +692,6 @@ void Agora::Start() {
             bool last_tomac_symbol =
                 this->tomac_counters_.CompleteSymbol(frame_id);
             if (last_tomac_symbol == true) {
-              assert(this->cur_proc_frame_id_ == frame_id);
               // this->stats_->MasterSetTsc(TsType::kMacTXDone, frame_id);
               PrintPerFrameDone(PrintType::kPacketToMac, frame_id);
               bool work_finished = this->CheckFrameComplete(frame_id);
@@ -487,7 +714,8 @@ void Agora::Start() {
             // Defer the schedule.  If frames are already deferred or the
             // current received frame is too far off
             if ((this->encode_deferral_.empty() == false) ||
-                (frame_id >= (this->cur_proc_frame_id_ + kScheduleQueues))) {
+                (frame_id >=
+                 (this->cur_proc_frame_id_ + cfg->PipelineDepth()))) {
               if (kDebugDeferral) {
                 std::printf("   +++ Deferring encoding of frame %zu\n",
                             frame_id);
@@ -508,12 +736,13 @@ void Agora::Start() {
             size_t symbol_id = gen_tag_t(event.tags_[i]).symbol_id_;
 
             bool last_encode_task =
+                decentralized ||
                 encode_counters_.CompleteTask(frame_id, symbol_id);
             if (last_encode_task == true) {
-              this->encode_cur_frame_for_symbol_.at(
-                  cfg->Frame().GetDLSymbolIdx(symbol_id)) = frame_id;
+              this->encode_cur_frame_for_symbol_.at(frame_id % kFrameWnd)
+                  .at(cfg->Frame().GetDLSymbolIdx(symbol_id)) = frame_id;
               // If precoder of the current frame exists
-              if (zf_last_frame_ == frame_id) {
+              if ((decentralized == false) && (IsZfDone(frame_id) == true)) {
                 ScheduleSubcarriers(EventType::kPrecode, frame_id, symbol_id);
               }
               PrintPerSymbolDone(PrintType::kEncode, frame_id, symbol_id);
@@ -536,13 +765,18 @@ void Agora::Start() {
           size_t symbol_id = gen_tag_t(event.tags_[0]).symbol_id_;
           PrintPerTaskDone(PrintType::kPrecode, frame_id, symbol_id, sc_id);
           bool last_precode_task =
+              decentralized ||
               this->precode_counters_.CompleteTask(frame_id, symbol_id);
 
           if (last_precode_task == true) {
             // precode_cur_frame_for_symbol_.at(
             //    this->config_->Frame().GetDLSymbolIdx(symbol_id)) = frame_id;
-            ScheduleAntennas(EventType::kIFFT, frame_id, symbol_id);
+            if (decentralized == false) {
+              ScheduleAntennas(EventType::kIFFT, frame_id, symbol_id);
+            }
             PrintPerSymbolDone(PrintType::kPrecode, frame_id, symbol_id);
+            this->stats_->MasterSetDlSymbolPrecoded(
+                frame_id, cfg->Frame().GetDLSymbolIdx(symbol_id));
 
             bool last_precode_symbol =
                 this->precode_counters_.CompleteSymbol(frame_id);
@@ -564,21 +798,24 @@ void Agora::Start() {
             PrintPerTaskDone(PrintType::kIFFT, frame_id, symbol_id, ant_id);
 
             bool last_ifft_task =
+                decentralized ||
                 this->ifft_counters_.CompleteTask(frame_id, symbol_id);
             if (last_ifft_task == true) {
-              ifft_cur_frame_for_symbol_.at(symbol_idx_dl) = frame_id;
-              if (symbol_idx_dl == ifft_next_symbol_) {
+              const size_t frame_slot = frame_id % kFrameWnd;
+              ifft_cur_frame_for_symbol_.at(frame_slot).at(symbol_idx_dl) =
+                  frame_id;
+              if (symbol_idx_dl == ifft_next_symbol_.at(frame_slot)) {
                 // Check the available symbols starting from the current symbol
                 // Only schedule symbols that are continuously avaialbe
                 for (size_t sym_id = symbol_idx_dl;
                      sym_id <= ifft_counters_.GetSymbolCount(frame_id);
                      sym_id++) {
                   size_t symbol_ifft_frame =
-                      ifft_cur_frame_for_symbol_.at(sym_id);
+                      ifft_cur_frame_for_symbol_.at(frame_slot).at(sym_id);
                   if (symbol_ifft_frame == frame_id) {
                     ScheduleAntennasTX(frame_id,
                                        cfg->Frame().GetDLSymbol(sym_id));
-                    ifft_next_symbol_++;
+                    ifft_next_symbol_.at(frame_slot)++;
                   } else {
                     break;
                   }
@@ -589,10 +826,9 @@ void Agora::Start() {
               bool last_ifft_symbol =
                   this->ifft_counters_.CompleteSymbol(frame_id);
               if (last_ifft_symbol == true) {
-                ifft_next_symbol_ = 0;
+                ifft_next_symbol_.at(frame_slot) = 0;
                 this->stats_->MasterSetTsc(TsType::kIFFTDone, frame_id);
                 PrintPerFrameDone(PrintType::kIFFT, frame_id);
-                assert(frame_id == this->cur_proc_frame_id_);
                 this->CheckIncrementScheduleFrame(frame_id, kDownlinkComplete);
                 bool work_finished = this->CheckFrameComplete(frame_id);
                 if (work_finished == true) {
@@ -614,6 +850,8 @@ void Agora::Start() {
               this->tx_counters_.CompleteTask(frame_id, symbol_id);
           if (last_tx_task == true) {
             PrintPerSymbolDone(PrintType::kPacketTX, frame_id, symbol_id);
+            this->stats_->MasterAddDlSymbolTx(
+                frame_id, cfg->Frame().GetDLSymbolIdx(symbol_id));
             // If tx of the first symbol is done
             if (symbol_id == cfg->Frame().GetDLSymbol(0)) {
               this->stats_->MasterSetTsc(TsType::kTXProcessedFirst, frame_id);
@@ -660,43 +898,41 @@ void Agora::Start() {
       // We schedule FFT processing if the event handling above results in
       // either (a) sufficient packets received for the current frame,
       // or (b) the current frame being updated.
-      std::queue<fft_req_tag_t>& cur_fftq =
-          fft_queue_arr_[(this->cur_sche_frame_id_ % kFrameWnd)];
-      size_t qid = this->cur_sche_frame_id_ & 0x1;
-      if (cur_fftq.size() >= config_->FftBlockSize()) {
-        size_t num_fft_blocks = cur_fftq.size() / config_->FftBlockSize();
-        for (size_t i = 0; i < num_fft_blocks; i++) {
-          EventData do_fft_task;
-          do_fft_task.num_tags_ = config_->FftBlockSize();
-          do_fft_task.event_type_ = EventType::kFFT;
-
-          for (size_t j = 0; j < config_->FftBlockSize(); j++) {
-            do_fft_task.tags_[j] = cur_fftq.front().tag_;
-            cur_fftq.pop();
-
-            if (this->fft_created_count_ == 0) {
-              this->stats_->MasterSetTsc(TsType::kProcessingStarted,
-                                         this->cur_sche_frame_id_);
-            }
-            this->fft_created_count_++;
-            if (this->fft_created_count_ == rx_counters_.num_pkts_per_frame_) {
-              this->fft_created_count_ = 0;
-              if (cfg->BigstationMode() == true) {
-                this->CheckIncrementScheduleFrame(cur_sche_frame_id_,
-                                                  kUplinkComplete);
-              }
-            }
-          }
-          TryEnqueueFallback(GetConq(EventType::kFFT, qid),
-                             GetPtok(EventType::kFFT, qid), do_fft_task);
-        }
-      }
+      ScheduleFftTasks();
+      Tracer::Record(event.event_type_, event.tags_[0], TracePhase::kHandleEnd,
+                     trace_tag_type);
     } /* End of for */
-  }   /* End of while */
+    if ((rx_symbol_timeout == true) &&
+        (GetTime::Rdtsc() >= this->next_rx_timeout_scan_tsc_)) {
+      FillTimedOutSymbols();
+      ScheduleFftTasks();
+    }
+    if (num_events > 0) {
+      this->stats_->MasterAddLoopCycles(GetTime::Rdtsc() - handle_start_tsc);
+    }
+  } /* End of while */
 
 finish:
   MLPD_INFO("Agora: printing stats and saving to file\n");
   this->stats_->PrintSummary();
+  if (work_stealing_queues_ != nullptr) {
+    std::printf("Agora: worker threads stole %zu tasks from peers\n",
+                work_stealing_queues_->NumSteals());
+  }
+  if (cfg->DropLateFrames() == true) {
+    std::printf("Agora: TXRX threads discarded %zu packets on full RX rings\n",
+                packet_tx_rx_->NumRxRingDrops());
+  }
+  if (cfg->Transport() == "shm") {
+    std::printf(
+        "Agora: TXRX threads discarded %zu packets on full downlink rings\n",
+        packet_tx_rx_->NumTxRingDrops());
+  }
+  if (cfg->Transport() == "replay") {
+    std::printf("Agora: replayed %zu frames at %.1f frames/s\n",
+                packet_tx_rx_->NumReplayedFrames(),
+                packet_tx_rx_->ReplayFramesPerSec());
+  }
   this->stats_->SaveToFile();
   if (flags_.enable_save_decode_data_to_file_ == true) {
     SaveDecodeDataToFile(this->stats_->LastFrameId());
@@ -708,6 +944,13 @@ finish:
   // Calculate and print per-user BER
   if ((kEnableMac == false) && (kPrintPhyStats == true)) {
     this->phy_stats_->PrintPhyStats();
+    if (kIsWorkerTimingEnabled == true) {
+      const size_t zf_cycles = this->stats_->GetTotalTaskCycles(
+          DoerType::kZF, cfg->WorkerThreadNum());
+      this->phy_stats_->PrintZfTradeoff(
+          GetTime::CyclesToUs(zf_cycles, cfg->FreqGhz()) /
+          (this->stats_->LastFrameId() + 1));
+    }
   }
   this->Stop();
 }
@@ -716,9 +959,13 @@ void Agora::HandleEventFft(size_t tag) {
   size_t frame_id = gen_tag_t(tag).frame_id_;
   size_t symbol_id = gen_tag_t(tag).symbol_id_;
   SymbolType sym_type = config_->GetSymbolType(symbol_id);
+  // In decentralized mode, the workers forward one event per completed
+  // symbol, and have already scheduled the next stage
+  const bool decentralized = config_->DecentralizedScheduling();
 
   if (sym_type == SymbolType::kPilot) {
-    bool last_fft_task = pilot_fft_counters_.CompleteTask(frame_id, symbol_id);
+    bool last_fft_task =
+        decentralized || pilot_fft_counters_.CompleteTask(frame_id, symbol_id);
     if (last_fft_task == true) {
       PrintPerSymbolDone(PrintType::kFFTPilots, frame_id, symbol_id);
 
@@ -737,7 +984,9 @@ void Agora::HandleEventFft(size_t tag) {
           if (kEnableMac == true) {
             SendSnrReport(EventType::kSNRReport, frame_id, symbol_id);
           }
-          ScheduleSubcarriers(EventType::kZF, frame_id, 0);
+          if (decentralized == false) {
+            ScheduleSubcarriers(EventType::kZF, frame_id, 0);
+          }
         }
       }
     }
@@ -745,14 +994,15 @@ void Agora::HandleEventFft(size_t tag) {
     size_t symbol_idx_ul = config_->Frame().GetULSymbolIdx(symbol_id);
 
     bool last_fft_per_symbol =
-        uplink_fft_counters_.CompleteTask(frame_id, symbol_id);
+        decentralized || uplink_fft_counters_.CompleteTask(frame_id, symbol_id);
 
     if (last_fft_per_symbol == true) {
-      fft_cur_frame_for_symbol_.at(symbol_idx_ul) = frame_id;
+      fft_cur_frame_for_symbol_.at(frame_id % kFrameWnd).at(symbol_idx_ul) =
+          frame_id;
 
       PrintPerSymbolDone(PrintType::kFFTData, frame_id, symbol_id);
       // If precoder exist, schedule demodulation
-      if (zf_last_frame_ == frame_id) {
+      if ((decentralized == false) && (IsZfDone(frame_id) == true)) {
         ScheduleSubcarriers(EventType::kDemul, frame_id, symbol_id);
       }
       bool last_uplink_fft = uplink_fft_counters_.CompleteSymbol(frame_id);
@@ -774,14 +1024,142 @@ void Agora::HandleEventFft(size_t tag) {
   }
 }
 
+void Agora::WorkerHandleCompletion(int tid, const EventData& event) {
+  const auto& cfg = config_;
+
+  switch (event.event_type_) {
+    case EventType::kFFT: {
+      for (size_t i = 0; i < event.num_tags_; i++) {
+        size_t frame_id = gen_tag_t(event.tags_[i]).frame_id_;
+        size_t symbol_id = gen_tag_t(event.tags_[i]).symbol_id_;
+        SymbolType sym_type = cfg->GetSymbolType(symbol_id);
+
+        if (sym_type == SymbolType::kPilot) {
+          if (shared_pilot_fft_counters_.CompleteTask(frame_id, symbol_id) ==
+              true) {
+            if (shared_pilot_fft_counters_.CompleteSymbol(frame_id) == true) {
+              ScheduleSubcarriers(EventType::kZF, frame_id, 0);
+            }
+            // The master keeps the timestamps, prints and SNR reports
+            ForwardToMaster(tid, EventType::kFFT, frame_id, symbol_id);
+          }
+        } else if (sym_type == SymbolType::kUL) {
+          if (shared_uplink_fft_counters_.CompleteTask(frame_id, symbol_id) ==
+              true) {
+            ResolveDemulDependency(frame_id, symbol_id);
+            ForwardToMaster(tid, EventType::kFFT, frame_id, symbol_id);
+          }
+        }
+      }
+    } break;
+
+    case EventType::kZF: {
+      for (size_t i = 0; i < event.num_tags_; i++) {
+        size_t frame_id = gen_tag_t(event.tags_[i]).frame_id_;
+        if (shared_zf_counters_.CompleteTask(frame_id) == true) {
+          for (size_t j = 0; j < cfg->Frame().NumULSyms(); j++) {
+            ResolveDemulDependency(frame_id, cfg->Frame().GetULSymbol(j));
+          }
+          for (size_t j = 0; j < cfg->Frame().NumDLSyms(); j++) {
+            ResolvePrecodeDependency(frame_id, cfg->Frame().GetDLSymbol(j));
+          }
+          ForwardToMaster(tid, EventType::kZF, frame_id, 0);
+        }
+      }
+    } break;
+
+    case EventType::kDemul: {
+      size_t frame_id = gen_tag_t(event.tags_[0]).frame_id_;
+      size_t symbol_id = gen_tag_t(event.tags_[0]).symbol_id_;
+      if (shared_demul_counters_.CompleteTask(frame_id, symbol_id) == true) {
+        ScheduleCodeblocks(EventType::kDecode, frame_id, symbol_id);
+        ForwardToMaster(tid, EventType::kDemul, frame_id, symbol_id);
+      }
+    } break;
+
+    case EventType::kDecode: {
+      for (size_t i = 0; i < event.num_tags_; i++) {
+        size_t frame_id = gen_tag_t(event.tags_[i]).frame_id_;
+        size_t symbol_id = gen_tag_t(event.tags_[i]).symbol_id_;
+        if (shared_decode_counters_.CompleteTask(frame_id, symbol_id) ==
+            true) {
+          if (kEnableMac == true) {
+            ScheduleUsers(EventType::kPacketToMac, frame_id, symbol_id);
+          }
+          ForwardToMaster(tid, EventType::kDecode, frame_id, symbol_id);
+        }
+      }
+    } break;
+
+    case EventType::kEncode: {
+      for (size_t i = 0; i < event.num_tags_; i++) {
+        size_t frame_id = gen_tag_t(event.tags_[i]).frame_id_;
+        size_t symbol_id = gen_tag_t(event.tags_[i]).symbol_id_;
+        if (shared_encode_counters_.CompleteTask(frame_id, symbol_id) ==
+            true) {
+          ResolvePrecodeDependency(frame_id, symbol_id);
+          ForwardToMaster(tid, EventType::kEncode, frame_id, symbol_id);
+        }
+      }
+    } break;
+
+    case EventType::kPrecode: {
+      size_t frame_id = gen_tag_t(event.tags_[0]).frame_id_;
+      size_t symbol_id = gen_tag_t(event.tags_[0]).symbol_id_;
+      if (shared_precode_counters_.CompleteTask(frame_id, symbol_id) == true) {
+        ScheduleAntennas(EventType::kIFFT, frame_id, symbol_id);
+        ForwardToMaster(tid, EventType::kPrecode, frame_id, symbol_id);
+      }
+    } break;
+
+    case EventType::kIFFT: {
+      // TX ordering across symbols is kept at the master
+      for (size_t i = 0; i < event.num_tags_; i++) {
+        size_t frame_id = gen_tag_t(event.tags_[i]).frame_id_;
+        size_t symbol_id = gen_tag_t(event.tags_[i]).symbol_id_;
+        if (shared_ifft_counters_.CompleteTask(frame_id, symbol_id) == true) {
+          ForwardToMaster(tid, EventType::kIFFT, frame_id, symbol_id);
+        }
+      }
+    } break;
+
+    default:
+      MLPD_ERROR("Wrong event type in worker completion!");
+      std::exit(0);
+  }
+}
+
+void Agora::ResolveDemulDependency(size_t frame_id, size_t symbol_id) {
+  // Demodulation of an uplink symbol waits for its FFT and the precoder
+  if (demul_dependencies_.CompleteTask(frame_id, symbol_id) == true) {
+    ScheduleSubcarriers(EventType::kDemul, frame_id, symbol_id);
+  }
+}
+
+void Agora::ResolvePrecodeDependency(size_t frame_id, size_t symbol_id) {
+  // Precoding of a downlink symbol waits for its encoding and the precoder
+  if (precode_dependencies_.CompleteTask(frame_id, symbol_id) == true) {
+    ScheduleSubcarriers(EventType::kPrecode, frame_id, symbol_id);
+  }
+}
+
+void Agora::ForwardToMaster(int tid, EventType event_type, size_t frame_id,
+                            size_t symbol_id) {
+  const size_t qid = FrameQueueId(frame_id);
+  TryEnqueueFallback(
+      &complete_task_queue_[qid], worker_ptoks_ptr_[tid][qid],
+      EventData(event_type, gen_tag_t::FrmSym(frame_id, symbol_id).tag_));
+}
+
 void Agora::Worker(int tid) {
   PinToCoreWithOffset(ThreadType::kWorker, base_worker_core_offset_, tid);
+  Tracer::RegisterThread("Worker " + std::to_string(tid));
 
   /* Initialize operators */
   auto compute_zf = std::make_unique<DoZF>(
       this->config_, tid, this->csi_buffers_, this->calib_dl_buffer_,
       this->calib_ul_buffer_, this->ul_zf_matrices_, this->dl_zf_matrices_,
-      this->stats_.get());
+      this->phy_stats_.get(), this->stats_.get());
 
   auto compute_fft = std::make_unique<DoFFT>(
       this->config_, tid, this->socket_buffer_, this->socket_buffer_status_,
@@ -836,31 +1214,106 @@ void Agora::Worker(int tid) {
     events_vec.push_back(EventType::kEncode);
   }
 
+  const bool decentralized = config_->DecentralizedScheduling();
+  IdlePolicy idle(config_->IdleSpinIters(), config_->IdlePauseIters(),
+                  config_->IdleSleepUs(), &worker_waker_,
+                  stats_->WorkerIdleStat(tid));
+  if ((work_stealing_queues_ != nullptr) || (deadline_queue_ != nullptr)) {
+    std::array<Doer*, kNumEventTypes> computers{};
+    for (size_t i = 0; i < computers_vec.size(); i++) {
+      computers.at(static_cast<size_t>(events_vec.at(i))) =
+          computers_vec.at(i);
+    }
+
+    EventData req_event;
+    EventData resp_event;
+    while (this->config_->Running() == true) {
+      size_t deadline_tsc = SIZE_MAX;
+      const bool dequeued =
+          (deadline_queue_ != nullptr)
+              ? deadline_queue_->TryPop(tid, req_event, deadline_tsc)
+              : work_stealing_queues_->TryPop(tid, req_event);
+      if (dequeued == false) {
+        idle.OnIdle();
+        continue;
+      }
+      idle.OnWork();
+      computers.at(static_cast<size_t>(req_event.event_type_))
+          ->RunEvent(req_event, resp_event);
+      if (GetTime::Rdtsc() > deadline_tsc) {
+        stats_->WorkerAddDeadlineMiss(
+            gen_tag_t(resp_event.tags_[0]).frame_id_);
+      }
+      if (decentralized == true) {
+        WorkerHandleCompletion(tid, resp_event);
+      } else {
+        // The master only drains the completion queue of the frame it is
+        // processing, so route by frame rather than by the dequeue set
+        const size_t qid =
+            FrameQueueId(gen_tag_t(resp_event.tags_[0]).frame_id_);
+        TryEnqueueFallback(&complete_task_queue_[qid],
+                           worker_ptoks_ptr_[tid][qid], resp_event);
+      }
+    }
+    MLPD_SYMBOL("Agora worker %d exit\n", tid);
+    return;
+  }
+
   size_t cur_qid = 0;
   size_t empty_queue_itrs = 0;
   bool empty_queue = true;
   while (this->config_->Running() == true) {
+    WorkerRole role = WorkerRole::kUplink;
+    if (worker_pool_ != nullptr) {
+      role = worker_pool_->Role(tid);
+      if (role == WorkerRole::kParked) {
+        worker_pool_->WaitWhileParked(tid);
+        continue;
+      }
+    }
     for (size_t i = 0; i < computers_vec.size(); i++) {
-      if (computers_vec.at(i)->TryLaunch(*GetConq(events_vec.at(i), cur_qid),
-                                         complete_task_queue_[cur_qid],
-                                         worker_ptoks_ptr_[tid][cur_qid])) {
+      if ((worker_pool_ != nullptr) &&
+          (WorkerPool::Serves(role, events_vec.at(i)) == false)) {
+        continue;
+      }
+      const size_t start_tsc = (worker_pool_ != nullptr) ? GetTime::Rdtsc() : 0;
+      bool launched;
+      if (decentralized == true) {
+        EventData resp_event;
+        launched = computers_vec.at(i)->TryLaunch(
+            *GetConq(events_vec.at(i), cur_qid), resp_event);
+        if (launched == true) {
+          WorkerHandleCompletion(tid, resp_event);
+        }
+      } else {
+        launched = computers_vec.at(i)->TryLaunch(
+            *GetConq(events_vec.at(i), cur_qid), complete_task_queue_[cur_qid],
+            worker_ptoks_ptr_[tid][cur_qid]);
+      }
+      if (launched == true) {
+        if (worker_pool_ != nullptr) {
+          worker_pool_->AddBusyCycles(tid, events_vec.at(i),
+                                      GetTime::Rdtsc() - start_tsc);
+        }
         empty_queue = false;
         break;
       }
     }
     // If all queues in this set are empty for 5 iterations,
-    // check the other set of queues
+    // check the next set of queues
     if (empty_queue == true) {
+      idle.OnIdle();
       empty_queue_itrs++;
       if (empty_queue_itrs == 5) {
         if (this->cur_sche_frame_id_ != this->cur_proc_frame_id_) {
-          cur_qid ^= 0x1;
+          cur_qid = (cur_qid + 1) % config_->PipelineDepth();
         } else {
-          cur_qid = (this->cur_sche_frame_id_ & 0x1);
+          cur_qid = FrameQueueId(this->cur_sche_frame_id_);
         }
         empty_queue_itrs = 0;
       }
     } else {
+      idle.OnWork();
       empty_queue = true;
     }
   }
@@ -869,6 +1322,7 @@ void Agora::Worker(int tid) {
 
 void Agora::WorkerFft(int tid) {
   PinToCoreWithOffset(ThreadType::kWorkerFFT, base_worker_core_offset_, tid);
+  Tracer::RegisterThread("Worker " + std::to_string(tid));
 
   /* Initialize IFFT operator */
   std::unique_ptr<DoFFT> compute_fft(
@@ -895,11 +1349,13 @@ void Agora::WorkerFft(int tid) {
 
 void Agora::WorkerZf(int tid) {
   PinToCoreWithOffset(ThreadType::kWorkerZF, base_worker_core_offset_, tid);
+  Tracer::RegisterThread("Worker " + std::to_string(tid));
 
   /* Initialize ZF operator */
   std::unique_ptr<DoZF> compute_zf(
       new DoZF(config_, tid, csi_buffers_, calib_dl_buffer_, calib_ul_buffer_,
-               ul_zf_matrices_, dl_zf_matrices_, this->stats_.get()));
+               ul_zf_matrices_, dl_zf_matrices_, this->phy_stats_.get(),
+               this->stats_.get()));
 
   while (this->config_->Running() == true) {
     compute_zf->TryLaunch(*GetConq(EventType::kZF, 0), complete_task_queue_[0],
@@ -909,6 +1365,7 @@ void Agora::WorkerZf(int tid) {
 
 void Agora::WorkerDemul(int tid) {
   PinToCoreWithOffset(ThreadType::kWorkerDemul, base_worker_core_offset_, tid);
+  Tracer::RegisterThread("Worker " + std::to_string(tid));
 
   std::unique_ptr<DoDemul> compute_demul(
       new DoDemul(config_, tid, data_buffer_, ul_zf_matrices_,
@@ -937,6 +1394,7 @@ void Agora::WorkerDemul(int tid) {
 
 void Agora::WorkerDecode(int tid) {
   PinToCoreWithOffset(ThreadType::kWorkerDecode, base_worker_core_offset_, tid);
+  Tracer::RegisterThread("Worker " + std::to_string(tid));
 
   std::unique_ptr<DoEncode> compute_encoding(new DoEncode(
       config_, tid, (kEnableMac == true) ? dl_bits_buffer_ : config_->DlBits(),
@@ -1017,7 +1475,7 @@ void Agora::UpdateRxCounters(size_t frame_id, size_t symbol_id) {
       // Defer the schedule.  If frames are already deferred or the current
       // received frame is too far off
       if ((this->encode_deferral_.empty() == false) ||
-          (frame_id >= (this->cur_proc_frame_id_ + kScheduleQueues))) {
+          (frame_id >= (this->cur_proc_frame_id_ + config_->PipelineDepth()))) {
         if (kDebugDeferral) {
           std::printf("   +++ Deferring encoding of frame %zu\n", frame_id);
         }
@@ -1163,7 +1621,7 @@ void Agora::PrintPerSymbolDone(PrintType print_type, size_t frame_id,
             frame_id, symbol_id,
             this->stats_->MasterGetMsSince(TsType::kFirstSymbolRX, frame_id),
             uplink_fft_counters_.GetSymbolCount(frame_id) + 1,
-            static_cast<int>(zf_last_frame_ == frame_id));
+            static_cast<int>(IsZfDone(frame_id)));
         break;
       case (PrintType::kDemul):
         std::printf(
@@ -1287,10 +1745,14 @@ void Agora::InitializeQueues() {
   int data_symbol_num_perframe = config_->Frame().NumDataSyms();
   message_queue_ =
       mt_queue_t(kDefaultMessageQueueSize * data_symbol_num_perframe);
+  complete_task_queue_ =
+      std::vector<mt_queue_t>(config_->PipelineDepth());
   for (auto& c : complete_task_queue_) {
     c = mt_queue_t(kDefaultWorkerQueueSize * data_symbol_num_perframe);
   }
   // Create concurrent queues for each Doer
+  sched_info_arr_ = std::vector<std::array<SchedInfoT, kNumEventTypes>>(
+      config_->PipelineDepth());
   for (auto& vec : sched_info_arr_) {
     for (auto& s : vec) {
       s.concurrent_q_ =
@@ -1306,11 +1768,22 @@ void Agora::InitializeQueues() {
   }
 
   for (size_t i = 0; i < config_->WorkerThreadNum(); i++) {
-    for (size_t j = 0; j < kScheduleQueues; j++) {
+    for (size_t j = 0; j < config_->PipelineDepth(); j++) {
       worker_ptoks_ptr_[i][j] =
           new moodycamel::ProducerToken(complete_task_queue_[j]);
     }
   }
+
+  if (config_->WorkerScheduler() == "work_stealing") {
+    work_stealing_queues_ = std::make_unique<WorkStealingQueues<EventData>>(
+        config_->WorkerThreadNum());
+  } else if (config_->WorkerScheduler() == "edf") {
+    deadline_queue_ = std::make_unique<DeadlineQueue<EventData>>(
+        config_->WorkerThreadNum());
+  }
+  if (config_->ElasticWorkerPool() == true) {
+    worker_pool_ = std::make_unique<WorkerPool>(config_);
+  }
 }
 
 void Agora::FreeQueues() {
@@ -1327,7 +1800,7 @@ void Agora::FreeQueues() {
   }
 
   for (size_t i = 0; i < config_->WorkerThreadNum(); i++) {
-    for (size_t j = 0; j < kScheduleQueues; j++) {
+    for (size_t j = 0; j < config_->PipelineDepth(); j++) {
       delete worker_ptoks_ptr_[i][j];
     }
   }
@@ -1339,13 +1812,27 @@ void Agora::InitializeUplinkBuffers() {
 
   socket_buffer_status_size_ =
       cfg->BsAntNum() * kFrameWnd * cfg->Frame().NumTotalSyms();
-  socket_buffer_size_ = cfg->PacketLength() * socket_buffer_status_size_;
+  socket_buffer_size_ =
+      cfg->PacketBufferStride() * socket_buffer_status_size_;
+  // With af_xdp, the rows of the RX threads are the UMEMs of their sockets,
+  // which also hold the sockets' TX frames after the RX slots
+  if (cfg->Transport() == "af_xdp") {
+    socket_buffer_size_ += kXdpNumTxFrames * kXdpFrameSize;
+  }
 
-  socket_buffer_.Malloc(cfg->SocketThreadNum() /* RX */, socket_buffer_size_,
-                        Agora_memory::Alignment_t::kAlign64);
-  socket_buffer_status_.Calloc(cfg->SocketThreadNum() /* RX */,
+  // The row after the RX threads' rows holds the zeroed packets that replace
+  // the missing packets of timed-out symbols
+  socket_buffer_.Malloc(cfg->SocketThreadNum() + 1 /* RX + filler */,
+                        socket_buffer_size_,
+                        (cfg->Transport() == "af_xdp")
+                            ? Agora_memory::Alignment_t::kAlign4096
+                            : Agora_memory::Alignment_t::kAlign64);
+  socket_buffer_status_.Calloc(cfg->SocketThreadNum() + 1 /* RX + filler */,
                                socket_buffer_status_size_,
                                Agora_memory::Alignment_t::kAlign64);
+  std::memset(socket_buffer_[cfg->SocketThreadNum()], 0, socket_buffer_size_);
+  rx_timeout_cycles_ = static_cast<size_t>(cfg->RxSymbolTimeoutUs() * 1000 *
+                                           cfg->FreqGhz());
 
   data_buffer_.Malloc(task_buffer_symbol_num_ul,
                       cfg->OfdmDataNum() * cfg->BsAntNum(),
@@ -1358,21 +1845,27 @@ void Agora::InitializeUplinkBuffers() {
       kFrameWnd, cfg->Frame().ClientUlPilotSymbols() * cfg->UeNum(),
       Agora_memory::Alignment_t::kAlign64);
 
+  // The RX counters count FFT task requests: one per antenna of a
+  // multi-antenna packet, or one per fragment of a fragmented symbol
+  const size_t ffts_per_symbol =
+      cfg->BsAntNum() * cfg->FronthaulFragsPerSymbol();
   rx_counters_.num_pkts_per_frame_ =
-      cfg->BsAntNum() *
+      ffts_per_symbol *
       (cfg->Frame().NumPilotSyms() + cfg->Frame().NumULSyms() +
        static_cast<size_t>(cfg->Frame().IsRecCalEnabled()));
   rx_counters_.num_pilot_pkts_per_frame_ =
-      cfg->BsAntNum() * cfg->Frame().NumPilotSyms();
-  rx_counters_.num_reciprocity_pkts_per_frame_ = cfg->BsAntNum();
+      ffts_per_symbol * cfg->Frame().NumPilotSyms();
+  rx_counters_.num_reciprocity_pkts_per_frame_ = ffts_per_symbol;
 
   fft_created_count_ = 0;
-  pilot_fft_counters_.Init(cfg->Frame().NumPilotSyms(), cfg->BsAntNum());
-  uplink_fft_counters_.Init(cfg->Frame().NumULSyms(), cfg->BsAntNum());
-  fft_cur_frame_for_symbol_ =
-      std::vector<size_t>(cfg->Frame().NumULSyms(), SIZE_MAX);
+  pilot_fft_counters_.Init(cfg->Frame().NumPilotSyms(), ffts_per_symbol);
+  uplink_fft_counters_.Init(cfg->Frame().NumULSyms(), ffts_per_symbol);
+  zf_done_frame_.fill(SIZE_MAX);
+  for (auto& fft_cur_frame : fft_cur_frame_for_symbol_) {
+    fft_cur_frame = std::vector<size_t>(cfg->Frame().NumULSyms(), SIZE_MAX);
+  }
 
-  rc_counters_.Init(cfg->BsAntNum());
+  rc_counters_.Init(ffts_per_symbol);
 
   zf_counters_.Init(cfg->ZfEventsPerSymbol());
 
@@ -1382,6 +1875,21 @@ void Agora::InitializeUplinkBuffers() {
                         cfg->LdpcConfig().NumBlocksInSymbol() * cfg->UeNum());
 
   tomac_counters_.Init(cfg->Frame().NumULSyms(), cfg->UeNum());
+
+  if (cfg->DecentralizedScheduling() == true) {
+    shared_pilot_fft_counters_.Init(cfg->Frame().NumPilotSyms(),
+                                    ffts_per_symbol);
+    shared_uplink_fft_counters_.Init(cfg->Frame().NumULSyms(),
+                                     ffts_per_symbol);
+    shared_zf_counters_.Init(cfg->ZfEventsPerSymbol());
+    shared_demul_counters_.Init(cfg->Frame().NumULSyms(),
+                                cfg->DemulEventsPerSymbol());
+    shared_decode_counters_.Init(
+        cfg->Frame().NumULSyms(),
+        cfg->LdpcConfig().NumBlocksInSymbol() * cfg->UeNum());
+    // Two dependencies per uplink symbol: its FFT and the precoder
+    demul_dependencies_.Init(cfg->Frame().NumULSyms(), 2);
+  }
 }
 
 void Agora::InitializeDownlinkBuffers() {
@@ -1399,6 +1907,22 @@ void Agora::InitializeDownlinkBuffers() {
                   Agora_memory::Alignment_t::kAlign64, 0);
     AllocBuffer1d(&dl_socket_buffer_status_, dl_socket_buffer_status_size,
                   Agora_memory::Alignment_t::kAlign64, 1);
+    // Each (frame slot, symbol, antenna) has its own packet. Write their
+    // headers once, so that DoIFFT only sets the frame ID and the TXRX
+    // threads send the packets as they are.
+    for (size_t frame_slot = 0; frame_slot < kFrameWnd; frame_slot++) {
+      for (size_t i = 0; i < config_->Frame().NumDLSyms(); i++) {
+        for (size_t ant_id = 0; ant_id < config_->BsAntNum(); ant_id++) {
+          const size_t offset =
+              (config_->GetTotalDataSymbolIdxDl(frame_slot, i) *
+               config_->BsAntNum()) +
+              ant_id;
+          new (&dl_socket_buffer_[offset * config_->DlPacketLength()])
+              Packet(frame_slot, config_->Frame().GetDLSymbol(i),
+                     0 /* cell_id */, ant_id);
+        }
+      }
+    }
 
     size_t dl_bits_buffer_size = kFrameWnd * config_->DlMacBytesNumPerframe();
     this->dl_bits_buffer_.Calloc(config_->UeNum(), dl_bits_buffer_size,
@@ -1428,10 +1952,14 @@ void Agora::InitializeDownlinkBuffers() {
     encode_counters_.Init(
         config_->Frame().NumDlDataSyms(),
         config_->LdpcConfig().NumBlocksInSymbol() * config_->UeNum());
-    encode_cur_frame_for_symbol_ =
-        std::vector<size_t>(config_->Frame().NumDLSyms(), SIZE_MAX);
-    ifft_cur_frame_for_symbol_ =
-        std::vector<size_t>(config_->Frame().NumDLSyms(), SIZE_MAX);
+    for (auto& encode_cur_frame : encode_cur_frame_for_symbol_) {
+      encode_cur_frame =
+          std::vector<size_t>(config_->Frame().NumDLSyms(), SIZE_MAX);
+    }
+    for (auto& ifft_cur_frame : ifft_cur_frame_for_symbol_) {
+      ifft_cur_frame =
+          std::vector<size_t>(config_->Frame().NumDLSyms(), SIZE_MAX);
+    }
     precode_counters_.Init(config_->Frame().NumDLSyms(),
                            config_->DemulEventsPerSymbol());
     // precode_cur_frame_for_symbol_ =
@@ -1440,6 +1968,19 @@ void Agora::InitializeDownlinkBuffers() {
     tx_counters_.Init(config_->Frame().NumDLSyms(), config_->BsAntNum());
     // mac data is sent per frame, so we set max symbol to 1
     mac_to_phy_counters_.Init(1, config_->UeNum());
+
+    if (config_->DecentralizedScheduling() == true) {
+      shared_encode_counters_.Init(
+          config_->Frame().NumDlDataSyms(),
+          config_->LdpcConfig().NumBlocksInSymbol() * config_->UeNum());
+      shared_precode_counters_.Init(config_->Frame().NumDLSyms(),
+                                    config_->DemulEventsPerSymbol());
+      shared_ifft_counters_.Init(config_->Frame().NumDLSyms(),
+                                 config_->BsAntNum());
+      // Two dependencies per downlink symbol: its encoding (or the start of
+      // the frame for pilot symbols) and the precoder
+      precode_dependencies_.Init(config_->Frame().NumDLSyms(), 2);
+    }
   }
 }
 
@@ -1520,15 +2061,254 @@ void Agora::CheckIncrementScheduleFrame(size_t frame_id,
 
   if (this->schedule_process_flags_ ==
       static_cast<uint8_t>(ScheduleProcessingFlags::kProcessingComplete)) {
-    this->cur_sche_frame_id_++;
-    this->schedule_process_flags_ = ScheduleProcessingFlags::kNone;
-    if (this->config_->Frame().NumULSyms() == 0) {
-      this->schedule_process_flags_ += ScheduleProcessingFlags::kUplinkComplete;
+    AdvanceScheduleFrame();
+  }
+}
+
+void Agora::AdvanceScheduleFrame() {
+  this->cur_sche_frame_id_++;
+  this->schedule_process_flags_ = ScheduleProcessingFlags::kNone;
+  if (this->config_->Frame().NumULSyms() == 0) {
+    this->schedule_process_flags_ += ScheduleProcessingFlags::kUplinkComplete;
+  }
+  if (this->config_->Frame().NumDLSyms() == 0) {
+    this->schedule_process_flags_ += ScheduleProcessingFlags::kDownlinkComplete;
+  }
+}
+
+void Agora::ScheduleDeferredDownlink() {
+  while (this->encode_deferral_.empty() == false) {
+    size_t deferred_frame = this->encode_deferral_.front();
+    if (deferred_frame <
+        (this->cur_proc_frame_id_ + config_->PipelineDepth())) {
+      if (kDebugDeferral) {
+        std::printf("   +++ Scheduling deferred frame %zu : %zu \n",
+                    deferred_frame, cur_proc_frame_id_);
+      }
+      RtAssert(deferred_frame >= this->cur_proc_frame_id_,
+               "Error scheduling encoding because deferral frame is less "
+               "than current frame");
+      ScheduleDownlinkProcessing(deferred_frame);
+      this->encode_deferral_.pop();
+    } else {
+      // No need to check the next frame because it is too large
+      break;
     }
-    if (this->config_->Frame().NumDLSyms() == 0) {
-      this->schedule_process_flags_ +=
-          ScheduleProcessingFlags::kDownlinkComplete;
+  }
+}
+
+bool Agora::RecordRxPacket(size_t frame_id, size_t symbol_id, size_t ant_id) {
+  RxSymbolTracker& tracker = rx_trackers_.at(frame_id % kFrameWnd);
+  if ((tracker.frame_id_ == SIZE_MAX) || (frame_id > tracker.frame_id_)) {
+    // First packet of the frame in this slot
+    tracker.frame_id_ = frame_id;
+    tracker.num_pkts_ = 0;
+    for (auto& ants : tracker.ants_) {
+      ants.reset();
     }
+  } else if (frame_id < tracker.frame_id_) {
+    return false;
+  }
+  if (tracker.ants_.at(symbol_id).test(ant_id) == true) {
+    return false;
+  }
+  tracker.ants_.at(symbol_id).set(ant_id);
+  tracker.num_pkts_++;
+  if ((this->latest_rx_frame_ == SIZE_MAX) ||
+      (frame_id > this->latest_rx_frame_)) {
+    this->latest_rx_frame_ = frame_id;
+  }
+  return true;
+}
+
+void Agora::FillTimedOutSymbols() {
+  const size_t now_tsc = GetTime::Rdtsc();
+  this->next_rx_timeout_scan_tsc_ =
+      now_tsc + (this->rx_timeout_cycles_ / kRxTimeoutScansPerTimeout);
+  if ((this->latest_rx_frame_ == SIZE_MAX) ||
+      (this->latest_rx_frame_ < this->cur_sche_frame_id_)) {
+    return;
+  }
+
+  const double frame_cycles =
+      config_->GetFrameDurationSec() * 1e9 * config_->FreqGhz();
+  const double symbol_cycles = frame_cycles / config_->Frame().NumTotalSyms();
+  const size_t latest_start_tsc =
+      this->stats_->MasterGetTsc(TsType::kFirstSymbolRX, latest_rx_frame_);
+  for (size_t frame_id = this->cur_sche_frame_id_;
+       frame_id <= this->latest_rx_frame_; frame_id++) {
+    const RxSymbolTracker& tracker = rx_trackers_.at(frame_id % kFrameWnd);
+    size_t start_tsc;
+    if (tracker.frame_id_ == frame_id) {
+      if (tracker.num_pkts_ == rx_counters_.num_pkts_per_frame_) {
+        continue;
+      }
+      start_tsc = this->stats_->MasterGetTsc(TsType::kFirstSymbolRX, frame_id);
+    } else {
+      // All packets of the frame so far were lost. Estimate its start from
+      // the latest frame that was received.
+      const auto frames_before = static_cast<size_t>(
+          (this->latest_rx_frame_ - frame_id) * frame_cycles);
+      start_tsc = latest_start_tsc - std::min(frames_before, latest_start_tsc);
+    }
+
+    for (size_t symbol_id = 0; symbol_id < config_->Frame().NumTotalSyms();
+         symbol_id++) {
+      if ((config_->IsPilot(frame_id, symbol_id) == false) &&
+          (config_->IsUplink(frame_id, symbol_id) == false)) {
+        continue;
+      }
+      const size_t deadline_tsc =
+          start_tsc + static_cast<size_t>(symbol_id * symbol_cycles) +
+          this->rx_timeout_cycles_;
+      if (now_tsc < deadline_tsc) {
+        // Later symbols have later deadlines
+        break;
+      }
+      FillMissingAntennas(frame_id, symbol_id);
+    }
+  }
+}
+
+void Agora::FillMissingAntennas(size_t frame_id, size_t symbol_id) {
+  const size_t frame_slot = frame_id % kFrameWnd;
+  const size_t filler_tid = config_->SocketThreadNum();
+  size_t num_missing = 0;
+  for (size_t ant_id = 0; ant_id < config_->BsAntNum(); ant_id++) {
+    const RxSymbolTracker& tracker = rx_trackers_.at(frame_slot);
+    if ((tracker.frame_id_ == frame_id) &&
+        (tracker.ants_.at(symbol_id).test(ant_id) == true)) {
+      continue;
+    }
+    // Same layout as the RX threads' buffers, so that each (frame slot,
+    // symbol, antenna) has its own filler packet
+    const size_t offset =
+        ((frame_slot * config_->Frame().NumTotalSyms()) + symbol_id) *
+            config_->BsAntNum() +
+        ant_id;
+    if (socket_buffer_status_[filler_tid][offset] == 1) {
+      // Still used by an FFT task of an older frame. Retry at the next scan.
+      continue;
+    }
+    auto* pkt = reinterpret_cast<Packet*>(
+        socket_buffer_[filler_tid] + config_->PacketBufferOffset(offset));
+    pkt->frame_id_ = frame_id;
+    pkt->symbol_id_ = symbol_id;
+    pkt->cell_id_ = 0;
+    pkt->ant_id_ = ant_id;
+    socket_buffer_status_[filler_tid][offset] = 1;
+
+    RecordRxPacket(frame_id, symbol_id, ant_id);
+    UpdateRxCounters(frame_id, symbol_id);
+    fft_queue_arr_.at(frame_slot).push(fft_req_tag_t(filler_tid, offset));
+    num_missing++;
+  }
+  if (num_missing > 0) {
+    MLPD_FRAME(
+        "Agora: frame %zu symbol %zu timed out, %zu of %zu antennas "
+        "zero-filled\n",
+        frame_id, symbol_id, num_missing, config_->BsAntNum());
+    this->stats_->MasterAddIncompleteSymbol(num_missing);
+  }
+}
+
+void Agora::ReleaseRxBuffer(size_t socket_thread_id, size_t offset) {
+  int* status = &socket_buffer_status_[socket_thread_id][offset];
+#if defined(USE_DPDK)
+  // Packets received with zero-copy RX hold their mbuf. The filler packets
+  // of timed-out symbols have none.
+  rte_mbuf* mbuf = nullptr;
+  if ((config_->DpdkZeroCopyRx() == true) &&
+      (socket_thread_id < config_->SocketThreadNum())) {
+    mbuf = DpdkTransport::GetRxMbuf(reinterpret_cast<Packet*>(
+        socket_buffer_[socket_thread_id] +
+        config_->PacketBufferOffset(offset)));
+  }
+#endif
+  // The buffer of a multi-antenna packet is shared by the FFT tasks of its
+  // antennas, and is free once all of them released it
+  if ((config_->FronthaulAntsPerPacket() > 1) &&
+      (__atomic_sub_fetch(status, 1, __ATOMIC_ACQ_REL) > 0)) {
+    return;
+  }
+#if defined(USE_DPDK)
+  if (mbuf != nullptr) {
+    rte_pktmbuf_free(mbuf);
+  }
+#endif
+  *status = 0;
+}
+
+bool Agora::DropStalestFrame() {
+  const size_t frame_id = this->cur_proc_frame_id_;
+  const size_t frame_slot = frame_id % kFrameWnd;
+  MLPD_WARN("Agora: dropping frame %zu (scheduling frame %zu)\n", frame_id,
+            this->cur_sche_frame_id_);
+
+  // Release the RX buffers of packets that are not in FFT tasks yet. Tasks
+  // already queued still run, and their completions are ignored.
+  std::queue<fft_req_tag_t>& fftq = fft_queue_arr_.at(frame_slot);
+  while (fftq.empty() == false) {
+    ReleaseRxBuffer(fftq.front().tid_, fftq.front().offset_);
+    fftq.pop();
+  }
+
+  rx_counters_.num_pkts_.at(frame_slot) = 0;
+  rx_counters_.num_pilot_pkts_.at(frame_slot) = 0;
+  rx_counters_.num_reciprocity_pkts_.at(frame_slot) = 0;
+  for (FrameCounters* counters :
+       {&pilot_fft_counters_, &uplink_fft_counters_, &rc_counters_,
+        &zf_counters_, &demul_counters_, &decode_counters_, &tomac_counters_,
+        &encode_counters_, &precode_counters_, &ifft_counters_, &tx_counters_,
+        &mac_to_phy_counters_}) {
+    counters->Reset(frame_id);
+  }
+  ifft_next_symbol_.at(frame_slot) = 0;
+  if (config_->Frame().NumDLSyms() > 0) {
+    std::fill(encode_cur_frame_for_symbol_.at(frame_slot).begin(),
+              encode_cur_frame_for_symbol_.at(frame_slot).end(), SIZE_MAX);
+    for (size_t ue_id = 0; ue_id < config_->UeNum(); ue_id++) {
+      this->dl_bits_buffer_status_[ue_id][frame_slot] = 0;
+    }
+  }
+
+  this->stats_->MasterAddDroppedFrame(frame_id);
+  if (kEnableMac == true) {
+    TryEnqueueFallback(
+        &mac_request_queue_,
+        EventData(EventType::kFrameDropped,
+                  gen_tag_t::FrmSym(frame_id, 0).tag_));
+  }
+
+  this->cur_proc_frame_id_++;
+  if (frame_id == this->cur_sche_frame_id_) {
+    // The frame was still being scheduled
+    this->fft_created_count_ = 0;
+    AdvanceScheduleFrame();
+  }
+  while ((this->encode_deferral_.empty() == false) &&
+         (this->encode_deferral_.front() <= frame_id)) {
+    this->encode_deferral_.pop();
+  }
+  ScheduleDeferredDownlink();
+  return frame_id == (this->config_->FramesToTest() - 1);
+}
+
+bool Agora::IsDroppedFrameEvent(const EventData& event) const {
+  switch (event.event_type_) {
+    case EventType::kFFT:
+    case EventType::kZF:
+    case EventType::kDemul:
+    case EventType::kDecode:
+    case EventType::kEncode:
+    case EventType::kPrecode:
+    case EventType::kIFFT:
+    case EventType::kPacketTX:
+    case EventType::kPacketToMac:
+      // Frames before cur_proc_frame_id are complete or dropped
+      return gen_tag_t(event.tags_[0]).frame_id_ < this->cur_proc_frame_id_;
+    default:
+      return false;
   }
 }
 
@@ -1544,15 +2324,35 @@ bool Agora::CheckFrameComplete(size_t frame_id) {
       static_cast<int>(this->tomac_counters_.IsLastSymbol(frame_id)),
       static_cast<int>(this->tx_counters_.IsLastSymbol(frame_id)));
 
+  // Frames complete in FIFO order. A later frame in the pipeline that
+  // finishes first keeps its counters and is completed together with the
+  // frames before it.
+  if (frame_id != this->cur_proc_frame_id_) {
+    return false;
+  }
+
   // Complete if last frame and ifft / decode complete
-  if ((true == this->ifft_counters_.IsLastSymbol(frame_id)) &&
-      (true == this->tx_counters_.IsLastSymbol(frame_id)) &&
-      (((false == kEnableMac) &&
-        (true == this->decode_counters_.IsLastSymbol(frame_id))) ||
-       ((true == kEnableMac) &&
-        (true == this->tomac_counters_.IsLastSymbol(frame_id))))) {
+  while ((finished == false) &&
+         (true == this->ifft_counters_.IsLastSymbol(frame_id)) &&
+         (true == this->tx_counters_.IsLastSymbol(frame_id)) &&
+         (((false == kEnableMac) &&
+           (true == this->decode_counters_.IsLastSymbol(frame_id))) ||
+          ((true == kEnableMac) &&
+           (true == this->tomac_counters_.IsLastSymbol(frame_id))))) {
     this->stats_->UpdateStats(frame_id);
-    assert(frame_id == this->cur_proc_frame_id_);
+    if (worker_pool_ != nullptr) {
+      std::array<size_t, kNumEventTypes> queue_depths{};
+      for (size_t i = 0; i < kNumEventTypes; i++) {
+        for (size_t qid = 0; qid < config_->PipelineDepth(); qid++) {
+          queue_depths.at(i) +=
+              GetConq(static_cast<EventType>(i), qid)->size_approx();
+        }
+      }
+      worker_pool_->Update(
+          frame_id,
+          stats_->MasterGetUsSince(TsType::kFirstSymbolRX, frame_id),
+          queue_depths);
+    }
     this->decode_counters_.Reset(frame_id);
     this->tomac_counters_.Reset(frame_id);
     this->ifft_counters_.Reset(frame_id);
@@ -1562,30 +2362,12 @@ bool Agora::CheckFrameComplete(size_t frame_id) {
         this->dl_bits_buffer_status_[ue_id][frame_id % kFrameWnd] = 0;
     }
     this->cur_proc_frame_id_++;
-
-    if (this->encode_deferral_.empty() == false) {
-      for (size_t encode = 0; encode < kScheduleQueues; encode++) {
-        size_t deferred_frame = this->encode_deferral_.front();
-        if (deferred_frame < (this->cur_proc_frame_id_ + kScheduleQueues)) {
-          if (kDebugDeferral) {
-            std::printf("   +++ Scheduling deferred frame %zu : %zu \n",
-                        deferred_frame, cur_proc_frame_id_);
-          }
-          RtAssert(deferred_frame >= this->cur_proc_frame_id_,
-                   "Error scheduling encoding because deferral frame is less "
-                   "than current frame");
-          ScheduleDownlinkProcessing(frame_id);
-          this->encode_deferral_.pop();
-        } else {
-          // No need to check the next frame because it is too large
-          break;
-        }
-      }
-    }
+    ScheduleDeferredDownlink();
 
     if (frame_id == (this->config_->FramesToTest() - 1)) {
       finished = true;
     }
+    frame_id = this->cur_proc_frame_id_;
   }
   return finished;
 }
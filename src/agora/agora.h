@@ -9,6 +9,8 @@
 #include <unistd.h>
 
 #include <algorithm>
+#include <array>
+#include <bitset>
 #include <iostream>
 #include <memory>
 #include <queue>
@@ -19,6 +21,7 @@
 #include "concurrent_queue_wrapper.h"
 #include "concurrentqueue.h"
 #include "config.h"
+#include "deadline_queue.h"
 #include "dodecode.h"
 #include "dodemul.h"
 #include "doencode.h"
@@ -26,13 +29,17 @@
 #include "doifft.h"
 #include "doprecode.h"
 #include "dozf.h"
+#include "idle_policy.h"
 #include "mac_thread_basestation.h"
 #include "memory_manage.h"
 #include "phy_stats.h"
 #include "signal_handler.h"
 #include "stats.h"
+#include "trace.h"
 #include "txrx.h"
 #include "utils.h"
+#include "work_stealing_queue.h"
+#include "worker_pool.h"
 
 class Agora {
  public:
@@ -41,7 +48,9 @@ class Agora {
   static const size_t kDequeueBulkSizeWorker = 4;
   // Max number of worker threads allowed
   static const size_t kMaxWorkerNum = 50;
-  static const size_t kScheduleQueues = 2;
+  // Max number of frames that can be processed concurrently, i.e., the max
+  // pipeline depth
+  static const size_t kMaxScheduleQueues = kFrameWnd;
 
   explicit Agora(
       Config* /*cfg*/);  /// Create an Agora object and start the worker threads
@@ -82,6 +91,41 @@ class Agora {
   void CheckIncrementScheduleFrame(size_t frame_id,
                                    ScheduleProcessingFlags completed);
 
+  /// Move scheduling to the next frame and reset the ScheduleProcessingFlags
+  void AdvanceScheduleFrame();
+
+  /// Schedule the downlink processing of deferred frames that now fit in the
+  /// pipeline
+  void ScheduleDeferredDownlink();
+
+  /// Abandon cur_proc_frame_id: release its queued RX packets, reset its
+  /// counters, and report it to Stats and the MAC. Returns true if it was the
+  /// last frame to test.
+  bool DropStalestFrame();
+
+  /// Release the RX buffer slot of a packet that will not be processed. For
+  /// multi-antenna packets, this releases the slot for one antenna.
+  void ReleaseRxBuffer(size_t socket_thread_id, size_t offset);
+
+  /// Return true if event is a completion for a frame that was dropped
+  bool IsDroppedFrameEvent(const EventData& event) const;
+
+  /// Create FFT tasks from the queued packets of cur_sche_frame_id
+  void ScheduleFftTasks();
+
+  /// With RX symbol timeouts, mark the packet of (frame_id, symbol_id,
+  /// ant_id) as received. Returns false if it was already received or
+  /// zero-filled, or if its frame slot was reused by a later frame.
+  bool RecordRxPacket(size_t frame_id, size_t symbol_id, size_t ant_id);
+
+  /// Zero-fill the missing packets of the pilot and uplink symbols of frames
+  /// being received whose timeout expired
+  void FillTimedOutSymbols();
+
+  /// Queue zeroed filler packets for the antennas of (frame_id, symbol_id)
+  /// that have not been received
+  void FillMissingAntennas(size_t frame_id, size_t symbol_id);
+
   void WorkerFft(int tid);
   void WorkerZf(int tid);
   void WorkerDemul(int tid);
@@ -101,6 +145,20 @@ class Agora {
   void SaveTxDataToFile(int frame_id);
 
   void HandleEventFft(size_t tag);
+
+  /// Decentralized scheduling: act on a task completed by worker tid. The
+  /// worker that completes the last task of a symbol (or frame) schedules the
+  /// dependent stage and forwards one completion event to the master.
+  void WorkerHandleCompletion(int tid, const EventData& event);
+  /// Count one of the two dependencies (FFT, ZF) of an uplink symbol's
+  /// demodulation, and schedule it once both are met
+  void ResolveDemulDependency(size_t frame_id, size_t symbol_id);
+  /// Count one of the two dependencies (encode, ZF) of a downlink symbol's
+  /// precoding, and schedule it once both are met
+  void ResolvePrecodeDependency(size_t frame_id, size_t symbol_id);
+  /// Send a symbol-level (or frame-level) completion event to the master
+  void ForwardToMaster(int tid, EventType event_type, size_t frame_id,
+                       size_t symbol_id);
   void UpdateRxCounters(size_t frame_id, size_t symbol_id);
   void PrintPerFrameDone(PrintType print_type, size_t frame_id);
   void PrintPerSymbolDone(PrintType print_type, size_t frame_id,
@@ -130,9 +188,32 @@ class Agora {
 
   void ScheduleUsers(EventType event_type, size_t frame_id, size_t symbol_id);
 
+  /// Enqueue a task to the worker queue of this event type
+  void EnqueueWorkerTask(EventType event_type, size_t qid,
+                         const EventData& event);
+
+  /// Return true if the ZF matrices of frame_id are computed
+  inline bool IsZfDone(size_t frame_id) const {
+    return zf_done_frame_.at(frame_id % kFrameWnd) == frame_id;
+  }
+
+  /// Return the worker that owns the subcarrier range containing sc_id when
+  /// subcarrier affinity is enabled
+  size_t SubcarrierOwner(size_t sc_id) const;
+
+  /// Return the RDTSC timestamp by which a task of this type, frame and
+  /// symbol should complete, used by the "edf" worker scheduler
+  size_t TaskDeadlineTsc(EventType event_type, size_t frame_id,
+                         size_t symbol_id) const;
+
   // Send current frame's SNR measurements from PHY to MAC
   void SendSnrReport(EventType event_type, size_t frame_id, size_t symbol_id);
 
+  /// Get the index of the task and completion queue set used by frame_id
+  size_t FrameQueueId(size_t frame_id) const {
+    return frame_id % config_->PipelineDepth();
+  }
+
   /// Fetch the concurrent queue for this event type
   moodycamel::ConcurrentQueue<EventData>* GetConq(EventType event_type,
                                                   size_t qid) {
@@ -237,24 +318,43 @@ class Agora {
   FrameCounters mac_to_phy_counters_;
   FrameCounters rc_counters_;
   RxCounters rx_counters_;
-  size_t zf_last_frame_ = SIZE_MAX;
+
+  // Task counters updated by the workers in decentralized scheduling mode
+  SharedFrameCounters shared_pilot_fft_counters_;
+  SharedFrameCounters shared_uplink_fft_counters_;
+  SharedFrameCounters shared_zf_counters_;
+  SharedFrameCounters shared_demul_counters_;
+  SharedFrameCounters shared_decode_counters_;
+  SharedFrameCounters shared_encode_counters_;
+  SharedFrameCounters shared_precode_counters_;
+  SharedFrameCounters shared_ifft_counters_;
+  SharedFrameCounters demul_dependencies_;
+  SharedFrameCounters precode_dependencies_;
+  // The frame whose ZF is done, per frame slot. Several frames can be in the
+  // pipeline at once, so a single entry would be overwritten by a later frame.
+  std::array<size_t, kFrameWnd> zf_done_frame_;
   size_t rc_last_frame_ = SIZE_MAX;
-  size_t ifft_next_symbol_ = 0;
+  // The next downlink symbol to transmit, per frame slot
+  std::array<size_t, kFrameWnd> ifft_next_symbol_{};
 
   // Agora schedules and processes a frame in FIFO order
   // cur_proc_frame_id is the frame that is currently being processed.
   // cur_sche_frame_id is the frame that is currently being scheduled.
   // A frame's schduling finishes before processing ends, so the two
-  // variables are possible to have different values.
+  // variables are possible to have different values. At most
+  // PipelineDepth() frames, starting at cur_proc_frame_id, are scheduled at
+  // once.
   size_t cur_proc_frame_id_ = 0;
   size_t cur_sche_frame_id_ = 0;
 
-  // The frame index for a symbol whose FFT is done
-  std::vector<size_t> fft_cur_frame_for_symbol_;
-  // The frame index for a symbol whose encode is done
-  std::vector<size_t> encode_cur_frame_for_symbol_;
-  // The frame index for a symbol whose IFFT is done
-  std::vector<size_t> ifft_cur_frame_for_symbol_;
+  // The frame index for a symbol whose FFT is done, per frame slot
+  std::array<std::vector<size_t>, kFrameWnd> fft_cur_frame_for_symbol_;
+  // The frame index for a symbol whose encode is done, per frame slot.
+  // Several frames can be encoding at once, so a single entry per symbol
+  // would be overwritten by a later frame.
+  std::array<std::vector<size_t>, kFrameWnd> encode_cur_frame_for_symbol_;
+  // The frame index for a symbol whose IFFT is done, per frame slot
+  std::array<std::vector<size_t>, kFrameWnd> ifft_cur_frame_for_symbol_;
 
   // The frame index for a symbol whose precode is done
   std::vector<size_t> precode_cur_frame_for_symbol_;
@@ -263,6 +363,20 @@ class Agora {
   // TX/RX buffers.
   std::array<std::queue<fft_req_tag_t>, kFrameWnd> fft_queue_arr_;
 
+  // Per frame slot record of the received (or zero-filled) packets, used to
+  // time out incomplete symbols when rx_symbol_timeout_us is set
+  struct RxSymbolTracker {
+    size_t frame_id_ = SIZE_MAX;  // Frame that owns the slot
+    size_t num_pkts_ = 0;         // Packets received or zero-filled
+    std::array<std::bitset<kMaxAntennas>, kMaxSymbols> ants_;
+  };
+  std::array<RxSymbolTracker, kFrameWnd> rx_trackers_;
+  // Check for timed-out symbols this many times per timeout
+  static constexpr size_t kRxTimeoutScansPerTimeout = 4;
+  size_t rx_timeout_cycles_;
+  size_t next_rx_timeout_scan_tsc_ = 0;
+  size_t latest_rx_frame_ = SIZE_MAX;  // Latest frame with a received packet
+
   // Data for IFFT
   // 1st dimension: kFrameWnd * number of antennas * number of
   // data symbols per frame
@@ -308,7 +422,27 @@ class Agora {
     moodycamel::ConcurrentQueue<EventData> concurrent_q_;
     moodycamel::ProducerToken* ptok_;
   };
-  SchedInfoT sched_info_arr_[kScheduleQueues][kNumEventTypes];
+  // One set of task queues per frame in the pipeline. Tasks of frame i go to
+  // set (i % PipelineDepth()).
+  std::vector<std::array<SchedInfoT, kNumEventTypes>> sched_info_arr_;
+
+  // Per-worker task deques, used instead of sched_info_arr_ for worker tasks
+  // when the "work_stealing" worker scheduler is selected
+  std::unique_ptr<WorkStealingQueues<EventData>> work_stealing_queues_;
+
+  // Earliest-deadline-first queue shared by all workers, used instead of
+  // sched_info_arr_ when the "edf" worker scheduler is selected
+  std::unique_ptr<DeadlineQueue<EventData>> deadline_queue_;
+
+  // Assigns workers to the uplink or downlink stages when the elastic worker
+  // pool is enabled
+  std::unique_ptr<WorkerPool> worker_pool_;
+
+  // Wakes worker threads sleeping under the adaptive idle policy
+  IdleWaker worker_waker_;
+  // True with the adaptive idle policy. Otherwise no thread sleeps, and
+  // enqueues skip the wakeup and its fence.
+  bool idle_sleep_enabled_ = false;
 
   // Master thread's message queue for receiving packets
   moodycamel::ConcurrentQueue<EventData> message_queue_;
@@ -320,8 +454,8 @@ class Agora {
   moodycamel::ConcurrentQueue<EventData> mac_response_queue_;
 
   // Master thread's message queue for event completion from Doers;
-  moodycamel::ConcurrentQueue<EventData> complete_task_queue_[kScheduleQueues];
-  moodycamel::ProducerToken* worker_ptoks_ptr_[kMaxThreads][kScheduleQueues];
+  std::vector<moodycamel::ConcurrentQueue<EventData>> complete_task_queue_;
+  moodycamel::ProducerToken* worker_ptoks_ptr_[kMaxThreads][kMaxScheduleQueues];
 
   moodycamel::ProducerToken* rx_ptoks_ptr_[kMaxThreads];
   moodycamel::ProducerToken* tx_ptoks_ptr_[kMaxThreads];
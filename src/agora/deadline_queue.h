@@ -0,0 +1,147 @@
+/**
+ * @file deadline_queue.h
+ * @brief Declaration file for the DeadlineQueue class, per-worker task heaps
+ * ordered by task deadline (earliest-deadline-first scheduling).
+ */
+#ifndef DEADLINE_QUEUE_H_
+#define DEADLINE_QUEUE_H_
+
+#include <immintrin.h>
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <queue>
+#include <vector>
+
+/// Earliest-deadline-first task heaps for worker threads. T is the task type,
+/// e.g., EventData. Tasks are spread over one heap per worker, so that pushes
+/// and pops do not all contend on one lock. A worker pops the earlier of the
+/// top tasks of its own heap and of one peer heap (which rotates), so the
+/// order is approximately global EDF. Tasks with equal deadlines in a heap
+/// are returned in FIFO order.
+template <typename T>
+class DeadlineQueue {
+ public:
+  explicit DeadlineQueue(size_t num_workers)
+      : heaps_(num_workers), next_push_(0) {
+    for (auto& heap : heaps_) {
+      heap = std::make_unique<WorkerHeap>();
+    }
+  }
+
+  /// Add a task that should complete before the RDTSC timestamp deadline_tsc,
+  /// to the heaps in round-robin order. Safe to call from any thread.
+  void Push(size_t deadline_tsc, const T& task) {
+    WorkerHeap& heap =
+        *heaps_.at(next_push_.fetch_add(1, std::memory_order_relaxed) %
+                   heaps_.size());
+    heap.Lock();
+    heap.tasks_.push(Entry{deadline_tsc, heap.next_seq_++, task});
+    heap.Published();
+    heap.Unlock();
+  }
+
+  /// Dequeue a task for worker tid, and return its deadline in deadline_tsc.
+  /// The earlier of the top tasks of the worker's heap and of the next peer
+  /// heap is returned. If both are empty, the first non-empty peer heap is
+  /// used, so that no task is stranded.
+  bool TryPop(size_t tid, T& task, size_t& deadline_tsc) {
+    WorkerHeap& own = *heaps_.at(tid);
+    if (heaps_.size() == 1) {
+      return TryPopTop(own, task, deadline_tsc);
+    }
+    // Only worker tid touches its own heap's peer cursor
+    own.next_peer_ = (own.next_peer_ % (heaps_.size() - 1)) + 1;
+    WorkerHeap& peer = *heaps_.at((tid + own.next_peer_) % heaps_.size());
+    WorkerHeap* best = &own;
+    if (peer.top_deadline_.load(std::memory_order_acquire) <
+        own.top_deadline_.load(std::memory_order_acquire)) {
+      best = &peer;
+    }
+    if (TryPopTop(*best, task, deadline_tsc) == true) {
+      return true;
+    }
+    for (size_t i = 1; i < heaps_.size(); i++) {
+      if (TryPopTop(*heaps_.at((tid + i) % heaps_.size()), task,
+                    deadline_tsc) == true) {
+        return true;
+      }
+    }
+    return TryPopTop(own, task, deadline_tsc);
+  }
+
+  /// Approximate number of queued tasks
+  size_t SizeApprox() const {
+    size_t size = 0;
+    for (const auto& heap : heaps_) {
+      size += heap->size_.load(std::memory_order_relaxed);
+    }
+    return size;
+  }
+
+ private:
+  struct Entry {
+    size_t deadline_tsc_;
+    size_t seq_;  // Enqueue order, to break ties between equal deadlines
+    T task_;
+  };
+
+  /// Orders the heap so that the earliest deadline is at the top
+  struct Later {
+    bool operator()(const Entry& a, const Entry& b) const {
+      return (a.deadline_tsc_ > b.deadline_tsc_) ||
+             ((a.deadline_tsc_ == b.deadline_tsc_) && (a.seq_ > b.seq_));
+    }
+  };
+
+  /// A task heap guarded by a spinlock. Critical sections are a single heap
+  /// push/pop, so spinning is cheaper than sleeping on a mutex.
+  struct alignas(64) WorkerHeap {
+    void Lock() {
+      while (lock_.test_and_set(std::memory_order_acquire) == true) {
+        _mm_pause();
+      }
+    }
+    void Unlock() { lock_.clear(std::memory_order_release); }
+
+    /// Publish the size and top deadline for lock-free reads. Called with
+    /// the lock held.
+    void Published() {
+      size_.store(tasks_.size(), std::memory_order_release);
+      top_deadline_.store(
+          tasks_.empty() ? SIZE_MAX : tasks_.top().deadline_tsc_,
+          std::memory_order_release);
+    }
+
+    std::atomic_flag lock_ = ATOMIC_FLAG_INIT;
+    // Read without the lock, to skip empty heaps and compare heaps cheaply
+    std::atomic<size_t> size_{0};
+    std::atomic<size_t> top_deadline_{SIZE_MAX};
+    size_t next_seq_ = 0;
+    size_t next_peer_ = 0;
+    std::priority_queue<Entry, std::vector<Entry>, Later> tasks_;
+  };
+
+  static bool TryPopTop(WorkerHeap& heap, T& task, size_t& deadline_tsc) {
+    if (heap.size_.load(std::memory_order_acquire) == 0) {
+      return false;
+    }
+    bool found = false;
+    heap.Lock();
+    if (heap.tasks_.empty() == false) {
+      task = heap.tasks_.top().task_;
+      deadline_tsc = heap.tasks_.top().deadline_tsc_;
+      heap.tasks_.pop();
+      heap.Published();
+      found = true;
+    }
+    heap.Unlock();
+    return found;
+  }
+
+  std::vector<std::unique_ptr<WorkerHeap>> heaps_;
+  std::atomic<size_t> next_push_;
+};
+
+#endif  // DEADLINE_QUEUE_H_
@@ -11,6 +11,7 @@
 #include "concurrentqueue.h"
 #include "logger.h"
 #include "stats.h"
+#include "trace.h"
 
 class Doer {
  public:
@@ -18,26 +19,48 @@ class Doer {
       moodycamel::ConcurrentQueue<EventData>& task_queue,
       moodycamel::ConcurrentQueue<EventData>& complete_task_queue,
       moodycamel::ProducerToken* worker_ptok) {
+    EventData resp_event;
+    if (TryLaunch(task_queue, resp_event)) {
+      TryEnqueueFallback(&complete_task_queue, worker_ptok, resp_event);
+      return true;
+    }
+    return false;
+  }
+
+  /// Dequeue one request event from task_queue and run it. Instead of being
+  /// enqueued to the master, the response event is returned in resp_event so
+  /// that the calling worker can act on the completion itself.
+  bool TryLaunch(moodycamel::ConcurrentQueue<EventData>& task_queue,
+                 EventData& resp_event) {
     EventData req_event;
     if (task_queue.try_dequeue(req_event)) {
-      // We will enqueue one response event containing results for all
-      // request tags in the request event
-      EventData resp_event;
-      resp_event.num_tags_ = req_event.num_tags_;
-
-      for (size_t i = 0; i < req_event.num_tags_; i++) {
-        EventData resp_i = Launch(req_event.tags_[i]);
-        RtAssert(resp_i.num_tags_ == 1, "Invalid num_tags in resp");
-        resp_event.tags_[i] = resp_i.tags_[0];
-        resp_event.event_type_ = resp_i.event_type_;
-      }
-
-      TryEnqueueFallback(&complete_task_queue, worker_ptok, resp_event);
+      RunEvent(req_event, resp_event);
       return true;
     }
     return false;
   }
 
+  /// Run an already dequeued request event. We return one response event
+  /// containing results for all request tags in the request event.
+  void RunEvent(const EventData& req_event, EventData& resp_event) {
+    resp_event.num_tags_ = req_event.num_tags_;
+    Tracer::Record(req_event.event_type_, req_event.tags_[0],
+                   TracePhase::kBegin,
+                   (req_event.event_type_ == EventType::kFFT)
+                       ? TraceTagType::kFftReq
+                       : TraceTagType::kGen);
+
+    for (size_t i = 0; i < req_event.num_tags_; i++) {
+      EventData resp_i = Launch(req_event.tags_[i]);
+      RtAssert(resp_i.num_tags_ == 1, "Invalid num_tags in resp");
+      resp_event.tags_[i] = resp_i.tags_[0];
+      resp_event.event_type_ = resp_i.event_type_;
+    }
+    // Recorded with the request's event type to close the same trace slice
+    Tracer::Record(req_event.event_type_, resp_event.tags_[0],
+                   TracePhase::kEnd);
+  }
+
   /// The main event handling function that performs Doer-specific work.
   /// Doers that handle only one event type use this signature.
   virtual EventData Launch(size_t tag) {
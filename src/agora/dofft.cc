@@ -4,8 +4,12 @@
  */
 #include "dofft.h"
 
+#include "bfp.h"
 #include "concurrent_queue_wrapper.h"
 #include "datatype_conversion.h"
+#if defined(USE_DPDK)
+#include "dpdk_transport.h"
+#endif
 
 static constexpr bool kPrintFFTInput = false;
 static constexpr bool kPrintPilotCorrStats = false;
@@ -86,34 +90,75 @@ static inline void CalibRegressionEstimate(const arma::cx_fvec& in_vec,
 EventData DoFFT::Launch(size_t tag) {
   size_t socket_thread_id = fft_req_tag_t(tag).tid_;
   size_t buf_offset = fft_req_tag_t(tag).offset_;
+  size_t ant_idx = fft_req_tag_t(tag).ant_idx_;
   size_t start_tsc = GetTime::WorkerRdtsc();
   auto* pkt = (Packet*)(socket_buffer_[socket_thread_id] +
-                        buf_offset * cfg_->PacketLength());
+                        cfg_->PacketBufferOffset(buf_offset));
   size_t frame_id = pkt->frame_id_;
   size_t frame_slot = frame_id % kFrameWnd;
   size_t symbol_id = pkt->symbol_id_;
-  size_t ant_id = pkt->ant_id_;
+  size_t ant_id = pkt->ant_id_ + ant_idx;
   SymbolType sym_type = cfg_->GetSymbolType(symbol_id);
 
-  if (cfg_->FftInRru() == true) {
+  // A fragment holds the FFT output of a range of subcarriers
+  const size_t num_frags = cfg_->FronthaulFragsPerSymbol();
+  const size_t sc_per_frag = cfg_->OfdmCaNum() / num_frags;
+  const size_t frag_id = (num_frags > 1) ? pkt->frag_id_ : 0;
+
+#if defined(USE_DPDK)
+  // With zero-copy RX, the samples are in the packet's mbuf. Filler packets
+  // are in the RX buffer.
+  rte_mbuf* mbuf = nullptr;
+  if ((cfg_->DpdkZeroCopyRx() == true) &&
+      (socket_thread_id < cfg_->SocketThreadNum())) {
+    mbuf = DpdkTransport::GetRxMbuf(pkt);
+    pkt = DpdkTransport::MbufPacket(mbuf);
+  }
+#endif
+
+  // The antenna's samples in a multi-antenna packet
+  auto* samples =
+      reinterpret_cast<short*>(reinterpret_cast<uint8_t*>(pkt->data_) +
+                               ant_idx * cfg_->PacketAntBytes());
+
+  // The first sample of the FFT window in a time-domain packet
+  size_t sample_offset = cfg_->OfdmRxZeroPrefixBs();
+  if (sym_type == SymbolType::kCalDL) {
+    sample_offset = cfg_->OfdmRxZeroPrefixCalDl();
+  } else if (sym_type == SymbolType::kCalUL) {
+    sample_offset = cfg_->OfdmRxZeroPrefixCalUl();
+  }
+
+  // BFP-compressed samples are decompressed straight into the FFT input
+  const size_t bfp_iq_width = cfg_->BfpIqWidth();
+  if ((bfp_iq_width > 0) && (cfg_->FftInRru() == true)) {
+    // The compressed samples are frequency-domain, starting at the
+    // fragment's first subcarrier
+    SimdBfpDecompress(
+        reinterpret_cast<uint8_t*>(samples),
+        reinterpret_cast<float*>(&fft_inout_[frag_id * sc_per_frag]), 0,
+        sc_per_frag, bfp_iq_width);
+  } else if (bfp_iq_width > 0) {
+    SimdBfpDecompress(reinterpret_cast<uint8_t*>(samples),
+                      reinterpret_cast<float*>(fft_inout_), sample_offset,
+                      cfg_->OfdmCaNum(), bfp_iq_width);
+  } else if (num_frags > 1) {
+    SimdConvertFloat16ToFloat32(
+        reinterpret_cast<float*>(&fft_inout_[frag_id * sc_per_frag]),
+        reinterpret_cast<float*>(samples), sc_per_frag * 2);
+  } else if (cfg_->FftInRru() == true) {
     SimdConvertFloat16ToFloat32(
         reinterpret_cast<float*>(fft_inout_),
-        reinterpret_cast<float*>(&pkt->data_[2 * cfg_->OfdmRxZeroPrefixBs()]),
+        reinterpret_cast<float*>(&samples[2 * cfg_->OfdmRxZeroPrefixBs()]),
         cfg_->OfdmCaNum() * 2);
   } else {
     if (kUse12BitIQ) {
       SimdConvert12bitIqToFloat(
-          (uint8_t*)pkt->data_ + 3 * cfg_->OfdmRxZeroPrefixBs(),
+          (uint8_t*)samples + 3 * cfg_->OfdmRxZeroPrefixBs(),
           reinterpret_cast<float*>(fft_inout_), temp_16bits_iq_,
           cfg_->OfdmCaNum() * 3);
     } else {
-      size_t sample_offset = cfg_->OfdmRxZeroPrefixBs();
-      if (sym_type == SymbolType::kCalDL) {
-        sample_offset = cfg_->OfdmRxZeroPrefixCalDl();
-      } else if (sym_type == SymbolType::kCalUL) {
-        sample_offset = cfg_->OfdmRxZeroPrefixCalUl();
-      }
-      SimdConvertShortToFloat(&pkt->data_[2 * sample_offset],
+      SimdConvertShortToFloat(&samples[2 * sample_offset],
                               reinterpret_cast<float*>(fft_inout_),
                               cfg_->OfdmCaNum() * 2);
     }
@@ -122,7 +167,7 @@ EventData DoFFT::Launch(size_t tag) {
                   tid_, frame_id, symbol_id, ant_id);
     }
     if (kPrintPilotCorrStats && sym_type == SymbolType::kPilot) {
-      SimdConvertShortToFloat(pkt->data_,
+      SimdConvertShortToFloat(samples,
                               reinterpret_cast<float*>(rx_samps_tmp_),
                               2 * cfg_->SampsPerSymbol());
       std::vector<std::complex<float>> samples_vec(
@@ -163,6 +208,20 @@ EventData DoFFT::Launch(size_t tag) {
     duration_stat = &dummy_duration_stat;  // For calibration symbols
   }
 
+  // The samples were copied out of the packet. The buffer of a
+  // multi-antenna packet is shared by the FFT tasks of its antennas, and is
+  // free once all of them copied their samples.
+  int* buf_status = &socket_buffer_status_[socket_thread_id][buf_offset];
+  if ((cfg_->FronthaulAntsPerPacket() == 1) ||
+      (__atomic_sub_fetch(buf_status, 1, __ATOMIC_ACQ_REL) == 0)) {
+#if defined(USE_DPDK)
+    if (mbuf != nullptr) {
+      rte_pktmbuf_free(mbuf);
+    }
+#endif
+    *buf_status = 0;  // Reset sock buf
+  }
+
   size_t start_tsc1 = GetTime::WorkerRdtsc();
   duration_stat->task_duration_[1] += start_tsc1 - start_tsc;
 
@@ -175,17 +234,26 @@ EventData DoFFT::Launch(size_t tag) {
   size_t start_tsc2 = GetTime::WorkerRdtsc();
   duration_stat->task_duration_[2] += start_tsc2 - start_tsc1;
 
+  // The data subcarriers in the fragment
+  const size_t data_start = cfg_->OfdmDataStart();
+  const size_t data_end = data_start + cfg_->OfdmDataNum();
+  const size_t sc_begin =
+      std::clamp(frag_id * sc_per_frag, data_start, data_end) - data_start;
+  const size_t sc_end =
+      std::clamp((frag_id + 1) * sc_per_frag, data_start, data_end) -
+      data_start;
+
   if (sym_type == SymbolType::kPilot) {
     size_t pilot_symbol_id = cfg_->Frame().GetPilotSymbolIdx(symbol_id);
-    if (kCollectPhyStats) {
+    if (kCollectPhyStats && (num_frags == 1)) {
       phy_stats_->UpdatePilotSnr(frame_id, pilot_symbol_id, fft_inout_);
     }
     const size_t ue_id = pilot_symbol_id;
     PartialTranspose(csi_buffers_[frame_slot][ue_id], ant_id,
-                     SymbolType::kPilot);
+                     SymbolType::kPilot, sc_begin, sc_end);
   } else if (sym_type == SymbolType::kUL) {
     PartialTranspose(cfg_->GetDataBuf(data_buffer_, frame_id, symbol_id),
-                     ant_id, SymbolType::kUL);
+                     ant_id, SymbolType::kUL, sc_begin, sc_end);
   } else if (sym_type == SymbolType::kCalUL and ant_id != cfg_->RefAnt()) {
     // Only process uplink for antennas that also do downlink in this frame
     // for consistency with calib downlink processing.
@@ -196,7 +264,7 @@ EventData DoFFT::Launch(size_t tag) {
       size_t frame_grp_slot = frame_grp_id % kFrameWnd;
       PartialTranspose(
           &calib_ul_buffer_[frame_grp_slot][ant_id * cfg_->OfdmDataNum()],
-          ant_id, sym_type);
+          ant_id, sym_type, sc_begin, sc_end);
     }
   } else if (sym_type == SymbolType::kCalDL && ant_id == cfg_->RefAnt()) {
     if (frame_id >= TX_FRAME_DELTA) {
@@ -208,7 +276,7 @@ EventData DoFFT::Launch(size_t tag) {
                        cal_dl_symbol_id;
       complex_float* calib_dl_ptr =
           &calib_dl_buffer_[frame_grp_slot][cur_ant * cfg_->OfdmDataNum()];
-      PartialTranspose(calib_dl_ptr, ant_id, sym_type);
+      PartialTranspose(calib_dl_ptr, ant_id, sym_type, sc_begin, sc_end);
     }
   } else {
     std::string error_message = "Unknown or unsupported symbol type " +
@@ -218,82 +286,80 @@ EventData DoFFT::Launch(size_t tag) {
   }
 
   duration_stat->task_duration_[3] += GetTime::WorkerRdtsc() - start_tsc2;
-  socket_buffer_status_[socket_thread_id][buf_offset] = 0;  // Reset sock buf
   duration_stat->task_count_++;
   duration_stat->task_duration_[0] += GetTime::WorkerRdtsc() - start_tsc;
   return EventData(EventType::kFFT,
-                   gen_tag_t::FrmSym(pkt->frame_id_, pkt->symbol_id_).tag_);
+                   gen_tag_t::FrmSym(frame_id, symbol_id).tag_);
 }
 
 void DoFFT::PartialTranspose(complex_float* out_buf, size_t ant_id,
-                             SymbolType symbol_type) const {
-  // We have OfdmDataNum() % kTransposeBlockSize == 0
-  const size_t num_blocks = cfg_->OfdmDataNum() / kTransposeBlockSize;
-
-  for (size_t block_idx = 0; block_idx < num_blocks; block_idx++) {
+                             SymbolType symbol_type, size_t sc_begin,
+                             size_t sc_end) const {
+  // We have OfdmDataNum() % kTransposeBlockSize == 0, and sc_begin and
+  // sc_end are multiples of kSCsPerCacheline. We also have
+  // kTransposeBlockSize % kSCsPerCacheline == 0.
+  for (size_t sc_idx = sc_begin; sc_idx < sc_end;
+       sc_idx += kSCsPerCacheline) {
+    const size_t block_idx = sc_idx / kTransposeBlockSize;
+    const size_t sc_j = sc_idx % kTransposeBlockSize;
     const size_t block_base_offset =
         block_idx * (kTransposeBlockSize * cfg_->BsAntNum());
-    // We have kTransposeBlockSize % kSCsPerCacheline == 0
-    for (size_t sc_j = 0; sc_j < kTransposeBlockSize;
-         sc_j += kSCsPerCacheline) {
-      const size_t sc_idx = (block_idx * kTransposeBlockSize) + sc_j;
-      const complex_float* src = &fft_inout_[sc_idx + cfg_->OfdmDataStart()];
+    const complex_float* src = &fft_inout_[sc_idx + cfg_->OfdmDataStart()];
 
-      complex_float* dst = nullptr;
-      if ((symbol_type == SymbolType::kCalDL) ||
-          (symbol_type == SymbolType::kCalUL)) {
-        dst = &out_buf[sc_idx];
-      } else {
-        dst = kUsePartialTrans
-                  ? &out_buf[block_base_offset +
-                             (ant_id * kTransposeBlockSize) + sc_j]
-                  : &out_buf[(cfg_->OfdmDataNum() * ant_id) + sc_j +
-                             block_idx * kTransposeBlockSize];
-      }
+    complex_float* dst = nullptr;
+    if ((symbol_type == SymbolType::kCalDL) ||
+        (symbol_type == SymbolType::kCalUL)) {
+      dst = &out_buf[sc_idx];
+    } else {
+      dst = kUsePartialTrans
+                ? &out_buf[block_base_offset +
+                           (ant_id * kTransposeBlockSize) + sc_j]
+                : &out_buf[(cfg_->OfdmDataNum() * ant_id) + sc_j +
+                           block_idx * kTransposeBlockSize];
+    }
 
-      // With either of AVX-512 or AVX2, load one cacheline =
-      // 16 float values = 8 subcarriers = kSCsPerCacheline
+    // With either of AVX-512 or AVX2, load one cacheline =
+    // 16 float values = 8 subcarriers = kSCsPerCacheline
 
 #ifdef __AVX512F__
-      // AVX-512.
-      __m512 fft_result = _mm512_load_ps(reinterpret_cast<const float*>(src));
-      if (symbol_type == SymbolType::kPilot) {
-        __m512 pilot_tx = _mm512_set_ps(
-            cfg_->PilotsSgn()[sc_idx + 7].im, cfg_->PilotsSgn()[sc_idx + 7].re,
-            cfg_->PilotsSgn()[sc_idx + 6].im, cfg_->PilotsSgn()[sc_idx + 6].re,
-            cfg_->PilotsSgn()[sc_idx + 5].im, cfg_->PilotsSgn()[sc_idx + 5].re,
-            cfg_->PilotsSgn()[sc_idx + 4].im, cfg_->PilotsSgn()[sc_idx + 4].re,
-            cfg_->PilotsSgn()[sc_idx + 3].im, cfg_->PilotsSgn()[sc_idx + 3].re,
-            cfg_->PilotsSgn()[sc_idx + 2].im, cfg_->PilotsSgn()[sc_idx + 2].re,
-            cfg_->PilotsSgn()[sc_idx + 1].im, cfg_->PilotsSgn()[sc_idx + 1].re,
-            cfg_->PilotsSgn()[sc_idx].im, cfg_->PilotsSgn()[sc_idx].re);
-        fft_result = CommsLib::M512ComplexCf32Mult(fft_result, pilot_tx, true);
-      }
-      _mm512_stream_ps(reinterpret_cast<float*>(dst), fft_result);
+    // AVX-512.
+    __m512 fft_result = _mm512_load_ps(reinterpret_cast<const float*>(src));
+    if (symbol_type == SymbolType::kPilot) {
+      __m512 pilot_tx = _mm512_set_ps(
+          cfg_->PilotsSgn()[sc_idx + 7].im, cfg_->PilotsSgn()[sc_idx + 7].re,
+          cfg_->PilotsSgn()[sc_idx + 6].im, cfg_->PilotsSgn()[sc_idx + 6].re,
+          cfg_->PilotsSgn()[sc_idx + 5].im, cfg_->PilotsSgn()[sc_idx + 5].re,
+          cfg_->PilotsSgn()[sc_idx + 4].im, cfg_->PilotsSgn()[sc_idx + 4].re,
+          cfg_->PilotsSgn()[sc_idx + 3].im, cfg_->PilotsSgn()[sc_idx + 3].re,
+          cfg_->PilotsSgn()[sc_idx + 2].im, cfg_->PilotsSgn()[sc_idx + 2].re,
+          cfg_->PilotsSgn()[sc_idx + 1].im, cfg_->PilotsSgn()[sc_idx + 1].re,
+          cfg_->PilotsSgn()[sc_idx].im, cfg_->PilotsSgn()[sc_idx].re);
+      fft_result = CommsLib::M512ComplexCf32Mult(fft_result, pilot_tx, true);
+    }
+    _mm512_stream_ps(reinterpret_cast<float*>(dst), fft_result);
 #else
-      __m256 fft_result0 = _mm256_load_ps(reinterpret_cast<const float*>(src));
-      __m256 fft_result1 =
-          _mm256_load_ps(reinterpret_cast<const float*>(src + 4));
-      if (symbol_type == SymbolType::kPilot) {
-        __m256 pilot_tx0 = _mm256_set_ps(
-            cfg_->PilotsSgn()[sc_idx + 3].im, cfg_->PilotsSgn()[sc_idx + 3].re,
-            cfg_->PilotsSgn()[sc_idx + 2].im, cfg_->PilotsSgn()[sc_idx + 2].re,
-            cfg_->PilotsSgn()[sc_idx + 1].im, cfg_->PilotsSgn()[sc_idx + 1].re,
-            cfg_->PilotsSgn()[sc_idx].im, cfg_->PilotsSgn()[sc_idx].re);
-        fft_result0 =
-            CommsLib::M256ComplexCf32Mult(fft_result0, pilot_tx0, true);
+    __m256 fft_result0 = _mm256_load_ps(reinterpret_cast<const float*>(src));
+    __m256 fft_result1 =
+        _mm256_load_ps(reinterpret_cast<const float*>(src + 4));
+    if (symbol_type == SymbolType::kPilot) {
+      __m256 pilot_tx0 = _mm256_set_ps(
+          cfg_->PilotsSgn()[sc_idx + 3].im, cfg_->PilotsSgn()[sc_idx + 3].re,
+          cfg_->PilotsSgn()[sc_idx + 2].im, cfg_->PilotsSgn()[sc_idx + 2].re,
+          cfg_->PilotsSgn()[sc_idx + 1].im, cfg_->PilotsSgn()[sc_idx + 1].re,
+          cfg_->PilotsSgn()[sc_idx].im, cfg_->PilotsSgn()[sc_idx].re);
+      fft_result0 =
+          CommsLib::M256ComplexCf32Mult(fft_result0, pilot_tx0, true);
 
-        __m256 pilot_tx1 = _mm256_set_ps(
-            cfg_->PilotsSgn()[sc_idx + 7].im, cfg_->PilotsSgn()[sc_idx + 7].re,
-            cfg_->PilotsSgn()[sc_idx + 6].im, cfg_->PilotsSgn()[sc_idx + 6].re,
-            cfg_->PilotsSgn()[sc_idx + 5].im, cfg_->PilotsSgn()[sc_idx + 5].re,
-            cfg_->PilotsSgn()[sc_idx + 4].im, cfg_->PilotsSgn()[sc_idx + 4].re);
-        fft_result1 =
-            CommsLib::M256ComplexCf32Mult(fft_result1, pilot_tx1, true);
-      }
-      _mm256_stream_ps(reinterpret_cast<float*>(dst), fft_result0);
-      _mm256_stream_ps(reinterpret_cast<float*>(dst + 4), fft_result1);
-#endif
+      __m256 pilot_tx1 = _mm256_set_ps(
+          cfg_->PilotsSgn()[sc_idx + 7].im, cfg_->PilotsSgn()[sc_idx + 7].re,
+          cfg_->PilotsSgn()[sc_idx + 6].im, cfg_->PilotsSgn()[sc_idx + 6].re,
+          cfg_->PilotsSgn()[sc_idx + 5].im, cfg_->PilotsSgn()[sc_idx + 5].re,
+          cfg_->PilotsSgn()[sc_idx + 4].im, cfg_->PilotsSgn()[sc_idx + 4].re);
+      fft_result1 =
+          CommsLib::M256ComplexCf32Mult(fft_result1, pilot_tx1, true);
     }
+    _mm256_stream_ps(reinterpret_cast<float*>(dst), fft_result0);
+    _mm256_stream_ps(reinterpret_cast<float*>(dst + 4), fft_result1);
+#endif
   }
 }
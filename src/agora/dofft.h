@@ -92,9 +92,13 @@ class DoFFT : public Doer {
    * Each partially-transposed block is identical to the corresponding block
    * of the fully-transposed matrix, but laid out in memory in column-major
    * order.
+   *
+   * Only the data subcarriers in [sc_begin, sc_end) are filled in, so that
+   * the fragments of a symbol can be transposed separately.
    */
   void PartialTranspose(complex_float* out_buf, size_t ant_id,
-                        SymbolType symbol_type) const;
+                        SymbolType symbol_type, size_t sc_begin,
+                        size_t sc_end) const;
 
  private:
   Table<char>& socket_buffer_;
@@ -4,13 +4,12 @@
  */
 #include "doifft.h"
 
+#include "bfp.h"
 #include "concurrent_queue_wrapper.h"
 #include "datatype_conversion.h"
 
 static constexpr bool kPrintIFFTOutput = false;
 static constexpr bool kPrintSocketOutput = false;
-static constexpr bool kUseOutOfPlaceIFFT = false;
-static constexpr bool kMemcpyBeforeIFFT = true;
 
 DoIFFT::DoIFFT(Config* in_config, int in_tid,
                Table<complex_float>& in_dl_ifft_buffer,
@@ -21,9 +20,9 @@ DoIFFT::DoIFFT(Config* in_config, int in_tid,
   duration_stat_ = in_stats_manager->GetDurationStat(DoerType::kIFFT, in_tid);
   DftiCreateDescriptor(&mkl_handle_, DFTI_SINGLE, DFTI_COMPLEX, 1,
                        cfg_->OfdmCaNum());
-  if (kUseOutOfPlaceIFFT) {
-    DftiSetValue(mkl_handle_, DFTI_PLACEMENT, DFTI_NOT_INPLACE);
-  }
+  // The IFFT reads dl_ifft_buffer_ out of place. Its non-data subcarriers
+  // are zeroed at allocation and never written, so they need no reset.
+  DftiSetValue(mkl_handle_, DFTI_PLACEMENT, DFTI_NOT_INPLACE);
   DftiCommitDescriptor(mkl_handle_);
 
   // Aligned for SIMD
@@ -31,11 +30,19 @@ DoIFFT::DoIFFT(Config* in_config, int in_tid,
       Agora_memory::PaddedAlignedAlloc(Agora_memory::Alignment_t::kAlign64,
                                        2 * cfg_->OfdmCaNum() * sizeof(float)));
   ifft_scale_factor_ = cfg_->OfdmCaNum() / std::sqrt(cfg_->BfAntNum() * 1.f);
+  if (cfg_->BfpIqWidth() > 0) {
+    // The zero prefix and postfix stay zero
+    bfp_symbol_ = static_cast<float*>(Agora_memory::PaddedAlignedAlloc(
+        Agora_memory::Alignment_t::kAlign64,
+        2 * cfg_->SampsPerSymbol() * sizeof(float)));
+    std::memset(bfp_symbol_, 0, 2 * cfg_->SampsPerSymbol() * sizeof(float));
+  }
 }
 
 DoIFFT::~DoIFFT() {
   DftiFreeDescriptor(&mkl_handle_);
   std::free(ifft_out_);
+  std::free(bfp_symbol_);
 }
 
 EventData DoIFFT::Launch(size_t tag) {
@@ -59,39 +66,20 @@ EventData DoIFFT::Launch(size_t tag) {
   size_t start_tsc1 = GetTime::WorkerRdtsc();
   duration_stat_->task_duration_[1] += start_tsc1 - start_tsc;
 
-  auto* ifft_in_ptr = reinterpret_cast<float*>(dl_ifft_buffer_[offset]);
-  auto* ifft_out_ptr =
-      (kUseOutOfPlaceIFFT || kMemcpyBeforeIFFT) ? ifft_out_ : ifft_in_ptr;
-
-  if (kMemcpyBeforeIFFT) {
-    std::memset(ifft_out_ptr, 0, sizeof(float) * cfg_->OfdmDataStart() * 2);
-    std::memset(ifft_out_ptr + (cfg_->OfdmDataStop() * 2), 0,
-                sizeof(float) * cfg_->OfdmDataStart() * 2);
-    std::memcpy(ifft_out_ptr + (cfg_->OfdmDataStart() * 2),
-                ifft_in_ptr + (cfg_->OfdmDataStart() * 2),
-                sizeof(float) * cfg_->OfdmDataNum() * 2);
-    DftiComputeBackward(mkl_handle_, ifft_out_ptr);
-  } else {
-    if (kUseOutOfPlaceIFFT) {
-      // Use out-of-place IFFT here is faster than in place IFFT
-      // There is no need to reset non-data subcarriers in ifft input
-      // to 0 since their values are not changed after IFFT
-      DftiComputeBackward(mkl_handle_, ifft_in_ptr, ifft_out_ptr);
-    } else {
-      std::memset(ifft_in_ptr, 0, sizeof(float) * cfg_->OfdmDataStart() * 2);
-      std::memset(ifft_in_ptr + (cfg_->OfdmDataStop()) * 2, 0,
-                  sizeof(float) * cfg_->OfdmDataStart() * 2);
-      DftiComputeBackward(mkl_handle_, ifft_in_ptr);
-    }
-  }
+  float* ifft_out =
+      (bfp_symbol_ != nullptr)
+          ? &bfp_symbol_[2 * (cfg_->OfdmTxZeroPrefix() + cfg_->CpLen())]
+          : ifft_out_;
+  DftiComputeBackward(mkl_handle_,
+                      reinterpret_cast<float*>(dl_ifft_buffer_[offset]),
+                      ifft_out);
 
   if (kPrintIFFTOutput) {
     std::stringstream ss;
     ss << "IFFT_output" << ant_id << "=[";
     for (size_t i = 0; i < cfg_->OfdmCaNum(); i++) {
       ss << std::fixed << std::setw(5) << std::setprecision(3)
-         << dl_ifft_buffer_[offset][i].re << "+1j*"
-         << dl_ifft_buffer_[offset][i].im << " ";
+         << ifft_out[2 * i] << "+1j*" << ifft_out[2 * i + 1] << " ";
     }
     ss << "];" << std::endl;
     std::cout << ss.str();
@@ -100,18 +88,31 @@ EventData DoIFFT::Launch(size_t tag) {
   size_t start_tsc2 = GetTime::WorkerRdtsc();
   duration_stat_->task_duration_[2] += start_tsc2 - start_tsc1;
 
+  // The rest of the packet's header was written once at initialization
   auto* pkt = reinterpret_cast<struct Packet*>(
       &dl_socket_buffer_[offset * cfg_->DlPacketLength()]);
+  pkt->frame_id_ = frame_id;
   short* socket_ptr = &pkt->data_[2 * cfg_->OfdmTxZeroPrefix()];
 
-  // IFFT scaled results by OfdmCaNum(), we scale down IFFT results
-  // during data type coversion
-  SimdConvertFloatToShort(ifft_out_ptr, socket_ptr, cfg_->OfdmCaNum(),
-                          cfg_->CpLen(), ifft_scale_factor_);
+  if (bfp_symbol_ != nullptr) {
+    // Insert the cyclic prefix, then compress the whole symbol with the
+    // IFFT's scaling
+    std::memcpy(&bfp_symbol_[2 * cfg_->OfdmTxZeroPrefix()],
+                &ifft_out[2 * (cfg_->OfdmCaNum() - cfg_->CpLen())],
+                2 * cfg_->CpLen() * sizeof(float));
+    BfpCompress(bfp_symbol_, reinterpret_cast<uint8_t*>(pkt->data_),
+                cfg_->SampsPerSymbol(), cfg_->BfpIqWidth(),
+                32768.f / ifft_scale_factor_);
+  } else {
+    // IFFT scaled results by OfdmCaNum(), we scale down IFFT results
+    // during data type coversion, which also inserts the cyclic prefix
+    SimdConvertFloatToShort(ifft_out_, socket_ptr, cfg_->OfdmCaNum(),
+                            cfg_->CpLen(), ifft_scale_factor_);
+  }
 
   duration_stat_->task_duration_[3] += GetTime::WorkerRdtsc() - start_tsc2;
 
-  if (kPrintSocketOutput) {
+  if (kPrintSocketOutput && (bfp_symbol_ == nullptr)) {
     std::stringstream ss;
     ss << "socket_tx_data" << ant_id << "_" << symbol_idx_dl << "=[";
     for (size_t i = 0; i < cfg_->SampsPerSymbol(); i++) {
@@ -56,6 +56,9 @@ class DoIFFT : public Doer {
   DurationStat* duration_stat_;
   DFTI_DESCRIPTOR_HANDLE mkl_handle_;
   float* ifft_out_;  // Buffer for IFFT output
+  // With BFP compression, the whole time-domain symbol, which the IFFT
+  // writes to after its zero prefix and cyclic prefix
+  float* bfp_symbol_ = nullptr;
   float ifft_scale_factor_;
 };
 
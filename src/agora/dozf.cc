@@ -5,6 +5,8 @@
  */
 #include "dozf.h"
 
+#include <cmath>
+
 #include "concurrent_queue_wrapper.h"
 #include "doer.h"
 
@@ -12,6 +14,12 @@ static constexpr bool kUseSIMDGather = true;
 // Calculate the zeroforcing receiver using the formula W_zf = inv(H' * H) * H'.
 // This is faster but less accurate than using an SVD-based pseudoinverse.
 static constexpr size_t kUseInverseForZF = 1u;
+// With time-orthogonal pilots, compute the zeroforcing receivers of
+// kCholeskyLanes subcarriers at once with SIMD Cholesky factorizations,
+// instead of one subcarrier at a time with inv_sympd()
+static constexpr bool kUseSimdCholesky = true;
+static_assert(kCholeskyLaneGroup == kTransposeBlockSize,
+              "SIMD Cholesky lane groups must be partial transpose blocks");
 
 DoZF::DoZF(Config* config, int tid,
            PtrGrid<kFrameWnd, kMaxUEs, complex_float>& csi_buffers,
@@ -19,13 +27,14 @@ DoZF::DoZF(Config* config, int tid,
            Table<complex_float>& calib_ul_buffer,
            PtrGrid<kFrameWnd, kMaxDataSCs, complex_float>& ul_zf_matrices,
            PtrGrid<kFrameWnd, kMaxDataSCs, complex_float>& dl_zf_matrices,
-           Stats* stats_manager)
+           PhyStats* in_phy_stats, Stats* stats_manager)
     : Doer(config, tid),
       csi_buffers_(csi_buffers),
       calib_dl_buffer_(calib_dl_buffer),
       calib_ul_buffer_(calib_ul_buffer),
       ul_zf_matrices_(ul_zf_matrices),
-      dl_zf_matrices_(dl_zf_matrices) {
+      dl_zf_matrices_(dl_zf_matrices),
+      phy_stats_(in_phy_stats) {
   duration_stat_ = stats_manager->GetDurationStat(DoerType::kZF, tid);
   pred_csi_buffer_ =
       static_cast<complex_float*>(Agora_memory::PaddedAlignedAlloc(
@@ -38,17 +47,80 @@ DoZF::DoZF(Config* config, int tid,
   calib_gather_buffer_ = static_cast<complex_float*>(
       Agora_memory::PaddedAlignedAlloc(Agora_memory::Alignment_t::kAlign64,
                                        kMaxAntennas * sizeof(complex_float)));
+
+  interp_spline_ = (cfg_->ZfInterpMode() == "spline");
+  interp_anchors_.reserve(cfg_->ZfBlockSize());
+  mmse_ = (cfg_->Beamformer() == "mmse");
+  approx_method_ = IterativeZfMethodFromString(cfg_->ZfApproxMethod());
+
+  if (kUseSimdCholesky && (kUseInverseForZF != 0u) &&
+      (cfg_->ExternalRefNode() == false) && (cfg_->ZfApproxIters() == 0)) {
+    simd_zf_ = GetSimdZfCholesky(cfg_->UeNum());
+  }
+  if ((cfg_->ZfBatchInversion() == true) &&
+      (cfg_->FreqOrthogonalPilot() == false)) {
+    const size_t batch_size = cfg_->ZfBlockSize();
+    const size_t csi_bytes =
+        batch_size * cfg_->BsAntNum() * cfg_->UeNum() * sizeof(complex_float);
+    csi_batch_buffer_ =
+        static_cast<complex_float*>(Agora_memory::PaddedAlignedAlloc(
+            Agora_memory::Alignment_t::kAlign64, csi_bytes));
+    zf_batch_buffer_ =
+        static_cast<complex_float*>(Agora_memory::PaddedAlignedAlloc(
+            Agora_memory::Alignment_t::kAlign64, csi_bytes));
+    compact_format_ = mkl_get_format_compact();
+    csi_compact_ = static_cast<float*>(mkl_malloc(
+        mkl_cget_size_compact(cfg_->BsAntNum(), cfg_->UeNum(), compact_format_,
+                              batch_size),
+        64));
+    gram_compact_ = static_cast<float*>(mkl_malloc(
+        mkl_cget_size_compact(cfg_->UeNum(), cfg_->UeNum(), compact_format_,
+                              batch_size),
+        64));
+    if (mmse_ == true) {
+      gram_load_buffer_ =
+          static_cast<complex_float*>(Agora_memory::PaddedAlignedAlloc(
+              Agora_memory::Alignment_t::kAlign64,
+              cfg_->UeNum() * cfg_->UeNum() * sizeof(complex_float)));
+      std::memset(gram_load_buffer_, 0,
+                  cfg_->UeNum() * cfg_->UeNum() * sizeof(complex_float));
+      // The same matrix is packed for all subcarriers
+      gram_load_ptrs_.assign(
+          batch_size, reinterpret_cast<const MKL_Complex8*>(gram_load_buffer_));
+    }
+    csi_batch_ptrs_.resize(batch_size);
+    zf_batch_ptrs_.resize(batch_size);
+    for (size_t i = 0; i < batch_size; i++) {
+      const size_t offset = i * cfg_->BsAntNum() * cfg_->UeNum();
+      csi_batch_ptrs_[i] =
+          reinterpret_cast<const MKL_Complex8*>(csi_batch_buffer_ + offset);
+      zf_batch_ptrs_[i] =
+          reinterpret_cast<MKL_Complex8*>(zf_batch_buffer_ + offset);
+    }
+  }
 }
 
 DoZF::~DoZF() {
   std::free(pred_csi_buffer_);
   std::free(csi_gather_buffer_);
   std::free(calib_gather_buffer_);
+  std::free(csi_batch_buffer_);
+  std::free(zf_batch_buffer_);
+  std::free(gram_load_buffer_);
+  if (csi_compact_ != nullptr) {
+    mkl_free(csi_compact_);
+    mkl_free(gram_compact_);
+  }
 }
 
 EventData DoZF::Launch(size_t tag) {
+  diag_load_ = DiagLoad(gen_tag_t(tag).frame_id_);
   if (cfg_->FreqOrthogonalPilot()) {
     ZfFreqOrthogonal(tag);
+  } else if (cfg_->ZfBatchInversion() == true) {
+    ZfTimeOrthogonalBatch(tag);
+  } else if (cfg_->ZfInterpStride() > 1) {
+    ZfTimeOrthogonalInterp(tag);
   } else {
     ZfTimeOrthogonal(tag);
   }
@@ -56,15 +128,25 @@ EventData DoZF::Launch(size_t tag) {
   return EventData(EventType::kZF, tag);
 }
 
+float DoZF::DiagLoad(size_t frame_id) {
+  if (mmse_ == false) {
+    return 0.0f;
+  }
+  // Zero (zeroforcing) until the pilot noise of the frame is measured
+  const float noise = phy_stats_->GetPilotNoise(frame_id);
+  return ((std::isfinite(noise) == true) && (noise > 0.0f)) ? noise : 0.0f;
+}
+
 void DoZF::ComputePrecoder(const arma::cx_fmat& mat_csi,
                            complex_float* calib_ptr, complex_float* _mat_ul_zf,
                            complex_float* _mat_dl_zf) {
-  arma::cx_fmat mat_ul_zf(reinterpret_cast<arma::cx_float*>(_mat_ul_zf),
-                          cfg_->UeNum(), cfg_->BsAntNum(), false);
   arma::cx_fmat mat_ul_zf_tmp;
-  if (kUseInverseForZF != 0u) {
+  // The MMSE detector inv(H' * H + noise * I) * H' has no pseudoinverse form
+  if ((kUseInverseForZF != 0u) || (diag_load_ > 0.0f)) {
     try {
-      mat_ul_zf_tmp = arma::inv_sympd(mat_csi.t() * mat_csi) * mat_csi.t();
+      arma::cx_fmat mat_gram = mat_csi.t() * mat_csi;
+      mat_gram.diag() += diag_load_;
+      mat_ul_zf_tmp = arma::inv_sympd(mat_gram) * mat_csi.t();
     } catch (std::runtime_error&) {
       MLPD_WARN("Failed to invert channel matrix, falling back to pinv()\n");
       arma::pinv(mat_ul_zf_tmp, mat_csi, 1e-2, "dc");
@@ -72,7 +154,48 @@ void DoZF::ComputePrecoder(const arma::cx_fmat& mat_csi,
   } else {
     arma::pinv(mat_ul_zf_tmp, mat_csi, 1e-2, "dc");
   }
+  StorePrecoders(mat_ul_zf_tmp, calib_ptr, _mat_ul_zf, _mat_dl_zf);
+}
+
+void DoZF::ComputePrecoderApprox(const arma::cx_fmat& mat_csi,
+                                 size_t frame_id, size_t sc_id,
+                                 complex_float* calib_ptr,
+                                 complex_float* _mat_ul_zf,
+                                 complex_float* _mat_dl_zf) {
+  const arma::cx_fmat mat_csi_t = mat_csi.t();
+  arma::cx_fmat mat_gram = mat_csi_t * mat_csi;
+  mat_gram.diag() += diag_load_;
+
+  // The previous frame's detector may still be in progress, or stale, which
+  // only makes it a worse starting point
+  arma::cx_fmat mat_ul_zf_tmp;
+  if ((cfg_->ZfApproxWarmStart() == true) && (frame_id > 0)) {
+    mat_ul_zf_tmp = arma::cx_fmat(
+        reinterpret_cast<arma::cx_float*>(
+            ul_zf_matrices_[(frame_id - 1) % kFrameWnd][sc_id]),
+        cfg_->UeNum(), cfg_->BsAntNum());
+  }
+  if ((mat_ul_zf_tmp.is_empty() == true) ||
+      (mat_ul_zf_tmp.is_finite() == false)) {
+    mat_ul_zf_tmp = IterativeZfColdStart(mat_csi_t, mat_gram);
+  }
 
+  const float residual = IterativeZf(mat_csi_t, mat_gram, mat_ul_zf_tmp,
+                                     cfg_->ZfApproxIters(), approx_method_);
+  if ((residual > cfg_->ZfApproxMaxResidual()) ||
+      (std::isfinite(residual) == false)) {
+    num_approx_fallbacks_++;
+    ComputePrecoder(mat_csi, calib_ptr, _mat_ul_zf, _mat_dl_zf);
+    return;
+  }
+  StorePrecoders(mat_ul_zf_tmp, calib_ptr, _mat_ul_zf, _mat_dl_zf);
+}
+
+void DoZF::StorePrecoders(arma::cx_fmat& mat_ul_zf_tmp,
+                          complex_float* calib_ptr, complex_float* _mat_ul_zf,
+                          complex_float* _mat_dl_zf) {
+  arma::cx_fmat mat_ul_zf(reinterpret_cast<arma::cx_float*>(_mat_ul_zf),
+                          cfg_->UeNum(), cfg_->BsAntNum(), false);
   if (cfg_->Frame().NumDLSyms() > 0) {
     arma::cx_fvec vec_calib(reinterpret_cast<arma::cx_float*>(calib_ptr),
                             cfg_->BfAntNum(), false);
@@ -105,6 +228,40 @@ void DoZF::ComputePrecoder(const arma::cx_fmat& mat_csi,
   mat_ul_zf = mat_ul_zf_tmp;
 }
 
+void DoZF::ComputeCalib(size_t frame_id, size_t sc_id) {
+  arma::cx_fvec calib_vec(
+      reinterpret_cast<arma::cx_float*>(calib_gather_buffer_),
+      cfg_->BfAntNum(), false);
+  size_t frame_cal_slot = kFrameWnd - 1;
+  size_t frame_cal_slot_prev = kFrameWnd - 1;
+  if (cfg_->Frame().IsRecCalEnabled() && (frame_id >= TX_FRAME_DELTA)) {
+    size_t frame_grp_id = (frame_id - TX_FRAME_DELTA) / cfg_->AntGroupNum();
+
+    // use the previous window which has a full set of calibration results
+    frame_cal_slot = (frame_grp_id + kFrameWnd - 1) % kFrameWnd;
+    if (frame_id >= TX_FRAME_DELTA + cfg_->AntGroupNum()) {
+      frame_cal_slot_prev = (frame_grp_id + kFrameWnd - 2) % kFrameWnd;
+    }
+  }
+  arma::cx_fmat calib_dl_mat(
+      reinterpret_cast<arma::cx_float*>(calib_dl_buffer_[frame_cal_slot]),
+      cfg_->OfdmDataNum(), cfg_->BfAntNum(), false);
+  arma::cx_fmat calib_ul_mat(
+      reinterpret_cast<arma::cx_float*>(calib_ul_buffer_[frame_cal_slot]),
+      cfg_->OfdmDataNum(), cfg_->BfAntNum(), false);
+  arma::cx_fmat calib_dl_mat_prev(
+      reinterpret_cast<arma::cx_float*>(calib_dl_buffer_[frame_cal_slot_prev]),
+      cfg_->OfdmDataNum(), cfg_->BfAntNum(), false);
+  arma::cx_fmat calib_ul_mat_prev(
+      reinterpret_cast<arma::cx_float*>(calib_ul_buffer_[frame_cal_slot_prev]),
+      cfg_->OfdmDataNum(), cfg_->BfAntNum(), false);
+  arma::cx_fvec calib_dl_vec =
+      (calib_dl_mat.row(sc_id) + calib_dl_mat_prev.row(sc_id)).st();
+  arma::cx_fvec calib_ul_vec =
+      (calib_ul_mat.row(sc_id) + calib_ul_mat_prev.row(sc_id)).st();
+  calib_vec = calib_dl_vec / calib_ul_vec;
+}
+
 // Gather data of one symbol from partially-transposed buffer
 // produced by dofft
 static inline void PartialTransposeGather(size_t cur_sc_id, float* src,
@@ -158,6 +315,95 @@ static inline void TransposeGather(size_t cur_sc_id, float* src, float*& dst,
   }
 }
 
+void DoZF::GatherCsi(size_t frame_slot, size_t sc_id, complex_float* dst) {
+  // Gather CSI matrices of each pilot from partially-transposed CSIs.
+  for (size_t ue_idx = 0; ue_idx < cfg_->UeNum(); ue_idx++) {
+    auto* dst_csi_ptr =
+        reinterpret_cast<float*>(dst + cfg_->BsAntNum() * ue_idx);
+    if (kUsePartialTrans) {
+      PartialTransposeGather(sc_id, (float*)csi_buffers_[frame_slot][ue_idx],
+                             dst_csi_ptr, cfg_->BsAntNum());
+    } else {
+      TransposeGather(sc_id, (float*)csi_buffers_[frame_slot][ue_idx],
+                      dst_csi_ptr, cfg_->BsAntNum(), cfg_->OfdmDataNum());
+    }
+  }
+}
+
+void DoZF::ZfSimdCholesky(size_t frame_id, size_t base_sc_id) {
+  const size_t frame_slot = frame_id % kFrameWnd;
+  size_t start_tsc1 = GetTime::WorkerRdtsc();
+
+  // The CSI is read in place from the CSI buffers
+  const float* csi_ptrs[kMaxCholeskyUes];
+  CholeskyCsiLayout layout;
+  layout.csi_ = csi_ptrs;
+  if (kUsePartialTrans) {
+    for (size_t ue_idx = 0; ue_idx < cfg_->UeNum(); ue_idx++) {
+      csi_ptrs[ue_idx] =
+          reinterpret_cast<const float*>(csi_buffers_[frame_slot][ue_idx]) +
+          2 * (base_sc_id * cfg_->BsAntNum());
+    }
+    layout.ant_stride_ = 2 * kTransposeBlockSize;
+    layout.group_stride_ = 2 * kTransposeBlockSize * cfg_->BsAntNum();
+  } else {
+    for (size_t ue_idx = 0; ue_idx < cfg_->UeNum(); ue_idx++) {
+      csi_ptrs[ue_idx] =
+          reinterpret_cast<const float*>(csi_buffers_[frame_slot][ue_idx]) +
+          2 * base_sc_id;
+    }
+    layout.ant_stride_ = 2 * cfg_->OfdmDataNum();
+    layout.group_stride_ = 2 * kCholeskyLaneGroup;
+  }
+  float* zf_ptrs[kCholeskyLanes];
+  for (size_t i = 0; i < kCholeskyLanes; i++) {
+    zf_ptrs[i] =
+        reinterpret_cast<float*>(ul_zf_matrices_[frame_slot][base_sc_id + i]);
+  }
+  simd_zf_(layout, zf_ptrs, cfg_->BsAntNum(), diag_load_);
+
+  size_t start_tsc2 = GetTime::WorkerRdtsc();
+  duration_stat_->task_duration_[3] += start_tsc2 - start_tsc1;
+
+  for (size_t i = 0; i < kCholeskyLanes; i++) {
+    const size_t cur_sc_id = base_sc_id + i;
+    arma::cx_fmat mat_ul_zf(reinterpret_cast<arma::cx_float*>(
+                                ul_zf_matrices_[frame_slot][cur_sc_id]),
+                            cfg_->UeNum(), cfg_->BsAntNum(), false);
+    const bool ul_zf_valid = mat_ul_zf.is_finite();
+    if ((ul_zf_valid == true) && (cfg_->Frame().NumDLSyms() == 0)) {
+      continue;
+    }
+
+    size_t start_tsc3 = GetTime::WorkerRdtsc();
+    if (cfg_->Frame().NumDLSyms() > 0) {
+      ComputeCalib(frame_id, cur_sc_id);
+    }
+    size_t start_tsc4 = GetTime::WorkerRdtsc();
+    duration_stat_->task_duration_[2] += start_tsc4 - start_tsc3;
+
+    if (ul_zf_valid == true) {
+      arma::cx_fmat mat_ul_zf_tmp = mat_ul_zf;
+      StorePrecoders(mat_ul_zf_tmp, calib_gather_buffer_,
+                     ul_zf_matrices_[frame_slot][cur_sc_id],
+                     dl_zf_matrices_[frame_slot][cur_sc_id]);
+    } else {
+      // The Gram matrix is not positive definite
+      GatherCsi(frame_slot, cur_sc_id, csi_gather_buffer_);
+      arma::cx_fmat mat_csi(
+          reinterpret_cast<arma::cx_float*>(csi_gather_buffer_),
+          cfg_->BsAntNum(), cfg_->UeNum(), false);
+      ComputePrecoder(mat_csi, calib_gather_buffer_,
+                      ul_zf_matrices_[frame_slot][cur_sc_id],
+                      dl_zf_matrices_[frame_slot][cur_sc_id]);
+    }
+    duration_stat_->task_duration_[3] += GetTime::WorkerRdtsc() - start_tsc4;
+  }
+
+  duration_stat_->task_count_ += kCholeskyLanes;
+  duration_stat_->task_duration_[0] += GetTime::WorkerRdtsc() - start_tsc1;
+}
+
 void DoZF::ZfTimeOrthogonal(size_t tag) {
   const size_t frame_id = gen_tag_t(tag).frame_id_;
   const size_t base_sc_id = gen_tag_t(tag).sc_id_;
@@ -169,86 +415,248 @@ void DoZF::ZfTimeOrthogonal(size_t tag) {
   size_t num_subcarriers =
       std::min(cfg_->ZfBlockSize(), cfg_->OfdmDataNum() - base_sc_id);
 
-  // Handle each subcarrier one by one
-  for (size_t i = 0; i < num_subcarriers; i++) {
-    size_t start_tsc1 = GetTime::WorkerRdtsc();
+  // Handle each subcarrier one by one, or aligned runs of kCholeskyLanes
+  // subcarriers together
+  size_t i = 0;
+  while (i < num_subcarriers) {
     const size_t cur_sc_id = base_sc_id + i;
+    if ((simd_zf_ != nullptr) && (cur_sc_id % kCholeskyLanes == 0) &&
+        (i + kCholeskyLanes <= num_subcarriers)) {
+      ZfSimdCholesky(frame_id, cur_sc_id);
+      i += kCholeskyLanes;
+      continue;
+    }
+    i++;
+    ZfSubcarrier(frame_id, cur_sc_id);
+  }
+}
 
-    // Gather CSI matrices of each pilot from partially-transposed CSIs.
-    for (size_t ue_idx = 0; ue_idx < cfg_->UeNum(); ue_idx++) {
-      auto* dst_csi_ptr = reinterpret_cast<float*>(csi_gather_buffer_ +
-                                                   cfg_->BsAntNum() * ue_idx);
-      if (kUsePartialTrans) {
-        PartialTransposeGather(cur_sc_id,
-                               (float*)csi_buffers_[frame_slot][ue_idx],
-                               dst_csi_ptr, cfg_->BsAntNum());
+void DoZF::ZfSubcarrier(size_t frame_id, size_t sc_id) {
+  const size_t frame_slot = frame_id % kFrameWnd;
+  size_t start_tsc1 = GetTime::WorkerRdtsc();
+  GatherCsi(frame_slot, sc_id, csi_gather_buffer_);
+
+  size_t start_tsc2 = GetTime::WorkerRdtsc();
+  duration_stat_->task_duration_[1] += start_tsc2 - start_tsc1;
+
+  arma::cx_fmat mat_csi((arma::cx_float*)csi_gather_buffer_, cfg_->BsAntNum(),
+                        cfg_->UeNum(), false);
+
+  if (cfg_->Frame().NumDLSyms() > 0) {
+    ComputeCalib(frame_id, sc_id);
+
+    if (cfg_->ExternalRefNode()) {
+      mat_csi.shed_rows(cfg_->RefAnt(),
+                        cfg_->RefAnt() + cfg_->NumChannels() - 1);
+    }
+  }
+
+  double start_tsc3 = GetTime::WorkerRdtsc();
+  duration_stat_->task_duration_[2] += start_tsc3 - start_tsc2;
+
+  if (cfg_->ZfApproxIters() > 0) {
+    ComputePrecoderApprox(mat_csi, frame_id, sc_id, calib_gather_buffer_,
+                          ul_zf_matrices_[frame_slot][sc_id],
+                          dl_zf_matrices_[frame_slot][sc_id]);
+  } else {
+    ComputePrecoder(mat_csi, calib_gather_buffer_,
+                    ul_zf_matrices_[frame_slot][sc_id],
+                    dl_zf_matrices_[frame_slot][sc_id]);
+  }
+
+  duration_stat_->task_duration_[3] += GetTime::WorkerRdtsc() - start_tsc3;
+  duration_stat_->task_count_++;
+  duration_stat_->task_duration_[0] += GetTime::WorkerRdtsc() - start_tsc1;
+  // if (duration > 500) {
+  //     std::printf("Thread %d ZF takes %.2f\n", tid, duration);
+  // }
+}
+
+void DoZF::ZfTimeOrthogonalInterp(size_t tag) {
+  const size_t frame_id = gen_tag_t(tag).frame_id_;
+  const size_t base_sc_id = gen_tag_t(tag).sc_id_;
+  const size_t frame_slot = frame_id % kFrameWnd;
+  if (kDebugPrintInTask) {
+    std::printf("In doZF thread %d: frame: %zu, base subcarrier: %zu\n", tid_,
+                frame_id, base_sc_id);
+  }
+  const size_t num_subcarriers =
+      std::min(cfg_->ZfBlockSize(), cfg_->OfdmDataNum() - base_sc_id);
+
+  // The other ZF blocks may not be done, so the last subcarrier of the block
+  // is inverted too, instead of extrapolating to it
+  interp_anchors_.clear();
+  for (size_t i = 0; i < num_subcarriers; i += cfg_->ZfInterpStride()) {
+    interp_anchors_.push_back(i);
+  }
+  if (interp_anchors_.back() != num_subcarriers - 1) {
+    interp_anchors_.push_back(num_subcarriers - 1);
+  }
+  for (size_t i : interp_anchors_) {
+    ZfSubcarrier(frame_id, base_sc_id + i);
+  }
+
+  size_t start_tsc = GetTime::WorkerRdtsc();
+  InterpolateMatrices(ul_zf_matrices_, frame_slot, base_sc_id);
+  if (cfg_->Frame().NumDLSyms() > 0) {
+    InterpolateMatrices(dl_zf_matrices_, frame_slot, base_sc_id);
+  }
+  const size_t duration = GetTime::WorkerRdtsc() - start_tsc;
+  duration_stat_->task_duration_[3] += duration;
+  duration_stat_->task_duration_[0] += duration;
+  duration_stat_->task_count_ += num_subcarriers - interp_anchors_.size();
+}
+
+void DoZF::InterpolateMatrices(
+    PtrGrid<kFrameWnd, kMaxDataSCs, complex_float>& matrices,
+    size_t frame_slot, size_t base_sc_id) {
+  const size_t num_elems = cfg_->BsAntNum() * cfg_->UeNum();
+  auto* const* mats = &matrices[frame_slot][base_sc_id];
+  const size_t num_anchors = interp_anchors_.size();
+
+  // Slope, per subcarrier, of the spline at anchor k: the central difference
+  // of the neighbouring anchors, or the one-sided one at the ends
+  auto slope = [&](size_t k) {
+    const size_t lo = (k == 0) ? k : k - 1;
+    const size_t hi = (k == num_anchors - 1) ? k : k + 1;
+    arma::cx_fvec p_lo(reinterpret_cast<arma::cx_float*>(
+                           mats[interp_anchors_[lo]]),
+                       num_elems, false);
+    arma::cx_fvec p_hi(reinterpret_cast<arma::cx_float*>(
+                           mats[interp_anchors_[hi]]),
+                       num_elems, false);
+    return arma::cx_fvec((p_hi - p_lo) / static_cast<float>(
+                                             interp_anchors_[hi] -
+                                             interp_anchors_[lo]));
+  };
+
+  for (size_t k = 0; k + 1 < num_anchors; k++) {
+    const size_t x0 = interp_anchors_[k];
+    const size_t x1 = interp_anchors_[k + 1];
+    if (x1 - x0 < 2) {
+      continue;
+    }
+    arma::cx_fvec p0(reinterpret_cast<arma::cx_float*>(mats[x0]), num_elems,
+                     false);
+    arma::cx_fvec p1(reinterpret_cast<arma::cx_float*>(mats[x1]), num_elems,
+                     false);
+    const auto d = static_cast<float>(x1 - x0);
+    arma::cx_fvec m0;
+    arma::cx_fvec m1;
+    if (interp_spline_ == true) {
+      m0 = slope(k) * d;
+      m1 = slope(k + 1) * d;
+    }
+    for (size_t x = x0 + 1; x < x1; x++) {
+      arma::cx_fvec out(reinterpret_cast<arma::cx_float*>(mats[x]), num_elems,
+                        false);
+      const float t = (x - x0) / d;
+      if (interp_spline_ == true) {
+        // Cubic Hermite basis
+        const float t2 = t * t;
+        const float t3 = t2 * t;
+        out = (2 * t3 - 3 * t2 + 1) * p0 + (t3 - 2 * t2 + t) * m0 +
+              (-2 * t3 + 3 * t2) * p1 + (t3 - t2) * m1;
       } else {
-        TransposeGather(cur_sc_id, (float*)csi_buffers_[frame_slot][ue_idx],
-                        dst_csi_ptr, cfg_->BsAntNum(), cfg_->OfdmDataNum());
+        out = (1 - t) * p0 + t * p1;
       }
     }
+  }
+}
 
-    size_t start_tsc2 = GetTime::WorkerRdtsc();
-    duration_stat_->task_duration_[1] += start_tsc2 - start_tsc1;
+void DoZF::ZfTimeOrthogonalBatch(size_t tag) {
+  const size_t frame_id = gen_tag_t(tag).frame_id_;
+  const size_t base_sc_id = gen_tag_t(tag).sc_id_;
+  const size_t frame_slot = frame_id % kFrameWnd;
+  if (kDebugPrintInTask) {
+    std::printf("In doZF thread %d: frame: %zu, base subcarrier: %zu\n", tid_,
+                frame_id, base_sc_id);
+  }
+  const size_t num_subcarriers =
+      std::min(cfg_->ZfBlockSize(), cfg_->OfdmDataNum() - base_sc_id);
+  const size_t bs_ant_num = cfg_->BsAntNum();
+  const size_t ue_num = cfg_->UeNum();
 
-    arma::cx_fmat mat_csi((arma::cx_float*)csi_gather_buffer_, cfg_->BsAntNum(),
-                          cfg_->UeNum(), false);
+  size_t start_tsc1 = GetTime::WorkerRdtsc();
 
-    if (cfg_->Frame().NumDLSyms() > 0) {
-      arma::cx_fvec calib_vec(
-          reinterpret_cast<arma::cx_float*>(calib_gather_buffer_),
-          cfg_->BfAntNum(), false);
-      size_t frame_cal_slot = kFrameWnd - 1;
-      size_t frame_cal_slot_prev = kFrameWnd - 1;
-      if (cfg_->Frame().IsRecCalEnabled() && frame_id >= TX_FRAME_DELTA) {
-        size_t frame_grp_id = (frame_id - TX_FRAME_DELTA) / cfg_->AntGroupNum();
-
-        // use the previous window which has a full set of calibration results
-        frame_cal_slot = (frame_grp_id + kFrameWnd - 1) % kFrameWnd;
-        if (frame_id >= TX_FRAME_DELTA + cfg_->AntGroupNum()) {
-          frame_cal_slot_prev = (frame_grp_id + kFrameWnd - 2) % kFrameWnd;
-        }
-      }
-      arma::cx_fmat calib_dl_mat(
-          reinterpret_cast<arma::cx_float*>(calib_dl_buffer_[frame_cal_slot]),
-          cfg_->OfdmDataNum(), cfg_->BfAntNum(), false);
-      arma::cx_fmat calib_ul_mat(
-          reinterpret_cast<arma::cx_float*>(calib_ul_buffer_[frame_cal_slot]),
-          cfg_->OfdmDataNum(), cfg_->BfAntNum(), false);
-      arma::cx_fmat calib_dl_mat_prev(
-          reinterpret_cast<arma::cx_float*>(
-              calib_dl_buffer_[frame_cal_slot_prev]),
-          cfg_->OfdmDataNum(), cfg_->BfAntNum(), false);
-      arma::cx_fmat calib_ul_mat_prev(
-          reinterpret_cast<arma::cx_float*>(
-              calib_ul_buffer_[frame_cal_slot_prev]),
-          cfg_->OfdmDataNum(), cfg_->BfAntNum(), false);
-      arma::cx_fvec calib_dl_vec =
-          (calib_dl_mat.row(cur_sc_id) + calib_dl_mat_prev.row(cur_sc_id)).st();
-      arma::cx_fvec calib_ul_vec =
-          (calib_ul_mat.row(cur_sc_id) + calib_ul_mat_prev.row(cur_sc_id)).st();
-      calib_vec = calib_dl_vec / calib_ul_vec;
-
-      if (cfg_->ExternalRefNode()) {
-        mat_csi.shed_rows(cfg_->RefAnt(),
-                          cfg_->RefAnt() + cfg_->NumChannels() - 1);
-      }
+  // Gather the CSI matrices of all subcarriers
+  for (size_t i = 0; i < num_subcarriers; i++) {
+    GatherCsi(frame_slot, base_sc_id + i,
+              csi_batch_buffer_ + i * ue_num * bs_ant_num);
+  }
+
+  size_t start_tsc2 = GetTime::WorkerRdtsc();
+  duration_stat_->task_duration_[1] += start_tsc2 - start_tsc1;
+
+  // W_zf' = H * inv(H' * H) for all subcarriers at once. H' * H = L * L' is
+  // factorized, and H is solved in place against L', then L. With the MMSE
+  // beamformer, the Gram matrices are accumulated onto the diagonal load.
+  const auto m = static_cast<MKL_INT>(bs_ant_num);
+  const auto u = static_cast<MKL_INT>(ue_num);
+  const auto nm = static_cast<MKL_INT>(num_subcarriers);
+  const MKL_Complex8 one = {1.0f, 0.0f};
+  const MKL_Complex8 zero = {0.0f, 0.0f};
+  MKL_INT info = 0;
+  mkl_cgepack_compact(MKL_COL_MAJOR, m, u, csi_batch_ptrs_.data(), m,
+                      csi_compact_, m, compact_format_, nm);
+  if (mmse_ == true) {
+    for (size_t i = 0; i < ue_num; i++) {
+      gram_load_buffer_[i * ue_num + i] = {diag_load_, 0.0f};
     }
+    mkl_cgepack_compact(MKL_COL_MAJOR, u, u, gram_load_ptrs_.data(), u,
+                        gram_compact_, u, compact_format_, nm);
+  }
+  mkl_cgemm_compact(MKL_COL_MAJOR, MKL_CONJTRANS, MKL_NOTRANS, u, u, m, &one,
+                    csi_compact_, m, csi_compact_, m,
+                    (mmse_ == true) ? &one : &zero, gram_compact_, u,
+                    compact_format_, nm);
+  mkl_cpotrf_compact(MKL_COL_MAJOR, MKL_LOWER, u, gram_compact_, u, &info,
+                     compact_format_, nm);
+  RtAssert(info >= 0, "Batched Cholesky factorization has an invalid argument");
+  mkl_ctrsm_compact(MKL_COL_MAJOR, MKL_RIGHT, MKL_LOWER, MKL_CONJTRANS,
+                    MKL_NONUNIT, m, u, &one, gram_compact_, u, csi_compact_, m,
+                    compact_format_, nm);
+  mkl_ctrsm_compact(MKL_COL_MAJOR, MKL_RIGHT, MKL_LOWER, MKL_NOTRANS,
+                    MKL_NONUNIT, m, u, &one, gram_compact_, u, csi_compact_, m,
+                    compact_format_, nm);
+  mkl_cgeunpack_compact(MKL_COL_MAJOR, m, u, zf_batch_ptrs_.data(), m,
+                        csi_compact_, m, compact_format_, nm);
+
+  size_t start_tsc3 = GetTime::WorkerRdtsc();
+  duration_stat_->task_duration_[3] += start_tsc3 - start_tsc2;
 
-    double start_tsc3 = GetTime::WorkerRdtsc();
-    duration_stat_->task_duration_[2] += start_tsc3 - start_tsc2;
+  for (size_t i = 0; i < num_subcarriers; i++) {
+    const size_t cur_sc_id = base_sc_id + i;
+    const size_t offset = i * bs_ant_num * ue_num;
+    arma::cx_fmat mat_ul_zf_tmp =
+        arma::cx_fmat(reinterpret_cast<arma::cx_float*>(zf_batch_buffer_ +
+                                                        offset),
+                      bs_ant_num, ue_num, false)
+            .t();
+    // A Gram matrix that is not positive definite leaves NaNs behind
+    if (mat_ul_zf_tmp.is_finite() == false) {
+      MLPD_WARN("Failed to invert channel matrix, falling back to pinv()\n");
+      arma::cx_fmat mat_csi(
+          reinterpret_cast<arma::cx_float*>(csi_batch_buffer_ + offset),
+          bs_ant_num, ue_num, false);
+      arma::pinv(mat_ul_zf_tmp, mat_csi, 1e-2, "dc");
+    }
 
-    ComputePrecoder(mat_csi, calib_gather_buffer_,
-                    ul_zf_matrices_[frame_slot][cur_sc_id],
-                    dl_zf_matrices_[frame_slot][cur_sc_id]);
+    size_t start_tsc4 = GetTime::WorkerRdtsc();
+    if (cfg_->Frame().NumDLSyms() > 0) {
+      ComputeCalib(frame_id, cur_sc_id);
+    }
+    size_t start_tsc5 = GetTime::WorkerRdtsc();
+    duration_stat_->task_duration_[2] += start_tsc5 - start_tsc4;
 
-    duration_stat_->task_duration_[3] += GetTime::WorkerRdtsc() - start_tsc3;
-    duration_stat_->task_count_++;
-    duration_stat_->task_duration_[0] += GetTime::WorkerRdtsc() - start_tsc1;
-    // if (duration > 500) {
-    //     std::printf("Thread %d ZF takes %.2f\n", tid, duration);
-    // }
+    StorePrecoders(mat_ul_zf_tmp, calib_gather_buffer_,
+                   ul_zf_matrices_[frame_slot][cur_sc_id],
+                   dl_zf_matrices_[frame_slot][cur_sc_id]);
+    duration_stat_->task_duration_[3] += GetTime::WorkerRdtsc() - start_tsc5;
   }
+
+  duration_stat_->task_count_ += num_subcarriers;
+  duration_stat_->task_duration_[0] += GetTime::WorkerRdtsc() - start_tsc1;
 }
 
 void DoZF::ZfFreqOrthogonal(size_t tag) {
@@ -278,39 +686,7 @@ void DoZF::ZfFreqOrthogonal(size_t tag) {
   duration_stat_->task_duration_[1] += start_tsc2 - start_tsc1;
 
   if (cfg_->Frame().NumDLSyms() > 0) {
-    arma::cx_fvec calib_vec(
-        reinterpret_cast<arma::cx_float*>(calib_gather_buffer_),
-        cfg_->BfAntNum(), false);
-    size_t frame_cal_slot = kFrameWnd - 1;
-    size_t frame_cal_slot_prev = kFrameWnd - 1;
-    if (cfg_->Frame().IsRecCalEnabled() && (frame_id >= TX_FRAME_DELTA)) {
-      size_t frame_grp_id = (frame_id - TX_FRAME_DELTA) / cfg_->AntGroupNum();
-
-      // use the previous window which has a full set of calibration results
-      frame_cal_slot = (frame_grp_id + kFrameWnd - 1) % kFrameWnd;
-      if (frame_id >= TX_FRAME_DELTA + cfg_->AntGroupNum()) {
-        frame_cal_slot_prev = (frame_grp_id + kFrameWnd - 2) % kFrameWnd;
-      }
-    }
-    arma::cx_fmat calib_dl_mat(
-        reinterpret_cast<arma::cx_float*>(calib_dl_buffer_[frame_cal_slot]),
-        cfg_->OfdmDataNum(), cfg_->BfAntNum(), false);
-    arma::cx_fmat calib_ul_mat(
-        reinterpret_cast<arma::cx_float*>(calib_ul_buffer_[frame_cal_slot]),
-        cfg_->OfdmDataNum(), cfg_->BfAntNum(), false);
-    arma::cx_fmat calib_dl_mat_prev(reinterpret_cast<arma::cx_float*>(
-                                        calib_dl_buffer_[frame_cal_slot_prev]),
-                                    cfg_->OfdmDataNum(), cfg_->BfAntNum(),
-                                    false);
-    arma::cx_fmat calib_ul_mat_prev(reinterpret_cast<arma::cx_float*>(
-                                        calib_ul_buffer_[frame_cal_slot_prev]),
-                                    cfg_->OfdmDataNum(), cfg_->BfAntNum(),
-                                    false);
-    arma::cx_fvec calib_dl_vec =
-        (calib_dl_mat.row(base_sc_id) + calib_dl_mat_prev.row(base_sc_id)).st();
-    arma::cx_fvec calib_ul_vec =
-        (calib_ul_mat.row(base_sc_id) + calib_ul_mat_prev.row(base_sc_id)).st();
-    calib_vec = calib_dl_vec / calib_ul_vec;
+    ComputeCalib(frame_id, base_sc_id);
   }
 
   double start_tsc3 = GetTime::WorkerRdtsc();
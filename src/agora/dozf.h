@@ -7,12 +7,16 @@
 
 #include <armadillo>
 #include <iostream>
+#include <vector>
 
 #include "buffer.h"
 #include "concurrentqueue.h"
 #include "config.h"
 #include "doer.h"
 #include "gettime.h"
+#include "iterative_zf.h"
+#include "phy_stats.h"
+#include "simd_cholesky.h"
 #include "stats.h"
 #include "symbols.h"
 #include "utils.h"
@@ -25,7 +29,7 @@ class DoZF : public Doer {
        Table<complex_float>& calib_ul_buffer,
        PtrGrid<kFrameWnd, kMaxDataSCs, complex_float>& ul_zf_matrices_,
        PtrGrid<kFrameWnd, kMaxDataSCs, complex_float>& dl_zf_matrices_,
-       Stats* stats_manager);
+       PhyStats* in_phy_stats, Stats* stats_manager);
   ~DoZF() override;
 
   /**
@@ -46,14 +50,67 @@ class DoZF : public Doer {
    */
   EventData Launch(size_t tag) override;
 
+  /// Number of subcarriers whose approximate detector missed
+  /// ZfApproxMaxResidual() and was computed exactly instead
+  size_t NumApproxFallbacks() const { return num_approx_fallbacks_; }
+
  private:
   void ZfTimeOrthogonal(size_t tag);
 
+  /// Compute the zeroforcing detector and precoder of one subcarrier with
+  /// time-orthogonal pilots
+  void ZfSubcarrier(size_t frame_id, size_t sc_id);
+
+  /// Invert every ZfInterpStride()-th subcarrier of a ZF block and its last
+  /// subcarrier, and interpolate the ZF matrices of the others
+  void ZfTimeOrthogonalInterp(size_t tag);
+
+  /// Interpolate the matrices of the subcarriers of a ZF block starting at
+  /// base_sc_id between those of interp_anchors_
+  void InterpolateMatrices(
+      PtrGrid<kFrameWnd, kMaxDataSCs, complex_float>& matrices,
+      size_t frame_slot, size_t base_sc_id);
+
+  /// Compute the zeroforcing detectors of the kCholeskyLanes subcarriers
+  /// starting at base_sc_id with SIMD Cholesky factorizations
+  void ZfSimdCholesky(size_t frame_id, size_t base_sc_id);
+
+  /// Compute the zeroforcing detectors of all subcarriers of a ZF block at
+  /// once: the CSI matrices are interleaved in MKL's compact format, and the
+  /// Gram matrices are formed, factorized and solved with one call each
+  void ZfTimeOrthogonalBatch(size_t tag);
+
+  /// The diagonal load of the Gram matrices of a frame: the pilot noise power
+  /// with the MMSE beamformer, or zero for zeroforcing
+  float DiagLoad(size_t frame_id);
+
   /// Compute the uplink zeroforcing detector matrix and/or the downlink
-  /// zeroforcing precoder using this CSI matrix and calibration buffer
+  /// zeroforcing precoder using this CSI matrix and calibration buffer. With
+  /// the MMSE beamformer, diag_load_ regularizes the inversion.
   void ComputePrecoder(const arma::cx_fmat& mat_csi, complex_float* calib_ptr,
                        complex_float* mat_ul_zf, complex_float* mat_dl_zf);
 
+  /// Like ComputePrecoder, but approximate the uplink detector with
+  /// ZfApproxIters() iterations, warm-started from the detector of subcarrier
+  /// sc_id in the previous frame if enabled. Invert exactly if the residual
+  /// is too large.
+  void ComputePrecoderApprox(const arma::cx_fmat& mat_csi, size_t frame_id,
+                             size_t sc_id, complex_float* calib_ptr,
+                             complex_float* mat_ul_zf,
+                             complex_float* mat_dl_zf);
+
+  /// Store the uplink zeroforcing detector mat_ul_zf_tmp, and derive and
+  /// store the downlink precoder from it and the calibration buffer
+  void StorePrecoders(arma::cx_fmat& mat_ul_zf_tmp, complex_float* calib_ptr,
+                      complex_float* mat_ul_zf, complex_float* mat_dl_zf);
+
+  /// Gather the CSI matrix of subcarrier sc_id into dst
+  void GatherCsi(size_t frame_slot, size_t sc_id, complex_float* dst);
+
+  /// Compute the reciprocity calibration vector of subcarrier sc_id into
+  /// calib_gather_buffer_
+  void ComputeCalib(size_t frame_id, size_t sc_id);
+
   void ZfFreqOrthogonal(size_t tag);
 
   /**
@@ -86,11 +143,45 @@ class DoZF : public Doer {
   Table<complex_float> calib_ul_buffer_;
   PtrGrid<kFrameWnd, kMaxDataSCs, complex_float>& ul_zf_matrices_;
   PtrGrid<kFrameWnd, kMaxDataSCs, complex_float>& dl_zf_matrices_;
+  PhyStats* phy_stats_;
   DurationStat* duration_stat_;
 
   complex_float* csi_gather_buffer_;  // Intermediate buffer to gather CSI
   // Intermediate buffer to gather reciprical calibration data vector
   complex_float* calib_gather_buffer_;
+
+  // Block-local indices of the inverted subcarriers with interpolation
+  std::vector<size_t> interp_anchors_;
+  // Cubic (spline) instead of linear interpolation
+  bool interp_spline_;
+
+  // MMSE instead of zeroforcing, and the diagonal load of the Gram matrices
+  // of the frame being processed
+  bool mmse_;
+  float diag_load_ = 0.0f;
+
+  IterativeZfMethod approx_method_;
+  size_t num_approx_fallbacks_ = 0;
+
+  // The SIMD Cholesky zeroforcing for the UE count, or nullptr if it is not
+  // used
+  SimdZfCholeskyFn simd_zf_ = nullptr;
+
+  // Buffers of batched inversion, allocated if it is enabled
+  // The CSI matrices of a ZF block, then the conjugate transposes of the
+  // zeroforcing detectors
+  complex_float* csi_batch_buffer_ = nullptr;
+  complex_float* zf_batch_buffer_ = nullptr;
+  // The CSI matrices and the Gram matrices in MKL's compact format
+  float* csi_compact_ = nullptr;
+  float* gram_compact_ = nullptr;
+  // The diagonal load of the MMSE beamformer, as a Gram matrix to add to
+  // those of all subcarriers
+  complex_float* gram_load_buffer_ = nullptr;
+  std::vector<const MKL_Complex8*> gram_load_ptrs_;
+  MKL_COMPACT_PACK compact_format_;
+  std::vector<const MKL_Complex8*> csi_batch_ptrs_;
+  std::vector<MKL_Complex8*> zf_batch_ptrs_;
 };
 
 #endif  // DOZF_H_
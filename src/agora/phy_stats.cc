@@ -4,7 +4,10 @@
  */
 #include "phy_stats.h"
 
+#include <algorithm>
 #include <cmath>
+#include <cstdio>
+#include <string>
 
 PhyStats::PhyStats(Config* const cfg) : config_(cfg) {
   if (config_->IsUe() == true) {
@@ -31,6 +34,10 @@ PhyStats::PhyStats(Config* const cfg) : config_(cfg) {
 
   evm_buffer_.Calloc(kFrameWnd, cfg->UeAntNum(),
                      Agora_memory::Alignment_t::kAlign64);
+  evm_sc_sum_.Calloc(kFrameWnd, cfg->OfdmDataNum() * cfg->UeAntNum(),
+                     Agora_memory::Alignment_t::kAlign64);
+  evm_sc_count_.Calloc(kFrameWnd, cfg->OfdmDataNum(),
+                       Agora_memory::Alignment_t::kAlign64);
 
   if (num_rx_symbols_ > 0) {
     if (config_->IsUe() == true) {
@@ -50,6 +57,8 @@ PhyStats::PhyStats(Config* const cfg) : config_(cfg) {
   }
   pilot_snr_.Calloc(kFrameWnd, cfg->UeAntNum(),
                     Agora_memory::Alignment_t::kAlign64);
+  pilot_noise_.Calloc(kFrameWnd, cfg->UeAntNum(),
+                      Agora_memory::Alignment_t::kAlign64);
 }
 
 PhyStats::~PhyStats() {
@@ -64,6 +73,9 @@ PhyStats::~PhyStats() {
 
   evm_buffer_.Free();
   pilot_snr_.Free();
+  pilot_noise_.Free();
+  evm_sc_sum_.Free();
+  evm_sc_count_.Free();
 }
 
 void PhyStats::PrintPhyStats() {
@@ -99,6 +111,56 @@ void PhyStats::PrintPhyStats() {
   }
 }
 
+void PhyStats::PrintZfTradeoff(double zf_us_per_frame) {
+  if (num_rx_symbols_ == 0) {
+    return;
+  }
+  const std::string inversion =
+      (config_->ZfApproxIters() > 0)
+          ? std::to_string(config_->ZfApproxIters()) + " " +
+                config_->ZfApproxMethod() + " iterations"
+          : "exact inversion";
+  std::printf(
+      "ZF tradeoff: %s beamformer, %s, inverting every %zu subcarriers (%s), "
+      "ZF %.1f us per frame\n",
+      config_->Beamformer().c_str(), inversion.c_str(),
+      config_->ZfInterpStride(), config_->ZfInterpMode().c_str(),
+      zf_us_per_frame);
+  const size_t task_buffer_symbol_num = num_rx_symbols_ * kFrameWnd;
+  // Fold the accumulators of all frame slots
+  size_t num_evm_symbols = 0;
+  for (size_t i = 0; i < kFrameWnd; i++) {
+    for (size_t sc_id = 0; sc_id < config_->OfdmDataNum(); sc_id++) {
+      num_evm_symbols += evm_sc_count_[i][sc_id];
+    }
+  }
+  for (size_t ue_id = 0; ue_id < config_->UeNum(); ue_id++) {
+    double evm_sum = 0;
+    for (size_t i = 0; i < kFrameWnd; i++) {
+      for (size_t sc_id = 0; sc_id < config_->OfdmDataNum(); sc_id++) {
+        evm_sum += evm_sc_sum_[i][sc_id * config_->UeAntNum() + ue_id];
+      }
+    }
+    const double evm =
+        std::sqrt(evm_sum / std::max<size_t>(num_evm_symbols, 1));
+    size_t uncoded_bits = 0;
+    size_t uncoded_bit_errors = 0;
+    size_t decoded_bits = 0;
+    size_t bit_errors = 0;
+    for (size_t i = 0; i < task_buffer_symbol_num; i++) {
+      uncoded_bits += uncoded_bits_count_[ue_id][i];
+      uncoded_bit_errors += uncoded_bit_error_count_[ue_id][i];
+      decoded_bits += decoded_bits_count_[ue_id][i];
+      bit_errors += bit_error_count_[ue_id][i];
+    }
+    std::printf(
+        "  UE %zu: EVM %.2f%% (SNR %.1f dB), uncoded BER %.2e, BER %.2e\n",
+        ue_id, 100 * evm, -20 * std::log10(evm),
+        1.0 * uncoded_bit_errors / std::max<size_t>(uncoded_bits, 1),
+        1.0 * bit_errors / std::max<size_t>(decoded_bits, 1));
+  }
+}
+
 void PhyStats::PrintEvmStats(size_t frame_id) {
   arma::fmat evm_mat(evm_buffer_[frame_id % kFrameWnd], config_->UeNum(), 1,
                      false);
@@ -138,9 +200,20 @@ void PhyStats::UpdatePilotSnr(size_t frame_id, size_t ue_id,
       fft_abs_mag.rows(config_->OfdmDataStop(), config_->OfdmCaNum() - 1)));
   float noise = config_->OfdmCaNum() * (noise_per_sc1 + noise_per_sc2) / 2;
   float snr = (rssi - noise) / noise;
+  pilot_noise_[frame_id % kFrameWnd][ue_id] =
+      (noise_per_sc1 + noise_per_sc2) / 2;
   pilot_snr_[frame_id % kFrameWnd][ue_id] = 10 * std::log10(snr);
 }
 
+float PhyStats::GetPilotNoise(size_t frame_id) {
+  const size_t num_pilots = config_->Frame().NumPilotSyms();
+  float noise = 0;
+  for (size_t i = 0; i < num_pilots; i++) {
+    noise += pilot_noise_[frame_id % kFrameWnd][i];
+  }
+  return noise / num_pilots;
+}
+
 void PhyStats::UpdateEvmStats(size_t frame_id, size_t sc_id,
                               const arma::cx_fmat& eq) {
   if (num_rx_symbols_ > 0) {
@@ -148,6 +221,14 @@ void PhyStats::UpdateEvmStats(size_t frame_id, size_t sc_id,
     arma::fmat cur_evm_mat(evm_buffer_[frame_id % kFrameWnd], config_->UeNum(),
                            1, false);
     cur_evm_mat += evm % evm;
+
+    // Only one demul task per frame measures a subcarrier, and frames that
+    // share a slot are not processed at once, so these need no atomics
+    arma::fmat sc_evm_mat(
+        &evm_sc_sum_[frame_id % kFrameWnd][sc_id * config_->UeAntNum()],
+        config_->UeNum(), 1, false);
+    sc_evm_mat += evm % evm;
+    evm_sc_count_[frame_id % kFrameWnd][sc_id]++;
   }
 }
 
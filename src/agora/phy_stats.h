@@ -34,7 +34,14 @@ class PhyStats {
   void UpdatePilotSnr(size_t /*frame_id*/, size_t /*ue_id*/,
                       complex_float* /*fft_data*/);
   float GetEvmSnr(size_t frame_id, size_t ue_id);
+  /// The noise power per subcarrier measured on the guard bands of the pilot
+  /// symbols of a frame, averaged over the pilot symbols
+  float GetPilotNoise(size_t frame_id);
   void PrintSnrStats(size_t /*frame_id*/);
+  /// Print the EVM and bit error rates of all frames next to the ZF cost, to
+  /// weigh ZF interpolation (zf_interp_stride), approximate ZF or the
+  /// beamformer against its accuracy
+  void PrintZfTradeoff(double zf_us_per_frame);
 
  private:
   Config const* const config_;
@@ -46,6 +53,12 @@ class PhyStats {
   Table<size_t> uncoded_bit_error_count_;
   Table<float> evm_buffer_;
   Table<float> pilot_snr_;
+  Table<float> pilot_noise_;
+  // Squared errors of all frames, per frame slot, subcarrier and UE, and the
+  // number of symbols measured on each subcarrier per frame slot. Folded
+  // over the frame slots when printed.
+  Table<float> evm_sc_sum_;
+  Table<size_t> evm_sc_count_;
 
   arma::cx_fmat gt_mat_;
   size_t num_rx_symbols_;
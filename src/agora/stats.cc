@@ -84,6 +84,18 @@ void Stats::UpdateStats(size_t frame_id) {
   this->last_frame_id_ = frame_id;
   size_t frame_slot = (frame_id % kNumStatsFrames);
 
+  this->master_loop_us_.at(frame_slot) = GetTime::CyclesToUs(
+      this->master_loop_cycles_ - this->master_loop_cycles_old_, freq_ghz_);
+  this->master_loop_cycles_old_ = this->master_loop_cycles_;
+
+  const size_t deadline_misses =
+      this->pending_deadline_misses_.at(frame_id % kFrameWnd).exchange(0);
+  this->deadline_misses_.at(frame_slot) = deadline_misses;
+  if (deadline_misses > 0) {
+    this->total_deadline_misses_ += deadline_misses;
+    this->frames_with_deadline_misses_++;
+  }
+
   if (kIsWorkerTimingEnabled == true) {
     std::vector<FrameSummary> work_summary(kAllDoerTypes.size());
     for (size_t i = 0u; i < task_thread_num_; i++) {
@@ -126,11 +138,32 @@ void Stats::UpdateStats(size_t frame_id) {
       for (size_t i = 0u; i < kAllDoerTypes.size(); i++) {
         PrintPerFrame(kDoerNames.at(kAllDoerTypes.at(i)), work_summary.at(i));
       }
-      std::printf("Total: %.2f ms\n", sum_us / 1000);
+      std::printf(
+          "Total: %.2f ms, Master: %.1f us, Deadline misses: %zu\n",
+          sum_us / 1000, this->master_loop_us_.at(frame_slot),
+          this->deadline_misses_.at(frame_slot));
     }
   }
 }
 
+void Stats::MasterAddDroppedFrame(size_t frame_id) {
+  this->num_dropped_frames_++;
+  this->pending_deadline_misses_.at(frame_id % kFrameWnd) = 0;
+}
+
+void Stats::MasterAddLatePacket(size_t frame_id) {
+  this->num_late_packets_++;
+  if (frame_id != this->last_late_frame_) {
+    this->num_late_frames_++;
+    this->last_late_frame_ = frame_id;
+  }
+}
+
+void Stats::MasterAddIncompleteSymbol(size_t num_missing) {
+  this->num_incomplete_symbols_++;
+  this->num_filled_packets_ += num_missing;
+}
+
 void Stats::SaveToFile() {
   std::string cur_directory = TOSTRING(PROJECT_DIRECTORY);
   std::string filename = cur_directory + "/data/timeresult.txt";
@@ -317,8 +350,66 @@ size_t Stats::GetTotalTaskCount(DoerType doer_type, size_t thread_num) {
   return total_count;
 }
 
+size_t Stats::GetTotalTaskCycles(DoerType doer_type, size_t thread_num) {
+  size_t total_cycles = 0;
+  for (size_t i = 0; i < thread_num; i++) {
+    total_cycles += GetDurationStat(doer_type, i)->task_duration_[0];
+  }
+  return total_cycles;
+}
+
+void Stats::PrintIdleStats(const std::string& thread_type,
+                           const IdleStat* idle_stats,
+                           size_t thread_num) const {
+  const size_t now_tsc = GetTime::Rdtsc();
+  for (size_t i = 0; i < thread_num; i++) {
+    const IdleStat& stat = idle_stats[i];
+    if (stat.start_tsc_ == 0) {
+      continue;
+    }
+    std::printf("Stats: %s thread %zu idle %.1f%% of %.2f s, %zu sleeps\n",
+                thread_type.c_str(), i,
+                stat.idle_cycles_ * 100.0 / (now_tsc - stat.start_tsc_),
+                GetTime::CyclesToMs(now_tsc - stat.start_tsc_, freq_ghz_) /
+                    1000.0,
+                stat.num_sleeps_);
+  }
+}
+
 void Stats::PrintSummary() {
   std::printf("Stats: total processed frames %zu\n", this->last_frame_id_ + 1);
+  std::printf("Stats: master thread spent %.2f us per frame handling events\n",
+              GetTime::CyclesToUs(this->master_loop_cycles_, freq_ghz_) /
+                  (this->last_frame_id_ + 1));
+  if (this->num_dl_symbols_tx_ > 0) {
+    std::printf(
+        "Stats: downlink symbols took %.2f us on average from the end of "
+        "precoding to the end of TX\n",
+        GetTime::CyclesToUs(this->dl_symbol_latency_cycles_, freq_ghz_) /
+            this->num_dl_symbols_tx_);
+  }
+  PrintIdleStats("TXRX", socket_idle_stats_.data(),
+                 config_->SocketThreadNum());
+  PrintIdleStats("Worker", worker_idle_stats_.data(), task_thread_num_);
+  if (config_->WorkerScheduler() == "edf") {
+    std::printf("Stats: %zu tasks missed their deadline in %zu frames\n",
+                this->total_deadline_misses_,
+                this->frames_with_deadline_misses_);
+  }
+  if (config_->DropLateFrames() == true) {
+    std::printf(
+        "Stats: dropped %zu frames, received %zu late packets of %zu dropped "
+        "frames\n",
+        this->num_dropped_frames_, this->num_late_packets_,
+        this->num_late_frames_);
+  }
+  if (config_->RxSymbolTimeoutUs() > 0) {
+    std::printf(
+        "Stats: %zu incomplete symbols timed out, %zu missing packets "
+        "zero-filled, %zu packets arrived after their symbol timed out\n",
+        this->num_incomplete_symbols_, this->num_filled_packets_,
+        this->num_timed_out_packets_);
+  }
   if (kIsWorkerTimingEnabled == false) {
     std::printf("Stats: Worker timing is disabled. Not printing summary\n");
   } else {
@@ -6,10 +6,12 @@
 #ifndef STATS_H_
 #define STATS_H_
 
+#include <atomic>
 #include <iostream>
 
 #include "config.h"
 #include "gettime.h"
+#include "idle_policy.h"
 #include "memory_manage.h"
 #include "symbols.h"
 
@@ -148,6 +150,85 @@ class Stats {
                                this->freq_ghz_);
   }
 
+  /// From the master, account for cycles spent handling events in the master
+  /// loop. The cycles accumulated between two UpdateStats() calls are
+  /// attributed to the frame passed to the second call.
+  void MasterAddLoopCycles(size_t cycles) {
+    this->master_loop_cycles_ += cycles;
+  }
+
+  /// Get the microseconds the master loop spent handling events for a frame
+  double MasterGetLoopUs(size_t frame_id) const {
+    return this->master_loop_us_.at(frame_id % kNumStatsFrames);
+  }
+
+  /// From a worker, count one task of frame_id that completed after its
+  /// deadline
+  void WorkerAddDeadlineMiss(size_t frame_id) {
+    this->pending_deadline_misses_.at(frame_id % kFrameWnd)
+        .fetch_add(1, std::memory_order_relaxed);
+  }
+
+  /// Get the number of tasks of frame_id that missed their deadline
+  size_t FrameDeadlineMisses(size_t frame_id) const {
+    return this->deadline_misses_.at(frame_id % kNumStatsFrames);
+  }
+
+  /// From the master, count frame_id as dropped because processing fell a
+  /// full frame window behind. Clears the frame's pending per-frame stats.
+  void MasterAddDroppedFrame(size_t frame_id);
+
+  /// From the master, count a packet of frame_id that arrived after the
+  /// frame was dropped
+  void MasterAddLatePacket(size_t frame_id);
+
+  inline size_t NumDroppedFrames() const { return this->num_dropped_frames_; }
+  inline size_t NumLateFrames() const { return this->num_late_frames_; }
+
+  /// From the master, count a symbol that timed out with num_missing
+  /// antennas' packets replaced by zeroed samples
+  void MasterAddIncompleteSymbol(size_t num_missing);
+
+  /// From the master, count a packet that arrived after its symbol timed out
+  inline void MasterAddTimedOutPacket() { this->num_timed_out_packets_++; }
+
+  inline size_t NumIncompleteSymbols() const {
+    return this->num_incomplete_symbols_;
+  }
+
+  /// From the master, record that the precoding of downlink symbol
+  /// symbol_idx_dl of frame_id is done
+  void MasterSetDlSymbolPrecoded(size_t frame_id, size_t symbol_idx_dl) {
+    this->dl_symbol_precoded_tsc_.at(frame_id % kFrameWnd)
+        .at(symbol_idx_dl) = GetTime::Rdtsc();
+  }
+
+  /// From the master, record that all packets of downlink symbol
+  /// symbol_idx_dl of frame_id were sent, and account for the time since its
+  /// precoding was done
+  void MasterAddDlSymbolTx(size_t frame_id, size_t symbol_idx_dl) {
+    const size_t precoded_tsc =
+        this->dl_symbol_precoded_tsc_.at(frame_id % kFrameWnd)
+            .at(symbol_idx_dl);
+    this->dl_symbol_latency_cycles_ += GetTime::Rdtsc() - precoded_tsc;
+    this->num_dl_symbols_tx_++;
+  }
+
+  /// Get the idle time accounting of worker thread thread_id
+  IdleStat* WorkerIdleStat(size_t thread_id) {
+    return &this->worker_idle_stats_.at(thread_id);
+  }
+
+  /// Get the idle time accounting of packet TXRX thread thread_id
+  IdleStat* SocketIdleStat(size_t thread_id) {
+    return &this->socket_idle_stats_.at(thread_id);
+  }
+
+  /// Get the total cycles that threads [0, thread_num) have spent in Doers of
+  /// type doer_type since the start. Reads are not synchronized with the
+  /// workers, so the result may be slightly stale.
+  size_t GetTotalTaskCycles(DoerType doer_type, size_t thread_num);
+
   /// Get the DurationStat object used by thread thread_id for DoerType
   /// doer_type
   DurationStat* GetDurationStat(DoerType doer_type, size_t thread_id) {
@@ -184,6 +265,10 @@ class Stats {
 
   size_t GetTotalTaskCount(DoerType doer_type, size_t thread_num);
 
+  /// Print the fraction of time each thread in idle_stats spent idle
+  void PrintIdleStats(const std::string& thread_type,
+                      const IdleStat* idle_stats, size_t thread_num) const;
+
   const Config* const config_;
 
   const size_t task_thread_num_;
@@ -218,6 +303,47 @@ class Stats {
 
   size_t last_frame_id_;
 
+  /// Total cycles spent by the master thread handling events, and the value
+  /// of that total at the previous UpdateStats() call
+  size_t master_loop_cycles_ = 0;
+  size_t master_loop_cycles_old_ = 0;
+
+  /// Microseconds spent by the master thread handling events per frame
+  std::array<double, kNumStatsFrames> master_loop_us_;
+
+  /// Deadline misses counted by the workers for frames in flight, moved to
+  /// deadline_misses_ when the frame completes
+  std::array<std::atomic<size_t>, kFrameWnd> pending_deadline_misses_{};
+  std::array<size_t, kNumStatsFrames> deadline_misses_{};
+  size_t total_deadline_misses_ = 0;
+  size_t frames_with_deadline_misses_ = 0;
+
+  /// Frames dropped by the master, and packets (and the frames they belong
+  /// to) that arrived after their frame was dropped
+  size_t num_dropped_frames_ = 0;
+  size_t num_late_packets_ = 0;
+  size_t num_late_frames_ = 0;
+  size_t last_late_frame_ = SIZE_MAX;
+
+  /// Symbols that timed out before all antennas' packets arrived, the
+  /// packets replaced by zeroed samples, and the packets that arrived after
+  /// their symbol timed out
+  size_t num_incomplete_symbols_ = 0;
+  size_t num_filled_packets_ = 0;
+  size_t num_timed_out_packets_ = 0;
+
+  /// Time at which the precoding of each downlink symbol of the frames in
+  /// the window was done, and the total time from then until the symbols
+  /// were sent (IFFT, scheduling and TX)
+  std::array<std::array<size_t, kMaxSymbols>, kFrameWnd>
+      dl_symbol_precoded_tsc_{};
+  size_t dl_symbol_latency_cycles_ = 0;
+  size_t num_dl_symbols_tx_ = 0;
+
+  /// Idle time of the worker and packet TXRX threads
+  std::array<IdleStat, kMaxThreads> worker_idle_stats_;
+  std::array<IdleStat, kMaxThreads> socket_idle_stats_;
+
   /// Dimensions = number of packet RX threads x kNumStatsFrames.
   /// frame_start[i][j] is the RDTSC timestamp taken by thread i when it
   /// starts receiving frame j.
@@ -6,6 +6,8 @@
 
 #include "txrx.h"
 
+#include <sys/mman.h>
+
 #include "logger.h"
 
 static constexpr bool kEnableSlowStart = true;
@@ -20,9 +22,45 @@ PacketTXRX::PacketTXRX(Config* cfg, size_t core_offset)
   if ((kUseArgos == false) && (kUseUHD == false)) {
     udp_servers_.resize(cfg->NumRadios());
     udp_clients_.resize(cfg->NumRadios());
+    if (cfg->Transport() == "af_xdp") {
+      // The sockets are created with the RX buffers, by StartTxRx()
+#if !defined(USE_AF_XDP)
+      RtAssert(false,
+               "The af_xdp transport requires building Agora with "
+               "USE_AF_XDP");
+#endif
+    } else if (cfg->Transport() == "io_uring") {
+#if !defined(USE_IO_URING)
+      RtAssert(false,
+               "The io_uring transport requires building Agora with "
+               "USE_IO_URING");
+#endif
+    } else if (cfg->Transport() == "shm") {
+      // The thread that sends an antenna's downlink packets is chosen by its
+      // radio, which must have a single antenna for each downlink ring to
+      // have a single producer
+      RtAssert(cfg->NumChannels() == 1,
+               "The shm transport requires one channel per radio");
+      shm_fronthaul_ = std::make_unique<ShmFronthaul>(
+          cfg->ShmPath(), cfg->NumRadios(),
+          std::max(cfg->PacketLength(), cfg->DlPacketLength()),
+          cfg->ShmRingSlots(), true /* create */);
+    } else if (cfg->Transport() == "replay") {
+      InitReplay();
+    }
   } else {
     radioconfig_ = std::make_unique<RadioConfig>(cfg);
   }
+  InitRecorder();
+}
+
+void PacketTXRX::InitRecorder() {
+  if (cfg_->RxRecordFile().empty() == false) {
+    recorder_ = std::make_unique<IqRecorder>(
+        cfg_->RxRecordFile(), cfg_->PacketLength(), cfg_->BsAntNum(),
+        cfg_->OfdmCaNum(), socket_thread_num_,
+        cfg_->RxRecordBufferMb() * 1024 * 1024);
+  }
 }
 
 PacketTXRX::PacketTXRX(Config* cfg, size_t core_offset,
@@ -44,19 +82,29 @@ PacketTXRX::~PacketTXRX() {
   for (size_t i = 0; i < cfg_->SocketThreadNum(); i++) {
     socket_std_threads_.at(i).join();
   }
+  if (replay_map_ != nullptr) {
+    munmap(replay_map_, replay_map_size_);
+  }
 }
 
 bool PacketTXRX::StartTxRx(Table<char>& buffer, Table<int>& buffer_status,
                            size_t packet_num_in_buffer,
                            Table<size_t>& frame_start, char* tx_buffer,
                            Table<complex_float>& calib_dl_buffer,
-                           Table<complex_float>& calib_ul_buffer) {
+                           Table<complex_float>& calib_ul_buffer,
+                           IdleStat* idle_stats) {
   buffer_ = &buffer;
   buffer_status_ = &buffer_status;
   frame_start_ = &frame_start;
+  idle_stats_ = idle_stats;
 
   packet_num_in_buffer_ = packet_num_in_buffer;
   tx_buffer_ = tx_buffer;
+#if defined(USE_AF_XDP)
+  if (cfg_->Transport() == "af_xdp") {
+    InitXdp();
+  }
+#endif
 
   if ((kUseArgos == true) || (kUseUHD == true)) {
     if (radioconfig_->RadioStart() == false) {
@@ -74,6 +122,7 @@ bool PacketTXRX::StartTxRx(Table<char>& buffer, Table<int>& buffer_status,
     }
   }
 
+  replay_start_tsc_ = GetTime::Rdtsc();
   for (size_t i = 0; i < socket_thread_num_; i++) {
     if (kUseArgos == true) {
       socket_std_threads_.at(i) =
@@ -81,6 +130,26 @@ bool PacketTXRX::StartTxRx(Table<char>& buffer, Table<int>& buffer_status,
     } else if (kUseUHD == true) {
       socket_std_threads_.at(i) =
           std::thread(&PacketTXRX::LoopTxRxUsrp, this, i);
+#if defined(USE_AF_XDP)
+    } else if (cfg_->Transport() == "af_xdp") {
+      MLPD_SYMBOL("LoopTXRX: Starting AF_XDP thread %zu\n", i);
+      socket_std_threads_.at(i) =
+          std::thread(&PacketTXRX::LoopTxRxXdp, this, i);
+#endif
+#if defined(USE_IO_URING)
+    } else if (cfg_->Transport() == "io_uring") {
+      MLPD_SYMBOL("LoopTXRX: Starting io_uring thread %zu\n", i);
+      socket_std_threads_.at(i) =
+          std::thread(&PacketTXRX::LoopTxRxUring, this, i);
+#endif
+    } else if (cfg_->Transport() == "replay") {
+      MLPD_SYMBOL("LoopTXRX: Starting replay thread %zu\n", i);
+      socket_std_threads_.at(i) =
+          std::thread(&PacketTXRX::LoopTxRxReplay, this, i);
+    } else if (cfg_->Transport() == "shm") {
+      MLPD_SYMBOL("LoopTXRX: Starting shared memory thread %zu\n", i);
+      socket_std_threads_.at(i) =
+          std::thread(&PacketTXRX::LoopTxRxShm, this, i);
     } else {
       MLPD_SYMBOL("LoopTXRX: Starting thread %zu\n", i);
       socket_std_threads_.at(i) = std::thread(&PacketTXRX::LoopTxRx, this, i);
@@ -122,31 +191,29 @@ void PacketTXRX::SendBeacon(int tid, size_t frame_id) {
   }
 }
 
-void PacketTXRX::LoopTxRx(int tid) {
-  PinToCoreWithOffset(ThreadType::kWorkerTXRX, core_offset_, tid);
-
-  const double rdtsc_freq = GetTime::MeasureRdtscFreq();
+size_t PacketTXRX::BeaconDelayTsc(size_t num_beacons,
+                                  double rdtsc_freq) const {
   const size_t frame_tsc_delta =
       cfg_->GetFrameDurationSec() * 1e9f * rdtsc_freq;
-  const size_t two_hundred_ms_ticks = (0.2f /* 200 ms */ * 1e9f * rdtsc_freq);
-
-  // Slow start variables (Start with no less than 200 ms)
-  const size_t slow_start_tsc1 =
-      std::max(40 * frame_tsc_delta, two_hundred_ms_ticks);
-  const size_t slow_start_thresh1 = kFrameWnd;
-  const size_t slow_start_tsc2 = 15 * frame_tsc_delta;
-  const size_t slow_start_thresh2 = kFrameWnd * 4;
-  size_t delay_tsc = frame_tsc_delta;
-
-  if (kEnableSlowStart) {
-    delay_tsc = slow_start_tsc1;
+  if (kEnableSlowStart == false) {
+    return frame_tsc_delta;
+  }
+  if (num_beacons < kFrameWnd) {
+    // Start with no less than 200 ms
+    const size_t two_hundred_ms_ticks =
+        (0.2f /* 200 ms */ * 1e9f * rdtsc_freq);
+    return std::max(40 * frame_tsc_delta, two_hundred_ms_ticks);
   }
+  if (num_beacons < kFrameWnd * 4) {
+    return 15 * frame_tsc_delta;
+  }
+  // Temp for historic reasons
+  return kEnableSlowSending ? (frame_tsc_delta * 4) : frame_tsc_delta;
+}
 
-  size_t* rx_frame_start = (*frame_start_)[tid];
-  size_t rx_offset = 0;
+void PacketTXRX::OpenUdpSockets(int tid) {
   size_t radio_lo = tid * cfg_->NumRadios() / socket_thread_num_;
   size_t radio_hi = (tid + 1) * cfg_->NumRadios() / socket_thread_num_;
-
   size_t sock_buf_size = (1024 * 1024 * 64 * 8) - 1;
   for (size_t radio_id = radio_lo; radio_id < radio_hi; ++radio_id) {
     size_t local_port_id = cfg_->BsServerPort() + radio_id;
@@ -160,12 +227,29 @@ void PacketTXRX::LoopTxRx(int tid) {
         tid, local_port_id, cfg_->BsRruAddr().c_str(),
         cfg_->BsRruPort() + radio_id);
   }
+}
+
+void PacketTXRX::LoopTxRx(int tid) {
+  PinToCoreWithOffset(ThreadType::kWorkerTXRX, core_offset_, tid);
+  Tracer::RegisterThread("TXRX " + std::to_string(tid));
+
+  const double rdtsc_freq = GetTime::MeasureRdtscFreq();
+  size_t* rx_frame_start = (*frame_start_)[tid];
+  size_t rx_offset = 0;
+  size_t radio_lo = tid * cfg_->NumRadios() / socket_thread_num_;
+  size_t radio_hi = (tid + 1) * cfg_->NumRadios() / socket_thread_num_;
+
+  OpenUdpSockets(tid);
 
   int prev_frame_id = -1;
   size_t radio_id = radio_lo;
-  size_t tx_frame_start = GetTime::Rdtsc();
+  const bool batched = (cfg_->UdpBatchSize() > 1);
   size_t tx_frame_id = 0;
-  size_t send_time = delay_tsc + tx_frame_start;
+  size_t send_time = GetTime::Rdtsc() + BeaconDelayTsc(0, rdtsc_freq);
+  // Packets cannot post a wakeup, so a sleeping thread polls its sockets
+  // again when the sleep times out. The timeout also bounds beacon jitter.
+  IdlePolicy idle(cfg_->IdleSpinIters(), cfg_->IdlePauseIters(),
+                  cfg_->IdleSleepUs(), &tx_waker_, &idle_stats_[tid]);
   // Send Beacons for the first time to kick off sim
   // SendBeacon(tid, tx_frame_id++);
   while (cfg_->Running() == true) {
@@ -173,41 +257,42 @@ void PacketTXRX::LoopTxRx(int tid) {
 
     if (rdtsc_now > send_time) {
       SendBeacon(tid, tx_frame_id++);
-
-      if (kEnableSlowStart) {
-        if (tx_frame_id == slow_start_thresh1) {
-          delay_tsc = slow_start_tsc2;
-        } else if (tx_frame_id == slow_start_thresh2) {
-          delay_tsc = frame_tsc_delta;
-          if (kEnableSlowSending) {
-            // Temp for historic reasons
-            delay_tsc = frame_tsc_delta * 4;
-          }
-        }
-      }
-      tx_frame_start = send_time;
-      send_time += delay_tsc;
+      send_time += BeaconDelayTsc(tx_frame_id, rdtsc_freq);
     }
 
-    int send_result = DequeueSend(tid);
+    int send_result = batched ? DequeueSendBatch(tid) : DequeueSend(tid);
     if (-1 == send_result) {
       // receive data
-      struct Packet* pkt = RecvEnqueue(tid, radio_id, rx_offset);
-      if (pkt != nullptr) {
-        rx_offset = (rx_offset + 1) % packet_num_in_buffer_;
+      size_t num_rx;
+      if (batched == true) {
+        num_rx = RecvEnqueueBatch(tid, radio_id, rx_offset);
+      } else {
+        num_rx = (RecvEnqueue(tid, radio_id, rx_offset) == nullptr) ? 0 : 1;
+      }
+      if (num_rx == 0) {
+        idle.OnIdle();
+      } else {
+        idle.OnWork();
 
         if (kIsWorkerTimingEnabled) {
-          int frame_id = pkt->frame_id_;
-          if (frame_id > prev_frame_id) {
-            rx_frame_start[frame_id % kNumStatsFrames] = GetTime::Rdtsc();
-            prev_frame_id = frame_id;
+          for (size_t i = 0; i < num_rx; i++) {
+            auto* pkt = reinterpret_cast<Packet*>(
+                &(*buffer_)[tid][(rx_offset + i) * cfg_->PacketLength()]);
+            int frame_id = pkt->frame_id_;
+            if (frame_id > prev_frame_id) {
+              rx_frame_start[frame_id % kNumStatsFrames] = GetTime::Rdtsc();
+              prev_frame_id = frame_id;
+            }
           }
         }
+        rx_offset = (rx_offset + num_rx) % packet_num_in_buffer_;
 
         if (++radio_id == radio_hi) {
           radio_id = radio_lo;
         }
       }
+    } else {
+      idle.OnWork();
     }  // end if -1 == send_result
   }    // end while
 }
@@ -219,7 +304,15 @@ struct Packet* PacketTXRX::RecvEnqueue(int tid, int radio_id, int rx_offset) {
   size_t packet_length = cfg_->PacketLength();
 
   // if rx_buffer is full, exit
-  if (rx_buffer_status[rx_offset] == 1) {
+  if (rx_buffer_status[rx_offset] != 0) {
+    if (cfg_->DropLateFrames() == true) {
+      // Discard the packet. A one-byte read drops the rest of the datagram.
+      uint8_t discarded;
+      if (udp_servers_.at(radio_id)->Recv(&discarded, sizeof(discarded)) > 0) {
+        num_rx_ring_drops_++;
+      }
+      return (nullptr);
+    }
     MLPD_ERROR("TXRX thread %d rx_buffer full, offset: %d\n", tid, rx_offset);
     cfg_->Running(false);
     return (nullptr);
@@ -245,6 +338,7 @@ struct Packet* PacketTXRX::RecvEnqueue(int tid, int radio_id, int rx_offset) {
           "antenna %d in cell %d,\n",
           pkt->ant_id_, pkt->cell_id_);
     }
+    RecordRx(tid, pkt);
     pkt->ant_id_ += pkt->cell_id_ * ant_per_cell_;
     if (kDebugMulticell) {
       std::printf(
@@ -256,6 +350,11 @@ struct Packet* PacketTXRX::RecvEnqueue(int tid, int radio_id, int rx_offset) {
     // get the position in rx_buffer
     // move ptr & set status to full
     rx_buffer_status[rx_offset] = 1;
+    Tracer::Record(
+        EventType::kPacketRX,
+        gen_tag_t::FrmSymAnt(pkt->frame_id_, pkt->symbol_id_, pkt->ant_id_)
+            .tag_,
+        TracePhase::kInstant);
 
     // Push kPacketRX event into the queue.
     EventData rx_message(EventType::kPacketRX, rx_tag_t(tid, rx_offset).tag_);
@@ -273,7 +372,6 @@ struct Packet* PacketTXRX::RecvEnqueue(int tid, int radio_id, int rx_offset) {
 }
 
 int PacketTXRX::DequeueSend(int tid) {
-  auto& c = cfg_;
   EventData event;
   if (task_queue_->try_dequeue_from_producer(*tx_ptoks_[tid], event) == false) {
     return -1;
@@ -282,9 +380,62 @@ int PacketTXRX::DequeueSend(int tid) {
   // std::printf("tx queue length: %d\n", task_queue_->size_approx());
   assert(event.event_type_ == EventType::kPacketTX);
 
-  size_t ant_id = gen_tag_t(event.tags_[0]).ant_id_;
-  size_t frame_id = gen_tag_t(event.tags_[0]).frame_id_;
-  size_t symbol_id = gen_tag_t(event.tags_[0]).symbol_id_;
+  struct Packet* pkt = PrepareTxPacket(tid, event.tags_[0]);
+  const size_t ant_id = pkt->ant_id_;
+
+  // Send data (one OFDM symbol)
+  udp_clients_.at(ant_id)->Send(cfg_->BsRruAddr(), cfg_->BsRruPort() + ant_id,
+                                reinterpret_cast<uint8_t*>(pkt),
+                                cfg_->DlPacketLength());
+  Tracer::Record(EventType::kPacketTX, event.tags_[0], TracePhase::kInstant);
+
+  RtAssert(
+      message_queue_->enqueue(*rx_ptoks_[tid],
+                              EventData(EventType::kPacketTX, event.tags_[0])),
+      "Socket message enqueue failed\n");
+  return event.tags_[0];
+}
+
+int PacketTXRX::DequeueSendBatch(int tid) {
+  std::array<EventData, kMaxUdpBatchSize> events;
+  const size_t num_events = task_queue_->try_dequeue_bulk_from_producer(
+      *tx_ptoks_[tid], events.data(), cfg_->UdpBatchSize());
+  if (num_events == 0) {
+    return -1;
+  }
+
+  std::array<const uint8_t*, kMaxUdpBatchSize> msgs;
+  std::array<uint16_t, kMaxUdpBatchSize> ports;
+  for (size_t i = 0; i < num_events; i++) {
+    assert(events[i].event_type_ == EventType::kPacketTX);
+    struct Packet* pkt = PrepareTxPacket(tid, events[i].tags_[0]);
+    msgs[i] = reinterpret_cast<uint8_t*>(pkt);
+    ports[i] = cfg_->BsRruPort() + pkt->ant_id_;
+  }
+
+  // Packets are sent to different ports from one socket, so one of this
+  // thread's sockets sends the whole batch
+  const size_t radio_lo = tid * cfg_->NumRadios() / socket_thread_num_;
+  udp_clients_.at(radio_lo)->SendBatch(cfg_->BsRruAddr(), ports.data(),
+                                       msgs.data(), cfg_->DlPacketLength(),
+                                       num_events);
+  for (size_t i = 0; i < num_events; i++) {
+    Tracer::Record(EventType::kPacketTX, events[i].tags_[0],
+                   TracePhase::kInstant);
+  }
+
+  // The completion events are the dequeued kPacketTX events
+  RtAssert(message_queue_->enqueue_bulk(*rx_ptoks_[tid], events.data(),
+                                        num_events),
+           "Socket message enqueue failed\n");
+  return num_events;
+}
+
+struct Packet* PacketTXRX::PrepareTxPacket(int tid, size_t tag) {
+  auto& c = cfg_;
+  size_t ant_id = gen_tag_t(tag).ant_id_;
+  size_t frame_id = gen_tag_t(tag).frame_id_;
+  size_t symbol_id = gen_tag_t(tag).symbol_id_;
 
   size_t data_symbol_idx_dl = cfg_->Frame().GetDLSymbolIdx(symbol_id);
   size_t offset = (c->GetTotalDataSymbolIdxDl(frame_id, data_symbol_idx_dl) *
@@ -295,22 +446,72 @@ int PacketTXRX::DequeueSend(int tid) {
     std::printf(
         "In TXRX thread %d: Transmitted frame %zu, symbol %zu, "
         "ant %zu, tag %zu, offset: %zu, msg_queue_length: %zu\n",
-        tid, frame_id, symbol_id, ant_id, gen_tag_t(event.tags_[0]).tag_,
-        offset, message_queue_->size_approx());
+        tid, frame_id, symbol_id, ant_id, tag, offset,
+        message_queue_->size_approx());
   }
 
-  char* cur_buffer_ptr = tx_buffer_ + offset * c->DlPacketLength();
-  auto* pkt = reinterpret_cast<Packet*>(cur_buffer_ptr);
-  new (pkt) Packet(frame_id, symbol_id, 0 /* cell_id */, ant_id);
+  return reinterpret_cast<Packet*>(tx_buffer_ + offset * c->DlPacketLength());
+}
 
-  // Send data (one OFDM symbol)
-  udp_clients_.at(ant_id)->Send(cfg_->BsRruAddr(), cfg_->BsRruPort() + ant_id,
-                                reinterpret_cast<uint8_t*>(cur_buffer_ptr),
-                                c->DlPacketLength());
+size_t PacketTXRX::RecvEnqueueBatch(int tid, int radio_id, size_t rx_offset) {
+  char* rx_buffer = (*buffer_)[tid];
+  int* rx_buffer_status = (*buffer_status_)[tid];
+  const size_t packet_length = cfg_->PacketLength();
+
+  // Receive into the free slots that follow rx_offset, without wrapping
+  // around the end of the RX ring
+  const size_t max_num =
+      std::min(cfg_->UdpBatchSize(), packet_num_in_buffer_ - rx_offset);
+  size_t num_free = 0;
+  while ((num_free < max_num) &&
+         (rx_buffer_status[rx_offset + num_free] == 0)) {
+    num_free++;
+  }
+  if (num_free == 0) {
+    // The RX ring is full. The single-packet path discards the packet or
+    // stops Agora.
+    RecvEnqueue(tid, radio_id, rx_offset);
+    return 0;
+  }
 
-  RtAssert(
-      message_queue_->enqueue(*rx_ptoks_[tid],
-                              EventData(EventType::kPacketTX, event.tags_[0])),
-      "Socket message enqueue failed\n");
-  return event.tags_[0];
+  std::array<size_t, kMaxUdpBatchSize> rx_lens;
+  ssize_t num_rx = udp_servers_.at(radio_id)->RecvBatch(
+      reinterpret_cast<uint8_t*>(&rx_buffer[rx_offset * packet_length]),
+      packet_length, num_free, rx_lens.data());
+  if (0 > num_rx) {
+    MLPD_ERROR("RecvEnqueueBatch: Udp RecvBatch failed with error");
+    throw std::runtime_error("PacketTXRX: recvmmsg failed");
+  }
+
+  std::array<EventData, kMaxUdpBatchSize> rx_events;
+  for (size_t i = 0; i < static_cast<size_t>(num_rx); i++) {
+    if (rx_lens[i] != packet_length) {
+      MLPD_ERROR(
+          "RecvEnqueueBatch: Udp RecvBatch failed to receive all expected "
+          "bytes");
+      throw std::runtime_error(
+          "PacketTXRX::RecvEnqueueBatch: Udp RecvBatch failed to receive all "
+          "expected bytes");
+    }
+    auto* pkt = reinterpret_cast<struct Packet*>(
+        &rx_buffer[(rx_offset + i) * packet_length]);
+    RecordRx(tid, pkt);
+    pkt->ant_id_ += pkt->cell_id_ * ant_per_cell_;
+    rx_buffer_status[rx_offset + i] = 1;
+    Tracer::Record(
+        EventType::kPacketRX,
+        gen_tag_t::FrmSymAnt(pkt->frame_id_, pkt->symbol_id_, pkt->ant_id_)
+            .tag_,
+        TracePhase::kInstant);
+    rx_events[i] =
+        EventData(EventType::kPacketRX, rx_tag_t(tid, rx_offset + i).tag_);
+  }
+
+  if ((num_rx > 0) &&
+      (message_queue_->enqueue_bulk(*rx_ptoks_[tid], rx_events.data(),
+                                    num_rx) == false)) {
+    MLPD_ERROR("socket message enqueue failed\n");
+    throw std::runtime_error("PacketTXRX: socket message enqueue failed");
+  }
+  return num_rx;
 }
@@ -8,6 +8,7 @@
 #define PACKETTXRX_H_
 
 #include <algorithm>
+#include <atomic>
 #include <cassert>
 #include <chrono>
 #include <ctime>
@@ -20,8 +21,12 @@
 #include "concurrentqueue.h"
 #include "config.h"
 #include "gettime.h"
+#include "idle_policy.h"
+#include "iq_recorder.h"
 #include "radio_lib.h"
+#include "shm_transport.h"
 #include "symbols.h"
+#include "trace.h"
 #include "udp_client.h"
 #include "udp_server.h"
 
@@ -29,6 +34,16 @@
 #include "dpdk_transport.h"
 #endif
 
+#if defined(USE_AF_XDP)
+#include "xdp_transport.h"
+
+struct XdpContext;
+#endif
+
+#if defined(USE_IO_URING)
+struct UringContext;
+#endif
+
 /**
  * @brief Implementations of this class provide packet I/O for Agora.
  *
@@ -67,6 +82,7 @@ class PacketTXRX {
    * @param buffer Ring buffer to save packets
    * @param buffer_status Status of each packet buffer (0: empty, 1: full)
    * @packet_num_in_buffer Total number of buffers in an RX ring
+   * @param idle_stats Idle time accounting, one entry per I/O thread
    *
    * @return True on successfully starting the network I/O threads, false
    * otherwise
@@ -74,14 +90,127 @@ class PacketTXRX {
   bool StartTxRx(Table<char>& buffer, Table<int>& buffer_status,
                  size_t packet_num_in_buffer, Table<size_t>& frame_start,
                  char* tx_buffer, Table<complex_float>& calib_dl_buffer_,
-                 Table<complex_float>& calib_ul_buffer_);
+                 Table<complex_float>& calib_ul_buffer_, IdleStat* idle_stats);
 
   void SendBeacon(int tid, size_t frame_id);
 
+  /// Wake I/O threads sleeping under the adaptive idle policy. Call after
+  /// enqueuing packets to transmit.
+  inline void NotifyTx() { tx_waker_.Notify(); }
+
+  /// Number of packets discarded because the RX ring was full, when late
+  /// frames are dropped
+  inline size_t NumRxRingDrops() const { return num_rx_ring_drops_.load(); }
+
+  /// Number of downlink packets discarded because the simulator's ring was
+  /// full, with the shm transport
+  inline size_t NumTxRingDrops() const { return num_tx_ring_drops_.load(); }
+
+  /// Number of frames that every TXRX thread has injected, with the replay
+  /// transport
+  size_t NumReplayedFrames() const;
+  /// Frames per second injected since the TXRX threads started, with the
+  /// replay transport. Without a rate limit, this is the rate at which the
+  /// pipeline frees RX buffer slots, i.e., its sustained frame rate.
+  double ReplayFramesPerSec() const;
+
  private:
   void LoopTxRx(int tid);  // The thread function for thread [tid]
   int DequeueSend(int tid);
   struct Packet* RecvEnqueue(int tid, int radio_id, int rx_offset);
+  /// Send up to UdpBatchSize() queued packets with one sendmmsg call. Returns
+  /// the number of packets sent, or -1 if none were queued.
+  int DequeueSendBatch(int tid);
+  /// Receive up to UdpBatchSize() packets with one recvmmsg call into the
+  /// consecutive RX buffer slots starting at rx_offset, and enqueue their
+  /// kPacketRX events in bulk. Returns the number of packets received.
+  size_t RecvEnqueueBatch(int tid, int radio_id, size_t rx_offset);
+  /// Return the downlink packet of tag (a kPacketTX tag) in the TX buffer.
+  /// Its header was written by Agora and DoIFFT.
+  struct Packet* PrepareTxPacket(int tid, size_t tag);
+
+  /// Create the recorder of the received packets if RxRecordFile() is set
+  void InitRecorder();
+  /// Record a packet received by thread tid, before its antenna ID is made
+  /// global, so that the capture holds packets in the fronthaul format
+  inline void RecordRx(int tid, const Packet* pkt) {
+    if (recorder_ != nullptr) {
+      recorder_->Record(tid, pkt);
+    }
+  }
+
+  /// Create the UDP sockets of the radios served by thread tid
+  void OpenUdpSockets(int tid);
+  /// Delay between the beacons number num_beacons - 1 and num_beacons,
+  /// which is longer for the first frames (slow start)
+  size_t BeaconDelayTsc(size_t num_beacons, double rdtsc_freq) const;
+
+#if defined(USE_IO_URING)
+  void LoopTxRxUring(int tid);
+  void InitUring(int tid, UringContext& ctx);
+  /// Provide free RX buffer slots to the kernel in ring order, and re-arm
+  /// the multishot receives that stopped. Does not submit.
+  void ProvideRxSlotsUring(int tid, UringContext& ctx);
+  /// Prepare zero-copy sends of up to kUringBatchSize queued packets from
+  /// the downlink buffer. Returns the number of packets, or -1 if none were
+  /// queued. Does not submit.
+  int DequeueSendUring(int tid, UringContext& ctx);
+  /// Handle a burst of completions: enqueue the kPacketRX events of the
+  /// received packets and the kPacketTX events of the sends whose buffer the
+  /// kernel released, in bulk. Returns the number of completions.
+  size_t ReapUring(int tid, UringContext& ctx, int& prev_frame_id);
+  /// Wait until the kernel released the buffers of all zero-copy sends, so
+  /// that the ring can be torn down
+  void DrainSendsUring(int tid, UringContext& ctx);
+#endif
+
+#if defined(USE_AF_XDP)
+  /// Create one AF_XDP socket per TXRX thread on XdpInterface(), with the
+  /// thread's RX buffer as its UMEM
+  void InitXdp();
+  void LoopTxRxXdp(int tid);
+  /// Give free RX buffer slots to the kernel in ring order, and detect the
+  /// packets dropped because none were free
+  void FillRxSlotsXdp(int tid, XdpContext& ctx);
+  /// Receive a burst of frames from the thread's AF_XDP socket, which the
+  /// NIC wrote into the RX buffer slots, and enqueue the kPacketRX events of
+  /// Agora's packets in bulk. Returns the number of frames received,
+  /// including those that were not Agora's packets.
+  size_t RecvEnqueueXdp(int tid, XdpContext& ctx, int& prev_frame_id);
+  /// Send up to kXdpBatchSize queued packets. Returns the number of packets
+  /// sent, or -1 if none were queued.
+  int DequeueSendXdp(int tid);
+  void SendBeaconXdp(int tid, size_t frame_id);
+  /// Queue a copy of payload to the simulator's port of antenna ant_id on
+  /// the thread's AF_XDP socket. Returns false if the packet was dropped
+  /// because no TX frame was free while Agora was stopping.
+  bool SendXdp(int tid, size_t ant_id, const uint8_t* payload, size_t len);
+#endif
+
+  void LoopTxRxShm(int tid);
+  /// Copy up to kShmBatchSize packets from the uplink rings of the radios
+  /// served by thread tid into the RX buffer slots from rx_offset, taking
+  /// one packet per radio in turn, and enqueue their kPacketRX events in
+  /// bulk. Returns the number of packets consumed, including dropped ones.
+  size_t RecvEnqueueShm(int tid, size_t& rx_offset, int& prev_frame_id);
+  /// Copy up to kShmBatchSize queued packets into the downlink rings.
+  /// Returns the number of packets, or -1 if none were queued.
+  int DequeueSendShm(int tid);
+  /// Send the beacons of the radios whose downlink rings thread tid produces
+  void SendBeaconShm(int tid, size_t frame_id);
+
+  /// Map the capture file, or build one frame of packets from the data
+  /// generator's samples, and split the packets among the TXRX threads
+  void InitReplay();
+  void LoopTxRxReplay(int tid);
+  /// Copy up to kReplayBatchSize packets into free RX buffer slots from
+  /// rx_offset, and enqueue their kPacketRX events in bulk. Returns the
+  /// number of packets injected.
+  size_t ReplayEnqueue(int tid, size_t& rx_offset, size_t& pos, size_t& pass,
+                       size_t ring_size);
+  /// Complete up to kReplayBatchSize queued downlink packets without
+  /// sending them. Returns the number of packets, or -1 if none were queued.
+  int DequeueDropReplay(int tid);
 
   void LoopTxRxArgos(int tid);
   int DequeueSendArgos(int tid);
@@ -115,6 +244,10 @@ class PacketTXRX {
   moodycamel::ConcurrentQueue<EventData>* task_queue_;
   moodycamel::ProducerToken** rx_ptoks_;
   moodycamel::ProducerToken** tx_ptoks_;
+  IdleWaker tx_waker_;
+  std::atomic<size_t> num_rx_ring_drops_{0};
+  std::atomic<size_t> num_tx_ring_drops_{0};
+  IdleStat* idle_stats_;
 
   std::vector<std::unique_ptr<UDPServer>> udp_servers_;
   std::vector<std::unique_ptr<UDPClient>> udp_clients_;
@@ -125,6 +258,38 @@ class PacketTXRX {
   struct rte_mempool* mbuf_pool;
 #endif
 
+#if defined(USE_AF_XDP)
+  uint32_t xdp_rru_addr_;     // IPv4 address of the simulator sender
+  uint32_t xdp_server_addr_;  // IPv4 address of the Agora server
+  std::vector<std::unique_ptr<XdpSocket>> xdp_sockets_;  // One per thread
+  // The simulator's MAC address, learned from the first packet or ARP
+  // request received from it. Until then, packets are broadcast.
+  std::array<uint8_t, ETH_ALEN> xdp_rru_mac_;
+  std::atomic<bool> xdp_rru_mac_known_{false};
+  std::once_flag xdp_rru_mac_once_;
+#endif
+
+  // Used only with the shm transport. Agora creates the region and the
+  // simulator attaches to it.
+  std::unique_ptr<ShmFronthaul> shm_fronthaul_;
+
+  // Used only with the replay transport
+  const char* replay_packets_ = nullptr;  // The packets to replay
+  size_t replay_num_packets_ = 0;
+  size_t replay_first_frame_ = 0;  // Smallest frame ID of the packets
+  size_t replay_num_frames_ = 0;   // Frame IDs are replayed modulo this
+  void* replay_map_ = nullptr;     // Mapping of the capture file
+  size_t replay_map_size_ = 0;
+  std::vector<char> replay_built_packets_;  // Packets built without a file
+  // Indices of the packets of the radios served by each thread
+  std::vector<std::vector<size_t>> replay_index_;
+  // Frames started by each thread
+  std::array<std::atomic<size_t>, kMaxSocketNum> replay_frames_{};
+  size_t replay_start_tsc_ = 0;
+
+  // Records the received packets if RxRecordFile() is set
+  std::unique_ptr<IqRecorder> recorder_;
+
   std::unique_ptr<RadioConfig> radioconfig_;  // Used only in Argos mode
 };
 
@@ -13,13 +13,25 @@ PacketTXRX::PacketTXRX(Config* cfg, size_t core_offset)
       core_offset_(core_offset),
       ant_per_cell_(cfg->BsAntNum() / cfg->NumCells()),
       socket_thread_num_(cfg->SocketThreadNum()) {
-  DpdkTransport::DpdkInit(core_offset_ - 1, socket_thread_num_);
+  DpdkTransport::DpdkInit(core_offset_ - 1, socket_thread_num_,
+                          cfg_->DpdkVdev());
   printf("Number of ports: %d used (offset: %d), %d available, socket: %d\n",
          cfg_->DpdkNumPorts(), cfg_->DpdkPortOffset(),
          rte_eth_dev_count_avail(), rte_socket_id());
   RtAssert(cfg_->DpdkNumPorts() <= rte_eth_dev_count_avail(),
            "Invalid number of DPDK ports");
-  mbuf_pool = DpdkTransport::CreateMempool(cfg->DpdkNumPorts());
+  // With zero-copy RX, Agora holds the mbufs of the packets in its frame
+  // window until their FFT is done. Only pilot, uplink and calibration
+  // symbols are received, so this is well below the number of RX buffer
+  // slots, which are sized for every symbol of the frame.
+  const size_t rx_pkts_per_frame =
+      cfg_->BsAntNum() * cfg_->FronthaulFragsPerSymbol() *
+      (cfg_->Frame().NumPilotSyms() + cfg_->Frame().NumULSyms() +
+       static_cast<size_t>(cfg_->Frame().IsRecCalEnabled()));
+  const size_t num_held_mbufs =
+      cfg_->DpdkZeroCopyRx() == true ? kFrameWnd * rx_pkts_per_frame : 0;
+  mbuf_pool = DpdkTransport::CreateMempool(
+      cfg->DpdkNumPorts(), kJumboFrameMaxSize, num_held_mbufs);
 
   int ret = inet_pton(AF_INET, cfg_->BsRruAddr().c_str(), &bs_rru_addr);
   RtAssert(ret == 1, "Invalid sender IP address");
@@ -32,24 +44,38 @@ PacketTXRX::PacketTXRX(Config* cfg, size_t core_offset)
       rte_exit(EXIT_FAILURE, "Cannot init port %u\n",
                port_id + cfg->DpdkPortOffset());
 
-  for (size_t i = 0; i < socket_thread_num_; i++) {
-    uint16_t src_port = rte_cpu_to_be_16(cfg_->BsRruPort() + i);
-    uint16_t dst_port = rte_cpu_to_be_16(cfg_->BsServerPort() + i);
-
-    std::printf(
-        "Adding steering rule for src IP %s, dest IP %s, src port: %zu, "
-        "dst port: %zu, DPDK port %zu, queue: %zu\n",
-        this->cfg_->BsRruAddr().c_str(), this->cfg_->BsServerAddr().c_str(),
-        this->cfg_->BsRruPort() + i, this->cfg_->BsServerPort() + i,
-        i % this->cfg_->DpdkNumPorts() + cfg->DpdkPortOffset(),
-        i / this->cfg_->DpdkNumPorts());
-    DpdkTransport::InstallFlowRule(
-        i % this->cfg_->DpdkNumPorts() + cfg->DpdkPortOffset(),
-        i / this->cfg_->DpdkNumPorts(), bs_rru_addr, bs_server_addr, src_port,
-        dst_port);
+  // Virtual devices do not support flow rules. Each of their RX queues
+  // receives what the device was given for it (e.g., a pcap file per queue).
+  if (cfg_->DpdkVdev().empty() == true) {
+    for (size_t i = 0; i < socket_thread_num_; i++) {
+      uint16_t src_port = rte_cpu_to_be_16(cfg_->BsRruPort() + i);
+      uint16_t dst_port = rte_cpu_to_be_16(cfg_->BsServerPort() + i);
+
+      std::printf(
+          "Adding steering rule for src IP %s, dest IP %s, src port: %zu, "
+          "dst port: %zu, DPDK port %zu, queue: %zu\n",
+          this->cfg_->BsRruAddr().c_str(), this->cfg_->BsServerAddr().c_str(),
+          this->cfg_->BsRruPort() + i, this->cfg_->BsServerPort() + i,
+          i % this->cfg_->DpdkNumPorts() + cfg->DpdkPortOffset(),
+          i / this->cfg_->DpdkNumPorts());
+      DpdkTransport::InstallFlowRule(
+          i % this->cfg_->DpdkNumPorts() + cfg->DpdkPortOffset(),
+          i / this->cfg_->DpdkNumPorts(), bs_rru_addr, bs_server_addr,
+          src_port, dst_port);
+    }
   }
 
   std::printf("Number of DPDK cores: %d\n", rte_lcore_count());
+  InitRecorder();
+}
+
+void PacketTXRX::InitRecorder() {
+  if (cfg_->RxRecordFile().empty() == false) {
+    recorder_ = std::make_unique<IqRecorder>(
+        cfg_->RxRecordFile(), cfg_->PacketLength(), cfg_->BsAntNum(),
+        cfg_->OfdmCaNum(), socket_thread_num_,
+        cfg_->RxRecordBufferMb() * 1024 * 1024);
+  }
 }
 
 PacketTXRX::PacketTXRX(Config* cfg, size_t core_offset,
@@ -70,12 +96,14 @@ bool PacketTXRX::StartTxRx(Table<char>& buffer, Table<int>& buffer_status,
                            size_t packet_num_in_buffer,
                            Table<size_t>& frame_start, char* tx_buffer,
                            Table<complex_float>& calib_dl_buffer,
-                           Table<complex_float>& calib_ul_buffer) {
+                           Table<complex_float>& calib_ul_buffer,
+                           IdleStat* idle_stats) {
   unused(calib_dl_buffer);
   unused(calib_ul_buffer);
   buffer_ = &buffer;
   buffer_status_ = &buffer_status;
   frame_start_ = &frame_start;
+  idle_stats_ = idle_stats;
 
   packet_num_in_buffer_ = packet_num_in_buffer;
   tx_buffer_ = tx_buffer;
@@ -108,16 +136,24 @@ void PacketTXRX::SendBeacon(int tid, size_t frame_id) {
 }
 
 void PacketTXRX::LoopTxRx(int tid) {
+  Tracer::RegisterThread("TXRX " + std::to_string(tid));
   size_t rx_offset = 0;
   size_t prev_frame_id = SIZE_MAX;
   const uint16_t port_id = tid % cfg_->DpdkNumPorts() + cfg_->DpdkPortOffset();
   const uint16_t queue_id = tid / cfg_->DpdkNumPorts();
+  IdlePolicy idle(cfg_->IdleSpinIters(), cfg_->IdlePauseIters(),
+                  cfg_->IdleSleepUs(), &tx_waker_, &idle_stats_[tid]);
 
   while (this->cfg_->Running()) {
     if (-1 != DequeueSend(tid)) {
+      idle.OnWork();
       continue;
     }
-    DpdkRecv(tid, port_id, queue_id, prev_frame_id, rx_offset);
+    if (DpdkRecv(tid, port_id, queue_id, prev_frame_id, rx_offset) > 0) {
+      idle.OnWork();
+    } else {
+      idle.OnIdle();
+    }
   }
 }
 
@@ -130,7 +166,12 @@ uint16_t PacketTXRX::DpdkRecv(int tid, uint16_t port_id, uint16_t queue_id,
   for (size_t i = 0; i < nb_rx; i++) {
     // If the RX buffer is full, it means that the base station processing
     // hasn't kept up, so exit.
-    if ((*buffer_status_)[tid][rx_offset] == 1) {
+    if ((*buffer_status_)[tid][rx_offset] != 0) {
+      if (cfg_->DropLateFrames() == true) {
+        rte_pktmbuf_free(rx_bufs[i]);
+        num_rx_ring_drops_++;
+        continue;
+      }
       std::printf("TXRX thread %d rx_buffer full, offset: %zu\n", tid,
                   rx_offset);
       cfg_->Running(false);
@@ -174,10 +215,23 @@ uint16_t PacketTXRX::DpdkRecv(int tid, uint16_t port_id, uint16_t queue_id,
     auto* payload = reinterpret_cast<uint8_t*>(eth_hdr) + kPayloadOffset;
     auto* pkt = reinterpret_cast<Packet*>(
         &(*buffer_)[tid][rx_offset * cfg_->PacketLength()]);
-    DpdkTransport::FastMemcpy(reinterpret_cast<uint8_t*>(pkt), payload,
-                              cfg_->PacketLength());
-
-    rte_pktmbuf_free(rx_bufs[i]);
+    if (cfg_->DpdkZeroCopyRx() == true) {
+      // Copy only the header. DoFFT reads the samples from the mbuf and
+      // frees it.
+      std::memcpy(pkt, payload, Packet::kOffsetOfData);
+      DpdkTransport::SetRxMbuf(pkt, rx_bufs[i]);
+      RecordRx(tid, reinterpret_cast<Packet*>(payload));
+    } else {
+      DpdkTransport::FastMemcpy(reinterpret_cast<uint8_t*>(pkt), payload,
+                                cfg_->PacketLength());
+      RecordRx(tid, pkt);
+      rte_pktmbuf_free(rx_bufs[i]);
+    }
+    Tracer::Record(
+        EventType::kPacketRX,
+        gen_tag_t::FrmSymAnt(pkt->frame_id_, pkt->symbol_id_, pkt->ant_id_)
+            .tag_,
+        TracePhase::kInstant);
 
     if (kIsWorkerTimingEnabled) {
       if (prev_frame_id == SIZE_MAX or pkt->frame_id_ > prev_frame_id) {
@@ -229,7 +283,6 @@ int PacketTXRX::DequeueSend(int tid) {
 
   char* cur_buffer_ptr = tx_buffer_ + offset * this->cfg_->DlPacketLength();
   auto* pkt = (Packet*)cur_buffer_ptr;
-  new (pkt) Packet(frame_id, symbol_id, 0 /* cell_id */, ant_id);
 
   struct rte_mbuf* tx_bufs[kTxBatchSize] __attribute__((aligned(64)));
   tx_bufs[0] = rte_pktmbuf_alloc(mbuf_pool);
@@ -259,6 +312,7 @@ int PacketTXRX::DequeueSend(int tid) {
     std::printf("rte_eth_tx_burst() failed\n");
     throw std::runtime_error("PacketTXRX: rte_eth_tx_burst() failed");
   }
+  Tracer::Record(EventType::kPacketTX, event.tags_[0], TracePhase::kInstant);
   RtAssert(
       message_queue_->enqueue(*rx_ptoks_[tid],
                               EventData(EventType::kPacketTX, event.tags_[0])),
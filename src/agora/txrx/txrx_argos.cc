@@ -56,7 +56,7 @@ std::vector<struct Packet*> PacketTXRX::RecvEnqueueArgos(int tid, int radio_id,
   void* samp[cfg_->NumChannels()];
   for (size_t ch = 0; ch < cfg_->NumChannels(); ++ch) {
     // if rx_buffer is full, exit
-    if (rx_buffer_status[rx_offset + ch] == 1) {
+    if (rx_buffer_status[rx_offset + ch] != 0) {
       MLPD_ERROR("TXRX thread %d rx_buffer full, offset: %d\n", tid, rx_offset);
       cfg_->Running(false);
       break;
@@ -0,0 +1,271 @@
+/**
+ * @file txrx_replay.cc
+ * @brief Implementation of PacketTXRX datapath functions for replaying
+ * recorded or generated packets without a network or real-time pacing
+ */
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+#include "bfp.h"
+#include "datatype_conversion.h"
+#include "iq_capture.h"
+#include "logger.h"
+#include "txrx.h"
+
+// Maximum number of packets that a TXRX thread injects per burst
+static constexpr size_t kReplayBatchSize = 64;
+
+void PacketTXRX::InitReplay() {
+  const size_t packet_length = cfg_->PacketLength();
+  if (cfg_->ReplayFile().empty() == false) {
+    const int fd = open(cfg_->ReplayFile().c_str(), O_RDONLY);
+    RtAssert(fd >= 0, "Failed to open the replay file " + cfg_->ReplayFile());
+    struct stat st;
+    RtAssert(fstat(fd, &st) == 0, "Failed to stat the replay file");
+    replay_map_size_ = st.st_size;
+    RtAssert(replay_map_size_ >= IqCaptureHeader::kSize + packet_length,
+             "The replay file holds no packets");
+    // Populate the mapping now, so that page faults do not slow down the
+    // replay
+    replay_map_ = mmap(nullptr, replay_map_size_, PROT_READ,
+                       MAP_PRIVATE | MAP_POPULATE, fd, 0);
+    close(fd);
+    RtAssert(replay_map_ != MAP_FAILED, "Failed to map the replay file");
+
+    const auto* header = static_cast<const IqCaptureHeader*>(replay_map_);
+    RtAssert(header->magic_ == IqCaptureHeader::kMagic,
+             cfg_->ReplayFile() + " is not an IQ capture file");
+    RtAssert((header->packet_length_ == packet_length) &&
+                 (header->bs_ant_num_ == cfg_->BsAntNum()) &&
+                 (header->ofdm_ca_num_ == cfg_->OfdmCaNum()),
+             "The capture was recorded with a different config");
+    replay_packets_ =
+        static_cast<const char*>(replay_map_) + IqCaptureHeader::kSize;
+    replay_num_packets_ =
+        (replay_map_size_ - IqCaptureHeader::kSize) / packet_length;
+  } else {
+    // Build the packets of one frame as the emulated RRU sends them
+    RtAssert(cfg_->FftInRru() == false,
+             "Replaying generated samples requires FFT in Agora");
+    RtAssert(cfg_->FronthaulAntsPerPacket() == 1,
+             "Replaying generated samples requires one antenna per packet");
+    const size_t sample_count = (cfg_->CpLen() + cfg_->OfdmCaNum()) * 2;
+    const size_t bfp_iq_width = cfg_->BfpIqWidth();
+    RtAssert(packet_length ==
+                 Packet::kOffsetOfData +
+                     ((bfp_iq_width > 0)
+                          ? BfpCompressedBytes(sample_count / 2, bfp_iq_width)
+                          : (kUse12BitIQ ? 3 : 4) * sample_count / 2),
+             "Replaying generated samples requires packets without padding");
+    const std::string filename =
+        std::string(TOSTRING(PROJECT_DIRECTORY)) + "/data/LDPC_rx_data_" +
+        std::to_string(cfg_->OfdmCaNum()) + "_ant" +
+        std::to_string(cfg_->BsAntNum()) + ".bin";
+    std::vector<float> samples(cfg_->Frame().NumTotalSyms() *
+                               cfg_->BsAntNum() * sample_count);
+    FILE* fp = std::fopen(filename.c_str(), "rb");
+    RtAssert(fp != nullptr, "Failed to open IQ data file " + filename);
+    const size_t count =
+        std::fread(samples.data(), sizeof(float), samples.size(), fp);
+    std::fclose(fp);
+    RtAssert(count == samples.size(), "Failed to read IQ data file");
+
+    for (size_t symbol_id = 0; symbol_id < cfg_->Frame().NumTotalSyms();
+         symbol_id++) {
+      const SymbolType type = cfg_->GetSymbolType(symbol_id);
+      if ((type != SymbolType::kPilot) && (type != SymbolType::kUL)) {
+        continue;
+      }
+      for (size_t ant_id = 0; ant_id < cfg_->BsAntNum(); ant_id++) {
+        replay_built_packets_.resize(replay_built_packets_.size() +
+                                     packet_length);
+        auto* pkt = reinterpret_cast<Packet*>(
+            &replay_built_packets_[replay_num_packets_ * packet_length]);
+        const size_t cell_id = ant_id / ant_per_cell_;
+        new (pkt) Packet(0, symbol_id, cell_id,
+                         ant_id - cell_id * ant_per_cell_);
+        const float* src =
+            &samples[(symbol_id * cfg_->BsAntNum() + ant_id) * sample_count];
+        if (bfp_iq_width > 0) {
+          BfpCompress(src, reinterpret_cast<uint8_t*>(pkt->data_),
+                      sample_count / 2, bfp_iq_width);
+        } else if (kUse12BitIQ) {
+          ConvertFloatTo12bitIq(src, reinterpret_cast<uint8_t*>(pkt->data_),
+                                sample_count);
+        } else {
+          // Saturate like the SIMD conversions; generated IQ can reach
+          // +/-1.0, which does not fit in a short after scaling
+          for (size_t i = 0; i < sample_count; i++) {
+            pkt->data_[i] = static_cast<short>(
+                std::clamp(src[i] * 32768.0f, -32768.0f, 32767.0f));
+          }
+        }
+        replay_num_packets_++;
+      }
+    }
+    replay_packets_ = replay_built_packets_.data();
+  }
+
+  // Frame IDs are shifted to start at 0 and keep increasing when the
+  // packets are replayed again
+  size_t max_frame = 0;
+  replay_first_frame_ = SIZE_MAX;
+  for (size_t i = 0; i < replay_num_packets_; i++) {
+    const auto* pkt =
+        reinterpret_cast<const Packet*>(replay_packets_ + i * packet_length);
+    replay_first_frame_ = std::min<size_t>(replay_first_frame_, pkt->frame_id_);
+    max_frame = std::max<size_t>(max_frame, pkt->frame_id_);
+  }
+  replay_num_frames_ = max_frame - replay_first_frame_ + 1;
+
+  // Each thread replays the packets of the radios it would receive from
+  replay_index_.resize(socket_thread_num_);
+  for (size_t i = 0; i < replay_num_packets_; i++) {
+    const auto* pkt =
+        reinterpret_cast<const Packet*>(replay_packets_ + i * packet_length);
+    const size_t ant_id = pkt->ant_id_ + pkt->cell_id_ * ant_per_cell_;
+    RtAssert(ant_id < cfg_->BsAntNum(), "Invalid antenna in replay packet");
+    const size_t radio_id = ant_id / cfg_->NumChannels();
+    for (size_t tid = 0; tid < socket_thread_num_; tid++) {
+      if (radio_id < (tid + 1) * cfg_->NumRadios() / socket_thread_num_) {
+        replay_index_[tid].push_back(i);
+        break;
+      }
+    }
+  }
+  MLPD_INFO("PacketTXRX: replaying %zu packets of %zu frames from %s\n",
+            replay_num_packets_, replay_num_frames_,
+            cfg_->ReplayFile().empty() ? "generated samples"
+                                       : cfg_->ReplayFile().c_str());
+}
+
+void PacketTXRX::LoopTxRxReplay(int tid) {
+  PinToCoreWithOffset(ThreadType::kWorkerTXRX, core_offset_, tid);
+  Tracer::RegisterThread("TXRX " + std::to_string(tid));
+
+  // Wrap around the RX ring after kFrameWnd / 2 frames of this thread's
+  // packets. As RX buffer slots are freed in frame order, injection then
+  // stays within Agora's frame window of the oldest unfinished frame.
+  const size_t num_packets = replay_index_.at(tid).size();
+  const size_t packets_per_frame =
+      (num_packets + replay_num_frames_ - 1) / replay_num_frames_;
+  const size_t ring_size = std::min(packet_num_in_buffer_,
+                                    packets_per_frame * (kFrameWnd / 2));
+  size_t rx_offset = 0;
+  size_t pos = 0;
+  size_t pass = 0;
+  IdlePolicy idle(cfg_->IdleSpinIters(), cfg_->IdlePauseIters(),
+                  cfg_->IdleSleepUs(), &tx_waker_, &idle_stats_[tid]);
+  while (cfg_->Running() == true) {
+    if (DequeueDropReplay(tid) != -1) {
+      idle.OnWork();
+    } else if ((num_packets > 0) &&
+               (ReplayEnqueue(tid, rx_offset, pos, pass, ring_size) > 0)) {
+      idle.OnWork();
+    } else {
+      idle.OnIdle();
+    }
+  }
+}
+
+size_t PacketTXRX::ReplayEnqueue(int tid, size_t& rx_offset, size_t& pos,
+                                 size_t& pass, size_t ring_size) {
+  const std::vector<size_t>& index = replay_index_[tid];
+  char* rx_buffer = (*buffer_)[tid];
+  int* rx_buffer_status = (*buffer_status_)[tid];
+  const size_t packet_length = cfg_->PacketLength();
+  const bool rate_limited = cfg_->ReplayRateFps() > 0;
+  const size_t now = rate_limited ? GetTime::Rdtsc() : 0;
+
+  std::array<EventData, kReplayBatchSize> rx_events;
+  size_t num_rx = 0;
+  while ((num_rx < kReplayBatchSize) && (rx_buffer_status[rx_offset] == 0)) {
+    const auto* src = reinterpret_cast<const Packet*>(
+        replay_packets_ + index[pos] * packet_length);
+    const size_t frame_id =
+        src->frame_id_ - replay_first_frame_ + pass * replay_num_frames_;
+    if ((rate_limited == true) &&
+        (now < replay_start_tsc_ + static_cast<size_t>(
+                                       frame_id * cfg_->FreqGhz() * 1e9 /
+                                       cfg_->ReplayRateFps()))) {
+      break;
+    }
+
+    auto* pkt =
+        reinterpret_cast<Packet*>(&rx_buffer[rx_offset * packet_length]);
+    std::memcpy(pkt, src, packet_length);
+    pkt->frame_id_ = frame_id;
+    pkt->ant_id_ += pkt->cell_id_ * ant_per_cell_;
+    rx_buffer_status[rx_offset] = 1;
+    Tracer::Record(EventType::kPacketRX,
+                   gen_tag_t::FrmSymAnt(frame_id, pkt->symbol_id_, pkt->ant_id_)
+                       .tag_,
+                   TracePhase::kInstant);
+
+    if (frame_id + 1 > replay_frames_[tid].load(std::memory_order_relaxed)) {
+      replay_frames_[tid].store(frame_id + 1, std::memory_order_relaxed);
+      if (kIsWorkerTimingEnabled) {
+        (*frame_start_)[tid][frame_id % kNumStatsFrames] = GetTime::Rdtsc();
+      }
+    }
+    rx_events[num_rx] =
+        EventData(EventType::kPacketRX, rx_tag_t(tid, rx_offset).tag_);
+    num_rx++;
+    rx_offset = (rx_offset + 1) % ring_size;
+    if (++pos == index.size()) {
+      pos = 0;
+      pass++;
+    }
+  }
+
+  if (num_rx > 0) {
+    RtAssert(message_queue_->enqueue_bulk(*rx_ptoks_[tid], rx_events.data(),
+                                          num_rx),
+             "Socket message enqueue failed\n");
+  }
+  return num_rx;
+}
+
+int PacketTXRX::DequeueDropReplay(int tid) {
+  std::array<EventData, kReplayBatchSize> events;
+  const size_t num_events = task_queue_->try_dequeue_bulk_from_producer(
+      *tx_ptoks_[tid], events.data(), kReplayBatchSize);
+  if (num_events == 0) {
+    return -1;
+  }
+  for (size_t i = 0; i < num_events; i++) {
+    assert(events[i].event_type_ == EventType::kPacketTX);
+    Tracer::Record(EventType::kPacketTX, events[i].tags_[0],
+                   TracePhase::kInstant);
+  }
+
+  // The completion events are the dequeued kPacketTX events
+  RtAssert(message_queue_->enqueue_bulk(*rx_ptoks_[tid], events.data(),
+                                        num_events),
+           "Socket message enqueue failed\n");
+  return num_events;
+}
+
+size_t PacketTXRX::NumReplayedFrames() const {
+  // The last frame that a thread started may still be incomplete
+  size_t num_frames = SIZE_MAX;
+  for (size_t tid = 0; tid < socket_thread_num_; tid++) {
+    if (replay_index_.at(tid).empty() == false) {
+      num_frames = std::min(num_frames, replay_frames_[tid].load());
+    }
+  }
+  return ((num_frames == SIZE_MAX) || (num_frames == 0)) ? 0
+                                                         : num_frames - 1;
+}
+
+double PacketTXRX::ReplayFramesPerSec() const {
+  return NumReplayedFrames() /
+         GetTime::CyclesToUs(GetTime::Rdtsc() - replay_start_tsc_,
+                             cfg_->FreqGhz()) *
+         1e6;
+}
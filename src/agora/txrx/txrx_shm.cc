@@ -0,0 +1,162 @@
+/**
+ * @file txrx_shm.cc
+ * @brief Implementation of PacketTXRX datapath functions for communicating
+ * with simulators through shared memory rings
+ */
+
+#include "logger.h"
+#include "txrx.h"
+
+void PacketTXRX::LoopTxRxShm(int tid) {
+  PinToCoreWithOffset(ThreadType::kWorkerTXRX, core_offset_, tid);
+  Tracer::RegisterThread("TXRX " + std::to_string(tid));
+
+  const double rdtsc_freq = GetTime::MeasureRdtscFreq();
+  size_t rx_offset = 0;
+  int prev_frame_id = -1;
+  size_t tx_frame_id = 0;
+  size_t send_time = GetTime::Rdtsc() + BeaconDelayTsc(0, rdtsc_freq);
+  IdlePolicy idle(cfg_->IdleSpinIters(), cfg_->IdlePauseIters(),
+                  cfg_->IdleSleepUs(), &tx_waker_, &idle_stats_[tid]);
+  while (cfg_->Running() == true) {
+    if (GetTime::Rdtsc() > send_time) {
+      SendBeaconShm(tid, tx_frame_id++);
+      send_time += BeaconDelayTsc(tx_frame_id, rdtsc_freq);
+    }
+
+    if (DequeueSendShm(tid) != -1) {
+      idle.OnWork();
+    } else if (RecvEnqueueShm(tid, rx_offset, prev_frame_id) > 0) {
+      idle.OnWork();
+    } else {
+      idle.OnIdle();
+    }
+  }
+}
+
+size_t PacketTXRX::RecvEnqueueShm(int tid, size_t& rx_offset,
+                                  int& prev_frame_id) {
+  const size_t radio_lo = tid * cfg_->NumRadios() / socket_thread_num_;
+  const size_t radio_hi = (tid + 1) * cfg_->NumRadios() / socket_thread_num_;
+  char* rx_buffer = (*buffer_)[tid];
+  int* rx_buffer_status = (*buffer_status_)[tid];
+  const size_t packet_length = cfg_->PacketLength();
+
+  std::array<EventData, kShmBatchSize> rx_events;
+  size_t num_rx = 0;
+  size_t num_consumed = 0;
+  bool progress = true;
+  while ((progress == true) && (num_consumed < kShmBatchSize)) {
+    progress = false;
+    for (size_t radio_id = radio_lo;
+         (radio_id < radio_hi) && (num_consumed < kShmBatchSize);
+         radio_id++) {
+      const Packet* slot =
+          shm_fronthaul_->ConsumerSlot(ShmDirection::kUplink, radio_id);
+      if (slot == nullptr) {
+        continue;
+      }
+      if (rx_buffer_status[rx_offset] != 0) {
+        if (cfg_->DropLateFrames() == false) {
+          MLPD_ERROR("TXRX thread %d rx_buffer full, offset: %zu\n", tid,
+                     rx_offset);
+          cfg_->Running(false);
+          progress = false;
+          break;
+        }
+        num_rx_ring_drops_++;
+      } else {
+        // The RX buffer slot stays in use until the packet is processed, so
+        // the ring slot is returned to the sender right away after a copy
+        auto* pkt =
+            reinterpret_cast<Packet*>(&rx_buffer[rx_offset * packet_length]);
+        std::memcpy(pkt, slot, packet_length);
+        RecordRx(tid, pkt);
+        pkt->ant_id_ += pkt->cell_id_ * ant_per_cell_;
+        rx_buffer_status[rx_offset] = 1;
+        Tracer::Record(
+            EventType::kPacketRX,
+            gen_tag_t::FrmSymAnt(pkt->frame_id_, pkt->symbol_id_, pkt->ant_id_)
+                .tag_,
+            TracePhase::kInstant);
+
+        if (kIsWorkerTimingEnabled) {
+          const int frame_id = pkt->frame_id_;
+          if (frame_id > prev_frame_id) {
+            (*frame_start_)[tid][frame_id % kNumStatsFrames] =
+                GetTime::Rdtsc();
+            prev_frame_id = frame_id;
+          }
+        }
+        rx_events[num_rx] =
+            EventData(EventType::kPacketRX, rx_tag_t(tid, rx_offset).tag_);
+        num_rx++;
+        rx_offset = (rx_offset + 1) % packet_num_in_buffer_;
+      }
+      shm_fronthaul_->Consume(ShmDirection::kUplink, radio_id);
+      num_consumed++;
+      progress = true;
+    }
+  }
+
+  if (num_rx > 0) {
+    RtAssert(message_queue_->enqueue_bulk(*rx_ptoks_[tid], rx_events.data(),
+                                          num_rx),
+             "Socket message enqueue failed\n");
+  }
+  return num_consumed;
+}
+
+int PacketTXRX::DequeueSendShm(int tid) {
+  std::array<EventData, kShmBatchSize> events;
+  const size_t num_events = task_queue_->try_dequeue_bulk_from_producer(
+      *tx_ptoks_[tid], events.data(), kShmBatchSize);
+  if (num_events == 0) {
+    return -1;
+  }
+
+  for (size_t i = 0; i < num_events; i++) {
+    assert(events[i].event_type_ == EventType::kPacketTX);
+    struct Packet* pkt = PrepareTxPacket(tid, events[i].tags_[0]);
+    // Agora schedules the packets of radio i to thread
+    // i % socket_thread_num_, the only producer of the radio's ring
+    Packet* slot =
+        shm_fronthaul_->ProducerSlot(ShmDirection::kDownlink, pkt->ant_id_);
+    if (slot == nullptr) {
+      num_tx_ring_drops_++;
+    } else {
+      // IFFT writes the downlink buffer by frame and symbol, as the other
+      // transports send it, and the symbols of a radio complete out of ring
+      // order. So the packet is copied rather than built in the ring slot.
+      std::memcpy(slot, pkt, cfg_->DlPacketLength());
+      shm_fronthaul_->Produce(ShmDirection::kDownlink, pkt->ant_id_);
+    }
+    Tracer::Record(EventType::kPacketTX, events[i].tags_[0],
+                   TracePhase::kInstant);
+  }
+
+  // The completion events are the dequeued kPacketTX events
+  RtAssert(message_queue_->enqueue_bulk(*rx_ptoks_[tid], events.data(),
+                                        num_events),
+           "Socket message enqueue failed\n");
+  return num_events;
+}
+
+void PacketTXRX::SendBeaconShm(int tid, size_t frame_id) {
+  for (size_t beacon_sym = 0; beacon_sym < cfg_->Frame().NumBeaconSyms();
+       beacon_sym++) {
+    for (size_t radio_id = tid; radio_id < cfg_->NumRadios();
+         radio_id += socket_thread_num_) {
+      Packet* slot =
+          shm_fronthaul_->ProducerSlot(ShmDirection::kDownlink, radio_id);
+      if (slot == nullptr) {
+        num_tx_ring_drops_++;
+        continue;
+      }
+      std::memset(reinterpret_cast<uint8_t*>(slot), 0, cfg_->PacketLength());
+      new (slot) Packet(frame_id, cfg_->Frame().GetBeaconSymbol(beacon_sym),
+                        0 /* cell_id */, radio_id);
+      shm_fronthaul_->Produce(ShmDirection::kDownlink, radio_id);
+    }
+  }
+}
@@ -0,0 +1,381 @@
+/**
+ * @file txrx_uring.cc
+ * @brief Implementation of PacketTXRX datapath functions for communicating
+ * with simulators over UDP sockets driven by io_uring
+ */
+
+#include <arpa/inet.h>
+
+#include "logger.h"
+#include "txrx.h"
+
+// liburing includes linux/fs.h, whose BLOCK_SIZE macro breaks
+// concurrentqueue.h if included before it
+#include <liburing.h>
+
+static constexpr unsigned kUringSqSize = 256;
+static constexpr unsigned kUringCqSize = 4096;
+/// Maximum number of packets sent and completions handled per burst
+static constexpr size_t kUringBatchSize = 64;
+/// Maximum number of RX buffer slots provided to the kernel at once. A
+/// power of two, as required for a provided buffer ring.
+static constexpr size_t kUringMaxProvidedSlots = 1 << 14;
+static constexpr uint16_t kUringBufGroup = 0;
+/// The user data of a receive is kUringRecvFlag | radio_id. The user data of
+/// a send is its gen_tag_t, whose top bit is clear.
+static constexpr uint64_t kUringRecvFlag = 1ull << 63;
+static_assert(kMaxAntennas < (1ull << 15), "");
+
+/// Per-thread io_uring state
+struct UringContext {
+  struct io_uring ring_;
+
+  // RX buffer slots are handed to the kernel in ring order through a
+  // provided buffer ring, from which the multishot receives of all of the
+  // thread's sockets pick them in the same order
+  struct io_uring_buf_ring* buf_ring_ = nullptr;
+  size_t buf_ring_entries_ = 0;
+  std::vector<size_t> bid_slots_;  // RX buffer slot of each buffer ID
+  size_t next_bid_ = 0;
+  size_t next_provided_slot_ = 0;  // Next RX buffer slot to provide
+  size_t num_provided_slots_ = 0;  // Provided and not yet filled
+  std::vector<bool> recv_armed_;   // Multishot receive active, per radio
+
+  // If true, the downlink buffer is registered as fixed buffer 0
+  bool fixed_tx_buffer_ = false;
+  // Zero-copy sends whose buffer the kernel may still read
+  size_t num_inflight_sends_ = 0;
+  std::vector<struct sockaddr_in> rru_addrs_;  // One per antenna
+};
+
+void PacketTXRX::LoopTxRxUring(int tid) {
+  PinToCoreWithOffset(ThreadType::kWorkerTXRX, core_offset_, tid);
+  Tracer::RegisterThread("TXRX " + std::to_string(tid));
+
+  const double rdtsc_freq = GetTime::MeasureRdtscFreq();
+  OpenUdpSockets(tid);
+  UringContext ctx;
+  InitUring(tid, ctx);
+
+  int prev_frame_id = -1;
+  size_t tx_frame_id = 0;
+  size_t send_time = GetTime::Rdtsc() + BeaconDelayTsc(0, rdtsc_freq);
+  // Completions are posted without system calls, so a sleeping thread finds
+  // them when the sleep times out
+  IdlePolicy idle(cfg_->IdleSpinIters(), cfg_->IdlePauseIters(),
+                  cfg_->IdleSleepUs(), &tx_waker_, &idle_stats_[tid]);
+  while (cfg_->Running() == true) {
+    if (GetTime::Rdtsc() > send_time) {
+      SendBeacon(tid, tx_frame_id++);
+      send_time += BeaconDelayTsc(tx_frame_id, rdtsc_freq);
+    }
+
+    // One io_uring_enter() submits the sends and re-armed receives
+    const int num_tx = DequeueSendUring(tid, ctx);
+    ProvideRxSlotsUring(tid, ctx);
+    if (io_uring_sq_ready(&ctx.ring_) > 0) {
+      io_uring_submit(&ctx.ring_);
+    }
+
+    if ((ReapUring(tid, ctx, prev_frame_id) > 0) || (num_tx != -1)) {
+      idle.OnWork();
+    } else {
+      idle.OnIdle();
+    }
+  }
+
+  DrainSendsUring(tid, ctx);
+  io_uring_free_buf_ring(&ctx.ring_, ctx.buf_ring_, ctx.buf_ring_entries_,
+                         kUringBufGroup);
+  io_uring_queue_exit(&ctx.ring_);
+}
+
+void PacketTXRX::InitUring(int tid, UringContext& ctx) {
+  struct io_uring_params params;
+  std::memset(&params, 0, sizeof(params));
+  params.flags = IORING_SETUP_CQSIZE;
+  params.cq_entries = kUringCqSize;
+  int ret = io_uring_queue_init_params(kUringSqSize, &ctx.ring_, &params);
+  RtAssert(ret == 0, std::string("io_uring_queue_init failed: ") +
+                         std::strerror(-ret));
+
+  ctx.buf_ring_entries_ = 1;
+  while ((ctx.buf_ring_entries_ < packet_num_in_buffer_) &&
+         (ctx.buf_ring_entries_ < kUringMaxProvidedSlots)) {
+    ctx.buf_ring_entries_ *= 2;
+  }
+  ctx.buf_ring_ = io_uring_setup_buf_ring(&ctx.ring_, ctx.buf_ring_entries_,
+                                          kUringBufGroup, 0, &ret);
+  RtAssert(ctx.buf_ring_ != nullptr,
+           std::string("io_uring_setup_buf_ring failed: ") +
+               std::strerror(-ret));
+  ctx.bid_slots_.resize(ctx.buf_ring_entries_);
+  const size_t radio_lo = tid * cfg_->NumRadios() / socket_thread_num_;
+  const size_t radio_hi = (tid + 1) * cfg_->NumRadios() / socket_thread_num_;
+  ctx.recv_armed_.resize(radio_hi - radio_lo, false);
+
+  // Registering the downlink buffer pins it, which counts against
+  // RLIMIT_MEMLOCK. Without it, sends are still zero-copy but map the pages
+  // per send.
+  if (cfg_->Frame().NumDLSyms() > 0) {
+    struct iovec iov;
+    iov.iov_base = tx_buffer_;
+    iov.iov_len = cfg_->DlPacketLength() * cfg_->BsAntNum() *
+                  cfg_->Frame().NumDLSyms() * kFrameWnd;
+    ret = io_uring_register_buffers(&ctx.ring_, &iov, 1);
+    ctx.fixed_tx_buffer_ = (ret == 0);
+    if (ret != 0) {
+      MLPD_WARN(
+          "TXRX thread %d: failed to register the downlink buffer with "
+          "io_uring (%s). Sending from unregistered memory.\n",
+          tid, std::strerror(-ret));
+    }
+  }
+
+  struct in_addr rru_addr;
+  ret = inet_pton(AF_INET, cfg_->BsRruAddr().c_str(), &rru_addr);
+  RtAssert(ret == 1, "Invalid sender IP address");
+  ctx.rru_addrs_.resize(cfg_->BsAntNum());
+  for (size_t ant_id = 0; ant_id < cfg_->BsAntNum(); ant_id++) {
+    struct sockaddr_in& addr = ctx.rru_addrs_.at(ant_id);
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(cfg_->BsRruPort() + ant_id);
+    addr.sin_addr = rru_addr;
+  }
+}
+
+void PacketTXRX::ProvideRxSlotsUring(int tid, UringContext& ctx) {
+  char* rx_buffer = (*buffer_)[tid];
+  int* rx_buffer_status = (*buffer_status_)[tid];
+  const size_t packet_length = cfg_->PacketLength();
+  const size_t max_provided =
+      std::min(ctx.buf_ring_entries_, packet_num_in_buffer_);
+
+  // Slots are provided in ring order and stop at the first slot that the
+  // master has not freed yet, as with the other RX loops
+  size_t num_added = 0;
+  while ((ctx.num_provided_slots_ + num_added < max_provided) &&
+         (rx_buffer_status[ctx.next_provided_slot_] == 0)) {
+    const auto bid =
+        static_cast<uint16_t>(ctx.next_bid_ % ctx.buf_ring_entries_);
+    ctx.bid_slots_.at(bid) = ctx.next_provided_slot_;
+    io_uring_buf_ring_add(ctx.buf_ring_,
+                          &rx_buffer[ctx.next_provided_slot_ * packet_length],
+                          packet_length, bid,
+                          io_uring_buf_ring_mask(ctx.buf_ring_entries_),
+                          num_added);
+    ctx.next_bid_++;
+    ctx.next_provided_slot_ =
+        (ctx.next_provided_slot_ + 1) % packet_num_in_buffer_;
+    num_added++;
+  }
+  if (num_added > 0) {
+    io_uring_buf_ring_advance(ctx.buf_ring_, num_added);
+    ctx.num_provided_slots_ += num_added;
+  }
+  const size_t radio_lo = tid * cfg_->NumRadios() / socket_thread_num_;
+  if (ctx.num_provided_slots_ == 0) {
+    // The RX ring is full and the receives stop with -ENOBUFS. Discard the
+    // waiting packets as the single-packet path does. A one-byte read drops
+    // the rest of the datagram.
+    if (cfg_->DropLateFrames() == true) {
+      for (size_t i = 0; i < ctx.recv_armed_.size(); i++) {
+        uint8_t discarded;
+        if ((ctx.recv_armed_[i] == false) &&
+            (udp_servers_.at(radio_lo + i)->Recv(&discarded,
+                                                 sizeof(discarded)) > 0)) {
+          num_rx_ring_drops_++;
+        }
+      }
+    }
+    return;
+  }
+
+  // (Re-)arm the multishot receives that the kernel terminated
+  for (size_t i = 0; i < ctx.recv_armed_.size(); i++) {
+    if (ctx.recv_armed_[i] == true) {
+      continue;
+    }
+    struct io_uring_sqe* sqe = io_uring_get_sqe(&ctx.ring_);
+    if (sqe == nullptr) {
+      break;
+    }
+    const size_t radio_id = radio_lo + i;
+    io_uring_prep_recv_multishot(sqe, udp_servers_.at(radio_id)->Fd(),
+                                 nullptr, 0, 0);
+    sqe->flags |= IOSQE_BUFFER_SELECT;
+    sqe->buf_group = kUringBufGroup;
+    io_uring_sqe_set_data64(sqe, kUringRecvFlag | radio_id);
+    ctx.recv_armed_[i] = true;
+  }
+}
+
+int PacketTXRX::DequeueSendUring(int tid, UringContext& ctx) {
+  std::array<EventData, kUringBatchSize> events;
+  const size_t max_num = std::min(
+      kUringBatchSize, static_cast<size_t>(io_uring_sq_space_left(&ctx.ring_)));
+  const size_t num_events = task_queue_->try_dequeue_bulk_from_producer(
+      *tx_ptoks_[tid], events.data(), max_num);
+  if (num_events == 0) {
+    return -1;
+  }
+
+  // Packets are sent to different ports from one socket
+  const size_t radio_lo = tid * cfg_->NumRadios() / socket_thread_num_;
+  const int fd = udp_clients_.at(radio_lo)->Fd();
+  for (size_t i = 0; i < num_events; i++) {
+    assert(events[i].event_type_ == EventType::kPacketTX);
+    struct Packet* pkt = PrepareTxPacket(tid, events[i].tags_[0]);
+    const struct sockaddr_in& addr = ctx.rru_addrs_.at(pkt->ant_id_);
+    struct io_uring_sqe* sqe = io_uring_get_sqe(&ctx.ring_);
+    if (ctx.fixed_tx_buffer_ == true) {
+      io_uring_prep_send_zc_fixed(sqe, fd, pkt, cfg_->DlPacketLength(), 0, 0,
+                                  0 /* buf_index */);
+    } else {
+      io_uring_prep_send_zc(sqe, fd, pkt, cfg_->DlPacketLength(), 0, 0);
+    }
+    io_uring_prep_send_set_addr(
+        sqe, reinterpret_cast<const struct sockaddr*>(&addr), sizeof(addr));
+    io_uring_sqe_set_data64(sqe, events[i].tags_[0]);
+    Tracer::Record(EventType::kPacketTX, events[i].tags_[0],
+                   TracePhase::kInstant);
+  }
+  ctx.num_inflight_sends_ += num_events;
+  return num_events;
+}
+
+void PacketTXRX::DrainSendsUring(int tid, UringContext& ctx) {
+  // The ring and the registered downlink buffer must outlive the zero-copy
+  // sends that still read the buffer
+  io_uring_submit(&ctx.ring_);
+  while (ctx.num_inflight_sends_ > 0) {
+    struct io_uring_cqe* cqe;
+    struct __kernel_timespec timeout = {1, 0};
+    const int ret = io_uring_wait_cqe_timeout(&ctx.ring_, &cqe, &timeout);
+    if (ret != 0) {
+      MLPD_WARN(
+          "TXRX thread %d: %zu io_uring sends not completed at exit: %s\n",
+          tid, ctx.num_inflight_sends_, std::strerror(-ret));
+      return;
+    }
+    const uint64_t data = io_uring_cqe_get_data64(cqe);
+    if (((data & kUringRecvFlag) == 0) &&
+        (((cqe->flags & IORING_CQE_F_NOTIF) != 0) ||
+         ((cqe->flags & IORING_CQE_F_MORE) == 0))) {
+      ctx.num_inflight_sends_--;
+    }
+    io_uring_cqe_seen(&ctx.ring_, cqe);
+  }
+}
+
+size_t PacketTXRX::ReapUring(int tid, UringContext& ctx, int& prev_frame_id) {
+  std::array<struct io_uring_cqe*, kUringBatchSize> cqes;
+  const size_t num_cqes =
+      io_uring_peek_batch_cqe(&ctx.ring_, cqes.data(), kUringBatchSize);
+  if (num_cqes == 0) {
+    return 0;
+  }
+
+  char* rx_buffer = (*buffer_)[tid];
+  int* rx_buffer_status = (*buffer_status_)[tid];
+  const size_t packet_length = cfg_->PacketLength();
+  const size_t radio_lo = tid * cfg_->NumRadios() / socket_thread_num_;
+  std::array<EventData, kUringBatchSize> rx_events;
+  size_t num_rx = 0;
+  std::array<EventData, kUringBatchSize> tx_events;
+  size_t num_tx = 0;
+  for (size_t i = 0; i < num_cqes; i++) {
+    const struct io_uring_cqe* cqe = cqes[i];
+    const uint64_t data = io_uring_cqe_get_data64(cqe);
+
+    if ((data & kUringRecvFlag) == 0) {
+      // A zero-copy send posts its result with IORING_CQE_F_MORE, and then a
+      // notification when the kernel no longer uses the buffer. The symbol
+      // is reported as sent only then, so that the master does not reuse the
+      // buffer while the kernel still reads it.
+      if ((cqe->flags & IORING_CQE_F_NOTIF) == 0) {
+        if (cqe->res < 0) {
+          MLPD_ERROR("TXRX thread %d: io_uring send failed: %s\n", tid,
+                     std::strerror(-cqe->res));
+          throw std::runtime_error("PacketTXRX: io_uring send failed");
+        }
+        if ((cqe->flags & IORING_CQE_F_MORE) != 0) {
+          continue;
+        }
+      }
+      ctx.num_inflight_sends_--;
+      tx_events[num_tx] = EventData(EventType::kPacketTX, data);
+      num_tx++;
+      continue;
+    }
+
+    const size_t radio_id = data & ~kUringRecvFlag;
+    if ((cqe->flags & IORING_CQE_F_MORE) == 0) {
+      ctx.recv_armed_.at(radio_id - radio_lo) = false;
+    }
+    if (cqe->res == -ENOBUFS) {
+      // All provided slots are filled. If the master has not freed the next
+      // slot either, the RX ring is full.
+      if ((ctx.num_provided_slots_ == 0) &&
+          (rx_buffer_status[ctx.next_provided_slot_] != 0) &&
+          (cfg_->DropLateFrames() == false)) {
+        MLPD_ERROR("TXRX thread %d rx_buffer full, offset: %zu\n", tid,
+                   ctx.next_provided_slot_);
+        cfg_->Running(false);
+      }
+      continue;
+    }
+    if (cqe->res < 0) {
+      MLPD_ERROR("TXRX thread %d: io_uring recv failed: %s\n", tid,
+                 std::strerror(-cqe->res));
+      throw std::runtime_error("PacketTXRX: io_uring recv failed");
+    }
+
+    const size_t bid = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+    const size_t rx_offset = ctx.bid_slots_.at(bid);
+    ctx.num_provided_slots_--;
+    if (static_cast<size_t>(cqe->res) != packet_length) {
+      MLPD_ERROR("ReapUring: received %d bytes instead of %zu\n", cqe->res,
+                 packet_length);
+      throw std::runtime_error(
+          "PacketTXRX::ReapUring: io_uring recv failed to receive all "
+          "expected bytes");
+    }
+    auto* pkt =
+        reinterpret_cast<Packet*>(&rx_buffer[rx_offset * packet_length]);
+    RecordRx(tid, pkt);
+    pkt->ant_id_ += pkt->cell_id_ * ant_per_cell_;
+    rx_buffer_status[rx_offset] = 1;
+    Tracer::Record(
+        EventType::kPacketRX,
+        gen_tag_t::FrmSymAnt(pkt->frame_id_, pkt->symbol_id_, pkt->ant_id_)
+            .tag_,
+        TracePhase::kInstant);
+
+    if (kIsWorkerTimingEnabled) {
+      const int frame_id = pkt->frame_id_;
+      if (frame_id > prev_frame_id) {
+        (*frame_start_)[tid][frame_id % kNumStatsFrames] = GetTime::Rdtsc();
+        prev_frame_id = frame_id;
+      }
+    }
+    rx_events[num_rx] =
+        EventData(EventType::kPacketRX, rx_tag_t(tid, rx_offset).tag_);
+    num_rx++;
+  }
+  io_uring_cq_advance(&ctx.ring_, num_cqes);
+
+  if (num_rx > 0) {
+    RtAssert(message_queue_->enqueue_bulk(*rx_ptoks_[tid], rx_events.data(),
+                                          num_rx),
+             "Socket message enqueue failed\n");
+  }
+  // The completion events are the kPacketTX events of the finished sends
+  if (num_tx > 0) {
+    RtAssert(message_queue_->enqueue_bulk(*rx_ptoks_[tid], tx_events.data(),
+                                          num_tx),
+             "Socket message enqueue failed\n");
+  }
+  return num_cqes;
+}
@@ -132,7 +132,7 @@ struct Packet* PacketTXRX::RecvEnqueueUsrp(int tid, int radio_id, int rx_offset,
   void* samp[n_channels];
   for (int ch = 0; ch < n_channels; ++ch) {
     // if rx_buffer is full, exit
-    if (rx_buffer_status[rx_offset + ch] == 1) {
+    if (rx_buffer_status[rx_offset + ch] != 0) {
       std::printf("Receive thread %d rx_buffer full, offset: %d\n", tid,
                   rx_offset);
       cfg_->Running(false);
@@ -0,0 +1,284 @@
+/**
+ * @file txrx_xdp.cc
+ * @brief Implementation of PacketTXRX datapath functions for communicating
+ * with simulators over AF_XDP sockets
+ */
+
+#include <arpa/inet.h>
+
+#include "logger.h"
+#include "txrx.h"
+
+static const uint8_t kBroadcastMac[ETH_ALEN] = {0xff, 0xff, 0xff,
+                                                0xff, 0xff, 0xff};
+
+/// Per-thread AF_XDP RX state
+struct XdpContext {
+  // RX buffer slots are handed to the kernel in ring order through the fill
+  // ring, and the NIC receives into them in the same order
+  size_t num_rx_slots_ = 0;
+  std::vector<bool> filled_;          // Handed to the kernel, per slot
+  size_t next_fill_slot_ = 0;         // Next RX buffer slot to hand over
+  size_t num_filled_slots_ = 0;       // Handed over, not yet received into
+  uint64_t num_fill_ring_empty_ = 0;  // Since the RX buffer became full
+  bool rx_buffer_full_ = false;
+};
+
+void PacketTXRX::InitXdp() {
+  RtAssert(cfg_->DlPacketLength() + kXdpPayloadOffset <= kXdpFrameSize,
+           "With the af_xdp transport, packets and their headers must fit in " +
+               std::to_string(kXdpFrameSize) + " bytes");
+  RtAssert(cfg_->PacketBufferStride() == kXdpFrameSize,
+           "The RX buffer slots must be UMEM frames");
+  int ret = inet_pton(AF_INET, cfg_->BsRruAddr().c_str(), &xdp_rru_addr_);
+  RtAssert(ret == 1, "Invalid sender IP address");
+  ret = inet_pton(AF_INET, cfg_->BsServerAddr().c_str(), &xdp_server_addr_);
+  RtAssert(ret == 1, "Invalid server IP address");
+
+  // TXRX thread i serves queue i of the interface. Packets are spread over
+  // the queues by the NIC (RSS), and any thread can receive any antenna's
+  // packets. The thread's RX buffer is the UMEM of its socket, so the NIC
+  // writes packets where the FFT reads them.
+  for (size_t tid = 0; tid < socket_thread_num_; tid++) {
+    xdp_sockets_.push_back(std::make_unique<XdpSocket>(
+        cfg_->XdpInterface(), tid, reinterpret_cast<uint8_t*>((*buffer_)[tid]),
+        (packet_num_in_buffer_ * cfg_->PacketBufferStride()) +
+            (kXdpNumTxFrames * kXdpFrameSize)));
+  }
+}
+
+void PacketTXRX::LoopTxRxXdp(int tid) {
+  PinToCoreWithOffset(ThreadType::kWorkerTXRX, core_offset_, tid);
+  Tracer::RegisterThread("TXRX " + std::to_string(tid));
+
+  const double rdtsc_freq = GetTime::MeasureRdtscFreq();
+  XdpContext ctx;
+  ctx.num_rx_slots_ = packet_num_in_buffer_;
+  ctx.filled_.resize(ctx.num_rx_slots_, false);
+  int prev_frame_id = -1;
+  size_t tx_frame_id = 0;
+  size_t send_time = GetTime::Rdtsc() + BeaconDelayTsc(0, rdtsc_freq);
+  IdlePolicy idle(cfg_->IdleSpinIters(), cfg_->IdlePauseIters(),
+                  cfg_->IdleSleepUs(), &tx_waker_, &idle_stats_[tid]);
+  while (cfg_->Running() == true) {
+    if (GetTime::Rdtsc() > send_time) {
+      SendBeaconXdp(tid, tx_frame_id++);
+      send_time += BeaconDelayTsc(tx_frame_id, rdtsc_freq);
+    }
+
+    FillRxSlotsXdp(tid, ctx);
+    if (DequeueSendXdp(tid) != -1) {
+      idle.OnWork();
+    } else if (RecvEnqueueXdp(tid, ctx, prev_frame_id) > 0) {
+      idle.OnWork();
+    } else {
+      idle.OnIdle();
+    }
+  }
+}
+
+void PacketTXRX::FillRxSlotsXdp(int tid, XdpContext& ctx) {
+  XdpSocket& socket = *xdp_sockets_.at(tid);
+  char* rx_buffer = (*buffer_)[tid];
+  int* rx_buffer_status = (*buffer_status_)[tid];
+
+  // Slots are handed over in ring order and stop at the first slot that the
+  // master has not freed yet, as with the other RX loops
+  std::array<uint8_t*, kXdpBatchSize> frames;
+  const size_t max_num = std::min(kXdpBatchSize, socket.FillSpace());
+  size_t num = 0;
+  while ((num < max_num) && (ctx.filled_[ctx.next_fill_slot_] == false) &&
+         (rx_buffer_status[ctx.next_fill_slot_] == 0)) {
+    frames[num] = reinterpret_cast<uint8_t*>(
+        &rx_buffer[ctx.next_fill_slot_ * cfg_->PacketBufferStride()]);
+    ctx.filled_[ctx.next_fill_slot_] = true;
+    ctx.next_fill_slot_ = (ctx.next_fill_slot_ + 1) % ctx.num_rx_slots_;
+    num++;
+  }
+  if (num > 0) {
+    socket.Fill(frames.data(), num);
+    ctx.num_filled_slots_ += num;
+  }
+
+  if (ctx.num_filled_slots_ > 0) {
+    ctx.rx_buffer_full_ = false;
+    return;
+  }
+  // The RX buffer is full, and the NIC drops the packets that arrive
+  const uint64_t num_fill_ring_empty = socket.NumFillRingEmpty();
+  if (ctx.rx_buffer_full_ == false) {
+    ctx.rx_buffer_full_ = true;
+  } else if (num_fill_ring_empty > ctx.num_fill_ring_empty_) {
+    if (cfg_->DropLateFrames() == false) {
+      MLPD_ERROR("TXRX thread %d rx_buffer full, offset: %zu\n", tid,
+                 ctx.next_fill_slot_);
+      cfg_->Running(false);
+    }
+    num_rx_ring_drops_ += num_fill_ring_empty - ctx.num_fill_ring_empty_;
+  }
+  ctx.num_fill_ring_empty_ = num_fill_ring_empty;
+}
+
+size_t PacketTXRX::RecvEnqueueXdp(int tid, XdpContext& ctx,
+                                  int& prev_frame_id) {
+  XdpSocket& socket = *xdp_sockets_.at(tid);
+  std::array<uint8_t*, kXdpBatchSize> frames;
+  std::array<size_t, kXdpBatchSize> lens;
+  const size_t num_frames =
+      socket.Recv(frames.data(), lens.data(), kXdpBatchSize);
+  if (num_frames == 0) {
+    return 0;
+  }
+
+  char* rx_buffer = (*buffer_)[tid];
+  int* rx_buffer_status = (*buffer_status_)[tid];
+  const size_t packet_length = cfg_->PacketLength();
+  const size_t port_lo = cfg_->BsServerPort();
+  const size_t port_hi = cfg_->BsServerPort() + cfg_->NumRadios();
+  std::array<EventData, kXdpBatchSize> rx_events;
+  size_t num_rx = 0;
+  for (size_t i = 0; i < num_frames; i++) {
+    // Frames that are not Agora's packets leave their slot free, to be
+    // handed to the kernel again in ring order
+    const size_t rx_offset =
+        static_cast<size_t>(reinterpret_cast<char*>(frames[i]) - rx_buffer) /
+        cfg_->PacketBufferStride();
+    ctx.filled_.at(rx_offset) = false;
+    ctx.num_filled_slots_--;
+
+    // The socket receives all traffic of its queue. The kernel does not see
+    // it, so ARP requests for the server address are answered here.
+    uint8_t arp_reply[ETH_FRAME_LEN];
+    const size_t arp_len = XdpSocket::WriteArpReply(
+        frames[i], lens[i], xdp_server_addr_, socket.Mac().data(), arp_reply);
+    if (arp_len > 0) {
+      uint8_t* tx_frame = socket.AllocTxFrame();
+      if (tx_frame != nullptr) {
+        std::memcpy(tx_frame, arp_reply, arp_len);
+        socket.Send(tx_frame, arp_len);
+        socket.FlushTx();
+      }
+      continue;
+    }
+
+    // The payload is in place unless the IPv4 header has options
+    auto* pkt = reinterpret_cast<Packet*>(
+        &rx_buffer[cfg_->PacketBufferOffset(rx_offset)]);
+    uint32_t src_addr;
+    uint16_t dst_port;
+    size_t payload_len;
+    const uint8_t* payload = XdpSocket::ParseUdp(
+        frames[i], lens[i], &src_addr, &dst_port, &payload_len);
+    if ((payload != reinterpret_cast<const uint8_t*>(pkt)) ||
+        (src_addr != xdp_rru_addr_) || (dst_port < port_lo) ||
+        (dst_port >= port_hi) || (payload_len != packet_length)) {
+      continue;
+    }
+    if (xdp_rru_mac_known_.load(std::memory_order_acquire) == false) {
+      std::call_once(xdp_rru_mac_once_, [&]() {
+        const auto* eth = reinterpret_cast<const struct ethhdr*>(frames[i]);
+        std::memcpy(xdp_rru_mac_.data(), eth->h_source, ETH_ALEN);
+        xdp_rru_mac_known_.store(true, std::memory_order_release);
+      });
+    }
+
+    // The slot was free when it was handed to the kernel
+    RecordRx(tid, pkt);
+    pkt->ant_id_ += pkt->cell_id_ * ant_per_cell_;
+    rx_buffer_status[rx_offset] = 1;
+    Tracer::Record(
+        EventType::kPacketRX,
+        gen_tag_t::FrmSymAnt(pkt->frame_id_, pkt->symbol_id_, pkt->ant_id_)
+            .tag_,
+        TracePhase::kInstant);
+
+    if (kIsWorkerTimingEnabled) {
+      const int frame_id = pkt->frame_id_;
+      if (frame_id > prev_frame_id) {
+        (*frame_start_)[tid][frame_id % kNumStatsFrames] = GetTime::Rdtsc();
+        prev_frame_id = frame_id;
+      }
+    }
+    rx_events[num_rx] =
+        EventData(EventType::kPacketRX, rx_tag_t(tid, rx_offset).tag_);
+    num_rx++;
+  }
+  socket.RecvDone();
+
+  if (num_rx > 0) {
+    RtAssert(message_queue_->enqueue_bulk(*rx_ptoks_[tid], rx_events.data(),
+                                          num_rx),
+             "Socket message enqueue failed\n");
+  }
+  return num_frames;
+}
+
+int PacketTXRX::DequeueSendXdp(int tid) {
+  std::array<EventData, kXdpBatchSize> events;
+  const size_t num_events = task_queue_->try_dequeue_bulk_from_producer(
+      *tx_ptoks_[tid], events.data(), kXdpBatchSize);
+  if (num_events == 0) {
+    return -1;
+  }
+
+  for (size_t i = 0; i < num_events; i++) {
+    assert(events[i].event_type_ == EventType::kPacketTX);
+    struct Packet* pkt = PrepareTxPacket(tid, events[i].tags_[0]);
+    SendXdp(tid, pkt->ant_id_, reinterpret_cast<uint8_t*>(pkt),
+            cfg_->DlPacketLength());
+    Tracer::Record(EventType::kPacketTX, events[i].tags_[0],
+                   TracePhase::kInstant);
+  }
+  xdp_sockets_.at(tid)->FlushTx();
+
+  // The completion events are the dequeued kPacketTX events
+  RtAssert(message_queue_->enqueue_bulk(*rx_ptoks_[tid], events.data(),
+                                        num_events),
+           "Socket message enqueue failed\n");
+  return num_events;
+}
+
+void PacketTXRX::SendBeaconXdp(int tid, size_t frame_id) {
+  const size_t radio_lo = tid * cfg_->NumRadios() / socket_thread_num_;
+  const size_t radio_hi = (tid + 1) * cfg_->NumRadios() / socket_thread_num_;
+  std::vector<uint8_t> beacon(cfg_->PacketLength(), 0);
+  auto* pkt = reinterpret_cast<Packet*>(beacon.data());
+
+  for (size_t beacon_sym = 0; beacon_sym < cfg_->Frame().NumBeaconSyms();
+       beacon_sym++) {
+    for (size_t ant_id = radio_lo; ant_id < radio_hi; ant_id++) {
+      new (pkt) Packet(frame_id, cfg_->Frame().GetBeaconSymbol(beacon_sym),
+                       0 /* cell_id */, ant_id);
+      SendXdp(tid, ant_id, beacon.data(), beacon.size());
+    }
+  }
+  xdp_sockets_.at(tid)->FlushTx();
+}
+
+bool PacketTXRX::SendXdp(int tid, size_t ant_id, const uint8_t* payload,
+                         size_t len) {
+  XdpSocket& socket = *xdp_sockets_.at(tid);
+  uint8_t* frame = socket.AllocTxFrame();
+  while (frame == nullptr) {
+    // All TX frames are in flight. Wait for the kernel to complete some,
+    // unless Agora is stopping and the link may no longer complete them.
+    if (cfg_->Running() == false) {
+      MLPD_WARN("TXRX thread %d: dropping an XDP packet at shutdown\n", tid);
+      return false;
+    }
+    socket.FlushTx();
+    frame = socket.AllocTxFrame();
+  }
+
+  const uint8_t* dst_mac =
+      (xdp_rru_mac_known_.load(std::memory_order_acquire) == true)
+          ? xdp_rru_mac_.data()
+          : kBroadcastMac;
+  XdpSocket::WriteUdpHeaders(frame, socket.Mac().data(), dst_mac,
+                             xdp_server_addr_, xdp_rru_addr_,
+                             htons(cfg_->BsServerPort() + ant_id),
+                             htons(cfg_->BsRruPort() + ant_id), len);
+  std::memcpy(frame + kXdpPayloadOffset, payload, len);
+  socket.Send(frame, kXdpPayloadOffset + len);
+  return true;
+}
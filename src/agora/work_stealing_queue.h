@@ -0,0 +1,126 @@
+/**
+ * @file work_stealing_queue.h
+ * @brief Declaration file for the WorkStealingQueues class. Each worker owns
+ * one task deque; it serves its own deque first and steals from its peers
+ * only when the local deque is empty.
+ */
+#ifndef WORK_STEALING_QUEUE_H_
+#define WORK_STEALING_QUEUE_H_
+
+#include <immintrin.h>
+
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <vector>
+
+/// Task deques for worker threads. T is the task type, e.g., EventData.
+template <typename T>
+class WorkStealingQueues {
+ public:
+  explicit WorkStealingQueues(size_t num_workers)
+      : deques_(num_workers), next_push_(0) {
+    for (auto& deque : deques_) {
+      deque = std::make_unique<WorkerDeque>();
+    }
+  }
+
+  /// Add a task to the deque of worker tid
+  void Push(size_t tid, const T& event) {
+    WorkerDeque& deque = *deques_.at(tid);
+    deque.Lock();
+    deque.tasks_.push_back(event);
+    deque.size_.store(deque.tasks_.size(), std::memory_order_release);
+    deque.Unlock();
+  }
+
+  /// Add a task to the deques in round-robin order. Safe to call from any
+  /// thread.
+  void Push(const T& event) {
+    Push(next_push_.fetch_add(1, std::memory_order_relaxed) % deques_.size(),
+         event);
+  }
+
+  /// Dequeue a task for worker tid. The oldest task in the worker's own deque
+  /// is returned first. If it is empty, the newest task of the first
+  /// non-empty peer deque (starting at tid + 1) is stolen.
+  bool TryPop(size_t tid, T& event) {
+    if (TryPopFront(*deques_.at(tid), event) == true) {
+      return true;
+    }
+    for (size_t i = 1; i < deques_.size(); i++) {
+      if (TrySteal(*deques_.at((tid + i) % deques_.size()), event) == true) {
+        num_steals_.fetch_add(1, std::memory_order_relaxed);
+        return true;
+      }
+    }
+    return false;
+  }
+
+  /// Approximate number of queued tasks in the deque of worker tid
+  size_t SizeApprox(size_t tid) const {
+    return deques_.at(tid)->size_.load(std::memory_order_relaxed);
+  }
+
+  /// Total number of successful steals since construction
+  size_t NumSteals() const {
+    return num_steals_.load(std::memory_order_relaxed);
+  }
+
+  size_t NumWorkers() const { return deques_.size(); }
+
+ private:
+  /// A task deque guarded by a spinlock. Critical sections are a single
+  /// push/pop, so spinning is cheaper than sleeping on a mutex.
+  struct alignas(64) WorkerDeque {
+    void Lock() {
+      while (lock_.test_and_set(std::memory_order_acquire) == true) {
+        _mm_pause();
+      }
+    }
+    void Unlock() { lock_.clear(std::memory_order_release); }
+
+    std::atomic_flag lock_ = ATOMIC_FLAG_INIT;
+    // Read without the lock to skip empty deques cheaply
+    std::atomic<size_t> size_{0};
+    std::deque<T> tasks_;
+  };
+
+  static bool TryPopFront(WorkerDeque& deque, T& event) {
+    if (deque.size_.load(std::memory_order_acquire) == 0) {
+      return false;
+    }
+    bool found = false;
+    deque.Lock();
+    if (deque.tasks_.empty() == false) {
+      event = deque.tasks_.front();
+      deque.tasks_.pop_front();
+      deque.size_.store(deque.tasks_.size(), std::memory_order_release);
+      found = true;
+    }
+    deque.Unlock();
+    return found;
+  }
+
+  static bool TrySteal(WorkerDeque& deque, T& event) {
+    if (deque.size_.load(std::memory_order_acquire) == 0) {
+      return false;
+    }
+    bool found = false;
+    deque.Lock();
+    if (deque.tasks_.empty() == false) {
+      event = deque.tasks_.back();
+      deque.tasks_.pop_back();
+      deque.size_.store(deque.tasks_.size(), std::memory_order_release);
+      found = true;
+    }
+    deque.Unlock();
+    return found;
+  }
+
+  std::vector<std::unique_ptr<WorkerDeque>> deques_;
+  std::atomic<size_t> next_push_;
+  std::atomic<size_t> num_steals_{0};
+};
+
+#endif  // WORK_STEALING_QUEUE_H_
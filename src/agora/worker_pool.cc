@@ -0,0 +1,216 @@
+/**
+ * @file worker_pool.cc
+ * @brief Implementation file for the WorkerPool class
+ */
+#include "worker_pool.h"
+
+#include <cmath>
+
+#include "logger.h"
+#include "utils.h"
+
+static const char* RoleName(WorkerRole role) {
+  switch (role) {
+    case WorkerRole::kUplink:
+      return "uplink";
+    case WorkerRole::kDownlink:
+      return "downlink";
+    case WorkerRole::kParked:
+      return "parked";
+  }
+  return "unknown";
+}
+
+WorkerPool::WorkerPool(Config* const cfg)
+    : cfg_(cfg),
+      worker_num_(cfg->WorkerThreadNum()),
+      interval_(cfg->ElasticPoolInterval()),
+      window_start_tsc_(GetTime::Rdtsc()) {
+  const size_t ul_syms = cfg->Frame().NumULSyms();
+  const size_t dl_syms = cfg->Frame().NumDLSyms();
+  RtAssert(((ul_syms == 0) || (dl_syms == 0)) || (worker_num_ >= 2),
+           "The elastic worker pool needs at least two workers when the "
+           "frame has both uplink and downlink symbols");
+
+  // Split the workers in proportion to the number of symbols per direction
+  size_t num_ul = worker_num_;
+  if (ul_syms == 0) {
+    num_ul = 0;
+  } else if (dl_syms > 0) {
+    num_ul = static_cast<size_t>(std::lround(
+        static_cast<double>(worker_num_ * ul_syms) / (ul_syms + dl_syms)));
+    num_ul = std::min(std::max(num_ul, 1ul), worker_num_ - 1);
+  }
+  for (size_t i = 0; i < worker_num_; i++) {
+    worker_roles_.at(i) =
+        (i < num_ul) ? WorkerRole::kUplink : WorkerRole::kDownlink;
+  }
+  MLPD_INFO("WorkerPool: %zu uplink workers, %zu downlink workers\n", num_ul,
+            worker_num_ - num_ul);
+}
+
+bool WorkerPool::Serves(WorkerRole role, EventType event_type) {
+  switch (event_type) {
+    case EventType::kFFT:
+    case EventType::kZF:
+      return role != WorkerRole::kParked;
+    case EventType::kDemul:
+    case EventType::kDecode:
+      return role == WorkerRole::kUplink;
+    case EventType::kEncode:
+    case EventType::kPrecode:
+    case EventType::kIFFT:
+      return role == WorkerRole::kDownlink;
+    default:
+      return false;
+  }
+}
+
+WorkerPool::StageGroup WorkerPool::GroupOf(EventType event_type) {
+  switch (event_type) {
+    case EventType::kDemul:
+    case EventType::kDecode:
+      return StageGroup::kUplink;
+    case EventType::kEncode:
+    case EventType::kPrecode:
+    case EventType::kIFFT:
+      return StageGroup::kDownlink;
+    default:
+      return StageGroup::kShared;
+  }
+}
+
+void WorkerPool::Update(
+    size_t frame_id, double frame_latency_us,
+    const std::array<size_t, kNumEventTypes>& queue_depths) {
+  window_frames_++;
+  window_latency_us_ += frame_latency_us;
+  if (window_frames_ < interval_) {
+    return;
+  }
+
+  const double avg_latency_us = window_latency_us_ / window_frames_;
+  if (last_change_frame_ != SIZE_MAX) {
+    MLPD_INFO(
+        "WorkerPool: frame latency after change at frame %zu: %.1f us "
+        "(before: %.1f us)\n",
+        last_change_frame_, avg_latency_us, latency_before_us_);
+    last_change_frame_ = SIZE_MAX;
+  }
+
+  const size_t now_tsc = GetTime::Rdtsc();
+  const size_t ul_cycles = TotalCycles(StageGroup::kUplink);
+  const size_t dl_cycles = TotalCycles(StageGroup::kDownlink);
+  const size_t shared_cycles = TotalCycles(StageGroup::kShared);
+  const double ul_delta = ul_cycles - ul_cycles_old_;
+  const double dl_delta = dl_cycles - dl_cycles_old_;
+  const double shared_delta = shared_cycles - shared_cycles_old_;
+
+  const size_t num_ul = NumWorkers(WorkerRole::kUplink);
+  const size_t num_dl = NumWorkers(WorkerRole::kDownlink);
+  const size_t num_parked = NumWorkers(WorkerRole::kParked);
+  const double utilization =
+      (ul_delta + dl_delta + shared_delta) /
+      (static_cast<double>(num_ul + num_dl) * (now_tsc - window_start_tsc_));
+  size_t backlog = 0;
+  for (size_t i = 0; i < kNumEventTypes; i++) {
+    const auto event_type = static_cast<EventType>(i);
+    if ((Serves(WorkerRole::kUplink, event_type) == true) ||
+        (Serves(WorkerRole::kDownlink, event_type) == true)) {
+      backlog += queue_depths.at(i);
+    }
+  }
+
+  // Per-worker load of each group, or -1 if the frame has no symbols in
+  // that direction
+  const bool has_ul = cfg_->Frame().NumULSyms() > 0;
+  const bool has_dl = cfg_->Frame().NumDLSyms() > 0;
+  const double ul_load = has_ul ? ul_delta / std::max(num_ul, 1ul) : -1;
+  const double dl_load = has_dl ? dl_delta / std::max(num_dl, 1ul) : -1;
+  const WorkerRole busier =
+      (ul_load >= dl_load) ? WorkerRole::kUplink : WorkerRole::kDownlink;
+  const WorkerRole idler =
+      (busier == WorkerRole::kUplink) ? WorkerRole::kDownlink
+                                      : WorkerRole::kUplink;
+
+  if ((num_parked > 0) &&
+      ((utilization > kUnparkUtilization) || (backlog > num_ul + num_dl))) {
+    Reassign(FindWorker(WorkerRole::kParked), busier, frame_id,
+             (backlog > num_ul + num_dl) ? "queue backlog"
+                                          : "high utilization");
+  } else if ((utilization < kParkUtilization) && (backlog == 0)) {
+    // Keep at least one worker in each group that has symbols to process
+    const bool has_idler = (idler == WorkerRole::kUplink) ? has_ul : has_dl;
+    if (NumWorkers(idler) > (has_idler ? 1 : 0)) {
+      Reassign(FindWorker(idler), WorkerRole::kParked, frame_id,
+               "low utilization");
+    } else if (NumWorkers(busier) > 1) {
+      Reassign(FindWorker(busier), WorkerRole::kParked, frame_id,
+               "low utilization");
+    }
+  } else if ((has_ul == true) && (has_dl == true) &&
+             (NumWorkers(idler) > 1)) {
+    const bool ul_busier = (busier == WorkerRole::kUplink);
+    const double busy_load = ul_busier ? ul_load : dl_load;
+    const double idle_load = ul_busier ? dl_load : ul_load;
+    if (busy_load > kImbalanceRatio * idle_load) {
+      Reassign(FindWorker(idler), busier, frame_id,
+               ul_busier ? "uplink overloaded" : "downlink overloaded");
+    }
+  }
+  if (last_change_frame_ != SIZE_MAX) {
+    latency_before_us_ = avg_latency_us;
+  }
+
+  window_frames_ = 0;
+  window_latency_us_ = 0;
+  window_start_tsc_ = now_tsc;
+  ul_cycles_old_ = ul_cycles;
+  dl_cycles_old_ = dl_cycles;
+  shared_cycles_old_ = shared_cycles;
+}
+
+void WorkerPool::Reassign(size_t tid, WorkerRole role, size_t frame_id,
+                          const char* reason) {
+  const WorkerRole old_role = Role(tid);
+  worker_roles_.at(tid).store(role, std::memory_order_relaxed);
+  if (old_role == WorkerRole::kParked) {
+    park_waker_.Notify();
+  }
+  last_change_frame_ = frame_id;
+  MLPD_INFO(
+      "WorkerPool: frame %zu: worker %zu %s -> %s (%s). %zu uplink, %zu "
+      "downlink, %zu parked workers\n",
+      frame_id, tid, RoleName(old_role), RoleName(role), reason,
+      NumWorkers(WorkerRole::kUplink), NumWorkers(WorkerRole::kDownlink),
+      NumWorkers(WorkerRole::kParked));
+}
+
+size_t WorkerPool::FindWorker(WorkerRole role) const {
+  for (size_t i = worker_num_; i > 0; i--) {
+    if (Role(i - 1) == role) {
+      return i - 1;
+    }
+  }
+  return SIZE_MAX;
+}
+
+size_t WorkerPool::NumWorkers(WorkerRole role) const {
+  size_t count = 0;
+  for (size_t i = 0; i < worker_num_; i++) {
+    if (Role(i) == role) {
+      count++;
+    }
+  }
+  return count;
+}
+
+size_t WorkerPool::TotalCycles(StageGroup group) const {
+  size_t total_cycles = 0;
+  for (size_t i = 0; i < worker_num_; i++) {
+    total_cycles += busy_cycles_.at(i)
+                        .cycles_.at(static_cast<size_t>(group))
+                        .load(std::memory_order_relaxed);
+  }
+  return total_cycles;
+}
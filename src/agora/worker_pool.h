@@ -0,0 +1,119 @@
+/**
+ * @file worker_pool.h
+ * @brief Declaration file for the WorkerPool class. It assigns worker threads
+ * to the uplink or downlink stage group, or parks them, and moves workers
+ * between groups at runtime based on queue depths and per-Doer run time.
+ */
+#ifndef WORKER_POOL_H_
+#define WORKER_POOL_H_
+
+#include <array>
+#include <atomic>
+
+#include "config.h"
+#include "idle_policy.h"
+#include "symbols.h"
+
+enum class WorkerRole : uint8_t {
+  kUplink,    // FFT, ZF, Demul, Decode
+  kDownlink,  // FFT, ZF, Encode, Precode, IFFT
+  kParked     // No tasks; sleeps until unparked
+};
+
+class WorkerPool {
+ public:
+  explicit WorkerPool(Config* const cfg);
+
+  /// From a worker, return whether role allows running tasks of event_type
+  static bool Serves(WorkerRole role, EventType event_type);
+
+  /// From a worker, get its current role
+  inline WorkerRole Role(size_t tid) const {
+    return worker_roles_.at(tid).load(std::memory_order_relaxed);
+  }
+
+  /// From worker tid, account the cycles it spent running a task of
+  /// event_type. The master reads these counters in Update().
+  inline void AddBusyCycles(size_t tid, EventType event_type, size_t cycles) {
+    std::atomic<size_t>& busy_cycles = busy_cycles_.at(tid).cycles_.at(
+        static_cast<size_t>(GroupOf(event_type)));
+    // Only worker tid writes its counters, so no read-modify-write is needed
+    busy_cycles.store(busy_cycles.load(std::memory_order_relaxed) + cycles,
+                      std::memory_order_relaxed);
+  }
+
+  /// From a parked worker, sleep until it is unparked or a timeout expires
+  inline void WaitWhileParked(size_t tid) {
+    const uint32_t seq = park_waker_.PrepareWait();
+    if (Role(tid) == WorkerRole::kParked) {
+      park_waker_.Wait(seq, kParkSleepUs * 1000);
+    } else {
+      park_waker_.CancelWait();
+    }
+  }
+
+  /// From the master, account for a completed frame. Every
+  /// ElasticPoolInterval() frames, move or park/unpark at most one worker.
+  /// queue_depths holds the number of queued tasks per event type.
+  void Update(size_t frame_id, double frame_latency_us,
+              const std::array<size_t, kNumEventTypes>& queue_depths);
+
+ private:
+  static constexpr size_t kParkSleepUs = 1000;
+  // A group is overloaded if its load per worker is this many times that of
+  // the other group
+  static constexpr double kImbalanceRatio = 1.5;
+  // Park a worker below this utilization, unpark one above it
+  static constexpr double kParkUtilization = 0.3;
+  static constexpr double kUnparkUtilization = 0.7;
+
+  // Groups of stages whose run time is accounted together
+  enum class StageGroup : size_t {
+    kUplink,    // Demul, Decode
+    kDownlink,  // Encode, Precode, IFFT
+    kShared,    // FFT and ZF, served by both worker groups
+    kNumGroups
+  };
+  static constexpr size_t kNumStageGroups =
+      static_cast<size_t>(StageGroup::kNumGroups);
+
+  /// Per-worker busy cycles of each stage group, written only by the worker
+  struct alignas(64) BusyCycles {
+    std::array<std::atomic<size_t>, kNumStageGroups> cycles_{};
+  };
+
+  static StageGroup GroupOf(EventType event_type);
+
+  /// Move worker tid to role and log the change
+  void Reassign(size_t tid, WorkerRole role, size_t frame_id,
+                const char* reason);
+  /// Return the highest-numbered worker with role, or SIZE_MAX if none
+  size_t FindWorker(WorkerRole role) const;
+  size_t NumWorkers(WorkerRole role) const;
+  /// Total busy cycles of all workers in stage group
+  size_t TotalCycles(StageGroup group) const;
+
+  Config* const cfg_;
+  const size_t worker_num_;
+  const size_t interval_;
+
+  std::array<std::atomic<WorkerRole>, kMaxThreads> worker_roles_;
+  IdleWaker park_waker_;
+  std::array<BusyCycles, kMaxThreads> busy_cycles_;
+
+  // State of the current evaluation window
+  size_t window_frames_ = 0;
+  double window_latency_us_ = 0;
+  size_t window_start_tsc_;
+  size_t ul_cycles_old_ = 0;
+  size_t dl_cycles_old_ = 0;
+  size_t shared_cycles_old_ = 0;  // FFT, CSI and ZF, served by both groups
+
+  // Frame of the last reassignment, and the average frame latency in the
+  // window before it. The latency after is logged at the end of the next
+  // window.
+  size_t last_change_frame_ = SIZE_MAX;
+  double latency_before_us_ = 0;
+};
+
+#endif  // WORKER_POOL_H_
@@ -0,0 +1,262 @@
+/**
+ * @file bfp.h
+ * @brief Block floating point (BFP) compression of IQ samples for the
+ * fronthaul, in the style of O-RAN's BFP compression
+ */
+#ifndef BFP_H_
+#define BFP_H_
+
+#include <immintrin.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+/*
+ * The samples are compressed in blocks of one PRB (12 IQ samples). A block
+ * is a one-byte exponent followed by the 24 mantissas of the block's I and Q
+ * values, each iq_width bits wide. A value is its mantissa shifted left by
+ * the exponent, in units of 1/32768 as in the 16-bit fixed-point format.
+ * Values are not limited to 16 bits, so that frequency-domain samples, which
+ * the FFT scales up, keep their dynamic range.
+ *
+ * Unlike O-RAN, the mantissas are packed least significant bit first, so
+ * that the decompressor extracts them with shifts of little-endian loads.
+ */
+static constexpr size_t kBfpBlockSamples = 12;
+static constexpr size_t kBfpBlockValues = 2 * kBfpBlockSamples;
+// The decompressor loads 16 bytes for each group of 8 mantissas, which may
+// extend this many bytes past the last block with 9-bit mantissas
+static constexpr size_t kBfpLoadSlack = 16 - 9;
+// Largest magnitude of a value before compression
+static constexpr int32_t kBfpMaxValue = (1 << 23) - 1;
+
+static inline bool BfpIqWidthValid(size_t iq_width) {
+  return (iq_width == 9) || (iq_width == 12) || (iq_width == 14);
+}
+
+// Bytes of one compressed block
+static inline size_t BfpBlockBytes(size_t iq_width) {
+  return 1 + (kBfpBlockValues * iq_width / 8);
+}
+
+// Bytes of num_samples compressed IQ samples, including the slack for the
+// decompressor's loads
+static inline size_t BfpCompressedBytes(size_t num_samples, size_t iq_width) {
+  return ((num_samples + kBfpBlockSamples - 1) / kBfpBlockSamples) *
+             BfpBlockBytes(iq_width) +
+         kBfpLoadSlack;
+}
+
+// Round a block's values to mantissas of kIqWidth bits and pack them. A
+// group of 8 mantissas takes kIqWidth bytes.
+template <size_t kIqWidth>
+static inline void BfpPackMantissas(const __m256i* values, int32_t exponent,
+                                    uint8_t* out) {
+  const __m256i round =
+      _mm256_set1_epi32((exponent > 0) ? (1 << (exponent - 1)) : 0);
+  const __m256i shift = _mm256_set1_epi32(exponent);
+  const __m256i max_mantissa = _mm256_set1_epi32((1 << (kIqWidth - 1)) - 1);
+  const __m256i mask = _mm256_set1_epi64x((1ul << kIqWidth) - 1);
+  for (size_t g = 0; g < kBfpBlockValues / 8; g++) {
+    const __m256i m = _mm256_min_epi32(
+        _mm256_srav_epi32(_mm256_add_epi32(values[g], round), shift),
+        max_mantissa);
+    // Each 64-bit lane holds a pair of mantissas, in its low 2 * kIqWidth bits
+    const __m256i pairs = _mm256_or_si256(
+        _mm256_and_si256(m, mask),
+        _mm256_slli_epi64(_mm256_and_si256(_mm256_srli_epi64(m, 32), mask),
+                          kIqWidth));
+    // Then each 64-bit lane holds four mantissas
+    const __m256i quads = _mm256_or_si256(
+        pairs, _mm256_slli_epi64(_mm256_srli_si256(pairs, 8), 2 * kIqWidth));
+    const uint64_t lo = _mm256_extract_epi64(quads, 0);
+    const uint64_t hi = _mm256_extract_epi64(quads, 2);
+    const uint64_t word0 = lo | (hi << (4 * kIqWidth));
+    const uint64_t word1 = hi >> (64 - 4 * kIqWidth);
+    std::memcpy(out + g * kIqWidth, &word0, sizeof(word0));
+    std::memcpy(out + g * kIqWidth + sizeof(word0), &word1,
+                kIqWidth - sizeof(word0));
+  }
+}
+
+// Compress num_samples complex floats of in_buf to out_buf. The samples are
+// multiplied by scale to get fixed-point values, which saturate at
+// kBfpMaxValue. If num_samples is not a multiple of kBfpBlockSamples, the
+// last block is padded with zeros.
+static inline void BfpCompress(const float* in_buf, uint8_t* out_buf,
+                               size_t num_samples, size_t iq_width,
+                               float scale = 32768.f) {
+  const size_t num_values = 2 * num_samples;
+  for (size_t i = 0; i < num_values; i += kBfpBlockValues) {
+    __m256i values[kBfpBlockValues / 8];
+    int32_t max_abs = 0;
+    if (i + kBfpBlockValues <= num_values) {
+      const __m256 scale_vec = _mm256_set1_ps(scale);
+      // Saturate before the conversion, which overflows to INT32_MIN
+      const __m256 lo = _mm256_set1_ps(-kBfpMaxValue);
+      const __m256 hi = _mm256_set1_ps(kBfpMaxValue);
+      __m256i max_vec = _mm256_setzero_si256();
+      for (size_t g = 0; g < kBfpBlockValues / 8; g++) {
+        const __m256 scaled =
+            _mm256_mul_ps(_mm256_loadu_ps(in_buf + i + 8 * g), scale_vec);
+        const __m256i val = _mm256_cvtps_epi32(
+            _mm256_min_ps(_mm256_max_ps(scaled, lo), hi));
+        values[g] = val;
+        // The magnitude of v < 0 is taken as ~v, which has the same number
+        // of significant bits
+        max_vec = _mm256_max_epi32(
+            max_vec, _mm256_xor_si256(val, _mm256_srai_epi32(val, 31)));
+      }
+      __m128i max4 = _mm_max_epi32(_mm256_castsi256_si128(max_vec),
+                                   _mm256_extracti128_si256(max_vec, 1));
+      max4 = _mm_max_epi32(max4, _mm_shuffle_epi32(max4, 0x4e));
+      max4 = _mm_max_epi32(max4, _mm_shuffle_epi32(max4, 0xb1));
+      max_abs = _mm_cvtsi128_si32(max4);
+    } else {
+      alignas(32) int32_t tail[kBfpBlockValues];
+      for (size_t j = 0; j < kBfpBlockValues; j++) {
+        int32_t val = 0;
+        if (i + j < num_values) {
+          val = std::lrint(std::clamp<float>(in_buf[i + j] * scale,
+                                             -kBfpMaxValue, kBfpMaxValue));
+        }
+        tail[j] = val;
+        max_abs = std::max(max_abs, val ^ (val >> 31));
+      }
+      for (size_t g = 0; g < kBfpBlockValues / 8; g++) {
+        values[g] =
+            _mm256_load_si256(reinterpret_cast<__m256i*>(tail + 8 * g));
+      }
+    }
+
+    // Bits of the largest value, with its sign bit
+    const int32_t num_bits =
+        (max_abs == 0) ? 1 : 33 - __builtin_clz(static_cast<uint32_t>(max_abs));
+    const int32_t exponent =
+        std::max<int32_t>(0, num_bits - static_cast<int32_t>(iq_width));
+    uint8_t* out = out_buf + (i / kBfpBlockValues) * BfpBlockBytes(iq_width);
+    *out = exponent;
+    switch (iq_width) {
+      case 9:
+        BfpPackMantissas<9>(values, exponent, out + 1);
+        break;
+      case 12:
+        BfpPackMantissas<12>(values, exponent, out + 1);
+        break;
+      default:
+        BfpPackMantissas<14>(values, exponent, out + 1);
+        break;
+    }
+  }
+}
+
+// Extract the 8 mantissas of a group, whose 16 bytes (from the group's first
+// byte) are in both 128-bit lanes of group, and scale them to floats
+static inline __m256 BfpUnpack8(__m256i group, __m256i byte_shuffle,
+                                __m256i shift_left, __m256i shift_right,
+                                __m256 scale) {
+  __m256i val = _mm256_shuffle_epi8(group, byte_shuffle);
+  val = _mm256_srav_epi32(_mm256_sllv_epi32(val, shift_left), shift_right);
+  return _mm256_mul_ps(_mm256_cvtepi32_ps(val), scale);
+}
+
+#if defined(__AVX512BW__)
+// BfpUnpack8 for two consecutive groups, the first in the lower and the
+// second in the upper 256 bits of groups
+static inline __m512 BfpUnpack16(__m512i groups, __m512i byte_shuffle,
+                                 __m512i shift_left, __m512i shift_right,
+                                 __m512 scale) {
+  __m512i val = _mm512_shuffle_epi8(groups, byte_shuffle);
+  val = _mm512_srav_epi32(_mm512_sllv_epi32(val, shift_left), shift_right);
+  return _mm512_mul_ps(_mm512_cvtepi32_ps(val), scale);
+}
+#endif
+
+// Decompress the num_samples IQ samples starting at sample first_sample of
+// the compressed in_buf to complex floats in out_buf, in the units of
+// SimdConvertShortToFloat. out_buf need not be aligned. Two of the three
+// groups of a block are decompressed together with AVX-512BW.
+static inline void SimdBfpDecompress(const uint8_t* in_buf, float* out_buf,
+                                     size_t first_sample, size_t num_samples,
+                                     size_t iq_width) {
+  const size_t block_bytes = BfpBlockBytes(iq_width);
+
+  // Value i of a group of 8 values starts at bit i * iq_width of the group,
+  // and a group takes iq_width bytes. Each value is shuffled into a 32-bit
+  // lane from the 4 bytes that start with its first bit, shifted left to drop
+  // the following bits, then shifted right to sign-extend it.
+  alignas(32) uint8_t shuffle[32];
+  alignas(32) int32_t shl[8];
+  for (size_t i = 0; i < 8; i++) {
+    for (size_t j = 0; j < 4; j++) {
+      // Values 4 to 7 are in the upper lane, which also holds the group
+      shuffle[4 * i + j] = (i * iq_width) / 8 + j;
+    }
+    shl[i] = 32 - iq_width - ((i * iq_width) % 8);
+  }
+  const __m256i byte_shuffle =
+      _mm256_load_si256(reinterpret_cast<__m256i*>(shuffle));
+  const __m256i shift_left = _mm256_load_si256(reinterpret_cast<__m256i*>(shl));
+  const __m256i shift_right = _mm256_set1_epi32(32 - iq_width);
+#if defined(__AVX512BW__)
+  // The same shuffle and shifts for each group of the two in a register
+  const __m512i byte_shuffle_x2 = _mm512_broadcast_i64x4(byte_shuffle);
+  const __m512i shift_left_x2 = _mm512_broadcast_i64x4(shift_left);
+  const __m512i shift_right_x2 = _mm512_set1_epi32(32 - iq_width);
+#endif
+
+  const size_t end_sample = first_sample + num_samples;
+  for (size_t block = first_sample / kBfpBlockSamples;
+       block * kBfpBlockSamples < end_sample; block++) {
+    const uint8_t* in = in_buf + block * block_bytes;
+    // 2^exponent / 32768, built from the float's exponent bits
+    const uint32_t scale_bits = static_cast<uint32_t>(127 + in[0] - 15) << 23;
+    float scale_float;
+    std::memcpy(&scale_float, &scale_bits, sizeof(scale_float));
+    const __m256 scale = _mm256_set1_ps(scale_float);
+    const uint8_t* mantissas = in + 1;
+
+    // Blocks cut by the range are decompressed to a temporary buffer
+    const size_t block_first = block * kBfpBlockSamples;
+    const bool whole = (block_first >= first_sample) &&
+                       (block_first + kBfpBlockSamples <= end_sample);
+    float tmp[kBfpBlockValues];
+    float* out = (whole == true) ? out_buf + 2 * (block_first - first_sample)
+                                 : tmp;
+
+#if defined(__AVX512BW__)
+    // Groups 0 and 1 in one register, then group 2
+    const __m512i groups = _mm512_inserti64x4(
+        _mm512_castsi256_si512(_mm256_broadcastsi128_si256(_mm_loadu_si128(
+            reinterpret_cast<const __m128i*>(mantissas)))),
+        _mm256_broadcastsi128_si256(_mm_loadu_si128(
+            reinterpret_cast<const __m128i*>(mantissas + iq_width))),
+        1);
+    _mm512_storeu_ps(out, BfpUnpack16(groups, byte_shuffle_x2, shift_left_x2,
+                                      shift_right_x2,
+                                      _mm512_set1_ps(scale_float)));
+    const size_t first_group = 2;
+#else
+    const size_t first_group = 0;
+#endif
+    for (size_t g = first_group; g < kBfpBlockValues / 8; g++) {
+      const __m256i group = _mm256_broadcastsi128_si256(_mm_loadu_si128(
+          reinterpret_cast<const __m128i*>(mantissas + g * iq_width)));
+      _mm256_storeu_ps(out + 8 * g, BfpUnpack8(group, byte_shuffle,
+                                               shift_left, shift_right, scale));
+    }
+
+    if (whole == false) {
+      const size_t begin = std::max(block_first, first_sample);
+      const size_t end = std::min(block_first + kBfpBlockSamples, end_sample);
+      std::memcpy(out_buf + 2 * (begin - first_sample),
+                  tmp + 2 * (begin - block_first),
+                  2 * (end - begin) * sizeof(float));
+    }
+  }
+}
+
+#endif  // BFP_H_
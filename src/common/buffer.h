@@ -5,6 +5,7 @@
 #ifndef BUFFER_H_
 #define BUFFER_H_
 
+#include <atomic>
 #include <sstream>
 #include <vector>
 
@@ -31,7 +32,19 @@ union rx_tag_t {
 };
 
 // Event data tag for FFT task requests
-using fft_req_tag_t = rx_tag_t;
+union fft_req_tag_t {
+  struct {
+    size_t tid_ : 8;      // ID of the socket thread that received the packet
+    size_t offset_ : 48;  // Offset in the socket thread's RX buffer
+    size_t ant_idx_ : 8;  // Index of the antenna in a multi-antenna packet
+  };
+  size_t tag_;
+
+  fft_req_tag_t(size_t tid, size_t offset, size_t ant_idx = 0)
+      : tid_(tid), offset_(offset), ant_idx_(ant_idx) {}
+
+  explicit fft_req_tag_t(size_t _tag) : tag_(_tag) {}
+};
 
 // A generic tag type for Agora tasks. The tag for a particular task will
 // have only a subset of the fields initialized.
@@ -182,16 +195,19 @@ struct Packet {
   uint32_t symbol_id_;
   uint32_t cell_id_;
   uint32_t ant_id_;
-  uint32_t fill_[12];  // Padding for 64-byte alignment needed for SIMD
+  uint32_t frag_id_;   // Index of the symbol fragment, if fragmented
+  uint32_t fill_[11];  // Padding for 64-byte alignment needed for SIMD
   short data_[];       // Elements sent by antennae are two bytes (I/Q samples)
-  Packet(int f, int s, int c, int a)  // TODO: Should be unsigned integers
-      : frame_id_(f), symbol_id_(s), cell_id_(c), ant_id_(a) {}
+  Packet(int f, int s, int c, int a,
+         int frag = 0)  // TODO: Should be unsigned integers
+      : frame_id_(f), symbol_id_(s), cell_id_(c), ant_id_(a), frag_id_(frag) {}
 
   std::string ToString() const {
     std::ostringstream ret;
     ret << "[Frame seq num " << frame_id_ << ", symbol ID " << symbol_id_
-        << ", cell ID " << cell_id_ << ", antenna ID " << ant_id_ << ", "
-        << sizeof(fill_) << " empty bytes]";
+        << ", cell ID " << cell_id_ << ", antenna ID " << ant_id_
+        << ", fragment ID " << frag_id_ << ", " << sizeof(fill_)
+        << " empty bytes]";
     return ret.str();
   }
 };
@@ -381,4 +397,85 @@ class FrameCounters {
   size_t max_task_count_;
 };
 
+/**
+ * @brief Thread-safe counterpart of FrameCounters, used when worker threads
+ * trigger downstream stages themselves (decentralized scheduling). For each
+ * (frame, symbol), exactly one caller of CompleteTask() observes the last
+ * completion. That caller's increment also resets the counter, so the slot
+ * is ready for reuse kFrameWnd frames later without a separate Reset().
+ */
+class SharedFrameCounters {
+ public:
+  SharedFrameCounters() { Init(0, 0); }
+
+  void Init(size_t max_symbol_count, size_t max_task_count = 0) {
+    this->max_symbol_count_ = max_symbol_count;
+    this->max_task_count_ = max_task_count;
+    for (auto& count : symbol_count_) {
+      count.store(0, std::memory_order_relaxed);
+    }
+    for (auto& frame : task_count_) {
+      for (auto& count : frame) {
+        count.store(0, std::memory_order_relaxed);
+      }
+    }
+  }
+
+  /**
+   * @brief Increments the symbol count for input frame. Returns true for
+   * exactly one caller: the one that completes the last symbol of the frame.
+   * @param frame_id The frame id of the symbol to increment
+   */
+  bool CompleteSymbol(size_t frame_id) {
+    return Increment(symbol_count_.at(frame_id % kFrameWnd),
+                     this->max_symbol_count_);
+  }
+
+  /**
+   * @brief Increments the task count for input frame and symbol. Returns true
+   * for exactly one caller: the one that completes the last task of the
+   * symbol.
+   * @param frame_id The frame id of the task to increment
+   * @param symbol_id The symbol id of the task to increment
+   */
+  bool CompleteTask(size_t frame_id, size_t symbol_id) {
+    return Increment(task_count_.at(frame_id % kFrameWnd).at(symbol_id),
+                     this->max_task_count_);
+  }
+
+  /**
+   * @brief Increments the task count for tasks performed once per frame
+   * (e.g., ZF)
+   * @param frame_id The frame id of the task to increment
+   */
+  bool CompleteTask(size_t frame_id) { return this->CompleteSymbol(frame_id); }
+
+  inline size_t MaxSymbolCount() const { return this->max_symbol_count_; }
+  inline size_t MaxTaskCount() const { return this->max_task_count_; }
+
+ private:
+  static bool Increment(std::atomic<size_t>& count, size_t max_count) {
+    // acq_rel so the last completer observes all results written by the
+    // workers that completed the earlier tasks
+    if ((count.fetch_add(1, std::memory_order_acq_rel) + 1) == max_count) {
+      count.store(0, std::memory_order_relaxed);
+      return true;
+    }
+    return false;
+  }
+
+  // task_count[i][j] is the number of tasks completed for
+  // frame (i % kFrameWnd) and symbol j
+  std::array<std::array<std::atomic<size_t>, kMaxSymbols>, kFrameWnd>
+      task_count_;
+  // symbol_count[i] is the number of symbols completed for
+  // frame (i % kFrameWnd)
+  std::array<std::atomic<size_t>, kFrameWnd> symbol_count_;
+
+  // Maximum number of symbols in a frame
+  size_t max_symbol_count_;
+  // Maximum number of tasks in a symbol
+  size_t max_task_count_;
+};
+
 #endif  // BUFFER_H_
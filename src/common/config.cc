@@ -11,6 +11,7 @@
 
 #include <boost/range/algorithm/count.hpp>
 
+#include "bfp.h"
 #include "logger.h"
 #include "nlohmann/json.hpp"
 #include "scrambler.h"
@@ -129,6 +130,8 @@ Config::Config(const std::string& jsonfile)
 
   dpdk_num_ports_ = tdd_conf.value("dpdk_num_ports", 1);
   dpdk_port_offset_ = tdd_conf.value("dpdk_port_offset", 0);
+  dpdk_zero_copy_rx_ = tdd_conf.value("dpdk_zero_copy_rx", false);
+  dpdk_vdev_ = tdd_conf.value("dpdk_vdev", "");
 
   ue_mac_tx_port_ = tdd_conf.value("ue_mac_tx_port", kMacUserRemotePort);
   ue_mac_rx_port_ = tdd_conf.value("ue_mac_rx_port", kMacUserLocalPort);
@@ -358,6 +361,87 @@ Config::Config(const std::string& jsonfile)
   zf_thread_num_ = worker_thread_num_ - fft_thread_num_ - demul_thread_num_ -
                    decode_thread_num_;
 
+  decentralized_scheduling_ = tdd_conf.value("decentralized_scheduling", false);
+  RtAssert((decentralized_scheduling_ == false) ||
+               ((bigstation_mode_ == false) &&
+                (frame_.IsRecCalEnabled() == false)),
+           "Decentralized scheduling does not support bigstation mode or "
+           "reciprocity calibration");
+
+  pipeline_depth_ = tdd_conf.value("pipeline_depth", 2);
+  RtAssert((pipeline_depth_ >= 1) && (pipeline_depth_ <= kFrameWnd),
+           "Pipeline depth must be between 1 and the frame window size");
+
+  drop_late_frames_ = tdd_conf.value("drop_late_frames", false);
+  RtAssert((drop_late_frames_ == false) ||
+               (decentralized_scheduling_ == false),
+           "Dropping late frames is not supported with decentralized "
+           "scheduling");
+
+  rx_symbol_timeout_us_ = tdd_conf.value("rx_symbol_timeout_us", 0);
+  RtAssert((rx_symbol_timeout_us_ == 0) ||
+               (this->frame_.IsRecCalEnabled() == false),
+           "RX symbol timeouts are not supported with reciprocity "
+           "calibration");
+
+  trace_ring_size_log2_ = tdd_conf.value("trace_ring_size_log2", 0);
+
+  udp_batch_size_ = tdd_conf.value("udp_batch_size", 1);
+  RtAssert((udp_batch_size_ >= 1) && (udp_batch_size_ <= kMaxUdpBatchSize),
+           "UDP batch size must be between 1 and " +
+               std::to_string(kMaxUdpBatchSize));
+
+  transport_ = tdd_conf.value("transport", "udp");
+  RtAssert((transport_ == "udp") || (transport_ == "af_xdp") ||
+               (transport_ == "io_uring") || (transport_ == "shm") ||
+               (transport_ == "replay"),
+           "Transport must be \"udp\", \"af_xdp\", \"io_uring\", \"shm\" "
+           "or \"replay\"");
+  xdp_interface_ = tdd_conf.value("xdp_interface", "");
+  RtAssert((transport_ != "af_xdp") || (xdp_interface_.empty() == false),
+           "The af_xdp transport requires xdp_interface");
+  shm_path_ = tdd_conf.value("shm_path", "/dev/shm/agora_fronthaul");
+  shm_ring_slots_ = tdd_conf.value("shm_ring_slots", 128);
+  RtAssert((shm_ring_slots_ > 0) &&
+               ((shm_ring_slots_ & (shm_ring_slots_ - 1)) == 0),
+           "shm_ring_slots must be a power of two");
+  replay_file_ = tdd_conf.value("replay_file", "");
+  replay_rate_fps_ = tdd_conf.value("replay_rate_fps", 0.0);
+  RtAssert(replay_rate_fps_ >= 0, "replay_rate_fps must not be negative");
+  rx_record_file_ = tdd_conf.value("rx_record_file", "");
+  rx_record_buffer_mb_ = tdd_conf.value("rx_record_buffer_mb", 512);
+
+  worker_scheduler_ = tdd_conf.value("worker_scheduler", "queues");
+  RtAssert((worker_scheduler_ == "queues") ||
+               (((worker_scheduler_ == "work_stealing") ||
+                 (worker_scheduler_ == "edf")) &&
+                (bigstation_mode_ == false)),
+           "Worker scheduler must be \"queues\", \"work_stealing\" or "
+           "\"edf\" (only \"queues\" is supported in bigstation mode)");
+  subcarrier_affinity_ = tdd_conf.value("subcarrier_affinity", false);
+  RtAssert((subcarrier_affinity_ == false) ||
+               (worker_scheduler_ == "work_stealing"),
+           "Subcarrier affinity requires the work_stealing worker scheduler");
+
+  elastic_worker_pool_ = tdd_conf.value("elastic_worker_pool", false);
+  RtAssert((elastic_worker_pool_ == false) ||
+               ((worker_scheduler_ == "queues") &&
+                (bigstation_mode_ == false)),
+           "The elastic worker pool requires the queues worker scheduler "
+           "and does not support bigstation mode");
+  elastic_pool_interval_ = tdd_conf.value("elastic_pool_interval", 100);
+  RtAssert(elastic_pool_interval_ > 0,
+           "Elastic pool interval must be at least one frame");
+
+  std::string idle_policy = tdd_conf.value("idle_policy", "spin");
+  RtAssert((idle_policy == "spin") || (idle_policy == "adaptive"),
+           "Idle policy must be \"spin\" or \"adaptive\"");
+  idle_spin_iters_ = (idle_policy == "spin")
+                         ? SIZE_MAX
+                         : tdd_conf.value("idle_spin_iters", 1000);
+  idle_pause_iters_ = tdd_conf.value("idle_pause_iters", 10000);
+  idle_sleep_us_ = tdd_conf.value("idle_sleep_us", 50);
+
   demul_block_size_ = tdd_conf.value("demul_block_size", 48);
   RtAssert(demul_block_size_ % kSCsPerCacheline == 0,
            "Demodulation block size must be a multiple of subcarriers per "
@@ -371,6 +455,33 @@ Config::Config(const std::string& jsonfile)
   zf_block_size_ =
       freq_orthogonal_pilot_ ? ue_ant_num_ : tdd_conf.value("zf_block_size", 1);
   zf_events_per_symbol_ = 1 + (ofdm_data_num_ - 1) / zf_block_size_;
+  zf_batch_inversion_ = tdd_conf.value("zf_batch_inversion", false);
+  RtAssert((zf_batch_inversion_ == false) || (external_ref_node_ == false),
+           "Batched ZF inversion does not support an external reference node");
+  zf_interp_stride_ = tdd_conf.value("zf_interp_stride", 1);
+  zf_interp_mode_ = tdd_conf.value("zf_interp_mode", "linear");
+  RtAssert(zf_interp_stride_ >= 1, "ZF interpolation stride must be positive");
+  RtAssert((zf_interp_mode_ == "linear") || (zf_interp_mode_ == "spline"),
+           "ZF interpolation mode must be linear or spline");
+  RtAssert((zf_interp_stride_ == 1) || ((freq_orthogonal_pilot_ == false) &&
+                                        (zf_batch_inversion_ == false)),
+           "ZF interpolation requires time-orthogonal pilots and no batched "
+           "inversion");
+  beamformer_ = tdd_conf.value("beamformer", "zf");
+  RtAssert((beamformer_ == "zf") || (beamformer_ == "mmse"),
+           "Beamformer must be zf or mmse");
+  zf_approx_iters_ = tdd_conf.value("zf_approx_iters", 0);
+  zf_approx_method_ = tdd_conf.value("zf_approx_method", "neumann");
+  zf_approx_warm_start_ = tdd_conf.value("zf_approx_warm_start", true);
+  zf_approx_max_residual_ = tdd_conf.value("zf_approx_max_residual", 0.03);
+  RtAssert((zf_approx_method_ == "neumann") ||
+               (zf_approx_method_ == "gauss_seidel"),
+           "Approximate ZF method must be neumann or gauss_seidel");
+  RtAssert((zf_approx_iters_ == 0) || ((freq_orthogonal_pilot_ == false) &&
+                                       (zf_batch_inversion_ == false) &&
+                                       (external_ref_node_ == false)),
+           "Approximate ZF requires time-orthogonal pilots, no batched "
+           "inversion and no external reference node");
 
   fft_block_size_ = tdd_conf.value("fft_block_size", 1);
   fft_block_size_ = std::max(fft_block_size_, num_channels_);
@@ -422,11 +533,80 @@ Config::Config(const std::string& jsonfile)
 
   samps_per_symbol_ =
       ofdm_tx_zero_prefix_ + ofdm_ca_num_ + cp_len_ + ofdm_tx_zero_postfix_;
-  packet_length_ =
-      Packet::kOffsetOfData + ((kUse12BitIQ ? 3 : 4) * samps_per_symbol_);
-  dl_packet_length_ = Packet::kOffsetOfData + (samps_per_symbol_ * 4);
+
+  bfp_iq_width_ = tdd_conf.value("fronthaul_bfp_iq_width", 0);
+  RtAssert((bfp_iq_width_ == 0) || (BfpIqWidthValid(bfp_iq_width_) == true),
+           "The BFP mantissa width must be 9, 12 or 14 bits");
+  RtAssert((bfp_iq_width_ == 0) ||
+               ((kUse12BitIQ == false) && (kUseArgos == false) &&
+                (kUseUHD == false)),
+           "BFP compression is only supported by the emulated RRU, with "
+           "16-bit IQ samples");
+
+  fronthaul_ants_per_packet_ = tdd_conf.value("fronthaul_ants_per_packet", 1);
+  fronthaul_frags_per_symbol_ =
+      tdd_conf.value("fronthaul_frags_per_symbol", 1);
+  RtAssert((fronthaul_ants_per_packet_ >= 1) &&
+               (fronthaul_frags_per_symbol_ >= 1),
+           "Antennas per packet and fragments per symbol must be positive");
+  RtAssert((fronthaul_ants_per_packet_ == 1) ||
+               (fronthaul_frags_per_symbol_ == 1),
+           "Packets cannot both pack antennas and fragment symbols");
+  RtAssert((bs_ant_num_ / num_cells_) % fronthaul_ants_per_packet_ == 0,
+           "The antennas of a cell must fill whole packets");
+  if (bfp_iq_width_ > 0) {
+    // With FFT in the RRU, packets hold the frequency-domain symbol
+    packet_ant_bytes_ = BfpCompressedBytes(
+        (fft_in_rru_ == true) ? ofdm_ca_num_ : samps_per_symbol_,
+        bfp_iq_width_);
+  } else {
+    packet_ant_bytes_ = (kUse12BitIQ ? 3 : 4) * samps_per_symbol_;
+  }
+  if (fronthaul_ants_per_packet_ > 1) {
+    // Keep each antenna's samples aligned for SIMD loads
+    packet_ant_bytes_ = Roundup<64>(packet_ant_bytes_);
+  }
+  if (fronthaul_frags_per_symbol_ > 1) {
+    // Fragments are subcarrier ranges of the frequency-domain symbol
+    const size_t sc_per_frag = ofdm_ca_num_ / fronthaul_frags_per_symbol_;
+    RtAssert(fft_in_rru_ == true,
+             "Fragmenting symbols requires FFT in the RRU");
+    RtAssert(rx_symbol_timeout_us_ == 0,
+             "RX symbol timeouts are not supported with fragmented symbols");
+    RtAssert(beamformer_ == "zf",
+             "The MMSE beamformer needs the pilot noise, which is not "
+             "measured with fragmented symbols");
+    RtAssert((ofdm_ca_num_ % fronthaul_frags_per_symbol_ == 0) &&
+                 (sc_per_frag % kSCsPerCacheline == 0) &&
+                 (ofdm_data_start_ % kSCsPerCacheline == 0),
+             "Fragments must hold whole cachelines of subcarriers");
+    packet_length_ =
+        Packet::kOffsetOfData + ((bfp_iq_width_ > 0)
+                                     ? BfpCompressedBytes(sc_per_frag,
+                                                          bfp_iq_width_)
+                                     : (4 * sc_per_frag));
+  } else {
+    packet_length_ = Packet::kOffsetOfData +
+                     (fronthaul_ants_per_packet_ * packet_ant_bytes_);
+  }
+  dl_packet_length_ =
+      Packet::kOffsetOfData +
+      ((bfp_iq_width_ > 0)
+           ? BfpCompressedBytes(samps_per_symbol_, bfp_iq_width_)
+           : (samps_per_symbol_ * 4));
   RtAssert(packet_length_ < 9000,
            "Packet size must be smaller than jumbo frame");
+  if (transport_ == "af_xdp") {
+    RtAssert(kXdpRxPacketOffset + packet_length_ <= kXdpFrameSize,
+             "With the af_xdp transport, packets and their headers must fit "
+             "in " +
+                 std::to_string(kXdpFrameSize) + " bytes");
+    packet_buffer_stride_ = kXdpFrameSize;
+    packet_buffer_headroom_ = kXdpRxPacketOffset;
+  } else {
+    packet_buffer_stride_ = packet_length_;
+    packet_buffer_headroom_ = 0;
+  }
 
   num_bytes_per_cb_ = ldpc_config_.NumCbLen() / 8;
   data_bytes_num_persymbol_ =
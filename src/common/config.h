@@ -119,6 +119,16 @@ class Config {
   }
   inline size_t ZfBlockSize() const { return this->zf_block_size_; }
   inline size_t ZfBatchSize() const { return this->zf_batch_size_; }
+  inline bool ZfBatchInversion() const { return this->zf_batch_inversion_; }
+  inline size_t ZfInterpStride() const { return this->zf_interp_stride_; }
+  inline std::string ZfInterpMode() const { return this->zf_interp_mode_; }
+  inline std::string Beamformer() const { return this->beamformer_; }
+  inline size_t ZfApproxIters() const { return this->zf_approx_iters_; }
+  inline std::string ZfApproxMethod() const { return this->zf_approx_method_; }
+  inline bool ZfApproxWarmStart() const { return this->zf_approx_warm_start_; }
+  inline float ZfApproxMaxResidual() const {
+    return this->zf_approx_max_residual_;
+  }
   inline size_t ZfEventsPerSymbol() const {
     return this->zf_events_per_symbol_;
   }
@@ -147,9 +157,57 @@ class Config {
   }
   inline size_t SampsPerSymbol() const { return this->samps_per_symbol_; }
   inline size_t PacketLength() const { return this->packet_length_; }
+  /// Distance between consecutive packets in the RX buffers
+  inline size_t PacketBufferStride() const {
+    return this->packet_buffer_stride_;
+  }
+  /// Offset of the packet of RX buffer slot slot_id from the buffer start
+  inline size_t PacketBufferOffset(size_t slot_id) const {
+    return (slot_id * this->packet_buffer_stride_) +
+           this->packet_buffer_headroom_;
+  }
+  inline size_t PacketAntBytes() const { return this->packet_ant_bytes_; }
+  inline size_t FronthaulAntsPerPacket() const {
+    return this->fronthaul_ants_per_packet_;
+  }
+  inline size_t FronthaulFragsPerSymbol() const {
+    return this->fronthaul_frags_per_symbol_;
+  }
+  inline size_t BfpIqWidth() const { return this->bfp_iq_width_; }
 
   inline float Scale() const { return this->scale_; }
   inline bool BigstationMode() const { return this->bigstation_mode_; }
+  inline bool DecentralizedScheduling() const {
+    return this->decentralized_scheduling_;
+  }
+  inline size_t PipelineDepth() const { return this->pipeline_depth_; }
+  inline bool DropLateFrames() const { return this->drop_late_frames_; }
+  inline size_t RxSymbolTimeoutUs() const {
+    return this->rx_symbol_timeout_us_;
+  }
+  inline size_t TraceRingSizeLog2() const {
+    return this->trace_ring_size_log2_;
+  }
+  inline size_t UdpBatchSize() const { return this->udp_batch_size_; }
+  inline std::string Transport() const { return this->transport_; }
+  inline std::string XdpInterface() const { return this->xdp_interface_; }
+  inline std::string ShmPath() const { return this->shm_path_; }
+  inline size_t ShmRingSlots() const { return this->shm_ring_slots_; }
+  inline std::string ReplayFile() const { return this->replay_file_; }
+  inline double ReplayRateFps() const { return this->replay_rate_fps_; }
+  inline std::string RxRecordFile() const { return this->rx_record_file_; }
+  inline size_t RxRecordBufferMb() const { return this->rx_record_buffer_mb_; }
+  inline std::string WorkerScheduler() const {
+    return this->worker_scheduler_;
+  }
+  inline bool SubcarrierAffinity() const { return this->subcarrier_affinity_; }
+  inline bool ElasticWorkerPool() const { return this->elastic_worker_pool_; }
+  inline size_t ElasticPoolInterval() const {
+    return this->elastic_pool_interval_;
+  }
+  inline size_t IdleSpinIters() const { return this->idle_spin_iters_; }
+  inline size_t IdlePauseIters() const { return this->idle_pause_iters_; }
+  inline size_t IdleSleepUs() const { return this->idle_sleep_us_; }
   inline size_t UlMacDataBytesNumPerframe() const {
     return this->ul_mac_data_bytes_num_perframe_;
   }
@@ -187,6 +245,8 @@ class Config {
 
   inline uint16_t DpdkNumPorts() const { return this->dpdk_num_ports_; }
   inline uint16_t DpdkPortOffset() const { return this->dpdk_port_offset_; }
+  inline bool DpdkZeroCopyRx() const { return this->dpdk_zero_copy_rx_; }
+  inline const std::string& DpdkVdev() const { return this->dpdk_vdev_; }
 
   inline size_t BsMacRxPort() const { return this->bs_mac_rx_port_; }
   inline size_t BsMacTxPort() const { return this->bs_mac_tx_port_; }
@@ -528,6 +588,32 @@ class Config {
   size_t zf_batch_size_;
   size_t zf_events_per_symbol_;  // Derived from zf_block_size
 
+  // If true, the ZF matrices of the subcarriers of one doZF call are computed
+  // together with MKL's batched (compact) routines. Only used with
+  // time-orthogonal pilots.
+  bool zf_batch_inversion_;
+
+  // Only every zf_interp_stride-th subcarrier of a ZF block (and its last
+  // subcarrier) is inverted, and the ZF matrices of the others are
+  // interpolated, "linear" or "spline", from them
+  size_t zf_interp_stride_;
+  std::string zf_interp_mode_;
+
+  // "zf" for zeroforcing, or "mmse" for MMSE detection and regularized
+  // zeroforcing precoding, which add the pilot noise power to the diagonal
+  // of the Gram matrices
+  std::string beamformer_;
+
+  // If positive, the ZF matrices are approximated with zf_approx_iters
+  // "neumann" or "gauss_seidel" iterations instead of inverting the Gram
+  // matrices, starting from the previous frame's matrices with
+  // zf_approx_warm_start. Subcarriers whose relative residual exceeds
+  // zf_approx_max_residual are inverted.
+  size_t zf_approx_iters_;
+  std::string zf_approx_method_;
+  bool zf_approx_warm_start_;
+  float zf_approx_max_residual_;
+
   // Number of antennas handled in one FFT event
   size_t fft_block_size_;
 
@@ -570,11 +656,124 @@ class Config {
   // Ethernet/IP/UDP headers.
   size_t packet_length_;
 
+  // Layout of the RX buffers: packet_length_ with no headroom, except with
+  // the af_xdp transport. Then each slot is a UMEM frame that the NIC writes
+  // the packet into after its headers, so that packets are not copied.
+  size_t packet_buffer_stride_;
+  size_t packet_buffer_headroom_;
+
+  // Number of bytes that one antenna's time-domain samples take in an uplink
+  // packet
+  size_t packet_ant_bytes_;
+
+  // Number of antennas whose samples of a symbol are sent in one uplink
+  // packet, one after the other. Antenna IDs in packet headers are those of
+  // the first antenna.
+  size_t fronthaul_ants_per_packet_;
+
+  // If greater than one, each antenna's frequency-domain symbol is sent in
+  // this many packets of consecutive subcarriers. Requires FFT in the RRU.
+  size_t fronthaul_frags_per_symbol_;
+
+  // If nonzero, the samples of uplink and downlink packets are compressed
+  // with block floating point (see bfp.h), with mantissas of this many bits
+  size_t bfp_iq_width_;
+
   std::vector<int> cl_tx_advance_;
 
   float scale_;  // Scaling factor for all transmit symbols
 
   bool bigstation_mode_;      // If true, use pipeline-parallel scheduling
+
+  // If true, the worker that completes the last task of a symbol or frame
+  // schedules the next stage itself. The master thread only handles packet
+  // RX bookkeeping and frame retirement.
+  bool decentralized_scheduling_;
+
+  // Max number of frames processed concurrently. Frame i uses task and
+  // completion queue set (i % pipeline_depth_).
+  size_t pipeline_depth_;
+
+  // If true, when the pipeline falls a full frame window behind, the oldest
+  // frame in flight is dropped instead of stopping Agora. Packets that
+  // arrive for a dropped frame, or when the RX ring is full, are discarded.
+  bool drop_late_frames_;
+
+  // If nonzero, a pilot or uplink symbol whose packets have not all arrived
+  // this many microseconds after the symbol's expected arrival time is
+  // processed with zeroed samples for the missing antennas
+  size_t rx_symbol_timeout_us_;
+
+  // If nonzero, the master, TXRX and worker threads record their events in
+  // per-thread rings of 2^trace_ring_size_log2 records, which are written to
+  // data/trace.json in Chrome trace format at exit
+  size_t trace_ring_size_log2_;
+
+  // Maximum number of packets that a TXRX thread receives or sends with one
+  // recvmmsg/sendmmsg call. With 1, packets are received and sent one at a
+  // time.
+  size_t udp_batch_size_;
+
+  // Packet I/O of the TXRX threads in simulation mode. "udp": kernel UDP
+  // sockets. "af_xdp": AF_XDP sockets bound to xdp_interface_, one per TXRX
+  // thread on the interface queue with the thread's index. Requires building
+  // with USE_AF_XDP. "io_uring": the UDP sockets, with multishot receives
+  // into the RX buffers and zero-copy sends from the downlink buffer through
+  // one io_uring per TXRX thread. Requires building with USE_IO_URING.
+  // "shm": packet rings in the shared memory region at shm_path_, to which
+  // the sender or the channel simulator on the same machine attaches.
+  // "replay": no peer; the TXRX threads inject the packets of replay_file_
+  // as fast as the pipeline frees RX buffer slots, to measure the compute
+  // capacity.
+  std::string transport_;
+  std::string xdp_interface_;
+
+  // File backing the shared memory region of the "shm" transport. Put it on
+  // a hugetlbfs mount to use hugepages.
+  std::string shm_path_;
+  // Packet slots in each uplink and downlink ring of the "shm" transport
+  size_t shm_ring_slots_;
+
+  // IQ capture file replayed in a loop by the "replay" transport. If empty,
+  // one frame of packets is built from the data generator's uplink samples.
+  std::string replay_file_;
+  // Frames per second injected by the "replay" transport. 0: as fast as
+  // the pipeline drains them.
+  double replay_rate_fps_;
+
+  // If not empty, the TXRX threads record the packets they receive to this
+  // IQ capture file, which the "replay" transport can replay
+  std::string rx_record_file_;
+  // Size of the buffer of packets waiting to be written to rx_record_file_,
+  // shared by the TXRX threads. Packets are dropped when it is full.
+  size_t rx_record_buffer_mb_;
+
+  // Task queues used by the worker threads. "queues": one shared queue per
+  // event type. "work_stealing": one deque per worker, idle workers steal
+  // from their peers. "edf": one heap per worker ordered by task deadline,
+  // where workers pop the earliest task of their own heap and a peer's.
+  std::string worker_scheduler_;
+
+  // If true, the ZF, demodulation and precoding tasks of a subcarrier block
+  // are queued to the same worker so that its precoder matrices stay in that
+  // core's cache. Requires the "work_stealing" worker scheduler.
+  bool subcarrier_affinity_;
+
+  // If true, each worker serves either the uplink or the downlink stages, or
+  // is parked. Every elastic_pool_interval_ frames, the master moves at most
+  // one worker between groups based on queue depths and worker busy time.
+  // Only supported with the "queues" worker scheduler.
+  bool elastic_worker_pool_;
+  size_t elastic_pool_interval_;
+
+  // Idle strategy of the worker, TXRX and sender threads. With the
+  // "adaptive" idle policy, an idle thread spins for idle_spin_iters_ empty
+  // polls, then pauses for idle_pause_iters_ polls, and then sleeps for up
+  // to idle_sleep_us_ per poll until woken by new work. With the default
+  // "spin" policy idle_spin_iters_ is SIZE_MAX.
+  size_t idle_spin_iters_;
+  size_t idle_pause_iters_;
+  size_t idle_sleep_us_;
   bool correct_phase_shift_;  // If true, do phase shift correction
 
   // The total number of uncoded data bytes in each OFDM symbol
@@ -633,6 +832,14 @@ class Config {
   // Offset of the first NIC port used by Agora's DPDK mode
   uint16_t dpdk_port_offset_;
 
+  // If true, the FFT reads received samples from the DPDK mbufs instead of
+  // a copy in the RX buffers, and frees the mbufs
+  bool dpdk_zero_copy_rx_;
+
+  // Virtual device passed to the DPDK EAL with --vdev (e.g.,
+  // "net_pcap0,rx_pcap=ul.pcap"). Empty to use physical NICs only.
+  std::string dpdk_vdev_;
+
   // Port ID at BaseStation MAC layer side
   size_t bs_mac_rx_port_;
   size_t bs_mac_tx_port_;
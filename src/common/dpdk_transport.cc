@@ -5,6 +5,7 @@
 #include <immintrin.h>
 
 #include <string>
+#include <vector>
 
 #include "buffer.h"
 #include "eth_common.h"
@@ -36,15 +37,18 @@ int DpdkTransport::NicInit(uint16_t port, struct rte_mempool* mbuf_pool,
   if (!rte_eth_dev_is_valid_port(port))
     rte_exit(EXIT_FAILURE, "NIC ID is invalid\n");
 
-  rte_eth_dev_set_mtu(port, 9000);
-  uint16_t mtu_size = 0;
-  rte_eth_dev_get_mtu(port, &mtu_size);
-  RtAssert(mtu_size == 9000, "Invalid MTU (must be 9000 bytes)");
+  // Virtual devices such as net_null and net_pcap have no MTU or
+  // promiscuous mode to set
+  if (rte_eth_dev_set_mtu(port, 9000) != -ENOTSUP) {
+    uint16_t mtu_size = 0;
+    rte_eth_dev_get_mtu(port, &mtu_size);
+    RtAssert(mtu_size == 9000, "Invalid MTU (must be 9000 bytes)");
+  }
 
-  int promiscuous_en = rte_eth_promiscuous_get(port);
-  rte_eth_promiscuous_enable(port);
-  promiscuous_en = rte_eth_promiscuous_get(port);
-  RtAssert(promiscuous_en == 1, "Unable to set promiscuous mode");
+  if (rte_eth_promiscuous_enable(port) != -ENOTSUP) {
+    int promiscuous_en = rte_eth_promiscuous_get(port);
+    RtAssert(promiscuous_en == 1, "Unable to set promiscuous mode");
+  }
 
   rte_eth_dev_info_get(port, &dev_info);
   if (dev_info.tx_offload_capa & DEV_TX_OFFLOAD_MBUF_FAST_FREE)
@@ -267,28 +271,35 @@ rte_mbuf* DpdkTransport::AllocUdp(rte_mempool* mbuf_pool,
   return tx_buf;
 }
 
-void DpdkTransport::DpdkInit(uint16_t core_offset, size_t thread_num) {
+void DpdkTransport::DpdkInit(uint16_t core_offset, size_t thread_num,
+                             const std::string& vdev) {
   // DPDK setup
   std::string core_list = std::to_string(GetPhysicalCoreId(core_offset));
   for (size_t i = 1; i < thread_num + 1; i++)
     core_list =
         core_list + "," + std::to_string(GetPhysicalCoreId(core_offset + i));
   // n: channels, m: maximum memory in megabytes
-  const char* rte_argv[] = {"txrx",        "-l", core_list.c_str(),
-                            "--log-level", "0",  nullptr};
-  int rte_argc = static_cast<int>(sizeof(rte_argv) / sizeof(rte_argv[0])) - 1;
+  std::vector<const char*> rte_argv = {"txrx", "-l", core_list.c_str(),
+                                       "--log-level", "0"};
+  if (vdev.empty() == false) {
+    rte_argv.push_back("--vdev");
+    rte_argv.push_back(vdev.c_str());
+  }
+  int rte_argc = static_cast<int>(rte_argv.size());
+  rte_argv.push_back(nullptr);
 
   // Initialize DPDK environment
-  int ret = rte_eal_init(rte_argc, const_cast<char**>(rte_argv));
+  int ret = rte_eal_init(rte_argc, const_cast<char**>(rte_argv.data()));
   RtAssert(ret >= 0, "Failed to initialize DPDK");
 }
 
 rte_mempool* DpdkTransport::CreateMempool(size_t num_ports,
-                                          size_t packet_length) {
+                                          size_t packet_length,
+                                          size_t num_held_mbufs) {
   size_t mbuf_size = packet_length + kMBufCacheSize;
-  rte_mempool* mbuf_pool =
-      rte_pktmbuf_pool_create("MBUF_POOL", kNumMBufs * num_ports,
-                              kMBufCacheSize, 0, mbuf_size, rte_socket_id());
+  rte_mempool* mbuf_pool = rte_pktmbuf_pool_create(
+      "MBUF_POOL", kNumMBufs * num_ports + num_held_mbufs, kMBufCacheSize, 0,
+      mbuf_size, rte_socket_id());
 
   RtAssert(mbuf_pool != NULL, "Cannot create mbuf pool");
 
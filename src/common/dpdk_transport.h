@@ -22,8 +22,10 @@
 #include <rte_udp.h>
 #include <unistd.h>
 
+#include <cstring>
 #include <string>
 
+#include "buffer.h"
 #include "utils.h"
 
 static constexpr size_t kRxRingSize = 2048;
@@ -71,10 +73,32 @@ class DpdkTransport {
                             uint32_t dst_ip_addr, uint16_t src_udp_port,
                             uint16_t dst_udp_port, size_t buffer_length);
 
-  /// Init dpdk on core [core_offset:core_offset+thread_num]
-  static void DpdkInit(uint16_t core_offset, size_t thread_num);
+  /// Init dpdk on core [core_offset:core_offset+thread_num]. If vdev is not
+  /// empty, it is added as a virtual device (e.g., net_null or net_pcap).
+  static void DpdkInit(uint16_t core_offset, size_t thread_num,
+                       const std::string& vdev = "");
+  /// Create a mempool for the RX and TX rings of num_ports ports, plus
+  /// num_held_mbufs mbufs that the application holds after receiving them
   static rte_mempool* CreateMempool(size_t num_ports,
-                                    size_t packet_length = kJumboFrameMaxSize);
+                                    size_t packet_length = kJumboFrameMaxSize,
+                                    size_t num_held_mbufs = 0);
+
+  /// With zero-copy RX, an RX buffer slot holds only the header of its
+  /// packet. The mbuf that holds the packet is stored in the header's
+  /// padding, which is not used after reception.
+  static inline void SetRxMbuf(Packet* slot, rte_mbuf* mbuf) {
+    static_assert(sizeof(Packet::fill_) >= sizeof(rte_mbuf*), "");
+    std::memcpy(slot->fill_, &mbuf, sizeof(mbuf));
+  }
+  static inline rte_mbuf* GetRxMbuf(const Packet* slot) {
+    rte_mbuf* mbuf;
+    std::memcpy(&mbuf, slot->fill_, sizeof(mbuf));
+    return mbuf;
+  }
+  /// Return the fronthaul packet in a received mbuf
+  static inline Packet* MbufPacket(rte_mbuf* mbuf) {
+    return rte_pktmbuf_mtod_offset(mbuf, Packet*, kPayloadOffset);
+  }
 };
 
 #endif  // DPDK_TRANSPORT_H_
\ No newline at end of file
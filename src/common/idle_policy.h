@@ -0,0 +1,146 @@
+/**
+ * @file idle_policy.h
+ * @brief Adaptive idle strategy for polling threads. An idle thread spins,
+ * then pauses, and finally sleeps on a futex until the enqueuing side posts a
+ * wakeup or a timeout expires.
+ */
+#ifndef IDLE_POLICY_H_
+#define IDLE_POLICY_H_
+
+#include <immintrin.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <climits>
+#include <cstdint>
+#include <ctime>
+
+#include "gettime.h"
+
+/// Idle time accounting for one polling thread. Written only by the thread
+/// that owns it; other threads may read stale values.
+struct alignas(64) IdleStat {
+  size_t start_tsc_ = 0;    // TSC at which the thread started polling
+  size_t idle_cycles_ = 0;  // Cycles spent polling without finding work
+  size_t num_sleeps_ = 0;   // Number of futex sleeps
+};
+
+/// A futex-based wakeup channel between producers and sleeping consumers.
+/// Notify() costs one fence and one atomic load when no consumer is asleep.
+///
+/// A consumer calls PrepareWait(), re-polls its queue, and then calls
+/// Wait() with the returned sequence number if the queue is still empty, or
+/// CancelWait() otherwise. A producer either sees the consumer registered as
+/// a sleeper and changes the sequence number, so that Wait() returns at once,
+/// or enqueued its work before the consumer's re-poll, so no wakeup is lost.
+class IdleWaker {
+ public:
+  /// Wake all sleeping consumers. Call after enqueuing work.
+  void Notify() {
+    // Order the enqueue before the load of num_sleepers_
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (num_sleepers_.load() > 0) {
+      seq_.fetch_add(1);
+      syscall(SYS_futex, reinterpret_cast<uint32_t*>(&seq_),
+              FUTEX_WAKE_PRIVATE, INT_MAX, nullptr, nullptr, 0);
+    }
+  }
+
+  /// Register as a sleeper and return the sequence number to pass to
+  /// Wait(). The caller must re-poll for work afterwards.
+  uint32_t PrepareWait() {
+    num_sleepers_.fetch_add(1);
+    return seq_.load();
+  }
+
+  /// Sleep until Notify() is called after PrepareWait() returned seq, or
+  /// timeout_ns expires
+  void Wait(uint32_t seq, size_t timeout_ns) {
+    struct timespec timeout;
+    timeout.tv_sec = static_cast<time_t>(timeout_ns / 1000000000);
+    timeout.tv_nsec = static_cast<long>(timeout_ns % 1000000000);
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(&seq_), FUTEX_WAIT_PRIVATE,
+            seq, &timeout, nullptr, 0);
+    num_sleepers_.fetch_sub(1);
+  }
+
+  /// Unregister after PrepareWait() when the re-poll found work
+  void CancelWait() { num_sleepers_.fetch_sub(1); }
+
+ private:
+  std::atomic<uint32_t> seq_{0};
+  std::atomic<uint32_t> num_sleepers_{0};
+};
+
+/// Per-thread idle state machine. Call OnWork() after a poll that found work
+/// and OnIdle() after one that did not.
+class IdlePolicy {
+ public:
+  /// With spin_iters == SIZE_MAX, the thread only spins (the default).
+  IdlePolicy(size_t spin_iters, size_t pause_iters, size_t sleep_us,
+             IdleWaker* waker, IdleStat* stat)
+      : spin_iters_(spin_iters),
+        pause_iters_(pause_iters),
+        sleep_ns_(sleep_us * 1000),
+        waker_(waker),
+        stat_(stat) {
+    stat_->start_tsc_ = GetTime::Rdtsc();
+  }
+
+  inline void OnWork() {
+    if (wait_prepared_ == true) {
+      waker_->CancelWait();
+      wait_prepared_ = false;
+    }
+    if (idle_itrs_ > 0) {
+      stat_->idle_cycles_ += GetTime::Rdtsc() - idle_start_tsc_;
+      idle_itrs_ = 0;
+    }
+  }
+
+  inline void OnIdle() {
+    if (idle_itrs_ == 0) {
+      idle_start_tsc_ = GetTime::Rdtsc();
+    }
+    idle_itrs_++;
+    if (idle_itrs_ <= spin_iters_) {
+      return;
+    }
+    if (idle_itrs_ - spin_iters_ <= pause_iters_) {
+#if defined(__WAITPKG__)
+      // Light-weight C0.1 wait for about one pause-loop worth of cycles
+      _tpause(1, GetTime::Rdtsc() + kTpauseCycles);
+#else
+      _mm_pause();
+#endif
+      return;
+    }
+    if (wait_prepared_ == false) {
+      // Register as a sleeper and return, so that the caller polls once more
+      // before sleeping
+      wait_seq_ = waker_->PrepareWait();
+      wait_prepared_ = true;
+      return;
+    }
+    stat_->num_sleeps_++;
+    waker_->Wait(wait_seq_, sleep_ns_);
+    wait_prepared_ = false;
+  }
+
+ private:
+  static constexpr size_t kTpauseCycles = 1000;
+
+  const size_t spin_iters_;
+  const size_t pause_iters_;
+  const size_t sleep_ns_;
+  IdleWaker* waker_;
+  IdleStat* stat_;
+  size_t idle_itrs_ = 0;
+  size_t idle_start_tsc_ = 0;
+  bool wait_prepared_ = false;
+  uint32_t wait_seq_ = 0;
+};
+
+#endif  // IDLE_POLICY_H_
@@ -0,0 +1,35 @@
+/**
+ * @file iq_capture.h
+ * @brief Format of the raw IQ capture files, which hold fronthaul packets
+ * as the base station received them
+ */
+
+#ifndef IQ_CAPTURE_H_
+#define IQ_CAPTURE_H_
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * @brief Header at the start of a capture file.
+ *
+ * The header is padded to kSize bytes. It is followed by packets of
+ * packet_length_ bytes each in the order they were received, in the Packet
+ * format of the fronthaul (antenna IDs are relative to the cell). The number
+ * of packets is given by the file size, so that a capture that was cut short
+ * is still valid up to its last full packet.
+ */
+struct IqCaptureHeader {
+  static constexpr uint64_t kMagic = 0x3150414351495241;  // "ARIQCAP1"
+  /// Offset of the first packet. A multiple of the block size, so that
+  /// packets can be written with O_DIRECT.
+  static constexpr size_t kSize = 4096;
+
+  uint64_t magic_;
+  uint64_t packet_length_;
+  uint64_t bs_ant_num_;   // Number of BS antennas of the recording config
+  uint64_t ofdm_ca_num_;  // FFT size of the recording config
+};
+static_assert(sizeof(IqCaptureHeader) <= IqCaptureHeader::kSize, "");
+
+#endif  // IQ_CAPTURE_H_
@@ -0,0 +1,191 @@
+/**
+ * @file iq_recorder.cc
+ * @brief Implementation file for the IqRecorder class
+ */
+#include "iq_recorder.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <chrono>
+#include <stdexcept>
+
+#include "logger.h"
+
+/// Alignment of the offset, length and memory of O_DIRECT writes
+static constexpr size_t kBlockSize = 4096;
+/// The writer thread writes once the staging buffer holds this many bytes
+static constexpr size_t kWriteSize = 4 * 1024 * 1024;
+static constexpr size_t kHugePageSize = 2 * 1024 * 1024;
+
+static size_t RoundUp(size_t value, size_t align) {
+  return (value + align - 1) / align * align;
+}
+
+IqRecorder::IqRecorder(const std::string& path, size_t packet_length,
+                       size_t bs_ant_num, size_t ofdm_ca_num,
+                       size_t num_producers, size_t buffer_bytes)
+    : path_(path), packet_length_(packet_length), rings_(num_producers) {
+  slots_per_ring_ = buffer_bytes / num_producers / packet_length_;
+  if (slots_per_ring_ < 2) {
+    throw std::runtime_error("IqRecorder: the buffer is too small");
+  }
+
+  // The staging buffer holds kWriteSize bytes, plus up to one packet and
+  // the partial block kept from the previous write
+  const size_t rings_size =
+      RoundUp(num_producers * slots_per_ring_ * packet_length_, kBlockSize);
+  staging_size_ = RoundUp(kWriteSize + packet_length_, kBlockSize) + kBlockSize;
+  memory_size_ = RoundUp(rings_size + staging_size_, kHugePageSize);
+  void* memory =
+      mmap(nullptr, memory_size_, PROT_READ | PROT_WRITE,
+           MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | MAP_POPULATE, -1, 0);
+  if (memory == MAP_FAILED) {
+    // No reserved hugepages. Ask for transparent hugepages instead.
+    memory = mmap(nullptr, memory_size_, PROT_READ | PROT_WRITE,
+                  MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+    if (memory == MAP_FAILED) {
+      throw std::runtime_error("IqRecorder: failed to allocate the buffer");
+    }
+    madvise(memory, memory_size_, MADV_HUGEPAGE);
+  }
+  memory_ = static_cast<uint8_t*>(memory);
+  for (size_t i = 0; i < num_producers; i++) {
+    rings_[i].slots_ = memory_ + i * slots_per_ring_ * packet_length_;
+  }
+  staging_ = memory_ + rings_size;
+
+  fd_ = open(path_.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_DIRECT, 0644);
+  if (fd_ < 0) {
+    // Some file systems, such as tmpfs, do not support O_DIRECT
+    fd_ = open(path_.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd_ < 0) {
+      munmap(memory_, memory_size_);
+      throw std::runtime_error("IqRecorder: failed to create " + path_ +
+                               ": " + std::strerror(errno));
+    }
+    MLPD_WARN("IqRecorder: %s does not support O_DIRECT\n", path_.c_str());
+  }
+
+  std::memset(staging_, 0, IqCaptureHeader::kSize);
+  auto* header = reinterpret_cast<IqCaptureHeader*>(staging_);
+  header->magic_ = IqCaptureHeader::kMagic;
+  header->packet_length_ = packet_length_;
+  header->bs_ant_num_ = bs_ant_num;
+  header->ofdm_ca_num_ = ofdm_ca_num;
+  if (pwrite(fd_, staging_, IqCaptureHeader::kSize, 0) !=
+      static_cast<ssize_t>(IqCaptureHeader::kSize)) {
+    close(fd_);
+    munmap(memory_, memory_size_);
+    throw std::runtime_error("IqRecorder: failed to write to " + path_);
+  }
+
+  MLPD_INFO("IqRecorder: recording to %s, %zu packets per RX thread\n",
+            path_.c_str(), slots_per_ring_);
+  writer_thread_ = std::thread(&IqRecorder::WriterThread, this);
+}
+
+IqRecorder::~IqRecorder() {
+  running_.store(false);
+  writer_thread_.join();
+  close(fd_);
+  munmap(memory_, memory_size_);
+  std::printf(
+      "IqRecorder: wrote %zu packets (%.1f MB) to %s, dropped %zu packets\n",
+      num_written_, num_written_ * packet_length_ / (1024.0 * 1024),
+      path_.c_str(), NumDrops());
+}
+
+size_t IqRecorder::NumDrops() const {
+  size_t num_drops = 0;
+  for (const auto& ring : rings_) {
+    num_drops += ring.num_drops_.load(std::memory_order_relaxed);
+  }
+  return num_drops;
+}
+
+void IqRecorder::WriterThread() {
+  while (running_.load() == true) {
+    const size_t num_moved = DrainRings();
+    if (staging_len_ >= kWriteSize) {
+      WriteStaging(false);
+    } else if (num_moved == 0) {
+      std::this_thread::sleep_for(std::chrono::microseconds(100));
+    }
+  }
+
+  // The producers have stopped. Write what is left in the rings.
+  while (DrainRings() > 0) {
+    if (staging_len_ >= kWriteSize) {
+      WriteStaging(false);
+    }
+  }
+  WriteStaging(true);
+}
+
+size_t IqRecorder::DrainRings() {
+  size_t num_moved = 0;
+  bool progress = true;
+  // Take one packet per ring in turn, to keep the file close to the order
+  // of reception
+  while ((progress == true) && (staging_len_ < kWriteSize)) {
+    progress = false;
+    for (auto& ring : rings_) {
+      if (staging_len_ >= kWriteSize) {
+        break;
+      }
+      const uint64_t tail = ring.tail_.load(std::memory_order_relaxed);
+      if (ring.head_.load(std::memory_order_acquire) == tail) {
+        continue;
+      }
+      std::memcpy(staging_ + staging_len_,
+                  ring.slots_ + (tail % slots_per_ring_) * packet_length_,
+                  packet_length_);
+      ring.tail_.store(tail + 1, std::memory_order_release);
+      staging_len_ += packet_length_;
+      num_moved++;
+      progress = true;
+    }
+  }
+  num_written_ += num_moved;
+  return num_moved;
+}
+
+void IqRecorder::WriteStaging(bool flush) {
+  // O_DIRECT writes whole blocks. The last partial block is kept and
+  // written again with the next packets, at the same file offset.
+  const size_t full_len = staging_len_ / kBlockSize * kBlockSize;
+  const size_t write_len =
+      (flush == true) ? RoundUp(staging_len_, kBlockSize) : full_len;
+  if (write_len > staging_len_) {
+    std::memset(staging_ + staging_len_, 0, write_len - staging_len_);
+  }
+
+  size_t done = 0;
+  while (done < write_len) {
+    const ssize_t ret = pwrite(fd_, staging_ + done, write_len - done,
+                               file_offset_ + done);
+    if (ret <= 0) {
+      MLPD_ERROR("IqRecorder: failed to write to %s: %s\n", path_.c_str(),
+                 std::strerror(errno));
+      staging_len_ = 0;
+      return;
+    }
+    done += ret;
+  }
+
+  if (flush == true) {
+    // Cut the padding of the last block
+    if (ftruncate(fd_, file_offset_ + staging_len_) != 0) {
+      MLPD_ERROR("IqRecorder: failed to truncate %s\n", path_.c_str());
+    }
+    file_offset_ += staging_len_;
+    staging_len_ = 0;
+  } else {
+    std::memmove(staging_, staging_ + full_len, staging_len_ - full_len);
+    file_offset_ += full_len;
+    staging_len_ -= full_len;
+  }
+}
@@ -0,0 +1,96 @@
+/**
+ * @file iq_recorder.h
+ * @brief Declaration file for the IqRecorder class, which writes received
+ * fronthaul packets to an IQ capture file at line rate
+ */
+
+#ifndef IQ_RECORDER_H_
+#define IQ_RECORDER_H_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "iq_capture.h"
+
+/**
+ * @brief Records packets to an IQ capture file (see iq_capture.h) that the
+ * replay transport can read.
+ *
+ * Each producer (an RX thread) copies its packets into its own ring of
+ * packet slots, without locks or system calls. A full ring drops the packet
+ * instead of slowing down the producer. A writer thread drains the rings
+ * into a staging buffer and writes it with O_DIRECT, so the capture does not
+ * go through the page cache. The rings and the staging buffer are allocated
+ * on hugepages if possible.
+ */
+class IqRecorder {
+ public:
+  /// Create the capture file at path and start the writer thread.
+  /// buffer_bytes is the total size of the producers' rings. Throws
+  /// std::runtime_error on failure.
+  IqRecorder(const std::string& path, size_t packet_length,
+             size_t bs_ant_num, size_t ofdm_ca_num, size_t num_producers,
+             size_t buffer_bytes);
+  /// Stop the writer thread after it has written all recorded packets. The
+  /// producers must have stopped.
+  ~IqRecorder();
+
+  /// Copy a packet of packet_length bytes for writing. Only producer
+  /// producer_id may call this, from one thread.
+  inline void Record(size_t producer_id, const void* packet) {
+    Ring& ring = rings_[producer_id];
+    const uint64_t head = ring.head_.load(std::memory_order_relaxed);
+    if (head - ring.tail_.load(std::memory_order_acquire) == slots_per_ring_) {
+      ring.num_drops_.store(ring.num_drops_.load(std::memory_order_relaxed) + 1,
+                            std::memory_order_relaxed);
+      return;
+    }
+    std::memcpy(ring.slots_ + (head % slots_per_ring_) * packet_length_,
+                packet, packet_length_);
+    ring.head_.store(head + 1, std::memory_order_release);
+  }
+
+  /// Number of packets dropped because a producer's ring was full
+  size_t NumDrops() const;
+
+ private:
+  struct Ring {
+    alignas(64) std::atomic<uint64_t> head_{0};  // Written by the producer
+    std::atomic<size_t> num_drops_{0};
+    alignas(64) std::atomic<uint64_t> tail_{0};  // Written by the writer
+    uint8_t* slots_ = nullptr;
+  };
+
+  void WriterThread();
+  /// Move the packets of all rings to the staging buffer until it holds at
+  /// least kWriteSize bytes or the rings are empty. Returns the number of
+  /// packets moved.
+  size_t DrainRings();
+  /// Write the whole blocks of the staging buffer, or all of it if flush is
+  /// true, and keep the remainder at its start
+  void WriteStaging(bool flush);
+
+  const std::string path_;
+  const size_t packet_length_;
+  size_t slots_per_ring_;
+  std::vector<Ring> rings_;
+
+  int fd_;
+  uint8_t* memory_;  // The rings, then the staging buffer
+  size_t memory_size_;
+  uint8_t* staging_;
+  size_t staging_size_;
+  size_t staging_len_ = 0;  // Bytes in the staging buffer
+  size_t file_offset_ = IqCaptureHeader::kSize;  // Where to write next
+  size_t num_written_ = 0;                       // Packets written
+
+  std::atomic<bool> running_{true};
+  std::thread writer_thread_;
+};
+
+#endif  // IQ_RECORDER_H_
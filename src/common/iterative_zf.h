@@ -0,0 +1,77 @@
+/**
+ * @file iterative_zf.h
+ * @brief Approximate zeroforcing with Neumann-series (Jacobi) or
+ * Gauss-Seidel iterations, which can be warm-started
+ */
+#ifndef ITERATIVE_ZF_H_
+#define ITERATIVE_ZF_H_
+
+#include <armadillo>
+#include <cmath>
+#include <cstddef>
+#include <string>
+
+/*
+ * With many more antennas than UEs, the Gram matrix A = H' * H (plus the
+ * diagonal load of MMSE) is strongly diagonally dominant, so a few
+ * iterations on A * W = H' give the detector W without inverting A. Each
+ * iteration costs about as much as forming A.
+ *
+ * Neumann: W += inv(D) * (H' - A * W), with D the diagonal of A. From the
+ * cold start W = inv(D) * H', k iterations sum the first k + 1 terms of the
+ * Neumann series of inv(A) * H'.
+ *
+ * Gauss-Seidel: the same update, one row of W at a time, with the rows
+ * already updated in the iteration. It converges for any positive definite
+ * A, and faster than Neumann.
+ *
+ * Either can start from the detector of the previous frame instead, which is
+ * close when the channel changes slowly.
+ */
+enum class IterativeZfMethod { kNeumann, kGaussSeidel };
+
+static inline IterativeZfMethod IterativeZfMethodFromString(
+    const std::string& method) {
+  return (method == "gauss_seidel") ? IterativeZfMethod::kGaussSeidel
+                                    : IterativeZfMethod::kNeumann;
+}
+
+// The cold start inv(D) * H' from the transposed CSI csi_t = H' and the Gram
+// matrix
+static inline arma::cx_fmat IterativeZfColdStart(const arma::cx_fmat& csi_t,
+                                                 const arma::cx_fmat& gram) {
+  const arma::cx_fvec inv_diag =
+      arma::ones<arma::cx_fvec>(gram.n_rows) / gram.diag();
+  return csi_t.each_col() % inv_diag;
+}
+
+// Run num_iters iterations on gram * w = csi_t, updating w in place. Returns
+// the norm of the residual csi_t - gram * w found in the last iteration,
+// before its update, relative to the norm of csi_t, so an upper bound of the
+// residual of the result in practice.
+static inline float IterativeZf(const arma::cx_fmat& csi_t,
+                                const arma::cx_fmat& gram, arma::cx_fmat& w,
+                                size_t num_iters, IterativeZfMethod method) {
+  const arma::cx_fvec inv_diag =
+      arma::ones<arma::cx_fvec>(gram.n_rows) / gram.diag();
+  float residual = 0.0f;
+  for (size_t iter = 0; iter < num_iters; iter++) {
+    if (method == IterativeZfMethod::kNeumann) {
+      arma::cx_fmat r = csi_t - gram * w;
+      residual = arma::norm(r, "fro");
+      w += r.each_col() % inv_diag;
+    } else {
+      float residual_sq = 0.0f;
+      for (size_t i = 0; i < gram.n_rows; i++) {
+        arma::cx_frowvec r = csi_t.row(i) - gram.row(i) * w;
+        const float r_norm = arma::norm(r);
+        residual_sq += r_norm * r_norm;
+        w.row(i) += r * inv_diag(i);
+      }
+      residual = std::sqrt(residual_sq);
+    }
+  }
+  return residual / arma::norm(csi_t, "fro");
+}
+
+#endif  // ITERATIVE_ZF_H_
@@ -0,0 +1,134 @@
+/**
+ * @file shm_transport.cc
+ * @brief Implementation file for the ShmFronthaul class
+ */
+#include "shm_transport.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <stdexcept>
+#include <thread>
+
+#include "logger.h"
+
+/// Written last by the owner, once the region is initialized
+static constexpr uint64_t kShmMagic = 0x4147524653484d31;  // "AGRFSHM1"
+
+struct ShmFronthaul::RegionHeader {
+  alignas(64) std::atomic<uint64_t> magic_;
+  uint64_t num_radios_;
+  uint64_t slot_size_;
+  uint64_t slots_per_ring_;
+};
+
+static size_t RoundUp(size_t value, size_t align) {
+  return (value + align - 1) / align * align;
+}
+
+ShmFronthaul::ShmFronthaul(const std::string& path, size_t num_radios,
+                           size_t slot_size, size_t slots_per_ring,
+                           bool create)
+    : path_(path),
+      num_radios_(num_radios),
+      slot_size_(RoundUp(slot_size, 64)),
+      slots_per_ring_(slots_per_ring),
+      owner_(create) {
+  if ((slots_per_ring_ == 0) ||
+      ((slots_per_ring_ & (slots_per_ring_ - 1)) != 0)) {
+    throw std::runtime_error(
+        "ShmFronthaul: the number of slots per ring must be a power of two");
+  }
+  const size_t num_rings = 2 * num_radios_;
+  const size_t rings_offset = sizeof(RegionHeader);
+  const size_t slots_offset = rings_offset + num_rings * sizeof(RingHeader);
+  region_size_ =
+      RoundUp(slots_offset + num_rings * slots_per_ring_ * slot_size_,
+              kShmRegionAlign);
+
+  const auto deadline = std::chrono::steady_clock::now() +
+                        std::chrono::seconds(kShmAttachTimeoutSec);
+  int fd = -1;
+  if (owner_ == true) {
+    // Replace the region of a previous run, which peers may still map
+    unlink(path_.c_str());
+    fd = open(path_.c_str(), O_RDWR | O_CREAT | O_EXCL, 0666);
+    if ((fd < 0) || (ftruncate(fd, region_size_) != 0)) {
+      throw std::runtime_error("ShmFronthaul: failed to create " + path_ +
+                               ": " + std::strerror(errno));
+    }
+  } else {
+    struct stat st;
+    while (true) {
+      fd = open(path_.c_str(), O_RDWR);
+      if ((fd >= 0) && (fstat(fd, &st) == 0) && (st.st_size > 0)) {
+        break;
+      }
+      if (fd >= 0) {
+        close(fd);
+      }
+      if (std::chrono::steady_clock::now() > deadline) {
+        throw std::runtime_error("ShmFronthaul: timed out waiting for " +
+                                 path_ + ". Is Agora running?");
+      }
+      std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+    if (static_cast<size_t>(st.st_size) != region_size_) {
+      close(fd);
+      throw std::runtime_error("ShmFronthaul: " + path_ +
+                               " has a different size. Do Agora and the "
+                               "simulator use the same config?");
+    }
+  }
+
+  void* region = mmap(nullptr, region_size_, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, fd, 0);
+  close(fd);
+  if (region == MAP_FAILED) {
+    throw std::runtime_error("ShmFronthaul: failed to map " + path_ + ": " +
+                             std::strerror(errno));
+  }
+  region_ = static_cast<uint8_t*>(region);
+  rings_ = reinterpret_cast<RingHeader*>(region_ + rings_offset);
+  slots_ = region_ + slots_offset;
+
+  auto* header = reinterpret_cast<RegionHeader*>(region_);
+  if (owner_ == true) {
+    // The file is zero-filled, so all rings start empty
+    header->num_radios_ = num_radios_;
+    header->slot_size_ = slot_size_;
+    header->slots_per_ring_ = slots_per_ring_;
+    header->magic_.store(kShmMagic, std::memory_order_release);
+    MLPD_INFO("ShmFronthaul: created %s, %zu MB, %zu slots per ring\n",
+              path_.c_str(), region_size_ / (1024 * 1024), slots_per_ring_);
+  } else {
+    while (header->magic_.load(std::memory_order_acquire) != kShmMagic) {
+      if (std::chrono::steady_clock::now() > deadline) {
+        munmap(region_, region_size_);
+        throw std::runtime_error("ShmFronthaul: " + path_ +
+                                 " was not initialized");
+      }
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    if ((header->num_radios_ != num_radios_) ||
+        (header->slot_size_ != slot_size_) ||
+        (header->slots_per_ring_ != slots_per_ring_)) {
+      munmap(region_, region_size_);
+      throw std::runtime_error("ShmFronthaul: the geometry of " + path_ +
+                               " does not match the config");
+    }
+    MLPD_INFO("ShmFronthaul: attached to %s\n", path_.c_str());
+  }
+}
+
+ShmFronthaul::~ShmFronthaul() {
+  munmap(region_, region_size_);
+  if (owner_ == true) {
+    unlink(path_.c_str());
+  }
+}
@@ -0,0 +1,125 @@
+/**
+ * @file shm_transport.h
+ * @brief Declaration file for the ShmFronthaul class, single-producer
+ * single-consumer packet rings in shared memory between Agora and the
+ * simulators running on the same machine.
+ */
+
+#ifndef SHM_TRANSPORT_H_
+#define SHM_TRANSPORT_H_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "buffer.h"
+
+/// Maximum number of packets that a thread moves through the rings per burst
+static constexpr size_t kShmBatchSize = 64;
+/// The size of the shared region is rounded up to a multiple of this, so
+/// that the region may be a file on hugetlbfs with 2 MB pages
+static constexpr size_t kShmRegionAlign = 2 * 1024 * 1024;
+/// Seconds that a peer waits for the owner to create the region
+static constexpr size_t kShmAttachTimeoutSec = 60;
+
+/// Direction of a ring. Uplink rings carry packets from the simulator to
+/// Agora, downlink rings from Agora to the simulator.
+enum class ShmDirection : size_t { kUplink = 0, kDownlink = 1 };
+
+/**
+ * @brief A shared-memory region with one uplink and one downlink ring of
+ * packet slots per radio.
+ *
+ * The region is a file mapped by all processes, by default on /dev/shm, or
+ * on a hugetlbfs mount to back it with hugepages. Agora creates it and the
+ * simulators attach to it by its path.
+ *
+ * Each ring has exactly one producer thread and one consumer thread. A slot
+ * holds one packet in the usual Packet format, so producers write packets in
+ * place, without an intermediate buffer. Producers do not block: when a ring
+ * is full, the packet is dropped by the caller, as a full socket buffer
+ * would drop it.
+ */
+class ShmFronthaul {
+ public:
+  /// If create is true, create the region at path, replacing any existing
+  /// file, and remove it on destruction. Otherwise, attach to the region
+  /// created at path by another process, waiting up to
+  /// kShmAttachTimeoutSec seconds for it. slots_per_ring must be a power of
+  /// two. Throws std::runtime_error on failure, or if an attached region was
+  /// created with a different geometry.
+  ShmFronthaul(const std::string& path, size_t num_radios, size_t slot_size,
+               size_t slots_per_ring, bool create);
+  ~ShmFronthaul();
+
+  /// Return the next free slot of a ring, or nullptr if the ring is full.
+  /// Only the ring's producer may call this.
+  inline Packet* ProducerSlot(ShmDirection dir, size_t radio_id) {
+    RingHeader& ring = Ring(dir, radio_id);
+    const uint64_t head = ring.head_.load(std::memory_order_relaxed);
+    if (head - ring.tail_.load(std::memory_order_acquire) == slots_per_ring_) {
+      return nullptr;
+    }
+    return Slot(dir, radio_id, head);
+  }
+  /// Pass the slot returned by ProducerSlot() to the consumer
+  inline void Produce(ShmDirection dir, size_t radio_id) {
+    RingHeader& ring = Ring(dir, radio_id);
+    ring.head_.store(ring.head_.load(std::memory_order_relaxed) + 1,
+                     std::memory_order_release);
+  }
+
+  /// Return the oldest full slot of a ring, or nullptr if the ring is empty.
+  /// Only the ring's consumer may call this.
+  inline const Packet* ConsumerSlot(ShmDirection dir, size_t radio_id) {
+    RingHeader& ring = Ring(dir, radio_id);
+    const uint64_t tail = ring.tail_.load(std::memory_order_relaxed);
+    if (ring.head_.load(std::memory_order_acquire) == tail) {
+      return nullptr;
+    }
+    return Slot(dir, radio_id, tail);
+  }
+  /// Return the slot returned by ConsumerSlot() to the producer
+  inline void Consume(ShmDirection dir, size_t radio_id) {
+    RingHeader& ring = Ring(dir, radio_id);
+    ring.tail_.store(ring.tail_.load(std::memory_order_relaxed) + 1,
+                     std::memory_order_release);
+  }
+
+  inline size_t NumRadios() const { return num_radios_; }
+
+ private:
+  // Counters of produced and consumed packets, on separate cache lines
+  struct RingHeader {
+    alignas(64) std::atomic<uint64_t> head_;
+    alignas(64) std::atomic<uint64_t> tail_;
+  };
+  static_assert(std::atomic<uint64_t>::is_always_lock_free,
+                "Shared memory rings require lock-free atomics");
+
+  struct RegionHeader;
+
+  inline RingHeader& Ring(ShmDirection dir, size_t radio_id) {
+    return rings_[static_cast<size_t>(dir) * num_radios_ + radio_id];
+  }
+  inline Packet* Slot(ShmDirection dir, size_t radio_id, uint64_t count) {
+    const size_t ring_id = static_cast<size_t>(dir) * num_radios_ + radio_id;
+    const size_t slot_id =
+        ring_id * slots_per_ring_ + (count & (slots_per_ring_ - 1));
+    return reinterpret_cast<Packet*>(slots_ + slot_id * slot_size_);
+  }
+
+  const std::string path_;
+  const size_t num_radios_;
+  const size_t slot_size_;  // Rounded up to a multiple of 64 bytes
+  const size_t slots_per_ring_;
+  const bool owner_;  // True if this process created the region
+
+  uint8_t* region_ = nullptr;
+  size_t region_size_ = 0;
+  RingHeader* rings_ = nullptr;  // Uplink rings, then downlink rings
+  uint8_t* slots_ = nullptr;
+};
+
+#endif  // SHM_TRANSPORT_H_
@@ -0,0 +1,289 @@
+/**
+ * @file simd_cholesky.h
+ * @brief Zeroforcing with a complex Cholesky factorization and solve,
+ * vectorized across subcarriers
+ */
+#ifndef SIMD_CHOLESKY_H_
+#define SIMD_CHOLESKY_H_
+
+#include <immintrin.h>
+
+#include <array>
+#include <cstddef>
+#include <cstring>
+#include <utility>
+
+/*
+ * The Gram matrices of the small systems of zeroforcing (a few UEs) are too
+ * small to vectorize within a matrix, so each SIMD lane holds the matrix of
+ * one subcarrier, and kCholeskyLanes subcarriers are processed at once. The
+ * real and imaginary parts of each matrix element are kept in separate
+ * vectors, and loops over the UEs are unrolled by templating on the UE count.
+ *
+ * For the CSI matrix H (antennas x UEs) of each lane, SimdZfCholesky computes
+ * the zeroforcing detector W = inv(H' * H) * H'. H' * H = L * L' is
+ * factorized, and each column of H' is solved against L, then L'. A Gram
+ * matrix that is not positive definite gives non-finite results. With a
+ * positive diagonal load s, H' * H + s * I is factorized instead, which gives
+ * the MMSE detector for noise power s.
+ *
+ * The CSI is read in the layout of the CSI buffers, where groups of
+ * kCholeskyLaneGroup subcarriers of one antenna and UE are contiguous (the
+ * size of a partial transpose block), so that loading the lanes only takes a
+ * deinterleave of the real and imaginary parts.
+ */
+static constexpr size_t kCholeskyLaneGroup = 8;
+#if defined(__AVX512F__)
+static constexpr size_t kCholeskyLanes = 16;
+using CholeskyVec = __m512;
+// Load kCholeskyLanes interleaved complex floats, in two groups of
+// kCholeskyLaneGroup, from p and from group_stride floats later (need not be
+// aligned)
+static inline void CholeskyLoadComplex(const float* p, size_t group_stride,
+                                       CholeskyVec& re, CholeskyVec& im) {
+  const __m512 lo = _mm512_loadu_ps(p);
+  const __m512 hi = _mm512_loadu_ps(p + group_stride);
+  const __m512i even = _mm512_setr_epi32(0, 2, 4, 6, 8, 10, 12, 14, 16, 18,
+                                         20, 22, 24, 26, 28, 30);
+  const __m512i odd = _mm512_setr_epi32(1, 3, 5, 7, 9, 11, 13, 15, 17, 19,
+                                        21, 23, 25, 27, 29, 31);
+  re = _mm512_permutex2var_ps(lo, even, hi);
+  im = _mm512_permutex2var_ps(lo, odd, hi);
+}
+static inline void CholeskyStore(float* p, CholeskyVec a) {
+  _mm512_store_ps(p, a);
+}
+static inline CholeskyVec CholeskyZero() { return _mm512_setzero_ps(); }
+static inline CholeskyVec CholeskySet1(float a) { return _mm512_set1_ps(a); }
+static inline CholeskyVec CholeskyNeg(CholeskyVec a) {
+  return _mm512_sub_ps(_mm512_setzero_ps(), a);
+}
+static inline CholeskyVec CholeskyMul(CholeskyVec a, CholeskyVec b) {
+  return _mm512_mul_ps(a, b);
+}
+// a * b + c
+static inline CholeskyVec CholeskyFmadd(CholeskyVec a, CholeskyVec b,
+                                        CholeskyVec c) {
+  return _mm512_fmadd_ps(a, b, c);
+}
+// c - a * b
+static inline CholeskyVec CholeskyFnmadd(CholeskyVec a, CholeskyVec b,
+                                         CholeskyVec c) {
+  return _mm512_fnmadd_ps(a, b, c);
+}
+static inline CholeskyVec CholeskyRsqrt(CholeskyVec a) {
+  return _mm512_div_ps(_mm512_set1_ps(1.0f), _mm512_sqrt_ps(a));
+}
+#else
+static constexpr size_t kCholeskyLanes = 8;
+using CholeskyVec = __m256;
+static inline void CholeskyLoadComplex(const float* p,
+                                       size_t /*group_stride*/,
+                                       CholeskyVec& re, CholeskyVec& im) {
+  const __m256 lo = _mm256_loadu_ps(p);
+  const __m256 hi = _mm256_loadu_ps(p + 8);
+  // The shuffles leave the values of each 128-bit lane in 64-bit order 0 2 1 3
+  re = _mm256_castpd_ps(_mm256_permute4x64_pd(
+      _mm256_castps_pd(_mm256_shuffle_ps(lo, hi, 0x88)), 0xd8));
+  im = _mm256_castpd_ps(_mm256_permute4x64_pd(
+      _mm256_castps_pd(_mm256_shuffle_ps(lo, hi, 0xdd)), 0xd8));
+}
+static inline void CholeskyStore(float* p, CholeskyVec a) {
+  _mm256_store_ps(p, a);
+}
+static inline CholeskyVec CholeskyZero() { return _mm256_setzero_ps(); }
+static inline CholeskyVec CholeskySet1(float a) { return _mm256_set1_ps(a); }
+static inline CholeskyVec CholeskyNeg(CholeskyVec a) {
+  return _mm256_sub_ps(_mm256_setzero_ps(), a);
+}
+static inline CholeskyVec CholeskyMul(CholeskyVec a, CholeskyVec b) {
+  return _mm256_mul_ps(a, b);
+}
+static inline CholeskyVec CholeskyFmadd(CholeskyVec a, CholeskyVec b,
+                                        CholeskyVec c) {
+  return _mm256_fmadd_ps(a, b, c);
+}
+static inline CholeskyVec CholeskyFnmadd(CholeskyVec a, CholeskyVec b,
+                                         CholeskyVec c) {
+  return _mm256_fnmadd_ps(a, b, c);
+}
+static inline CholeskyVec CholeskyRsqrt(CholeskyVec a) {
+  return _mm256_div_ps(_mm256_set1_ps(1.0f), _mm256_sqrt_ps(a));
+}
+#endif
+
+// Largest UE count with a specialization
+static constexpr size_t kMaxCholeskyUes = 16;
+
+// Layout of the CSI of kCholeskyLanes subcarriers
+struct CholeskyCsiLayout {
+  // csi_[u] points to the interleaved complex CSI of UE u, antenna 0 and the
+  // first lane
+  const float* const* csi_;
+  // Floats from the CSI of one antenna to the next
+  size_t ant_stride_;
+  // Floats from one group of kCholeskyLaneGroup lanes to the next
+  size_t group_stride_;
+};
+
+// Load the CSI of antenna ant of all UEs
+template <size_t kUeNum>
+static inline void CholeskyLoadAnt(const CholeskyCsiLayout& layout, size_t ant,
+                                   CholeskyVec* re, CholeskyVec* im) {
+  for (size_t u = 0; u < kUeNum; u++) {
+    CholeskyLoadComplex(layout.csi_[u] + ant * layout.ant_stride_,
+                        layout.group_stride_, re[u], im[u]);
+  }
+}
+
+// Factorize the Gram matrices g = L * L' of all lanes in place. Only the
+// lower triangle of g is used. On return, the lower triangle of g holds L,
+// and inv_diag holds the inverses of its diagonal.
+template <size_t kUeNum>
+static inline void SimdCholeskyFactor(CholeskyVec (&g_re)[kUeNum][kUeNum],
+                                      CholeskyVec (&g_im)[kUeNum][kUeNum],
+                                      CholeskyVec (&inv_diag)[kUeNum]) {
+  for (size_t j = 0; j < kUeNum; j++) {
+    // L(j, j) = sqrt(G(j, j) - sum |L(j, k)|^2)
+    CholeskyVec d = g_re[j][j];
+    for (size_t k = 0; k < j; k++) {
+      d = CholeskyFnmadd(g_re[j][k], g_re[j][k], d);
+      d = CholeskyFnmadd(g_im[j][k], g_im[j][k], d);
+    }
+    inv_diag[j] = CholeskyRsqrt(d);
+    g_re[j][j] = CholeskyMul(d, inv_diag[j]);
+    g_im[j][j] = CholeskyZero();
+
+    // L(i, j) = (G(i, j) - sum L(i, k) * conj(L(j, k))) / L(j, j)
+    for (size_t i = j + 1; i < kUeNum; i++) {
+      CholeskyVec s_re = g_re[i][j];
+      CholeskyVec s_im = g_im[i][j];
+      for (size_t k = 0; k < j; k++) {
+        s_re = CholeskyFnmadd(g_re[i][k], g_re[j][k], s_re);
+        s_re = CholeskyFnmadd(g_im[i][k], g_im[j][k], s_re);
+        s_im = CholeskyFnmadd(g_im[i][k], g_re[j][k], s_im);
+        s_im = CholeskyFmadd(g_re[i][k], g_im[j][k], s_im);
+      }
+      g_re[i][j] = CholeskyMul(s_re, inv_diag[j]);
+      g_im[i][j] = CholeskyMul(s_im, inv_diag[j]);
+    }
+  }
+}
+
+// Solve L * L' * x = b for the factors of SimdCholeskyFactor, in place
+template <size_t kUeNum>
+static inline void SimdCholeskySolve(const CholeskyVec (&l_re)[kUeNum][kUeNum],
+                                     const CholeskyVec (&l_im)[kUeNum][kUeNum],
+                                     const CholeskyVec (&inv_diag)[kUeNum],
+                                     CholeskyVec* b_re, CholeskyVec* b_im) {
+  // Forward substitution: y(i) = (b(i) - sum L(i, k) * y(k)) / L(i, i)
+  for (size_t i = 0; i < kUeNum; i++) {
+    CholeskyVec s_re = b_re[i];
+    CholeskyVec s_im = b_im[i];
+    for (size_t k = 0; k < i; k++) {
+      s_re = CholeskyFnmadd(l_re[i][k], b_re[k], s_re);
+      s_re = CholeskyFmadd(l_im[i][k], b_im[k], s_re);
+      s_im = CholeskyFnmadd(l_re[i][k], b_im[k], s_im);
+      s_im = CholeskyFnmadd(l_im[i][k], b_re[k], s_im);
+    }
+    b_re[i] = CholeskyMul(s_re, inv_diag[i]);
+    b_im[i] = CholeskyMul(s_im, inv_diag[i]);
+  }
+  // Back substitution: x(i) = (y(i) - sum conj(L(k, i)) * x(k)) / L(i, i)
+  for (size_t i = kUeNum; i-- > 0;) {
+    CholeskyVec s_re = b_re[i];
+    CholeskyVec s_im = b_im[i];
+    for (size_t k = i + 1; k < kUeNum; k++) {
+      s_re = CholeskyFnmadd(l_re[k][i], b_re[k], s_re);
+      s_re = CholeskyFnmadd(l_im[k][i], b_im[k], s_re);
+      s_im = CholeskyFnmadd(l_re[k][i], b_im[k], s_im);
+      s_im = CholeskyFmadd(l_im[k][i], b_re[k], s_im);
+    }
+    b_re[i] = CholeskyMul(s_re, inv_diag[i]);
+    b_im[i] = CholeskyMul(s_im, inv_diag[i]);
+  }
+}
+
+// Compute the zeroforcing detectors zf[lane] of kCholeskyLanes consecutive
+// subcarriers from their CSI, with diag_load added to the diagonal of the
+// Gram matrices. zf[lane] is a column-major kUeNum x bs_ant_num matrix of
+// interleaved complex floats.
+template <size_t kUeNum>
+static inline void SimdZfCholesky(const CholeskyCsiLayout& layout,
+                                  float* const* zf, size_t bs_ant_num,
+                                  float diag_load) {
+  CholeskyVec g_re[kUeNum][kUeNum];
+  CholeskyVec g_im[kUeNum][kUeNum];
+  CholeskyVec inv_diag[kUeNum];
+  CholeskyVec h_re[kUeNum];
+  CholeskyVec h_im[kUeNum];
+
+  // Lower triangle of G = H' * H + diag_load * I, one row of H at a time:
+  // G(i, j) += conj(H(ant, i)) * H(ant, j)
+  for (size_t i = 0; i < kUeNum; i++) {
+    for (size_t j = 0; j < i; j++) {
+      g_re[i][j] = CholeskyZero();
+      g_im[i][j] = CholeskyZero();
+    }
+    g_re[i][i] = CholeskySet1(diag_load);
+    g_im[i][i] = CholeskyZero();
+  }
+  for (size_t ant = 0; ant < bs_ant_num; ant++) {
+    CholeskyLoadAnt<kUeNum>(layout, ant, h_re, h_im);
+    for (size_t i = 0; i < kUeNum; i++) {
+      for (size_t j = 0; j <= i; j++) {
+        g_re[i][j] = CholeskyFmadd(h_re[i], h_re[j], g_re[i][j]);
+        g_re[i][j] = CholeskyFmadd(h_im[i], h_im[j], g_re[i][j]);
+        g_im[i][j] = CholeskyFmadd(h_re[i], h_im[j], g_im[i][j]);
+        g_im[i][j] = CholeskyFnmadd(h_im[i], h_re[j], g_im[i][j]);
+      }
+    }
+  }
+
+  SimdCholeskyFactor<kUeNum>(g_re, g_im, inv_diag);
+
+  // Column ant of W is inv(G) * H(ant, :)'
+  alignas(64) float out_buf[kCholeskyLanes][2 * kUeNum];
+  for (size_t ant = 0; ant < bs_ant_num; ant++) {
+    CholeskyLoadAnt<kUeNum>(layout, ant, h_re, h_im);
+    for (size_t u = 0; u < kUeNum; u++) {
+      h_im[u] = CholeskyNeg(h_im[u]);
+    }
+    SimdCholeskySolve<kUeNum>(g_re, g_im, inv_diag, h_re, h_im);
+
+    alignas(64) float re_buf[kUeNum][kCholeskyLanes];
+    alignas(64) float im_buf[kUeNum][kCholeskyLanes];
+    for (size_t u = 0; u < kUeNum; u++) {
+      CholeskyStore(re_buf[u], h_re[u]);
+      CholeskyStore(im_buf[u], h_im[u]);
+    }
+    for (size_t lane = 0; lane < kCholeskyLanes; lane++) {
+      for (size_t u = 0; u < kUeNum; u++) {
+        out_buf[lane][2 * u] = re_buf[u][lane];
+        out_buf[lane][2 * u + 1] = im_buf[u][lane];
+      }
+      std::memcpy(zf[lane] + 2 * kUeNum * ant, out_buf[lane],
+                  sizeof(out_buf[lane]));
+    }
+  }
+}
+
+using SimdZfCholeskyFn = void (*)(const CholeskyCsiLayout&, float* const*,
+                                  size_t, float);
+
+template <size_t... kUeNums>
+static constexpr std::array<SimdZfCholeskyFn, sizeof...(kUeNums)>
+MakeSimdZfCholeskyTable(std::index_sequence<kUeNums...>) {
+  return {{&SimdZfCholesky<kUeNums + 1>...}};
+}
+
+// The specialization of SimdZfCholesky for ue_num UEs, or nullptr if there is
+// none
+static inline SimdZfCholeskyFn GetSimdZfCholesky(size_t ue_num) {
+  static constexpr auto kTable = MakeSimdZfCholeskyTable(
+      std::make_index_sequence<kMaxCholeskyUes>());
+  return ((ue_num >= 1) && (ue_num <= kMaxCholeskyUes)) ? kTable[ue_num - 1]
+                                                       : nullptr;
+}
+
+#endif  // SIMD_CHOLESKY_H_
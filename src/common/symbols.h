@@ -3,6 +3,7 @@
 
 #include <mkl.h>
 
+#include <array>
 #include <map>
 #include <string>
 
@@ -50,9 +51,10 @@ enum class EventType : int {
   kPacketFromMac,
   kPacketToMac,
   kFFTPilot,
-  kSNRReport,   // Signal new SNR measurement from PHY to MAC
-  kRANUpdate,   // Signal new RAN config to Agora
-  kRBIndicator  // Signal RB schedule to UEs
+  kSNRReport,    // Signal new SNR measurement from PHY to MAC
+  kRANUpdate,    // Signal new RAN config to Agora
+  kRBIndicator,  // Signal RB schedule to UEs
+  kFrameDropped  // Signal that PHY dropped a frame to MAC
 };
 static constexpr size_t kNumEventTypes =
     static_cast<size_t>(EventType::kPacketToMac) + 1;
@@ -259,6 +261,23 @@ static constexpr size_t kMaxStatsBreakdown = 4;
 // Maximum number of hardware threads on one machine
 static constexpr size_t kMaxThreads = 128;
 
+// Maximum number of packets received or sent by one recvmmsg/sendmmsg call
+static constexpr size_t kMaxUdpBatchSize = 64;
+
+// Size of an AF_XDP UMEM frame, which is also the distance between the RX
+// buffer slots with the af_xdp transport
+static constexpr size_t kXdpFrameSize = 4096;
+
+// Number of UMEM frames per AF_XDP socket used for transmitting. They follow
+// the RX buffer slots.
+static constexpr size_t kXdpNumTxFrames = 512;
+
+// Offset of Agora's packet in a UMEM frame received with the af_xdp
+// transport: the headroom that the kernel keeps for XDP programs, the UMEM
+// frame headroom, and the Ethernet, IPv4 and UDP headers. A multiple of 64
+// bytes, so that the samples are aligned as in the other RX buffers.
+static constexpr size_t kXdpRxPacketOffset = 320;
+
 // Number of subcarriers in one cache line, when represented as complex floats
 static constexpr size_t kSCsPerCacheline = 64 / (2 * sizeof(float));
 
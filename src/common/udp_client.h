@@ -57,6 +57,9 @@ class UDPClient {
     }
   }
 
+  /// The socket's file descriptor, for asynchronous I/O interfaces
+  inline int Fd() const { return sock_fd_; }
+
   /**
    * @brief Send one UDP packet to a remote server. The client caches the
    * the remote server's addrinfo after resolving it for the first time. After
@@ -70,13 +73,83 @@ class UDPClient {
    */
   void Send(const std::string& rem_hostname, uint16_t rem_port,
             const uint8_t* msg, size_t len) {
-    std::string remote_uri = rem_hostname + ":" + std::to_string(rem_port);
-    struct addrinfo* rem_addrinfo = nullptr;
-
     if (kDebugPrintUdpClientSend) {
       std::printf("UDPClient sending message to %s to port %d\n",
                   rem_hostname.c_str(), rem_port);
     }
+    struct addrinfo* rem_addrinfo = Resolve(rem_hostname, rem_port);
+
+    ssize_t ret = sendto(sock_fd_, msg, len, 0, rem_addrinfo->ai_addr,
+                         rem_addrinfo->ai_addrlen);
+    if (ret != static_cast<ssize_t>(len)) {
+      throw std::runtime_error("sendto() failed. errno = " +
+                               std::string(std::strerror(errno)));
+    }
+
+    if (enable_recording_flag_) {
+      std::scoped_lock map_access(map_insert_access_);
+      sent_vec_.emplace_back(msg, msg + len);
+    }
+  }
+
+  /**
+   * @brief Send num UDP packets of len bytes each with one sendmmsg() call.
+   * Packet i is sent from msgs[i] to rem_hostname:rem_ports[i].
+   *
+   * @param rem_hostname Hostname or IP address of the remote server
+   * @param rem_ports UDP ports that the packets are sent to
+   * @param msgs Pointers to the messages to send
+   * @param len Length in bytes of each message
+   * @param num Number of messages to send
+   */
+  void SendBatch(const std::string& rem_hostname, const uint16_t* rem_ports,
+                 const uint8_t* const* msgs, size_t len, size_t num) {
+    if (batch_msgs_.size() < num) {
+      batch_msgs_.resize(num);
+      batch_iovecs_.resize(num);
+    }
+    for (size_t i = 0; i < num; i++) {
+      struct addrinfo* rem_addrinfo = Resolve(rem_hostname, rem_ports[i]);
+      batch_iovecs_[i].iov_base = const_cast<uint8_t*>(msgs[i]);
+      batch_iovecs_[i].iov_len = len;
+      std::memset(&batch_msgs_[i].msg_hdr, 0, sizeof(batch_msgs_[i].msg_hdr));
+      batch_msgs_[i].msg_hdr.msg_name = rem_addrinfo->ai_addr;
+      batch_msgs_[i].msg_hdr.msg_namelen = rem_addrinfo->ai_addrlen;
+      batch_msgs_[i].msg_hdr.msg_iov = &batch_iovecs_[i];
+      batch_msgs_[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    // sendmmsg() may send fewer messages than requested
+    size_t num_sent = 0;
+    while (num_sent < num) {
+      int ret = sendmmsg(sock_fd_, &batch_msgs_[num_sent], num - num_sent, 0);
+      if (ret == -1) {
+        throw std::runtime_error("sendmmsg() failed. errno = " +
+                                 std::string(std::strerror(errno)));
+      }
+      num_sent += ret;
+    }
+
+    if (enable_recording_flag_) {
+      std::scoped_lock map_access(map_insert_access_);
+      for (size_t i = 0; i < num; i++) {
+        sent_vec_.emplace_back(msgs[i], msgs[i] + len);
+      }
+    }
+  }
+
+  // Enable recording of all packets sent by this UDP client
+  void EnableRecording() { enable_recording_flag_ = true; }
+
+ private:
+  /**
+   * @brief Return the addrinfo of rem_hostname:rem_port, resolving and
+   * caching it on first use
+   */
+  struct addrinfo* Resolve(const std::string& rem_hostname,
+                           uint16_t rem_port) {
+    std::string remote_uri = rem_hostname + ":" + std::to_string(rem_port);
+    struct addrinfo* rem_addrinfo = nullptr;
 
     const auto remote_itr = addrinfo_map_.find(remote_uri);
     if (remote_itr == addrinfo_map_.end()) {
@@ -120,23 +193,9 @@ class UDPClient {
       rem_addrinfo = remote_itr->second;
     }
 
-    ssize_t ret = sendto(sock_fd_, msg, len, 0, rem_addrinfo->ai_addr,
-                         rem_addrinfo->ai_addrlen);
-    if (ret != static_cast<ssize_t>(len)) {
-      throw std::runtime_error("sendto() failed. errno = " +
-                               std::string(std::strerror(errno)));
-    }
-
-    if (enable_recording_flag_) {
-      std::scoped_lock map_access(map_insert_access_);
-      sent_vec_.emplace_back(msg, msg + len);
-    }
+    return rem_addrinfo;
   }
 
-  // Enable recording of all packets sent by this UDP client
-  void EnableRecording() { enable_recording_flag_ = true; }
-
- private:
   /**
    * @brief The raw socket file descriptor
    */
@@ -157,6 +216,12 @@ class UDPClient {
    */
   std::vector<std::vector<uint8_t>> sent_vec_;
 
+  /**
+   * @brief Message headers and I/O vectors for SendBatch()
+   */
+  std::vector<struct mmsghdr> batch_msgs_;
+  std::vector<struct iovec> batch_iovecs_;
+
   /**
    * @brief If set to ture, we record all sent packets, otherwise we dont
    */
@@ -23,6 +23,7 @@
 
 #include <cstring> /* std::strerror, std::memset, std::memcpy */
 #include <stdexcept>
+#include <vector>
 
 /// Basic UDP server class based on OS sockets that supports receiving messages
 class UDPServer {
@@ -93,6 +94,9 @@ class UDPServer {
     }
   }
 
+  /// The socket's file descriptor, for asynchronous I/O interfaces
+  inline int Fd() const { return sock_fd_; }
+
   /**
    * @brief Try to receive up to len bytes in buf by default this will not block
    *
@@ -116,6 +120,49 @@ class UDPServer {
     return ret;
   }
 
+  /**
+   * @brief Try to receive up to max_num packets of up to len bytes each with
+   * one recvmmsg() call. Packet i is written to buf + i * len. This will not
+   * block.
+   *
+   * @param msg_lens If not null, receives the length of each packet
+   *
+   * @return Return the number of packets received, zero if none, or -1 if
+   * there was an error in receiving.
+   */
+  ssize_t RecvBatch(uint8_t* buf, size_t len, size_t max_num,
+                    size_t* msg_lens = nullptr) {
+    if (msgs_.size() < max_num) {
+      msgs_.resize(max_num);
+      iovecs_.resize(max_num);
+    }
+    for (size_t i = 0; i < max_num; i++) {
+      iovecs_[i].iov_base = buf + i * len;
+      iovecs_[i].iov_len = len;
+      std::memset(&msgs_[i].msg_hdr, 0, sizeof(msgs_[i].msg_hdr));
+      msgs_[i].msg_hdr.msg_iov = &iovecs_[i];
+      msgs_[i].msg_hdr.msg_iovlen = 1;
+    }
+    int ret = recvmmsg(sock_fd_, msgs_.data(), max_num, 0, nullptr);
+    if (ret == -1) {
+      if (errno == EAGAIN || errno == EWOULDBLOCK) {
+        // These errors mean that there's no data to receive
+        return 0;
+      } else {
+        std::fprintf(stderr,
+                     "UDPServer: recvmmsg() failed with unexpected error %s\n",
+                     std::strerror(errno));
+        return ret;
+      }
+    }
+    if (msg_lens != nullptr) {
+      for (int i = 0; i < ret; i++) {
+        msg_lens[i] = msgs_[i].msg_len;
+      }
+    }
+    return ret;
+  }
+
   /**
    * @brief Try once to receive up to len bytes in buf
    *
@@ -229,6 +276,12 @@ class UDPServer {
    * structures
    */
   std::mutex map_insert_access_;
+
+  /**
+   * @brief Message headers and I/O vectors for RecvBatch()
+   */
+  std::vector<struct mmsghdr> msgs_;
+  std::vector<struct iovec> iovecs_;
 };
 
 #endif  // UDP_SERVER_H_
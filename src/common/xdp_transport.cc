@@ -0,0 +1,325 @@
+/**
+ * @file xdp_transport.cc
+ * @brief Implementation file for the XdpSocket class
+ */
+#include "xdp_transport.h"
+
+#include <arpa/inet.h>
+#include <linux/if_link.h>
+#include <linux/if_xdp.h>
+#include <net/if.h>
+#include <netinet/if_ether.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <cassert>
+#include <cstring>
+#include <stdexcept>
+
+#include "logger.h"
+#include "utils.h"
+
+/// Return the MAC address of interface ifname
+static std::array<uint8_t, ETH_ALEN> GetMacAddress(const std::string& ifname) {
+  struct ifreq ifr;
+  std::memset(&ifr, 0, sizeof(ifr));
+  std::strncpy(ifr.ifr_name, ifname.c_str(), IFNAMSIZ - 1);
+  const int fd = socket(AF_INET, SOCK_DGRAM, 0);
+  if ((fd < 0) || (ioctl(fd, SIOCGIFHWADDR, &ifr) != 0)) {
+    if (fd >= 0) {
+      close(fd);
+    }
+    throw std::runtime_error("XdpSocket: failed to get the MAC address of " +
+                             ifname);
+  }
+  close(fd);
+  std::array<uint8_t, ETH_ALEN> mac;
+  std::memcpy(mac.data(), ifr.ifr_hwaddr.sa_data, ETH_ALEN);
+  return mac;
+}
+
+static uint16_t IpChecksum(const struct iphdr* ip) {
+  const auto* words = reinterpret_cast<const uint16_t*>(ip);
+  uint32_t sum = 0;
+  for (size_t i = 0; i < ip->ihl * 2u; i++) {
+    sum += words[i];
+  }
+  while ((sum >> 16) != 0) {
+    sum = (sum & 0xffff) + (sum >> 16);
+  }
+  return static_cast<uint16_t>(~sum);
+}
+
+XdpSocket::XdpSocket(const std::string& ifname, uint32_t queue_id,
+                     uint8_t* umem_area, size_t umem_size)
+    : umem_area_(umem_area),
+      num_rx_frames_(umem_size / kXdpFrameSize - kXdpNumTxFrames),
+      mac_(GetMacAddress(ifname)) {
+  if ((reinterpret_cast<uintptr_t>(umem_area) % kXdpFrameSize != 0) ||
+      (umem_size % kXdpFrameSize != 0) ||
+      (umem_size / kXdpFrameSize <= kXdpNumTxFrames)) {
+    throw std::runtime_error(
+        "XdpSocket: the UMEM must be page-aligned frames, RX frames included");
+  }
+
+  struct xsk_umem_config umem_cfg;
+  std::memset(&umem_cfg, 0, sizeof(umem_cfg));
+  umem_cfg.fill_size = XSK_RING_PROD__DEFAULT_NUM_DESCS;
+  umem_cfg.comp_size = XSK_RING_CONS__DEFAULT_NUM_DESCS;
+  umem_cfg.frame_size = kXdpFrameSize;
+  umem_cfg.frame_headroom = kXdpFrameHeadroom;
+  int ret = xsk_umem__create(&umem_, umem_area_, umem_size, &fill_ring_,
+                             &comp_ring_, &umem_cfg);
+  if (ret != 0) {
+    throw std::runtime_error("XdpSocket: xsk_umem__create failed: " +
+                             std::string(std::strerror(-ret)));
+  }
+
+  // Prefer zero-copy in native (driver) mode. Fall back to copy mode, first
+  // in native mode and then in generic (SKB) mode, which works on any
+  // interface.
+  struct XdpMode {
+    uint32_t xdp_flags_;
+    uint16_t bind_flags_;
+  };
+  static constexpr XdpMode kModes[] = {{XDP_FLAGS_DRV_MODE, XDP_ZEROCOPY},
+                                       {XDP_FLAGS_DRV_MODE, XDP_COPY},
+                                       {XDP_FLAGS_SKB_MODE, XDP_COPY}};
+  for (const XdpMode& mode : kModes) {
+    struct xsk_socket_config xsk_cfg;
+    std::memset(&xsk_cfg, 0, sizeof(xsk_cfg));
+    xsk_cfg.rx_size = XSK_RING_CONS__DEFAULT_NUM_DESCS;
+    xsk_cfg.tx_size = XSK_RING_PROD__DEFAULT_NUM_DESCS;
+    xsk_cfg.xdp_flags = mode.xdp_flags_;
+    xsk_cfg.bind_flags = mode.bind_flags_ | XDP_USE_NEED_WAKEUP;
+    ret = xsk_socket__create(&xsk_, ifname.c_str(), queue_id, umem_,
+                             &rx_ring_, &tx_ring_, &xsk_cfg);
+    if (ret == 0) {
+      zero_copy_ = (mode.bind_flags_ == XDP_ZEROCOPY);
+      break;
+    }
+  }
+  if (ret != 0) {
+    xsk_umem__delete(umem_);
+    throw std::runtime_error(
+        "XdpSocket: failed to create an AF_XDP socket on " + ifname +
+        " queue " + std::to_string(queue_id) + ": " + std::strerror(-ret));
+  }
+
+  for (size_t i = num_rx_frames_; i < num_rx_frames_ + kXdpNumTxFrames;
+       i++) {
+    tx_free_addrs_.push_back(i * kXdpFrameSize);
+  }
+
+  MLPD_INFO("XdpSocket: %s queue %u in %s mode\n", ifname.c_str(), queue_id,
+            zero_copy_ ? "zero-copy" : "copy");
+}
+
+XdpSocket::~XdpSocket() {
+  xsk_socket__delete(xsk_);
+  xsk_umem__delete(umem_);
+}
+
+size_t XdpSocket::FillSpace() {
+  return xsk_prod_nb_free(&fill_ring_, XSK_RING_PROD__DEFAULT_NUM_DESCS);
+}
+
+void XdpSocket::Fill(uint8_t* const* frames, size_t num) {
+  uint32_t fill_idx;
+  const size_t num_reserved =
+      xsk_ring_prod__reserve(&fill_ring_, num, &fill_idx);
+  assert(num_reserved == num);
+  for (size_t i = 0; i < num_reserved; i++) {
+    const size_t frame_id =
+        static_cast<size_t>(frames[i] - umem_area_) / kXdpFrameSize;
+    assert(frame_id < num_rx_frames_);
+    *xsk_ring_prod__fill_addr(&fill_ring_, fill_idx + i) =
+        frame_id * kXdpFrameSize;
+  }
+  xsk_ring_prod__submit(&fill_ring_, num_reserved);
+}
+
+size_t XdpSocket::Recv(uint8_t** frames, size_t* lens, size_t max_num) {
+  assert(num_rx_peeked_ == 0);
+  const size_t num = xsk_ring_cons__peek(&rx_ring_, max_num, &rx_idx_);
+  if (num == 0) {
+    if (xsk_ring_prod__needs_wakeup(&fill_ring_)) {
+      recvfrom(xsk_socket__fd(xsk_), nullptr, 0, MSG_DONTWAIT, nullptr,
+               nullptr);
+    }
+    return 0;
+  }
+  for (size_t i = 0; i < num; i++) {
+    const struct xdp_desc* desc =
+        xsk_ring_cons__rx_desc(&rx_ring_, rx_idx_ + i);
+    frames[i] =
+        static_cast<uint8_t*>(xsk_umem__get_data(umem_area_, desc->addr));
+    lens[i] = desc->len;
+  }
+  num_rx_peeked_ = num;
+  return num;
+}
+
+void XdpSocket::RecvDone() {
+  if (num_rx_peeked_ == 0) {
+    return;
+  }
+  xsk_ring_cons__release(&rx_ring_, num_rx_peeked_);
+  num_rx_peeked_ = 0;
+}
+
+uint64_t XdpSocket::NumFillRingEmpty() const {
+  struct xdp_statistics stats;
+  socklen_t len = sizeof(stats);
+  if (getsockopt(xsk_socket__fd(xsk_), SOL_XDP, XDP_STATISTICS, &stats,
+                 &len) != 0) {
+    return 0;
+  }
+  return stats.rx_fill_ring_empty_descs;
+}
+
+uint8_t* XdpSocket::AllocTxFrame() {
+  if (tx_free_addrs_.empty() == true) {
+    ReclaimTx();
+    if (tx_free_addrs_.empty() == true) {
+      return nullptr;
+    }
+  }
+  const uint64_t addr = tx_free_addrs_.back();
+  tx_free_addrs_.pop_back();
+  return static_cast<uint8_t*>(xsk_umem__get_data(umem_area_, addr));
+}
+
+void XdpSocket::Send(uint8_t* frame, size_t len) {
+  // The TX ring has room for all TX frames
+  uint32_t tx_idx;
+  const size_t num_reserved = xsk_ring_prod__reserve(&tx_ring_, 1, &tx_idx);
+  assert(num_reserved == 1);
+  unused(num_reserved);
+  struct xdp_desc* desc = xsk_ring_prod__tx_desc(&tx_ring_, tx_idx);
+  desc->addr = static_cast<uint64_t>(frame - umem_area_);
+  desc->len = static_cast<uint32_t>(len);
+  num_tx_queued_++;
+}
+
+void XdpSocket::FlushTx() {
+  if (num_tx_queued_ > 0) {
+    xsk_ring_prod__submit(&tx_ring_, num_tx_queued_);
+    num_tx_queued_ = 0;
+  }
+  // In copy mode, the kernel transmits only when woken up. Failures such as
+  // EAGAIN are retried by the next flush.
+  if (xsk_ring_prod__needs_wakeup(&tx_ring_)) {
+    sendto(xsk_socket__fd(xsk_), nullptr, 0, MSG_DONTWAIT, nullptr, 0);
+  }
+  ReclaimTx();
+}
+
+void XdpSocket::ReclaimTx() {
+  uint32_t comp_idx;
+  const size_t num =
+      xsk_ring_cons__peek(&comp_ring_, kXdpNumTxFrames, &comp_idx);
+  for (size_t i = 0; i < num; i++) {
+    tx_free_addrs_.push_back(
+        *xsk_ring_cons__comp_addr(&comp_ring_, comp_idx + i));
+  }
+  xsk_ring_cons__release(&comp_ring_, num);
+}
+
+void XdpSocket::WriteUdpHeaders(uint8_t* frame, const uint8_t* src_mac,
+                                const uint8_t* dst_mac, uint32_t src_addr,
+                                uint32_t dst_addr, uint16_t src_port,
+                                uint16_t dst_port, size_t payload_len) {
+  auto* eth = reinterpret_cast<struct ethhdr*>(frame);
+  std::memcpy(eth->h_dest, dst_mac, ETH_ALEN);
+  std::memcpy(eth->h_source, src_mac, ETH_ALEN);
+  eth->h_proto = htons(ETH_P_IP);
+
+  auto* ip = reinterpret_cast<struct iphdr*>(frame + sizeof(struct ethhdr));
+  ip->version = 4;
+  ip->ihl = sizeof(struct iphdr) / 4;
+  ip->tos = 0;
+  ip->tot_len =
+      htons(sizeof(struct iphdr) + sizeof(struct udphdr) + payload_len);
+  ip->id = 0;
+  ip->frag_off = htons(IP_DF);
+  ip->ttl = 64;
+  ip->protocol = IPPROTO_UDP;
+  ip->check = 0;
+  ip->saddr = src_addr;
+  ip->daddr = dst_addr;
+  ip->check = IpChecksum(ip);
+
+  // The UDP checksum is optional over IPv4
+  auto* udp = reinterpret_cast<struct udphdr*>(frame + sizeof(struct ethhdr) +
+                                               sizeof(struct iphdr));
+  udp->source = src_port;
+  udp->dest = dst_port;
+  udp->len = htons(sizeof(struct udphdr) + payload_len);
+  udp->check = 0;
+}
+
+const uint8_t* XdpSocket::ParseUdp(const uint8_t* frame, size_t len,
+                                   uint32_t* src_addr, uint16_t* dst_port,
+                                   size_t* payload_len) {
+  if (len < kXdpPayloadOffset) {
+    return nullptr;
+  }
+  const auto* eth = reinterpret_cast<const struct ethhdr*>(frame);
+  if (eth->h_proto != htons(ETH_P_IP)) {
+    return nullptr;
+  }
+  const auto* ip =
+      reinterpret_cast<const struct iphdr*>(frame + sizeof(struct ethhdr));
+  // IP fragments are not reassembled
+  if ((ip->version != 4) || (ip->protocol != IPPROTO_UDP) ||
+      ((ntohs(ip->frag_off) & (IP_MF | IP_OFFMASK)) != 0)) {
+    return nullptr;
+  }
+  const size_t udp_offset = sizeof(struct ethhdr) + ip->ihl * 4;
+  if (len < udp_offset + sizeof(struct udphdr)) {
+    return nullptr;
+  }
+  const auto* udp = reinterpret_cast<const struct udphdr*>(frame + udp_offset);
+  const size_t udp_len = ntohs(udp->len);
+  if ((udp_len < sizeof(struct udphdr)) || (udp_offset + udp_len > len)) {
+    return nullptr;
+  }
+  *src_addr = ip->saddr;
+  *dst_port = ntohs(udp->dest);
+  *payload_len = udp_len - sizeof(struct udphdr);
+  return frame + udp_offset + sizeof(struct udphdr);
+}
+
+size_t XdpSocket::WriteArpReply(const uint8_t* frame, size_t len,
+                                uint32_t addr, const uint8_t* mac,
+                                uint8_t* reply) {
+  const size_t arp_len = sizeof(struct ethhdr) + sizeof(struct ether_arp);
+  if (len < arp_len) {
+    return 0;
+  }
+  const auto* eth = reinterpret_cast<const struct ethhdr*>(frame);
+  const auto* request =
+      reinterpret_cast<const struct ether_arp*>(frame + sizeof(struct ethhdr));
+  if ((eth->h_proto != htons(ETH_P_ARP)) ||
+      (request->ea_hdr.ar_op != htons(ARPOP_REQUEST)) ||
+      (request->ea_hdr.ar_pro != htons(ETH_P_IP)) ||
+      (std::memcmp(request->arp_tpa, &addr, sizeof(addr)) != 0)) {
+    return 0;
+  }
+
+  auto* reply_eth = reinterpret_cast<struct ethhdr*>(reply);
+  std::memcpy(reply_eth->h_dest, eth->h_source, ETH_ALEN);
+  std::memcpy(reply_eth->h_source, mac, ETH_ALEN);
+  reply_eth->h_proto = htons(ETH_P_ARP);
+  auto* response =
+      reinterpret_cast<struct ether_arp*>(reply + sizeof(struct ethhdr));
+  response->ea_hdr = request->ea_hdr;
+  response->ea_hdr.ar_op = htons(ARPOP_REPLY);
+  std::memcpy(response->arp_sha, mac, ETH_ALEN);
+  std::memcpy(response->arp_spa, &addr, sizeof(addr));
+  std::memcpy(response->arp_tha, request->arp_sha, ETH_ALEN);
+  std::memcpy(response->arp_tpa, request->arp_spa, sizeof(addr));
+  return arp_len;
+}
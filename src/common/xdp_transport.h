@@ -0,0 +1,125 @@
+/**
+ * @file xdp_transport.h
+ * @brief Declaration file for the XdpSocket class, an AF_XDP socket for
+ * kernel-bypass packet I/O on one interface queue, whose UMEM is provided by
+ * the caller.
+ */
+
+#ifndef XDP_TRANSPORT_H_
+#define XDP_TRANSPORT_H_
+
+#include <linux/bpf.h>
+#include <linux/if_ether.h>
+#include <netinet/ip.h>
+#include <netinet/udp.h>
+#include <xdp/xsk.h>
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "symbols.h"
+
+/// A packet, including its Ethernet, IPv4 and UDP headers, must fit in one
+/// UMEM frame of kXdpFrameSize bytes
+static_assert(kXdpFrameSize == XSK_UMEM__DEFAULT_FRAME_SIZE, "");
+static_assert(kXdpNumTxFrames <= XSK_RING_PROD__DEFAULT_NUM_DESCS, "");
+/// Maximum number of packets that a TXRX thread receives or sends per burst
+static constexpr size_t kXdpBatchSize = 64;
+/// Offset of the UDP payload from the start of a frame without IP options
+static constexpr size_t kXdpPayloadOffset =
+    sizeof(struct ethhdr) + sizeof(struct iphdr) + sizeof(struct udphdr);
+static_assert(kXdpPayloadOffset == 42, "");
+/// UMEM frame headroom that places the UDP payload of a received frame
+/// kXdpRxPacketOffset bytes into the frame
+static constexpr size_t kXdpFrameHeadroom =
+    kXdpRxPacketOffset - XDP_PACKET_HEADROOM - kXdpPayloadOffset;
+static_assert(kXdpRxPacketOffset > XDP_PACKET_HEADROOM + kXdpPayloadOffset,
+              "");
+
+class XdpSocket {
+ public:
+  /// Create an AF_XDP socket on queue queue_id of interface ifname, with the
+  /// umem_size bytes at the page-aligned umem_area as its UMEM. The last
+  /// kXdpNumTxFrames frames of the UMEM are used for transmitting, and the
+  /// others are received into once given to the kernel with Fill(). Zero-copy
+  /// mode is used if the driver supports it, copy mode otherwise. Throws
+  /// std::runtime_error on failure.
+  XdpSocket(const std::string& ifname, uint32_t queue_id, uint8_t* umem_area,
+            size_t umem_size);
+  ~XdpSocket();
+
+  /// Number of RX frames that Fill() can give to the kernel at once
+  size_t FillSpace();
+  /// Give num RX frames to the kernel, which receives packets into them in
+  /// this order. frames[i] is any address in the i-th frame. num must not be
+  /// more than FillSpace().
+  void Fill(uint8_t* const* frames, size_t num);
+
+  /// Peek up to max_num received frames. frames[i] points to the Ethernet
+  /// header of the i-th frame, and lens[i] is its length. The frames are the
+  /// caller's until given back to the kernel with Fill().
+  size_t Recv(uint8_t** frames, size_t* lens, size_t max_num);
+  /// Release the descriptors of the last Recv() call
+  void RecvDone();
+  /// Number of times that the kernel found no RX frame to receive into, and
+  /// dropped the packet
+  uint64_t NumFillRingEmpty() const;
+
+  /// Return a free UMEM frame to transmit, or nullptr if all TX frames are
+  /// in flight
+  uint8_t* AllocTxFrame();
+  /// Queue the first len bytes of frame, which was returned by
+  /// AllocTxFrame(), for transmission
+  void Send(uint8_t* frame, size_t len);
+  /// Make the queued frames visible to the kernel and wake it up if needed
+  void FlushTx();
+
+  inline bool ZeroCopy() const { return zero_copy_; }
+  /// MAC address of the interface
+  inline const std::array<uint8_t, ETH_ALEN>& Mac() const { return mac_; }
+
+  /// Write Ethernet, IPv4 and UDP headers for a payload of payload_len bytes
+  /// at the start of frame. IP addresses and ports are in network byte order.
+  static void WriteUdpHeaders(uint8_t* frame, const uint8_t* src_mac,
+                              const uint8_t* dst_mac, uint32_t src_addr,
+                              uint32_t dst_addr, uint16_t src_port,
+                              uint16_t dst_port, size_t payload_len);
+
+  /// Return the UDP payload of an Ethernet frame, or nullptr if the frame is
+  /// not an IPv4 UDP packet. On success, sets src_addr (network byte order),
+  /// dst_port (host byte order) and payload_len.
+  static const uint8_t* ParseUdp(const uint8_t* frame, size_t len,
+                                 uint32_t* src_addr, uint16_t* dst_port,
+                                 size_t* payload_len);
+
+  /// If frame is an ARP request for addr (network byte order), write the
+  /// reply of the interface with MAC address mac to reply and return its
+  /// length. Otherwise, return 0.
+  static size_t WriteArpReply(const uint8_t* frame, size_t len, uint32_t addr,
+                              const uint8_t* mac, uint8_t* reply);
+
+ private:
+  /// Return the frames of completed transmissions to the free list
+  void ReclaimTx();
+
+  uint8_t* umem_area_;
+  size_t num_rx_frames_;  // The frames before the TX frames
+  struct xsk_umem* umem_ = nullptr;
+  struct xsk_socket* xsk_ = nullptr;
+  struct xsk_ring_prod fill_ring_;
+  struct xsk_ring_cons comp_ring_;
+  struct xsk_ring_cons rx_ring_;
+  struct xsk_ring_prod tx_ring_;
+  bool zero_copy_;
+  std::array<uint8_t, ETH_ALEN> mac_;
+
+  uint32_t rx_idx_ = 0;       // Index of the first frame of the last Recv()
+  size_t num_rx_peeked_ = 0;  // Number of frames of the last Recv()
+  std::vector<uint64_t> tx_free_addrs_;  // UMEM addresses of free TX frames
+  size_t num_tx_queued_ = 0;             // Queued since the last FlushTx()
+};
+
+#endif  // XDP_TRANSPORT_H_
@@ -39,6 +39,7 @@ MacThreadBaseStation::MacThreadBaseStation(
   dl_bits_buffer_id_.fill(0);
 
   server_.n_filled_in_frame_.fill(0);
+  server_.fill_frame_id_.fill(SIZE_MAX);
   for (auto& v : server_.frame_data_) {
     v.resize(cfg_->UlMacDataBytesNumPerframe());
   }
@@ -79,6 +80,9 @@ void MacThreadBaseStation::ProcessRxFromPhy() {
   } else if (event.event_type_ == EventType::kSNRReport) {
     MLPD_TRACE("MAC thread event kSNRReport\n");
     ProcessSnrReportFromPhy(event);
+  } else if (event.event_type_ == EventType::kFrameDropped) {
+    MLPD_TRACE("MAC thread event kFrameDropped\n");
+    ProcessFrameDroppedFromPhy(event);
   }
 }
 
@@ -93,6 +97,24 @@ void MacThreadBaseStation::ProcessSnrReportFromPhy(EventData event) {
   server_.snr_[ue_id].push(snr);
 }
 
+void MacThreadBaseStation::ProcessFrameDroppedFromPhy(EventData event) {
+  const size_t frame_id = gen_tag_t(event.tags_[0]).frame_id_;
+  num_dropped_frames_++;
+  std::fprintf(log_file_,
+               "MAC thread: PHY dropped frame %zu (%zu frames dropped)\n",
+               frame_id, num_dropped_frames_);
+
+  // The codeblocks of the dropped frame that were not decoded will never
+  // arrive, so its partially filled frames cannot complete. UEs already
+  // filling a later frame keep their data.
+  for (size_t ue_id = 0; ue_id < cfg_->UeAntNum(); ue_id++) {
+    if (server_.fill_frame_id_[ue_id] == frame_id) {
+      server_.n_filled_in_frame_[ue_id] = 0;
+      server_.fill_frame_id_[ue_id] = SIZE_MAX;
+    }
+  }
+}
+
 void MacThreadBaseStation::SendRanConfigUpdate(EventData /*event*/) {
   RanConfig rc;
   rc.n_antennas_ = 0;  // TODO [arjun]: What's the correct value here?
@@ -137,6 +159,7 @@ void MacThreadBaseStation::ProcessCodeblocksFromPhy(EventData event) {
     std::memcpy(&server_.frame_data_[ue_id][frame_data_offset], pkt->data_,
                 cfg_->MacPayloadLength());
     server_.n_filled_in_frame_[ue_id] += cfg_->MacPayloadLength();
+    server_.fill_frame_id_[ue_id] = frame_id;
 
     // Check CRC
     auto crc = static_cast<uint16_t>(
@@ -171,6 +194,7 @@ void MacThreadBaseStation::ProcessCodeblocksFromPhy(EventData event) {
   // When the frame is full, send it to the application
   if (server_.n_filled_in_frame_[ue_id] == cfg_->UlMacDataBytesNumPerframe()) {
     server_.n_filled_in_frame_[ue_id] = 0;
+    server_.fill_frame_id_[ue_id] = SIZE_MAX;
 
     udp_client_->Send(kMacRemoteHostname, cfg_->BsMacTxPort() + ue_id,
                       &server_.frame_data_[ue_id][0],
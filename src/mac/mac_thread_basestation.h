@@ -65,6 +65,10 @@ class MacThreadBaseStation {
   // TODO: process CQI report here as well.
   void ProcessSnrReportFromPhy(EventData event);
 
+  // Receive notice from the PHY master thread that it dropped a frame.
+  // Discard the partially received uplink data of that frame.
+  void ProcessFrameDroppedFromPhy(EventData event);
+
   // Push RAN config update to PHY master thread.
   void SendRanConfigUpdate(EventData event);
 
@@ -127,6 +131,9 @@ class MacThreadBaseStation {
   // The frame ID of the next TTI that the scheduler plans for
   size_t scheduler_next_frame_id_ = 0;
 
+  // Number of frames dropped by the PHY
+  size_t num_dropped_frames_ = 0;
+
   FastRand fast_rand_;
 
   // Server-only members
@@ -138,6 +145,9 @@ class MacThreadBaseStation {
     // frame for UE #i
     std::array<size_t, kMaxUEs> n_filled_in_frame_;
 
+    // fill_frame_id_[i] is the frame whose data is in UE #i's staging buffer
+    std::array<size_t, kMaxUEs> fill_frame_id_;
+
     // snr_[i] contains a moving window of SNR measurement for UE #i
     std::array<std::queue<float>, kMaxUEs> snr_;
   } server_;
@@ -0,0 +1,53 @@
+#!/bin/bash
+#
+# Report the EVM, BER and ZF cost of the zeroforcing and MMSE beamformers at
+# several channel SNRs, over the channel simulator's Rayleigh channel model.
+#
+# Usage:
+#  * This script must be run from Agora's top-level directory.
+#  * Optional arguments set the channel SNRs in dB (default 0 5 10 15 20).
+###############################################################################
+
+exe_list="build/user build/data_generator build/chsim build/agora data/bs-sim.json"
+for exe in ${exe_list}; do
+  if [ ! -f ${exe} ]; then
+      echo "${exe} not found. Exiting."
+      exit
+  fi
+done
+
+SNRS="$@"
+if [ "$SNRS" == "" ]; then
+  SNRS="0 5 10 15 20"
+fi
+
+cp data/ue-sim.json data/ue-sim-tmp.json
+sed -i '2i\ \ "frames_to_test": 1000,' data/ue-sim-tmp.json
+cp data/bs-sim.json data/bs-sim-tmp.json
+sed -i '2i\ \ "frames_to_test": 1000,' data/bs-sim-tmp.json
+./build/data_generator --conf_file data/bs-sim-tmp.json > /dev/null
+
+for snr in ${SNRS}; do
+  for beamformer in zf mmse; do
+    cp data/bs-sim.json data/bs-sim-tmp.json
+    sed -i '2i\ \ "frames_to_test": 1000,' data/bs-sim-tmp.json
+    sed -i '2i\ \ "zf_block_size": 48,' data/bs-sim-tmp.json
+    sed -i "2i\ \ \"beamformer\": \"${beamformer}\"," data/bs-sim-tmp.json
+
+    ./build/user data/ue-sim-tmp.json > /dev/null &
+    sleep 1; ./build/chsim --bs_threads 1 --ue_threads 1 --worker_threads 2 --core_offset 24 --bs_conf_file data/bs-sim-tmp.json --ue_conf_file data/ue-sim-tmp.json --chan_model RAYLEIGH --chan_snr ${snr} > /dev/null &
+    sleep 1; ./build/agora data/bs-sim-tmp.json > test_agora_output.txt
+    sleep 5
+    pkill -INT chsim
+    pkill -INT user
+    pkill -INT agora
+    sleep 1
+
+    echo "RAYLEIGH, SNR ${snr} dB:"
+    grep -A 100 "ZF tradeoff" test_agora_output.txt | grep "ZF tradeoff\|  UE"
+  done
+done
+
+rm data/bs-sim-tmp.json
+rm data/ue-sim-tmp.json
+rm test_agora_output.txt
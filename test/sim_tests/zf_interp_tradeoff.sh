@@ -0,0 +1,58 @@
+#!/bin/bash
+#
+# Report the EVM and BER against the ZF cost of ZF interpolation, for several
+# interpolation strides and both interpolation modes, over the channel
+# simulator's Rayleigh fading model.
+#
+# Usage:
+#  * This script must be run from Agora's top-level directory.
+#  * An optional argument sets the channel SNR in dB (default 20).
+###############################################################################
+
+exe_list="build/user build/data_generator build/chsim build/agora data/bs-sim.json"
+for exe in ${exe_list}; do
+  if [ ! -f ${exe} ]; then
+      echo "${exe} not found. Exiting."
+      exit
+  fi
+done
+
+SNR=$1
+if [ "$SNR" == "" ]; then
+  SNR=20
+fi
+
+cp data/ue-sim.json data/ue-sim-tmp.json
+sed -i '2i\ \ "frames_to_test": 1000,' data/ue-sim-tmp.json
+cp data/bs-sim.json data/bs-sim-tmp.json
+sed -i '2i\ \ "frames_to_test": 1000,' data/bs-sim-tmp.json
+./build/data_generator --conf_file data/bs-sim-tmp.json > /dev/null
+
+for stride in 1 2 4 8 12; do
+  for mode in linear spline; do
+    if [ "$stride" == "1" ] && [ "$mode" == "spline" ]; then
+      continue
+    fi
+    cp data/bs-sim.json data/bs-sim-tmp.json
+    sed -i '2i\ \ "frames_to_test": 1000,' data/bs-sim-tmp.json
+    sed -i '2i\ \ "zf_block_size": 48,' data/bs-sim-tmp.json
+    sed -i "2i\ \ \"zf_interp_stride\": ${stride}," data/bs-sim-tmp.json
+    sed -i "2i\ \ \"zf_interp_mode\": \"${mode}\"," data/bs-sim-tmp.json
+
+    ./build/user data/ue-sim-tmp.json > /dev/null &
+    sleep 1; ./build/chsim --bs_threads 1 --ue_threads 1 --worker_threads 2 --core_offset 24 --bs_conf_file data/bs-sim-tmp.json --ue_conf_file data/ue-sim-tmp.json --chan_model RAYLEIGH --chan_snr ${SNR} > /dev/null &
+    sleep 1; ./build/agora data/bs-sim-tmp.json > test_agora_output.txt
+    sleep 5
+    pkill -INT chsim
+    pkill -INT user
+    pkill -INT agora
+    sleep 1
+
+    echo "Rayleigh, SNR ${SNR} dB:"
+    grep -A 100 "ZF tradeoff" test_agora_output.txt | grep "ZF tradeoff\|  UE"
+  done
+done
+
+rm data/bs-sim-tmp.json
+rm data/ue-sim-tmp.json
+rm test_agora_output.txt
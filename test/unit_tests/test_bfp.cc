@@ -0,0 +1,86 @@
+/**
+ * @file test_bfp.cc
+ * @brief Unit tests for block floating point fronthaul compression
+ */
+
+#include <gtest/gtest.h>
+
+#include <cmath>
+#include <random>
+#include <vector>
+
+#include "bfp.h"
+
+// Not a multiple of the block size, so that the last block is padded
+static constexpr size_t kNumSamples = 2048 + 128 + 5;
+
+// The error of a value of a block with exponent e is at most one mantissa
+// step, 2^e / 32768: half a step from rounding, or up to a step where the
+// largest value of the block rounds up and saturates
+static void CheckRoundTrip(const std::vector<float>& in, size_t iq_width,
+                           size_t first_sample, size_t num_samples) {
+  std::vector<uint8_t> compressed(BfpCompressedBytes(in.size() / 2, iq_width));
+  BfpCompress(in.data(), compressed.data(), in.size() / 2, iq_width);
+  std::vector<float> out(2 * num_samples);
+  SimdBfpDecompress(compressed.data(), out.data(), first_sample, num_samples,
+                    iq_width);
+
+  for (size_t i = 0; i < 2 * num_samples; i++) {
+    const size_t block = (first_sample + i / 2) / kBfpBlockSamples;
+    const int exponent = compressed[block * BfpBlockBytes(iq_width)];
+    ASSERT_LE(exponent, 24 - static_cast<int>(iq_width));
+    const float tolerance = std::ldexp(1.f, exponent) / 32768.f;
+    ASSERT_NEAR(out[i], in[2 * first_sample + i], tolerance)
+        << "iq_width " << iq_width << ", value " << i;
+  }
+}
+
+TEST(TestBfp, RoundTrip) {
+  std::mt19937 gen(7);
+  // Small and large time-domain levels, and FFT outputs beyond full scale
+  for (float level : {0.001f, 0.3f, 20.f}) {
+    std::normal_distribution<float> dist(0.f, level);
+    std::vector<float> in(2 * kNumSamples);
+    for (auto& v : in) {
+      v = dist(gen);
+    }
+    for (size_t iq_width : {9, 12, 14}) {
+      CheckRoundTrip(in, iq_width, 0, kNumSamples);
+      // Ranges that cut blocks, as DoFFT skips the cyclic prefix
+      CheckRoundTrip(in, iq_width, 5, 2048);
+      CheckRoundTrip(in, iq_width, 128, 2048);
+      CheckRoundTrip(in, iq_width, 7, 3);
+    }
+  }
+}
+
+TEST(TestBfp, ZerosAndSaturation) {
+  for (size_t iq_width : {9, 12, 14}) {
+    std::vector<float> in(2 * kBfpBlockSamples * 2, 0.f);
+    // A block of zeros, then a block with the largest values
+    for (size_t i = 2 * kBfpBlockSamples; i < in.size(); i++) {
+      in[i] = (i % 2 == 0) ? 1e6f : -1e6f;
+    }
+    std::vector<uint8_t> compressed(
+        BfpCompressedBytes(in.size() / 2, iq_width));
+    BfpCompress(in.data(), compressed.data(), in.size() / 2, iq_width);
+    std::vector<float> out(in.size());
+    SimdBfpDecompress(compressed.data(), out.data(), 0, in.size() / 2,
+                      iq_width);
+    for (size_t i = 0; i < 2 * kBfpBlockSamples; i++) {
+      ASSERT_EQ(out[i], 0.f);
+    }
+    // Within a mantissa step of the largest value
+    const float max_value = kBfpMaxValue / 32768.f;
+    const float step = std::ldexp(1.f, 24 - iq_width) / 32768.f;
+    for (size_t i = 2 * kBfpBlockSamples; i < in.size(); i++) {
+      ASSERT_NEAR(std::fabs(out[i]), max_value, step);
+      ASSERT_EQ(out[i] > 0, in[i] > 0);
+    }
+  }
+}
+
+int main(int argc, char** argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
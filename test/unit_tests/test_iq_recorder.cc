@@ -0,0 +1,91 @@
+#include <gtest/gtest.h>
+
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <thread>
+#include <vector>
+
+#include "iq_recorder.h"
+
+// Not a multiple of the block size, so that packets straddle blocks
+static constexpr size_t kPacketLength = 8256;
+static constexpr size_t kNumProducers = 3;
+static constexpr size_t kPacketsPerProducer = 2000;
+
+static std::vector<uint8_t> ReadFile(const std::string& filename) {
+  std::ifstream file(filename, std::ios::binary);
+  return std::vector<uint8_t>(std::istreambuf_iterator<char>(file), {});
+}
+
+TEST(TestIqRecorder, RecordsAllPackets) {
+  const std::string filename = "test_iq_recorder.bin";
+  {
+    // Rings large enough to hold all packets, so that none is dropped
+    IqRecorder recorder(filename, kPacketLength, 8, 2048, kNumProducers,
+                        kNumProducers * kPacketsPerProducer * kPacketLength);
+    std::thread threads[kNumProducers];
+    for (size_t i = 0; i < kNumProducers; i++) {
+      threads[i] = std::thread([&recorder, i]() {
+        std::vector<uint32_t> packet(kPacketLength / sizeof(uint32_t));
+        for (size_t j = 0; j < kPacketsPerProducer; j++) {
+          packet.front() = i;
+          packet.back() = j;
+          recorder.Record(i, packet.data());
+        }
+      });
+    }
+    for (auto& t : threads) {
+      t.join();
+    }
+    ASSERT_EQ(recorder.NumDrops(), 0);
+  }
+
+  const std::vector<uint8_t> file = ReadFile(filename);
+  std::remove(filename.c_str());
+  ASSERT_EQ(file.size(), IqCaptureHeader::kSize +
+                             kNumProducers * kPacketsPerProducer *
+                                 kPacketLength);
+  const auto* header = reinterpret_cast<const IqCaptureHeader*>(file.data());
+  ASSERT_EQ(header->magic_, IqCaptureHeader::kMagic);
+  ASSERT_EQ(header->packet_length_, kPacketLength);
+  ASSERT_EQ(header->bs_ant_num_, 8);
+  ASSERT_EQ(header->ofdm_ca_num_, 2048);
+
+  // Each producer's packets are whole and in order
+  std::vector<size_t> next(kNumProducers, 0);
+  for (size_t offset = IqCaptureHeader::kSize; offset < file.size();
+       offset += kPacketLength) {
+    const auto* packet = reinterpret_cast<const uint32_t*>(&file[offset]);
+    const size_t producer = packet[0];
+    ASSERT_LT(producer, kNumProducers);
+    ASSERT_EQ(packet[kPacketLength / sizeof(uint32_t) - 1], next[producer]);
+    next[producer]++;
+  }
+}
+
+TEST(TestIqRecorder, DropsWhenFull) {
+  const std::string filename = "test_iq_recorder_full.bin";
+  size_t num_drops;
+  {
+    // Two slots, and more packets than the writer thread can keep up with
+    // without sleeping
+    IqRecorder recorder(filename, kPacketLength, 8, 2048, 1,
+                        2 * kPacketLength);
+    std::vector<uint8_t> packet(kPacketLength, 0);
+    for (size_t j = 0; j < kPacketsPerProducer; j++) {
+      recorder.Record(0, packet.data());
+    }
+    num_drops = recorder.NumDrops();
+  }
+  const std::vector<uint8_t> file = ReadFile(filename);
+  std::remove(filename.c_str());
+  ASSERT_EQ(file.size(), IqCaptureHeader::kSize +
+                             (kPacketsPerProducer - num_drops) *
+                                 kPacketLength);
+}
+
+int main(int argc, char** argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
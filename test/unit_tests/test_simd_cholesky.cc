@@ -0,0 +1,103 @@
+/**
+ * @file test_simd_cholesky.cc
+ * @brief Unit tests for the SIMD Cholesky zeroforcing
+ */
+
+#include <gtest/gtest.h>
+
+#include <armadillo>
+#include <vector>
+
+#include "simd_cholesky.h"
+
+// Compare SimdZfCholesky with Armadillo for ue_num UEs, bs_ant_num antennas
+// and a diagonal load of diag_load. With partial_transpose, the CSI is laid
+// out as in the partially transposed CSI buffers, otherwise the subcarriers
+// are contiguous.
+static void CheckZf(size_t ue_num, size_t bs_ant_num, bool partial_transpose,
+                    float diag_load = 0.0f) {
+  std::vector<arma::cx_fmat> csi(kCholeskyLanes);
+  for (auto& h : csi) {
+    h = arma::randn<arma::cx_fmat>(bs_ant_num, ue_num);
+  }
+
+  // The CSI of lane l, antenna a and UE u is csi_buf[u][index(a, l)]
+  auto index = [&](size_t ant, size_t lane) {
+    if (partial_transpose == true) {
+      return ((lane / kCholeskyLaneGroup) * bs_ant_num + ant) *
+                 kCholeskyLaneGroup +
+             lane % kCholeskyLaneGroup;
+    }
+    return ant * kCholeskyLanes + lane;
+  };
+  std::vector<arma::cx_fvec> csi_buf(
+      ue_num, arma::cx_fvec(bs_ant_num * kCholeskyLanes));
+  for (size_t u = 0; u < ue_num; u++) {
+    for (size_t lane = 0; lane < kCholeskyLanes; lane++) {
+      for (size_t ant = 0; ant < bs_ant_num; ant++) {
+        csi_buf[u](index(ant, lane)) = csi[lane](ant, u);
+      }
+    }
+  }
+
+  const float* csi_ptrs[kMaxCholeskyUes];
+  for (size_t u = 0; u < ue_num; u++) {
+    csi_ptrs[u] = reinterpret_cast<const float*>(csi_buf[u].memptr());
+  }
+  CholeskyCsiLayout layout;
+  layout.csi_ = csi_ptrs;
+  layout.ant_stride_ =
+      2 * ((partial_transpose == true) ? kCholeskyLaneGroup : kCholeskyLanes);
+  layout.group_stride_ = 2 * kCholeskyLaneGroup *
+                         ((partial_transpose == true) ? bs_ant_num : 1);
+
+  std::vector<arma::cx_fmat> zf(kCholeskyLanes,
+                                arma::cx_fmat(ue_num, bs_ant_num));
+  float* zf_ptrs[kCholeskyLanes];
+  for (size_t lane = 0; lane < kCholeskyLanes; lane++) {
+    zf_ptrs[lane] = reinterpret_cast<float*>(zf[lane].memptr());
+  }
+  SimdZfCholeskyFn simd_zf = GetSimdZfCholesky(ue_num);
+  ASSERT_NE(simd_zf, nullptr);
+  simd_zf(layout, zf_ptrs, bs_ant_num, diag_load);
+
+  for (size_t lane = 0; lane < kCholeskyLanes; lane++) {
+    const arma::cx_fmat& h = csi[lane];
+    arma::cx_fmat gram = h.t() * h;
+    gram.diag() += diag_load;
+    arma::cx_fmat expected = arma::inv_sympd(gram) * h.t();
+    ASSERT_LE(arma::norm(zf[lane] - expected), 1e-4 * arma::norm(expected))
+        << ue_num << " UEs, " << bs_ant_num << " antennas, lane " << lane;
+  }
+}
+
+TEST(TestSimdCholesky, MatchesArmadillo) {
+  arma::arma_rng::set_seed(11);
+  for (size_t ue_num = 1; ue_num <= kMaxCholeskyUes; ue_num++) {
+    for (size_t bs_ant_num : {2 * ue_num, size_t{64}}) {
+      CheckZf(ue_num, bs_ant_num, true);
+      CheckZf(ue_num, bs_ant_num, false);
+    }
+  }
+}
+
+TEST(TestSimdCholesky, DiagonalLoad) {
+  arma::arma_rng::set_seed(13);
+  for (size_t ue_num = 1; ue_num <= kMaxCholeskyUes; ue_num++) {
+    // Square systems are the worst conditioned, and the most regularized
+    for (float diag_load : {0.1f, 10.0f}) {
+      CheckZf(ue_num, ue_num, true, diag_load);
+      CheckZf(ue_num, size_t{64}, false, diag_load);
+    }
+  }
+}
+
+TEST(TestSimdCholesky, Specializations) {
+  ASSERT_EQ(GetSimdZfCholesky(0), nullptr);
+  ASSERT_EQ(GetSimdZfCholesky(kMaxCholeskyUes + 1), nullptr);
+}
+
+int main(int argc, char** argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,139 @@
+#include <gtest/gtest.h>
+
+#include <cstdio>
+#include <fstream>
+#include <thread>
+
+#include "buffer.h"
+#include "nlohmann/json.hpp"
+#include "trace.h"
+
+static constexpr size_t kRingSizeLog2 = 4;
+static constexpr size_t kNumThreads = 4;
+static constexpr size_t kTasksPerThread = 3;
+
+TEST(TestTrace, RingOverwritesOldest) {
+  TraceRing ring("ring", kRingSizeLog2);
+  const size_t ring_size = 1ull << kRingSizeLog2;
+  for (size_t i = 0; i < ring_size + 5; i++) {
+    ring.Push(EventType::kFFT, i, TracePhase::kInstant);
+  }
+  ASSERT_EQ(ring.Size(), ring_size);
+  ASSERT_EQ(ring.NumPushed(), ring_size + 5);
+  for (size_t i = 0; i < ring.Size(); i++) {
+    ASSERT_EQ(ring.At(i).tag_, i + 5);
+  }
+  for (size_t i = 1; i < ring.Size(); i++) {
+    ASSERT_GE(ring.At(i).tsc_, ring.At(i - 1).tsc_);
+  }
+}
+
+TEST(TestTrace, DisabledRecordsNothing) {
+  Tracer::Reset();
+  Tracer::RegisterThread("Disabled");
+  Tracer::Record(EventType::kZF, 0, TracePhase::kBegin);
+  ASSERT_FALSE(Tracer::Enabled());
+}
+
+TEST(TestTrace, DumpChromeTrace) {
+  Tracer::Reset();
+  Tracer::Enable(kRingSizeLog2);
+
+  std::thread threads[kNumThreads];
+  for (size_t i = 0; i < kNumThreads; i++) {
+    threads[i] = std::thread([i]() {
+      Tracer::RegisterThread("Worker " + std::to_string(i));
+      for (size_t j = 0; j < kTasksPerThread; j++) {
+        const size_t tag = gen_tag_t::FrmSymSc(j, i, 0).tag_;
+        Tracer::Record(EventType::kDemul, tag, TracePhase::kEnqueue);
+        Tracer::Record(EventType::kDemul, tag, TracePhase::kBegin);
+        Tracer::Record(EventType::kDemul, tag, TracePhase::kEnd);
+      }
+    });
+  }
+  for (auto& t : threads) {
+    t.join();
+  }
+
+  const std::string filename = "test_trace.json";
+  Tracer::Dump(filename, GetTime::MeasureRdtscFreq());
+  Tracer::Reset();
+
+  std::ifstream ifs(filename);
+  nlohmann::json trace = nlohmann::json::parse(ifs);
+  size_t num_thread_names = 0;
+  size_t num_begin = 0;
+  size_t num_end = 0;
+  size_t num_flow_start = 0;
+  size_t num_flow_end = 0;
+  for (const auto& event : trace.at("traceEvents")) {
+    const std::string ph = event.at("ph");
+    if (ph == "M") {
+      num_thread_names++;
+    } else if (ph == "B") {
+      num_begin++;
+      ASSERT_EQ(event.at("name"), "Demul");
+      ASSERT_LT(event.at("args").at("frame").get<size_t>(), kTasksPerThread);
+    } else if (ph == "E") {
+      num_end++;
+    } else if (ph == "s") {
+      num_flow_start++;
+    } else if (ph == "f") {
+      num_flow_end++;
+    }
+  }
+  ASSERT_EQ(num_thread_names, kNumThreads);
+  ASSERT_EQ(num_begin, kNumThreads * kTasksPerThread);
+  ASSERT_EQ(num_end, kNumThreads * kTasksPerThread);
+  ASSERT_EQ(num_flow_start, kNumThreads * kTasksPerThread);
+  ASSERT_EQ(num_flow_end, kNumThreads * kTasksPerThread);
+  std::remove(filename.c_str());
+}
+
+TEST(TestTrace, DecodesTagsByOrigin) {
+  Tracer::Reset();
+  Tracer::Enable(kRingSizeLog2);
+  Tracer::RegisterThread("Master");
+
+  // An FFT request, run by a worker, whose completion the master handles
+  const size_t req_tag = fft_req_tag_t(1, 2, 3).tag_;
+  const size_t resp_tag = gen_tag_t::FrmSymAnt(4, 5, 3).tag_;
+  Tracer::Record(EventType::kFFT, req_tag, TracePhase::kEnqueue,
+                 TraceTagType::kFftReq);
+  Tracer::Record(EventType::kFFT, req_tag, TracePhase::kBegin,
+                 TraceTagType::kFftReq);
+  Tracer::Record(EventType::kFFT, resp_tag, TracePhase::kEnd);
+  Tracer::Record(EventType::kFFT, resp_tag, TracePhase::kHandleBegin);
+  Tracer::Record(EventType::kFFT, resp_tag, TracePhase::kHandleEnd);
+
+  const std::string filename = "test_trace_tags.json";
+  Tracer::Dump(filename, GetTime::MeasureRdtscFreq());
+  Tracer::Reset();
+
+  std::ifstream ifs(filename);
+  nlohmann::json trace = nlohmann::json::parse(ifs);
+  size_t num_flow_end = 0;
+  size_t num_master_begin = 0;
+  for (const auto& event : trace.at("traceEvents")) {
+    const std::string ph = event.at("ph");
+    if (ph == "f") {
+      num_flow_end++;
+    } else if ((ph == "B") && (event.at("cat") == "task")) {
+      ASSERT_EQ(event.at("args").at("rx_thread").get<size_t>(), 1);
+      ASSERT_EQ(event.at("args").at("offset").get<size_t>(), 2);
+    } else if ((ph == "B") && (event.at("cat") == "master")) {
+      num_master_begin++;
+      ASSERT_EQ(event.at("args").at("frame").get<size_t>(), 4);
+      ASSERT_EQ(event.at("args").at("symbol").get<size_t>(), 5);
+    }
+  }
+  // Only the worker's slice ends the queueing flow
+  ASSERT_EQ(num_flow_end, 1);
+  ASSERT_EQ(num_master_begin, 1);
+  std::remove(filename.c_str());
+}
+
+int main(int argc, char** argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
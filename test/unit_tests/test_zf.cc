@@ -1,9 +1,17 @@
 #include <gtest/gtest.h>
+
+#include <cstdio>
+#include <fstream>
+#include <numeric>
+#include <random>
+#include <set>
 // For some reason, gtest include order matters
 #include "concurrentqueue.h"
 #include "config.h"
 #include "dozf.h"
 #include "gettime.h"
+#include "nlohmann/json.hpp"
+#include "phy_stats.h"
 #include "utils.h"
 
 /// Measure performance of zeroforcing
@@ -32,11 +40,12 @@ TEST(TestZF, Perf) {
                                    cfg->OfdmDataNum() * cfg->BsAntNum(),
                                    Agora_memory::Alignment_t::kAlign64);
 
+  auto phy_stats = std::make_unique<PhyStats>(cfg.get());
   auto stats = std::make_unique<Stats>(cfg.get());
 
   auto compute_zf = std::make_unique<DoZF>(
       cfg.get(), tid, csi_buffers, calib_dl_buffer, calib_ul_buffer,
-      ul_zf_matrices, dl_zf_matrices, stats.get());
+      ul_zf_matrices, dl_zf_matrices, phy_stats.get(), stats.get());
 
   FastRand fast_rand;
   size_t start_tsc = GetTime::Rdtsc();
@@ -55,6 +64,324 @@ TEST(TestZF, Perf) {
   calib_ul_buffer.Free();
 }
 
+/// The ZF matrices of frames, computed with the given config from shared
+/// CSI and calibration buffers, and pilots measured with noise power
+/// pilot_noise per subcarrier
+class ZfFrame {
+ public:
+  ZfFrame(const std::string& conf_file,
+          PtrGrid<kFrameWnd, kMaxUEs, complex_float>& csi_buffers,
+          Table<complex_float>& calib_dl_buffer,
+          Table<complex_float>& calib_ul_buffer, float pilot_noise = 0.0f)
+      : cfg_(std::make_unique<Config>(conf_file)),
+        pilot_noise_(pilot_noise),
+        ul_zf_matrices_(cfg_->BsAntNum() * cfg_->UeNum()),
+        dl_zf_matrices_(cfg_->UeNum() * cfg_->BsAntNum()) {
+    cfg_->GenData();
+    phy_stats_ = std::make_unique<PhyStats>(cfg_.get());
+    stats_ = std::make_unique<Stats>(cfg_.get());
+    compute_zf_ = std::make_unique<DoZF>(
+        cfg_.get(), 0, csi_buffers, calib_dl_buffer, calib_ul_buffer,
+        ul_zf_matrices_, dl_zf_matrices_, phy_stats_.get(), stats_.get());
+    Compute(0);
+  }
+
+  /// Compute the ZF matrices of frame_id, which Ul() and Dl() then return
+  void Compute(size_t frame_id) {
+    // Pilot symbols with the noise power on all subcarriers, guard bands
+    // included
+    std::vector<complex_float> pilot(cfg_->OfdmCaNum(),
+                                     {std::sqrt(pilot_noise_), 0.0f});
+    for (size_t i = 0; i < cfg_->Frame().NumPilotSyms(); i++) {
+      phy_stats_->UpdatePilotSnr(frame_id, i, pilot.data());
+    }
+    // The last block may have fewer subcarriers than the block size
+    for (size_t base_sc_id = 0; base_sc_id < cfg_->OfdmDataNum();
+         base_sc_id += cfg_->ZfBlockSize()) {
+      compute_zf_->Launch(gen_tag_t::FrmSc(frame_id, base_sc_id).tag_);
+    }
+    frame_id_ = frame_id;
+  }
+
+  arma::cx_fmat Ul(size_t sc_id) {
+    return arma::cx_fmat(reinterpret_cast<arma::cx_float*>(
+                             ul_zf_matrices_[frame_id_ % kFrameWnd][sc_id]),
+                         cfg_->UeNum(), cfg_->BsAntNum());
+  }
+  arma::cx_fmat Dl(size_t sc_id) {
+    return arma::cx_fmat(reinterpret_cast<arma::cx_float*>(
+                             dl_zf_matrices_[frame_id_ % kFrameWnd][sc_id]),
+                         cfg_->BsAntNum(), cfg_->UeNum());
+  }
+  Config* Cfg() { return cfg_.get(); }
+  size_t NumApproxFallbacks() const {
+    return compute_zf_->NumApproxFallbacks();
+  }
+
+ private:
+  std::unique_ptr<Config> cfg_;
+  float pilot_noise_;
+  size_t frame_id_ = 0;
+  std::unique_ptr<PhyStats> phy_stats_;
+  std::unique_ptr<Stats> stats_;
+  PtrGrid<kFrameWnd, kMaxDataSCs, complex_float> ul_zf_matrices_;
+  PtrGrid<kFrameWnd, kMaxDataSCs, complex_float> dl_zf_matrices_;
+  std::unique_ptr<DoZF> compute_zf_;
+};
+
+/// Check that the ZF matrices of subcarriers sc_ids match those of ref
+static void ExpectSameZf(ZfFrame& ref, ZfFrame& zf,
+                         const std::vector<size_t>& sc_ids) {
+  for (size_t sc_id : sc_ids) {
+    ASSERT_LE(arma::norm(zf.Ul(sc_id) - ref.Ul(sc_id)),
+              1e-3 * arma::norm(ref.Ul(sc_id)))
+        << "subcarrier " << sc_id;
+    ASSERT_LE(arma::norm(zf.Dl(sc_id) - ref.Dl(sc_id)),
+              1e-3 * arma::norm(ref.Dl(sc_id)))
+        << "subcarrier " << sc_id;
+  }
+}
+
+/// Shared CSI and calibration buffers, and configs derived from
+/// data/bs-sim.json, which has time-orthogonal pilots and downlink symbols
+class TestZFSim : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    ref_conf_ =
+        WriteSimConfig("test_zf_per_subcarrier.json", nlohmann::json::object());
+    cfg_ = std::make_unique<Config>(ref_conf_);
+    csi_buffers_.RandAllocCxFloat(cfg_->BsAntNum() * cfg_->OfdmDataNum());
+    calib_dl_buffer_.RandAllocCxFloat(kFrameWnd,
+                                      cfg_->OfdmDataNum() * cfg_->BsAntNum(),
+                                      Agora_memory::Alignment_t::kAlign64);
+    calib_ul_buffer_.RandAllocCxFloat(kFrameWnd,
+                                      cfg_->OfdmDataNum() * cfg_->BsAntNum(),
+                                      Agora_memory::Alignment_t::kAlign64);
+    sc_ids_.resize(cfg_->OfdmDataNum());
+    std::iota(sc_ids_.begin(), sc_ids_.end(), 0);
+  }
+
+  void TearDown() override {
+    calib_dl_buffer_.Free();
+    calib_ul_buffer_.Free();
+    for (const std::string& filename : conf_files_) {
+      std::remove(filename.c_str());
+    }
+  }
+
+  /// Write a copy of data/bs-sim.json to filename with the given options
+  /// changed. The file is deleted after the test.
+  std::string WriteSimConfig(const std::string& filename,
+                             const nlohmann::json& options) {
+    std::ifstream ifs("data/bs-sim.json");
+    nlohmann::json conf = nlohmann::json::parse(ifs);
+    conf["zf_block_size"] = 20;
+    conf.update(options);
+    std::ofstream ofs(filename);
+    ofs << conf.dump(2);
+    conf_files_.insert(filename);
+    return filename;
+  }
+
+  /// Compute the ZF matrices of a frame with conf_file from the shared
+  /// buffers
+  std::unique_ptr<ZfFrame> Zf(const std::string& conf_file,
+                              float pilot_noise = 0.0f) {
+    return std::make_unique<ZfFrame>(conf_file, csi_buffers_,
+                                     calib_dl_buffer_, calib_ul_buffer_,
+                                     pilot_noise);
+  }
+
+  std::string ref_conf_;  // Exact per-subcarrier inversion
+  std::unique_ptr<Config> cfg_;
+  PtrGrid<kFrameWnd, kMaxUEs, complex_float> csi_buffers_;
+  Table<complex_float> calib_dl_buffer_;
+  Table<complex_float> calib_ul_buffer_;
+  std::vector<size_t> sc_ids_;  // All data subcarriers
+
+ private:
+  std::set<std::string> conf_files_;
+};
+
+/// Check that batched inversion matches per-subcarrier inversion
+TEST_F(TestZFSim, BatchInversion) {
+  const std::string batch_conf =
+      WriteSimConfig("test_zf_batch.json", {{"zf_batch_inversion", true}});
+  ASSERT_GT(cfg_->Frame().NumDLSyms(), 0);
+
+  auto ref = Zf(ref_conf_);
+  auto batch = Zf(batch_conf);
+  ASSERT_TRUE(batch->Cfg()->ZfBatchInversion());
+  ExpectSameZf(*ref, *batch, sc_ids_);
+}
+
+/// Check that interpolation keeps the inverted subcarriers, and is exact
+/// where the channel does not change across subcarriers
+TEST_F(TestZFSim, Interpolation) {
+  static constexpr size_t kStride = 6;
+
+  // The inverted subcarriers of each ZF block
+  std::vector<size_t> anchors;
+  for (size_t base = 0; base < cfg_->OfdmDataNum();
+       base += cfg_->ZfBlockSize()) {
+    const size_t end =
+        std::min(base + cfg_->ZfBlockSize(), cfg_->OfdmDataNum());
+    for (size_t sc_id = base; sc_id < end; sc_id += kStride) {
+      anchors.push_back(sc_id);
+    }
+    anchors.push_back(end - 1);
+  }
+
+  for (std::string mode : {"linear", "spline"}) {
+    const std::string interp_conf = WriteSimConfig(
+        "test_zf_interp.json",
+        {{"zf_interp_stride", kStride}, {"zf_interp_mode", mode}});
+    auto ref = Zf(ref_conf_);
+    auto interp = Zf(interp_conf);
+    ASSERT_EQ(interp->Cfg()->ZfInterpStride(), kStride);
+    ExpectSameZf(*ref, *interp, anchors);
+  }
+
+  // The same channel and calibration on all subcarriers
+  for (size_t i = 0; i < kFrameWnd; i++) {
+    for (size_t ue = 0; ue < cfg_->UeNum(); ue++) {
+      complex_float* csi = csi_buffers_[i][ue];
+      for (size_t j = 0; j < cfg_->BsAntNum() * cfg_->OfdmDataNum(); j++) {
+        // Partially transposed blocks of kTransposeBlockSize subcarriers
+        const size_t ant = (j / kTransposeBlockSize) % cfg_->BsAntNum();
+        csi[j] = csi[ant * kTransposeBlockSize];
+      }
+    }
+    for (size_t j = 0; j < cfg_->OfdmDataNum() * cfg_->BsAntNum(); j++) {
+      const size_t ant = j / cfg_->OfdmDataNum();
+      calib_dl_buffer_[i][j] = calib_dl_buffer_[i][ant * cfg_->OfdmDataNum()];
+      calib_ul_buffer_[i][j] = calib_ul_buffer_[i][ant * cfg_->OfdmDataNum()];
+    }
+  }
+  for (std::string mode : {"linear", "spline"}) {
+    const std::string interp_conf = WriteSimConfig(
+        "test_zf_interp.json",
+        {{"zf_interp_stride", kStride}, {"zf_interp_mode", mode}});
+    auto ref = Zf(ref_conf_);
+    auto interp = Zf(interp_conf);
+    ExpectSameZf(*ref, *interp, sc_ids_);
+  }
+}
+
+/// Check the MMSE detector against its formula on all paths (SIMD Cholesky,
+/// inv_sympd() and batched inversion), and that it is zeroforcing without
+/// pilot noise
+TEST_F(TestZFSim, Mmse) {
+  static constexpr float kPilotNoise = 0.5f;
+  const std::string mmse_conf =
+      WriteSimConfig("test_zf_mmse.json", {{"beamformer", "mmse"}});
+  const std::string batch_conf = WriteSimConfig(
+      "test_zf_mmse_batch.json",
+      {{"beamformer", "mmse"}, {"zf_batch_inversion", true}});
+  const size_t bs_ant_num = cfg_->BsAntNum();
+  const size_t ue_num = cfg_->UeNum();
+
+  auto zf = Zf(ref_conf_);
+  auto noiseless = Zf(mmse_conf);
+  ExpectSameZf(*zf, *noiseless, sc_ids_);
+
+  auto mmse = Zf(mmse_conf, kPilotNoise);
+  auto batch = Zf(batch_conf, kPilotNoise);
+  ExpectSameZf(*mmse, *batch, sc_ids_);
+  for (size_t sc_id : sc_ids_) {
+    // The CSI of frame 0, in partially transposed blocks
+    arma::cx_fmat csi(bs_ant_num, ue_num);
+    for (size_t ue = 0; ue < ue_num; ue++) {
+      for (size_t ant = 0; ant < bs_ant_num; ant++) {
+        const complex_float c =
+            csi_buffers_[0][ue][((sc_id / kTransposeBlockSize) * bs_ant_num +
+                                 ant) *
+                                    kTransposeBlockSize +
+                                sc_id % kTransposeBlockSize];
+        csi(ant, ue) = {c.re, c.im};
+      }
+    }
+    arma::cx_fmat gram = csi.t() * csi;
+    gram.diag() += kPilotNoise;
+    const arma::cx_fmat expected = arma::inv_sympd(gram) * csi.t();
+    ASSERT_LE(arma::norm(mmse->Ul(sc_id) - expected),
+              1e-3 * arma::norm(expected))
+        << "subcarrier " << sc_id;
+    ASSERT_GT(arma::norm(zf->Ul(sc_id) - expected),
+              1e-2 * arma::norm(expected))
+        << "subcarrier " << sc_id;
+  }
+}
+
+/// Check that converged iterations match exact inversion, and that a large
+/// residual falls back to it
+TEST_F(TestZFSim, Approximate) {
+  auto ref = Zf(ref_conf_);
+  for (std::string method : {"neumann", "gauss_seidel"}) {
+    // Without the fallback
+    const std::string converged_conf = WriteSimConfig(
+        "test_zf_approx.json", {{"zf_approx_iters", 50},
+                                {"zf_approx_method", method},
+                                {"zf_approx_max_residual", 1.0}});
+    auto converged = Zf(converged_conf);
+    ASSERT_EQ(converged->Cfg()->ZfApproxIters(), 50);
+    ExpectSameZf(*ref, *converged, sc_ids_);
+
+    // One iteration always leaves a residual
+    const std::string fallback_conf = WriteSimConfig(
+        "test_zf_approx.json", {{"zf_approx_iters", 1},
+                                {"zf_approx_method", method},
+                                {"zf_approx_max_residual", 0.0}});
+    auto fallback = Zf(fallback_conf);
+    ExpectSameZf(*ref, *fallback, sc_ids_);
+  }
+}
+
+/// Check that the detector of the previous frame is a warm start which
+/// converges in a budget of iterations too small for the cold start
+TEST_F(TestZFSim, ApproximateWarmStart) {
+  static constexpr size_t kFrameId = 1;
+  static constexpr float kPerturbation = 1e-4f;
+  const size_t num_entries = cfg_->BsAntNum() * cfg_->OfdmDataNum();
+
+  // The channel of frame kFrameId - 1, slightly changed
+  std::default_random_engine generator;
+  std::uniform_real_distribution<float> distribution(-kPerturbation,
+                                                     kPerturbation);
+  for (size_t ue = 0; ue < cfg_->UeNum(); ue++) {
+    for (size_t j = 0; j < num_entries; j++) {
+      const complex_float c = csi_buffers_[kFrameId - 1][ue][j];
+      csi_buffers_[kFrameId][ue][j] = {c.re + distribution(generator),
+                                       c.im + distribution(generator)};
+    }
+  }
+
+  auto ref = Zf(ref_conf_);
+  ref->Compute(kFrameId);
+  for (std::string method : {"neumann", "gauss_seidel"}) {
+    const nlohmann::json options = {{"zf_approx_iters", 2},
+                                    {"zf_approx_method", method},
+                                    {"zf_approx_max_residual", 0.01}};
+    const std::string warm_conf =
+        WriteSimConfig("test_zf_approx_warm.json", options);
+    nlohmann::json cold_options = options;
+    cold_options["zf_approx_warm_start"] = false;
+    const std::string cold_conf =
+        WriteSimConfig("test_zf_approx_cold.json", cold_options);
+
+    // Frame kFrameId - 1 is cold-started, and may fall back
+    auto warm = Zf(warm_conf);
+    const size_t cold_fallbacks = warm->NumApproxFallbacks();
+    warm->Compute(kFrameId);
+    ASSERT_EQ(warm->NumApproxFallbacks(), cold_fallbacks) << method;
+    ExpectSameZf(*ref, *warm, sc_ids_);
+
+    auto cold = Zf(cold_conf);
+    cold->Compute(kFrameId);
+    ASSERT_GT(cold->NumApproxFallbacks(), cold_fallbacks) << method;
+  }
+}
+
 int main(int argc, char** argv) {
   testing::InitGoogleTest(&argc, argv);
   return RUN_ALL_TESTS();